@@ -134,6 +134,24 @@ configEnum rocksdb_compression_enum[] = {
     {NULL, 0}
 };
 
+configEnum rocksdb_block_cache_type_enum[] = {
+    {"lru", ROCKS_BLOCK_CACHE_LRU},
+    {"hyper_clock", ROCKS_BLOCK_CACHE_HYPER_CLOCK},
+    {NULL, 0}
+};
+
+configEnum swap_dispatch_policy_enum[] = {
+    {"least-loaded", SWAP_DISPATCH_LEAST_LOADED},
+    {"key-affinity", SWAP_DISPATCH_KEY_AFFINITY},
+    {NULL, 0}
+};
+
+configEnum swap_key_format_enum[] = {
+    {"v1", SWAP_KEY_FORMAT_V1},
+    {"v2", SWAP_KEY_FORMAT_V2},
+    {NULL, 0}
+};
+
 configEnum cuckoo_filter_bit_type_enum[] = {
     {"8", CUCKOO_FILTER_BITS_PER_TAG_8},
     {"12", CUCKOO_FILTER_BITS_PER_TAG_12},
@@ -171,6 +189,16 @@ swapBatchLimitsConfig swapBatchLimitsDefaults[SWAP_TYPES] = {
     {SWAP_BATCH_DEFAULT_SIZE, 1024*1024*1},  /* DEL */
     {0, 0}, /* UTILS */
 };
+
+/* swap priority weights presets. */
+swapPriorityWeightsConfig swapPriorityWeightsDefaults[SWAP_PRIORITY_TYPES] = {
+    {8}, /* client */
+    {4}, /* metascan */
+    {2}, /* expire */
+    {2}, /* evict */
+    {1}, /* persist */
+    {1}, /* util */
+};
 #endif
 /* Output buffer limits presets. */
 clientBufferLimitsConfig clientBufferLimitsDefaults[CLIENT_TYPE_OBUF_COUNT] = {
@@ -637,6 +665,21 @@ void loadServerConfigFromString(char *config) {
             mem = memtoll(argv[3],NULL);
             server.swap_batch_limits[intention].count = count;
             server.swap_batch_limits[intention].mem = mem;
+        } else if (!strcasecmp(argv[0],"swap-priority-weight") &&
+                   argc == 3)
+        {
+            int priority = getSwapPriorityByName(argv[1]), weight;
+
+            if (priority < 0) {
+                err = "Unrecognized swap priority class name.";
+                goto loaderr;
+            }
+            weight = atoi(argv[2]);
+            if (weight < 0) {
+                err = "Negative swap priority weight is invalid";
+                goto loaderr;
+            }
+            server.swap_priority_weights[priority].weight = weight;
 #endif
         } else if (!strcasecmp(argv[0],"oom-score-adj-values") && argc == 1 + CONFIG_OOM_COUNT) {
             if (updateOOMScoreAdjValues(&argv[1], &err, 0) == C_ERR) goto loaderr;
@@ -947,6 +990,38 @@ void configSetCommand(client *c) {
             server.swap_batch_limits[intention].mem = mem;
         }
         sdsfreesplitres(v,vlen);
+    } config_set_special_field("swap-priority-weight") {
+        int vlen, j;
+        sds *v = sdssplitlen(o->ptr,sdslen(o->ptr)," ",1,&vlen);
+
+        /* We need a multiple of 2: <class> <weight> */
+        if (vlen % 2) {
+            sdsfreesplitres(v,vlen);
+            goto badfmt;
+        }
+
+        /* Refuse the whole configuration string if any pair is invalid. */
+        for (j = 0; j < vlen; j++) {
+            if ((j % 2) == 0) {
+                if (getSwapPriorityByName(v[j]) < 0) {
+                    sdsfreesplitres(v,vlen);
+                    goto badfmt;
+                }
+            } else {
+                char *eptr;
+                long val = strtol(v[j], &eptr, 10);
+                if (eptr[0] != '\0' || val < 0 || val > INT_MAX) {
+                    sdsfreesplitres(v,vlen);
+                    goto badfmt;
+                }
+            }
+        }
+        /* Finally set the new config */
+        for (j = 0; j < vlen; j += 2) {
+            int priority = getSwapPriorityByName(v[j]);
+            server.swap_priority_weights[priority].weight = strtol(v[j+1],NULL,10);
+        }
+        sdsfreesplitres(v,vlen);
 #endif
     } config_set_special_field("oom-score-adj-values") {
         int vlen;
@@ -1117,6 +1192,22 @@ void configGetCommand(client *c) {
         sdsfree(buf);
         matches++;
     }
+    if (stringmatch(pattern,"swap-priority-weight",1)) {
+        sds buf = sdsempty();
+        int j;
+
+        for (j = 0; j < SWAP_PRIORITY_TYPES; j++) {
+            buf = sdscatprintf(buf,"%s %d",
+                    swapPriorityName(j),
+                    server.swap_priority_weights[j].weight);
+            if (j != SWAP_PRIORITY_TYPES-1)
+                buf = sdscatlen(buf," ",1);
+        }
+        addReplyBulkCString(c,"swap-priority-weight");
+        addReplyBulkCString(c,buf);
+        sdsfree(buf);
+        matches++;
+    }
 #endif
     if (stringmatch(pattern,"unixsocketperm",1)) {
         char buf[32];
@@ -1650,6 +1741,21 @@ void rewriteConfigSwapBatchlimitOption(struct rewriteConfigState *state) {
         rewriteConfigRewriteLine(state,option,line,force);
     }
 }
+
+/* Rewrite the swap-priority-weight option. */
+void rewriteConfigSwapPriorityWeightOption(struct rewriteConfigState *state) {
+    int j;
+    char *option = "swap-priority-weight";
+
+    for (j = 0; j < SWAP_PRIORITY_TYPES; j++) {
+        int force = server.swap_priority_weights[j].weight !=
+                    swapPriorityWeightsDefaults[j].weight;
+        sds line = sdscatprintf(sdsempty(),"%s %s %d",
+                option, swapPriorityName(j),
+                server.swap_priority_weights[j].weight);
+        rewriteConfigRewriteLine(state,option,line,force);
+    }
+}
 #endif
 /* Rewrite the oom-score-adj-values option. */
 void rewriteConfigOOMScoreAdjValuesOption(struct rewriteConfigState *state) {
@@ -1853,6 +1959,9 @@ int rewriteConfig(char *path, int force_all) {
     rewriteConfigNotifykeyspaceeventsOption(state);
     rewriteConfigClientoutputbufferlimitOption(state);
     rewriteConfigOOMScoreAdjValuesOption(state);
+#ifdef ENABLE_SWAP
+    rewriteConfigSwapPriorityWeightOption(state);
+#endif
 
     /* Rewrite Sentinel config if in Sentinel mode. */
     if (server.sentinel_mode) rewriteConfigSentinelOption(state);
@@ -2484,6 +2593,16 @@ static int updateSwapAbsentCacheCapacity(long long val, long long prev, const ch
     return 1;
 }
 
+static int updateRocksdbBlockCacheSize(long long val, long long prev, const char **err) {
+    UNUSED(val);
+    UNUSED(prev);
+    if (rocksUpdateBlockCacheCapacity() != C_OK) {
+        *err = "Fail to set block cache capacity, check rocksdb state.";
+        return 0;
+    }
+    return 1;
+}
+
 static int updateRocksdbCFOption(int cf,char *key, char *val, const char**err) {
     rocks* rocks = serverRocksGetTryReadLock();
     if (rocks == NULL) {
@@ -2963,6 +3082,9 @@ standardConfig configs[] = {
     createBoolConfig("swap-ttl-compact-enabled", NULL, MODIFIABLE_CONFIG, server.swap_ttl_compact_enabled, 1, NULL, NULL),
     createBoolConfig("rocksdb.data.cache_index_and_filter_blocks", "rocksdb.cache_index_and_filter_blocks", IMMUTABLE_CONFIG, server.rocksdb_data_cache_index_and_filter_blocks, 0, NULL, NULL),
     createBoolConfig("rocksdb.meta.cache_index_and_filter_blocks", NULL, IMMUTABLE_CONFIG, server.rocksdb_meta_cache_index_and_filter_blocks, 0, NULL, NULL),
+    createBoolConfig("rocksdb.data.block_cache_high_priority", NULL, IMMUTABLE_CONFIG, server.rocksdb_data_block_cache_high_priority, 0, NULL, NULL),
+    createBoolConfig("rocksdb.data.prefix_bloom", NULL, IMMUTABLE_CONFIG, server.rocksdb_data_prefix_bloom, 1, NULL, NULL),
+    createBoolConfig("rocksdb.meta.block_cache_high_priority", NULL, IMMUTABLE_CONFIG, server.rocksdb_meta_block_cache_high_priority, 1, NULL, NULL),
     createBoolConfig("rocksdb.enable_pipelined_write", NULL, IMMUTABLE_CONFIG, server.rocksdb_enable_pipelined_write, 0, NULL, NULL),
     createBoolConfig("rocksdb.data.disable_auto_compactions", "rocksdb.disable_auto_compactions", MODIFIABLE_CONFIG, server.rocksdb_data_disable_auto_compactions, 0, NULL, updateRocksdbDataDisableAutoCompactions),
     createBoolConfig("rocksdb.meta.disable_auto_compactions", NULL, MODIFIABLE_CONFIG, server.rocksdb_meta_disable_auto_compactions, 0, NULL, updateRocksdbMetaDisableAutoCompactions),
@@ -2973,6 +3095,9 @@ standardConfig configs[] = {
     createBoolConfig("rocksdb.data.enable_blob_garbage_collection", "rocksdb.enable_blob_garbage_collection", MODIFIABLE_CONFIG, server.rocksdb_data_enable_blob_garbage_collection, 1, NULL, updateRocksdbDataEnableBlobGarbageCollection),
     createBoolConfig("rocksdb.meta.enable_blob_garbage_collection", NULL, MODIFIABLE_CONFIG, server.rocksdb_meta_enable_blob_garbage_collection, 1, NULL, updateRocksdbMetaEnableBlobGarbageCollection),
     createBoolConfig("rocksdb.read_enable_async_io", NULL, IMMUTABLE_CONFIG, server.rocksdb_read_enable_async_io, 0, NULL, NULL),
+    createBoolConfig("swap-rio-pinned-get", NULL, MODIFIABLE_CONFIG, server.swap_rio_pinned_get, 0, NULL, NULL),
+    createBoolConfig("swap-rio-batch-iterate", NULL, MODIFIABLE_CONFIG, server.swap_rio_batch_iterate, 1, NULL, NULL),
+    createBoolConfig("swap-native-value-encoding", NULL, MODIFIABLE_CONFIG, server.swap_native_value_encoding, 0, NULL, NULL),
 #endif
 
 
@@ -3009,8 +3134,10 @@ standardConfig configs[] = {
     createEnumConfig("sanitize-dump-payload", NULL, MODIFIABLE_CONFIG, sanitize_dump_payload_enum, server.sanitize_dump_payload, SANITIZE_DUMP_NO, NULL, NULL),
 #ifdef ENABLE_SWAP
     createEnumConfig("rocksdb.data.compression","rocksdb.compression", MODIFIABLE_CONFIG, rocksdb_compression_enum, server.rocksdb_data_compression, rocksdb_snappy_compression, NULL, updateRocksdbDataCompression),
+    createEnumConfig("rocksdb.block_cache_type", NULL, IMMUTABLE_CONFIG, rocksdb_block_cache_type_enum, server.rocksdb_block_cache_type, ROCKS_BLOCK_CACHE_LRU, NULL, NULL),
     createEnumConfig("rocksdb.meta.compression", NULL, MODIFIABLE_CONFIG, rocksdb_compression_enum, server.rocksdb_meta_compression, rocksdb_snappy_compression, NULL, updateRocksdbMetaCompression),
     createEnumConfig("swap-cuckoo-filter-bit-per-key", NULL, IMMUTABLE_CONFIG, cuckoo_filter_bit_type_enum, server.swap_cuckoo_filter_bit_type, CUCKOO_FILTER_BITS_PER_TAG_8, NULL, NULL),
+    createEnumConfig("swap-key-format", NULL, IMMUTABLE_CONFIG, swap_key_format_enum, server.swap_key_format, SWAP_KEY_FORMAT_V1, NULL, NULL),
     createEnumConfig("swap-ratelimit-policy", NULL, MODIFIABLE_CONFIG, swap_ratelimit_policy_enum, server.swap_ratelimit_policy, SWAP_RATELIMIT_POLICY_PAUSE, NULL, NULL),
     createEnumConfig("swap-swap-info-supported", NULL, MODIFIABLE_CONFIG, swap_info_supported_enum, server.swap_swap_info_supported, SWAP_INFO_SUPPORTED_AUTO, NULL, NULL),
     createEnumConfig("swap-swap-info-propagate-mode", NULL, MODIFIABLE_CONFIG, swap_info_propagate_mode_enum, server.swap_swap_info_propagate_mode, SWAP_INFO_PROPAGATE_BY_PING, NULL, NULL),
@@ -3061,6 +3188,9 @@ standardConfig configs[] = {
     createIntConfig("swap-threads-auto-scale-max", NULL, IMMUTABLE_CONFIG, 4, 64, server.swap_threads_auto_scale_max, 12, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("swap-threads-auto-scale-up-threshold", NULL, MODIFIABLE_CONFIG, 0, INT_MAX, server.swap_threads_auto_scale_up_threshold, 32, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("swap-threads-auto-scale-down-idle-seconds", NULL, MODIFIABLE_CONFIG, 0, INT_MAX, server.swap_threads_auto_scale_down_idle_seconds, 300, INTEGER_CONFIG, NULL, NULL),
+    createIntConfig("swap-complete-queue-drain-max-batches", NULL, MODIFIABLE_CONFIG, 0, INT_MAX, server.swap_complete_queue_drain_max_batches, 0, INTEGER_CONFIG, NULL, NULL),
+    createIntConfig("swap-complete-queue-drain-max-us", NULL, MODIFIABLE_CONFIG, 0, INT_MAX, server.swap_complete_queue_drain_max_us, 10000, INTEGER_CONFIG, NULL, NULL),
+    createBoolConfig("swap-threads-work-stealing", NULL, MODIFIABLE_CONFIG, server.swap_threads_work_stealing, 1, NULL, NULL),
     createIntConfig("jemalloc-max-bg-threads", NULL, IMMUTABLE_CONFIG, 4, 16, server.jemalloc_max_bg_threads, 4, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("swap-debug-swapout-notify-delay-micro", NULL, MODIFIABLE_CONFIG, -1, INT_MAX, server.swap_debug_swapout_notify_delay_micro, 0, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("swap-debug-before-exec-swap-delay-micro", NULL, MODIFIABLE_CONFIG, 0, INT_MAX, server.swap_debug_before_exec_swap_delay_micro, 0, INTEGER_CONFIG, NULL, NULL),
@@ -3072,18 +3202,35 @@ standardConfig configs[] = {
     createIntConfig("swap-rocksdb-stats-collect-interval-ms", NULL, MODIFIABLE_CONFIG, 1, INT_MAX, server.swap_rocksdb_stats_collect_interval_ms, 2000, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("swap-evict-inprogress-limit", NULL, MODIFIABLE_CONFIG, 4, INT_MAX, server.swap_evict_inprogress_limit, 128, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("swap-evict-inprogress-growth-rate", NULL, MODIFIABLE_CONFIG, 1, INT_MAX, server.swap_evict_inprogress_growth_rate, 5*1024*1024, MEMORY_CONFIG, NULL, NULL),
+    createIntConfig("swap-evict-watermark-low", NULL, MODIFIABLE_CONFIG, 1, 100, server.swap_evict_watermark_low, 85, INTEGER_CONFIG, NULL, NULL),
+    createIntConfig("swap-evict-watermark-high", NULL, MODIFIABLE_CONFIG, 0, 100, server.swap_evict_watermark_high, 0, INTEGER_CONFIG, NULL, NULL),
+    createIntConfig("swap-pre-evict-period-ms", NULL, MODIFIABLE_CONFIG, 1, INT_MAX, server.swap_pre_evict_period_ms, 100, INTEGER_CONFIG, NULL, NULL),
+    createBoolConfig("swap-evict-cost-aware", NULL, MODIFIABLE_CONFIG, server.swap_evict_cost_aware, 1, NULL, NULL),
+    createBoolConfig("swap-evict-subkey-hotness", NULL, MODIFIABLE_CONFIG, server.swap_evict_subkey_hotness, 1, NULL, NULL),
+    createBoolConfig("swap-swapin-admission", NULL, MODIFIABLE_CONFIG, server.swap_swapin_admission, 0, NULL, NULL),
+    createIntConfig("swap-swapin-admission-min-freq", NULL, MODIFIABLE_CONFIG, 1, SWAP_ADMISSION_MAX_FREQ, server.swap_swapin_admission_min_freq, 2, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("swap-evict-loop-check-interval", NULL, MODIFIABLE_CONFIG, 1, 1024, server.swap_evict_loop_check_interval, 8, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("swap-ratelimit-maxmemory-percentage", NULL, MODIFIABLE_CONFIG, 100, INT_MAX, server.swap_ratelimit_maxmemory_percentage, 200, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("swap-ratelimit-maxmemory-pause-growth-rate", NULL, MODIFIABLE_CONFIG, 1, INT_MAX, server.swap_ratelimit_maxmemory_pause_growth_rate, 20*1024*1024, MEMORY_CONFIG, NULL, NULL),
     createIntConfig("swap-scan-session-bits", NULL, IMMUTABLE_CONFIG, 1, 16, server.swap_scan_session_bits, 7, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("swap-scan-session-max-idle-seconds", NULL, MODIFIABLE_CONFIG, 1, INT_MAX, server.swap_scan_session_max_idle_seconds, 60, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("swap-compaction-filter-skip-level", NULL, MODIFIABLE_CONFIG, -1, INT_MAX, server.swap_compaction_filter_skip_level, 0, INTEGER_CONFIG, NULL, NULL),
+    createBoolConfig("swap-compaction-filter-scan-meta", NULL, MODIFIABLE_CONFIG, server.swap_compaction_filter_scan_meta, 1, NULL, NULL),
+    createEnumConfig("swap-dispatch-policy", NULL, MODIFIABLE_CONFIG, swap_dispatch_policy_enum, server.swap_dispatch_policy, SWAP_DISPATCH_LEAST_LOADED, NULL, NULL),
+    createBoolConfig("swap-lock-read-shared", NULL, MODIFIABLE_CONFIG, server.swap_lock_read_shared, 1, NULL, NULL),
+    createBoolConfig("swap-lock-subkey-enabled", NULL, MODIFIABLE_CONFIG, server.swap_lock_subkey_enabled, 0, NULL, NULL),
+    createBoolConfig("swap-batch-adaptive", NULL, MODIFIABLE_CONFIG, server.swap_batch_adaptive, 0, NULL, NULL),
+    createIntConfig("swap-batch-latency-slo-us", NULL, MODIFIABLE_CONFIG, 1, INT_MAX, server.swap_batch_latency_slo_us, 1000, INTEGER_CONFIG, NULL, NULL),
+    createIntConfig("swap-prefetch-lookahead", NULL, MODIFIABLE_CONFIG, 0, 1024, server.swap_prefetch_lookahead, 16, INTEGER_CONFIG, NULL, NULL),
+    createIntConfig("swap-prefetch-lookahead-bytes", NULL, MODIFIABLE_CONFIG, 0, INT_MAX, server.swap_prefetch_lookahead_bytes, 64*1024, MEMORY_CONFIG, NULL, NULL),
+    createIntConfig("swap-priority-starvation-ms", NULL, MODIFIABLE_CONFIG, 0, INT_MAX, server.swap_priority_starvation_ms, 100, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("swap-ratelimit-persist-lag", NULL, MODIFIABLE_CONFIG, 1, INT_MAX, server.swap_ratelimit_persist_lag, 60, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("swap-ratelimit-persist-pause-growth-rate", NULL, MODIFIABLE_CONFIG, 1, INT_MAX, server.swap_ratelimit_persist_pause_growth_rate, 10, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("swap-persist-lag-millis", NULL, MODIFIABLE_CONFIG, 0, INT_MAX, server.swap_persist_lag_millis, 0, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("swap-persist-inprogress-growth-rate", NULL, MODIFIABLE_CONFIG, 1, INT_MAX, server.swap_persist_inprogress_growth_rate, 500, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("swap-flush-meta-deletes-percentage", NULL, MODIFIABLE_CONFIG, 0, 100, server.swap_flush_meta_deletes_percentage, 40, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("rocksdb.max_open_files", NULL, IMMUTABLE_CONFIG, -1, INT_MAX, server.rocksdb_max_open_files, -1, INTEGER_CONFIG, NULL, NULL),
+    createIntConfig("rocksdb.block_cache_high_pri_pool_percent", NULL, IMMUTABLE_CONFIG, 0, 100, server.rocksdb_block_cache_high_pri_pool_percent, 50, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("rocksdb.data.max_write_buffer_number", "rocksdb.max_write_buffer_number", MODIFIABLE_CONFIG, 1, 256, server.rocksdb_data_max_write_buffer_number, 4, INTEGER_CONFIG, NULL, updateRocksdbDataMaxWriteBufferNumber),
     createIntConfig("rocksdb.meta.max_write_buffer_number", NULL, MODIFIABLE_CONFIG, 1, 256, server.rocksdb_meta_max_write_buffer_number, 3, INTEGER_CONFIG, NULL, updateRocksdbMetaMaxWriteBufferNumber),
     createIntConfig("rocksdb.max_background_compactions", NULL, IMMUTABLE_CONFIG, 1, 64, server.rocksdb_max_background_compactions, 2, INTEGER_CONFIG, NULL, NULL),
@@ -3142,6 +3289,7 @@ standardConfig configs[] = {
     createULongLongConfig("swap-flush-meta-deletes-num", NULL, MODIFIABLE_CONFIG, 1, LLONG_MAX, server.swap_flush_meta_deletes_num, 200000, INTEGER_CONFIG, NULL, NULL),
     createULongLongConfig("rocksdb.data.block_cache_size", "rocksdb.block_cache_size", IMMUTABLE_CONFIG, 0, ULLONG_MAX, server.rocksdb_data_block_cache_size, 8*1024*1024, MEMORY_CONFIG, NULL, NULL),
     createULongLongConfig("rocksdb.meta.block_cache_size", NULL, IMMUTABLE_CONFIG, 0, ULLONG_MAX, server.rocksdb_meta_block_cache_size, 512*1024*1024, MEMORY_CONFIG, NULL, NULL),
+    createULongLongConfig("rocksdb.shared_block_cache_size", NULL, MODIFIABLE_CONFIG, 0, ULLONG_MAX, server.rocksdb_shared_block_cache_size, 0, MEMORY_CONFIG, NULL, updateRocksdbBlockCacheSize),
     createULongLongConfig("rocksdb.data.write_buffer_size", "rocksdb.write_buffer_size", MODIFIABLE_CONFIG, 0, ULLONG_MAX, server.rocksdb_data_write_buffer_size, 64*1024*1024, MEMORY_CONFIG, NULL, updateRocksdbDataWriteBufferSize),
     createULongLongConfig("rocksdb.meta.write_buffer_size", NULL, MODIFIABLE_CONFIG, 0, ULLONG_MAX, server.rocksdb_meta_write_buffer_size, 64*1024*1024, MEMORY_CONFIG, NULL, updateRocksdbMetaWriteBufferSize),
     createULongLongConfig("rocksdb.data.target_file_size_base", "rocksdb.target_file_size_base", MODIFIABLE_CONFIG, 0, ULLONG_MAX, server.rocksdb_data_target_file_size_base, 32*1024*1024, MEMORY_CONFIG, NULL, updateRocksdbDataTargetFileSizeBase),
@@ -3182,6 +3330,7 @@ standardConfig configs[] = {
     createSSizeTConfig("maxmemory-tracking-clients", NULL, MODIFIABLE_CONFIG, 0, SSIZE_MAX, server.maxmemory_tracking_clients, 512*1024*1024, MEMORY_CONFIG, NULL, applyClientMaxMemoryUsage),
 #ifdef ENABLE_SWAP
     createSizeTConfig("swap-bitmap-subkey-size", NULL, MODIFIABLE_CONFIG, 256, 16*1024, server.swap_bitmap_subkey_size, 4*1024, MEMORY_CONFIG, NULL, NULL), /* Default: 4096 bytes. */
+    createSizeTConfig("swap-string-chunked-threshold", NULL, MODIFIABLE_CONFIG, 0, LONG_MAX, server.swap_string_chunked_threshold, 0, MEMORY_CONFIG, NULL, NULL),
 #endif
 
     /* Other configs */
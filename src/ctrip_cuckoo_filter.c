@@ -128,11 +128,12 @@ void cuckooTableWriteTag(cuckooTable *table, size_t i, size_t j, int32_t tag) {
     }
 }
 
-int cuckooTableInsertNoKick(cuckooTable *table, uint64_t hv) {
-    size_t i1, i2;
-    uint32_t tag;
+/* Note that i could be either index of tag (or index of tag in a larger
+ * table, see cuckooFilterRebuildStep). */
+static int cuckooTableInsertIndexTagNoKick(cuckooTable *table, size_t i,
+        uint32_t tag) {
+    size_t i1 = i & (table->nbuckets - 1), i2;
 
-    cuckooTableIndexTag(table,hv,&i1,&tag);
     i2 = cuckooTableAltIndex(table,i1,tag);
 
     for (int j = 0; j < CUCKOO_FILTER_TAGS_PER_BUCKET; j++) {
@@ -154,6 +155,13 @@ int cuckooTableInsertNoKick(cuckooTable *table, uint64_t hv) {
     return CUCKOO_ERR;
 }
 
+int cuckooTableInsertNoKick(cuckooTable *table, uint64_t hv) {
+    size_t i;
+    uint32_t tag;
+    cuckooTableIndexTag(table,hv,&i,&tag);
+    return cuckooTableInsertIndexTagNoKick(table,i,tag);
+}
+
 static int cuckooTableInsertKickOutIndexTag(cuckooTable *table, size_t i,
         uint32_t tag) {
     uint32_t otag;
@@ -291,6 +299,8 @@ cuckooFilter *cuckooFilterNew(cuckoo_hash_fn hash_fn, int bits_per_tag_type,
     filter->ntables = 1;
     filter->tables = cuckoo_malloc(sizeof(cuckooTable));
     cuckooTableInit(filter->tables,filter->bits_per_tag,nbuckets);
+    filter->rebuild_table = 0;
+    filter->rebuild_cursor = 0;
     return filter;
 }
 
@@ -305,10 +315,12 @@ void cuckooFilterFree(cuckooFilter *filter) {
 
 static int cuckooFilterExpand(cuckooFilter *filter) {
     cuckooTable *table = cuckooFilterCurrentTable(filter);
-    size_t nbuckets = table->nbuckets*CUCKOO_FILTER_BUCKETS_EXPANSION;
-    /* NOTE that we never expand more then 4 tables. */
-    if (filter->ntables >= CUCKOO_FILTER_MAX_TABLES)
+    size_t nbuckets = table->nbuckets;
+    if (filter->ntables >= CUCKOO_FILTER_MAX_GROWN_TABLES)
         return CUCKOO_ERR;
+    /* Grown tables are as large as the last one, otherwise memory explodes. */
+    if (filter->ntables < CUCKOO_FILTER_MAX_TABLES)
+        nbuckets *= CUCKOO_FILTER_BUCKETS_EXPANSION;
     /* i1 uses higher 32bit of hv, can't index more that 2^32 */
     if (nbuckets > UINT32_MAX) nbuckets = UINT32_MAX;
     filter->ntables++;
@@ -323,8 +335,10 @@ int cuckooFilterInsert(cuckooFilter *filter, const char *key, size_t klen) {
     cuckooTable *table;
     uint64_t hv = cuckooFilterGenerateHash(filter,key,klen);
 
-    /* Try insert without kickout for all tables. */
+    /* Try insert without kickout for all tables (except the one being
+     * rebuilt, so that it could be released sooner). */
     for (int i = filter->ntables-1; i >= 0; i--) {
+        if (filter->rebuild_table && i == filter->rebuild_table) continue;
         table = filter->tables+i;
         if (cuckooTableInsertNoKick(table,hv) == CUCKOO_OK)
             return CUCKOO_OK;
@@ -380,9 +394,17 @@ void cuckooFilterGetStat(cuckooFilter *filter, cuckooFilterStat *stat) {
         stat->ntags += table->ntags;
         stat->used_memory += table->bytes_per_bucket * table->nbuckets;
         stat->load_factors[i] = (double)table->ntags / slots;
+        /* lookup compares 2 buckets of non-null tags in every table. */
+        stat->fpr += 2.0*CUCKOO_FILTER_TAGS_PER_BUCKET*stat->load_factors[i]/
+            ((1ULL<<table->bits_per_tag)-1);
         total_slots += slots;
     }
     stat->load_factor = (double)stat->ntags / total_slots;
+    if (filter->rebuild_table) {
+        cuckooTable *table = filter->tables+filter->rebuild_table;
+        stat->rebuilding = 1;
+        stat->rebuild_progress = (double)filter->rebuild_cursor/table->nbuckets;
+    }
 }
 
 size_t cuckooFilterUsedMemory(cuckooFilter *filter) {
@@ -394,10 +416,95 @@ size_t cuckooFilterUsedMemory(cuckooFilter *filter) {
     return used_memory;
 }
 
+/* Rebuild starts if tags of the last grown table could fit in free slots of
+ * lower tables, leave some room because cuckoo table can't be fully loaded. */
+static int cuckooFilterShouldRebuild(cuckooFilter *filter) {
+    size_t free_slots = 0;
+    cuckooTable *table = cuckooFilterCurrentTable(filter);
+
+    if (filter->ntables <= CUCKOO_FILTER_MAX_TABLES) return 0;
+
+    for (int i = 0; i < filter->ntables-1; i++) {
+        cuckooTable *lower = filter->tables+i;
+        size_t slots = lower->nbuckets*CUCKOO_FILTER_TAGS_PER_BUCKET;
+        if (slots > lower->ntags) free_slots += slots - lower->ntags;
+    }
+
+    return table->ntags <= free_slots/CUCKOO_FILTER_REBUILD_FREE_RATIO;
+}
+
+static int cuckooFilterRelocateTag(cuckooFilter *filter, int from, size_t i,
+        uint32_t tag) {
+    for (int k = from-1; k >= 0; k--) {
+        if (cuckooTableInsertIndexTagNoKick(filter->tables+k,i,tag) == CUCKOO_OK)
+            return CUCKOO_OK;
+    }
+    return CUCKOO_ERR;
+}
+
+static void cuckooFilterReleaseTable(cuckooFilter *filter, int index) {
+    cuckooTableDeinit(filter->tables+index);
+    memmove(filter->tables+index,filter->tables+index+1,
+            (filter->ntables-index-1)*sizeof(cuckooTable));
+    filter->ntables--;
+    filter->tables = cuckoo_realloc(filter->tables,
+            filter->ntables*sizeof(cuckooTable));
+}
+
+/* Tags of grown table are migrated back to lower tables bucket by bucket:
+ * lower tables are smaller (or as large) and power of 2 sized, so bucket
+ * index i of tag in grown table masked by lower table size is one of the two
+ * candidate buckets of the tag in lower table. Tag is removed only after
+ * relocated, so that lookups are served correctly during rebuild. */
+int cuckooFilterRebuildStep(cuckooFilter *filter, size_t max_buckets) {
+    cuckooTable *table;
+    uint32_t tag;
+
+    if (filter->rebuild_table == 0) {
+        if (!cuckooFilterShouldRebuild(filter)) return 0;
+        filter->rebuild_table = filter->ntables-1;
+        filter->rebuild_cursor = 0;
+    }
+
+    table = filter->tables+filter->rebuild_table;
+    for (size_t n = 0; n < max_buckets &&
+            filter->rebuild_cursor < table->nbuckets; n++) {
+        size_t i = filter->rebuild_cursor++;
+        for (int j = 0; j < CUCKOO_FILTER_TAGS_PER_BUCKET; j++) {
+            if ((tag = cuckooTableReadTag(table,i,j)) == CUCKOO_TAG_NULL)
+                continue;
+            if (cuckooFilterRelocateTag(filter,filter->rebuild_table,i,tag)
+                    == CUCKOO_OK) {
+                cuckooTableWriteTag(table,i,j,CUCKOO_TAG_NULL);
+                table->ntags--;
+            }
+        }
+    }
+
+    if (filter->rebuild_cursor < table->nbuckets) return 1;
+
+    if (table->victim.used && cuckooFilterRelocateTag(filter,
+                filter->rebuild_table,table->victim.index,
+                table->victim.tag) == CUCKOO_OK) {
+        table->victim.used = 0;
+        table->ntags--;
+    }
+
+    /* Tags left (lower tables full, or inserted with kickout) would be
+     * migrated in next round. */
+    if (table->ntags == 0)
+        cuckooFilterReleaseTable(filter,filter->rebuild_table);
+
+    filter->rebuild_table = 0;
+    filter->rebuild_cursor = 0;
+    return 0;
+}
+
 void cuckooFilterDump(cuckooFilter *filter) {
     serverLog(LL_NOTICE, "==== cuckoo filter(%p) ====", (void*)filter);
     serverLog(LL_NOTICE, "  bits_per_tag: %d", filter->bits_per_tag);
     serverLog(LL_NOTICE, "  ntables: %d", filter->ntables);
+    serverLog(LL_NOTICE, "  rebuild: table=%d,cursor=%lu", filter->rebuild_table, filter->rebuild_cursor);
     for (int i = 0; i < filter->ntables; i++) {
         cuckooTable *table = filter->tables+i;
         serverLog(LL_NOTICE, "  table(%d):", i);
@@ -550,6 +657,61 @@ int cuckooFilterTest(int argc, char *argv[], int accurate) {
         }
     }
 
+    TEST("cuckoo-filter: grow & rebuild") {
+        cuckooFilter *filter;
+        size_t ncases = 8192, nbuckets_base = 16;
+        cuckooFilterStat stat_, *stat = &stat_;
+        char key[KEYMAXLEN];
+
+        filter = cuckooFilterNew(cuckooGenHashFunction,CUCKOO_FILTER_BITS_PER_TAG_16,16);
+        for (size_t i = 0; i < ncases; i++) {
+            snprintf(key,KEYMAXLEN,"%08ld",i);
+            test_assert(cuckooFilterInsert(filter,key,strlen(key)) == CUCKOO_OK);
+        }
+        cuckooFilterGetStat(filter,stat);
+        test_assert(stat->ntables > CUCKOO_FILTER_MAX_TABLES);
+        test_assert(filter->tables[stat->ntables-1].nbuckets == nbuckets_base*64);
+        test_assert(stat->ntags == ncases);
+        test_assert(stat->fpr > 0 && !stat->rebuilding);
+
+        /* no room in lower tables, nothing to rebuild. */
+        test_assert(cuckooFilterRebuildStep(filter,16) == 0);
+
+        for (size_t i = 0; i < ncases; i++) {
+            if (i % 8 == 0) continue;
+            snprintf(key,KEYMAXLEN,"%08ld",i);
+            test_assert(cuckooFilterDelete(filter,key,strlen(key)) == CUCKOO_OK);
+        }
+
+        test_assert(cuckooFilterRebuildStep(filter,16) == 1);
+        cuckooFilterGetStat(filter,stat);
+        test_assert(stat->rebuilding && stat->rebuild_progress > 0);
+
+        /* lookups are served correctly during rebuild. */
+        while (cuckooFilterRebuildStep(filter,16)) {
+            for (size_t i = 0; i < ncases; i += 8) {
+                snprintf(key,KEYMAXLEN,"%08ld",i);
+                test_assert(cuckooFilterContains(filter,key,strlen(key)) == CUCKOO_OK);
+            }
+        }
+        for (int round = 0; round < 16; round++) {
+            if (filter->ntables == CUCKOO_FILTER_MAX_TABLES) break;
+            while (cuckooFilterRebuildStep(filter,1024));
+        }
+
+        cuckooFilterGetStat(filter,stat);
+        test_assert(stat->ntables == CUCKOO_FILTER_MAX_TABLES);
+        test_assert(stat->ntags == ncases/8);
+        for (size_t i = 0; i < ncases; i += 8) {
+            snprintf(key,KEYMAXLEN,"%08ld",i);
+            test_assert(cuckooFilterContains(filter,key,strlen(key)) == CUCKOO_OK);
+            test_assert(cuckooFilterDelete(filter,key,strlen(key)) == CUCKOO_OK);
+        }
+        cuckooFilterGetStat(filter,stat);
+        test_assert(stat->ntags == 0);
+        cuckooFilterFree(filter);
+    }
+
     TEST("cuckoo-filter: bench") {
         size_t nkeys = 1000000;
         double fp_rate;
@@ -41,6 +41,8 @@
 #define CUCKOO_FILTER_TAGS_PER_BUCKET  4
 #define CUCKOO_FILTER_BUCKETS_EXPANSION 4
 #define CUCKOO_FILTER_MAX_TABLES 4
+#define CUCKOO_FILTER_MAX_GROWN_TABLES 16
+#define CUCKOO_FILTER_REBUILD_FREE_RATIO 2
 #define CUCKOO_TAG_NULL 0
 #define CUCKOO_FILTER_TABLE_MIN_BUCKETS  16
 
@@ -72,15 +74,24 @@ typedef struct cuckooFilterStat {
   size_t used_memory;
   size_t ntables;
   double load_factor;
-  double load_factors[CUCKOO_FILTER_MAX_TABLES];
+  double load_factors[CUCKOO_FILTER_MAX_GROWN_TABLES];
+  double fpr; /* estimated false positive rate */
+  int rebuilding;
+  double rebuild_progress;
 } cuckooFilterStat;
 
-/* Cuckoo filter consists of cuckoo table with N, 4N, 16N... buckets. */
+/* Cuckoo filter consists of cuckoo table with N, 4N, 16N... buckets, up to
+ * CUCKOO_FILTER_MAX_TABLES tables. Filter keeps growing after that by tables
+ * as large as the last one (up to CUCKOO_FILTER_MAX_GROWN_TABLES), grown
+ * tables are rebuilt (tags migrated back to lower tables) and released once
+ * lower tables have enough room again. */
 typedef struct cuckooFilter {
   cuckoo_hash_fn hash_fn;
   int bits_per_tag;
   int ntables;
   cuckooTable *tables;
+  int rebuild_table; /* grown table being rebuilt, 0 if not rebuilding */
+  size_t rebuild_cursor; /* next bucket of rebuild_table to migrate */
 } cuckooFilter;
 
 /* hash function with static seed(so that cuckoo filter can reload) */
@@ -99,5 +110,8 @@ int cuckooFilterDelete(cuckooFilter *filter, const char *key, size_t klen);
 void cuckooFilterGetStat(cuckooFilter *filter, cuckooFilterStat *stat);
 /* Get filter used memory */
 size_t cuckooFilterUsedMemory(cuckooFilter *filter);
+/* Rebuild grown tables by at most max_buckets buckets, returns 1 if rebuild
+ * is in progress. */
+int cuckooFilterRebuildStep(cuckooFilter *filter, size_t max_buckets);
 
 #endif
@@ -176,6 +176,7 @@ swapCtx *swapCtxCreate(client *c, keyRequest *key_request,
     moveKeyRequest(ctx->key_request,key_request);
     ctx->finished = finished;
     ctx->errcode = 0;
+    ctx->admission = SWAP_ADMISSION_NONE;
     ctx->swap_lock = NULL;
 #ifdef SWAP_DEBUG
     char *key = key_request->key ? key_request->key->ptr : "(nil)";
@@ -294,6 +295,9 @@ void keyRequestSwapFinished(swapData *data, void *pd, int errcode) {
 	if (errcode) ctx->errcode = errcode;
 
     if (data) {
+        if (!ctx->errcode)
+            swapAdmissionSwapFinished(data->db,data->key,ctx->admission,
+                    ctx->swap_lock && lockHasWaiters(ctx->swap_lock));
         swapDataKeyRequestFinished(data);
         DEBUG_MSGS_APPEND(&ctx->msgs,"swap-finished",
                 "key=%s,propagate_expire=%d,set_dirty=%d",
@@ -302,7 +306,8 @@ void keyRequestSwapFinished(swapData *data, void *pd, int errcode) {
 
     /* release io will trigger either another swap within the same tx or
      * command call, but never both. so swap and main thread will not
-     * touch the same key in parallel. */
+     * touch the same key in parallel (subkey locked swap ins only do io in
+     * swap thread, see merge_in_main). */
     clientReleaseRequestIO(ctx->c,ctx);
 
     ctx->finished(ctx->c,ctx);
@@ -395,6 +400,9 @@ void keyRequestProceed(void *lock, int flush, redisDb *db, robj *key,
                 reason_num = NOSWAP_REASON_FILT_BY_ABSENTCACHE;
             goto noswap;
         } else {
+            /* next reader would find key hot once this one swapped in. */
+            lockUnshare(lock);
+            ctx->admission = swapAdmissionDecide(c,ctx->key_request);
             req = swapMetaRequestNew(ctx->key_request,
                     ctx,data,datactx,ctx->key_request->trace,
                     keyRequestSwapFinished,ctx,msgs);
@@ -404,6 +412,8 @@ void keyRequestProceed(void *lock, int flush, redisDb *db, robj *key,
     }
 
     expire = getExpire(db,key);
+    /* key might expire (and be deleted) once reader proceeded. */
+    if (expire != -1) lockUnshare(lock);
 
     object_meta = lookupMeta(db,key);
     swap_type = swapDataAnaSwapType(value,object_meta);
@@ -458,6 +468,14 @@ allset:
 
     req = swapDataRequestNew(swap_intention,swap_intention_flags,ctx,data,
             datactx,ctx->key_request->trace,keyRequestSwapFinished,ctx,msgs);
+    /* other subkey lockers (or readers proceeded with shared lock) of the
+     * key might be running commands, reader is unshared so that next reader
+     * won't proceed before this one unlocks. */
+    if (lockUnshare(lock) || lockIsSubkey(lock)) {
+        serverAssert(swap_intention == SWAP_IN &&
+                !(swap_intention_flags & SWAP_EXEC_IN_DEL));
+        req->merge_in_main = 1;
+    }
 
     swapBatchCtxFeed(server.swap_batch_ctx,flush,req,thread_idx);
 
@@ -469,6 +487,10 @@ noswap:
     if (isSwapHitStatKeyRequest(ctx->key_request)) {
         if (reason_num == NOSWAP_REASON_SWAPANADECIDED)
             atomicIncr(server.swap_hit_stats->stat_swapin_no_io_count,1);
+        /* waited while key swapping in: served by that in-flight swap. */
+        if (reason_num == NOSWAP_REASON_SWAPANADECIDED &&
+                ctx->cold_when_locked && lockConflicted(lock))
+            atomicIncr(server.swap_hit_stats->stat_swapin_coalesced_count,1);
         if (reason_num == NOSWAP_REASON_FILT_BY_CUCKOOFILTER)
             atomicIncr(server.swap_hit_stats->stat_swapin_not_found_coldfilter_cuckoofilter_filt_count,1);
         if (reason_num == NOSWAP_REASON_FILT_BY_ABSENTCACHE)
@@ -482,6 +504,97 @@ noswap:
     return;
 }
 
+/* Pure reads on key with no arg rewrite or datatype switching before call
+ * could share key lock: they would find the key hot once first one swapped
+ * in. Reader needs swap io is unshared when proceeded (see lockUnshare), so
+ * only readers of hot keys (or not needing io) actually run concurrently.
+ * Keys with expire are excluded since reads might expire them. */
+static int keyRequestLockMode(redisDb *db, keyRequest *key_request) {
+    objectMeta *object_meta;
+
+    if (!server.swap_lock_read_shared) return LOCK_MODE_WRITE;
+    if (key_request->level != REQUEST_LEVEL_KEY || db == NULL ||
+            key_request->key == NULL) return LOCK_MODE_WRITE;
+    if (key_request->cmd_intention != SWAP_IN ||
+            !(key_request->cmd_flags & CMD_READONLY) ||
+            (key_request->cmd_flags & (CMD_SWAP_DATATYPE_LIST|CMD_SWAP_DATATYPE_BITMAP)) ||
+            (key_request->cmd_intention_flags & ~SWAP_IN_META))
+        return LOCK_MODE_WRITE;
+    if (key_request->type != KEYREQUEST_TYPE_KEY &&
+            key_request->type != KEYREQUEST_TYPE_SUBKEY)
+        return LOCK_MODE_WRITE;
+
+    if (getExpire(db,key_request->key) != -1) return LOCK_MODE_WRITE;
+
+    object_meta = lookupMeta(db,key_request->key);
+    if (object_meta && (object_meta->swap_type == SWAP_TYPE_LIST ||
+                object_meta->swap_type == SWAP_TYPE_BITMAP))
+        return LOCK_MODE_WRITE;
+
+    return LOCK_MODE_READ;
+}
+
+/* Read on a single field of hash/set/zset takes subkey lock so that reads
+ * on other fields of the same key swap concurrently. Only applicable if
+ * merging swapped in fields is all it takes: key is in memory without
+ * expire (can't turn cold or get deleted by the request itself) and request
+ * won't modify the key. Swapped in fields are merged by main thread (see
+ * merge_in_main), so that swap threads never touch the live value. */
+static robj *keyRequestLockSubkey(redisDb *db, keyRequest *key_request) {
+    robj *value, *subkey;
+
+    if (!server.swap_lock_subkey_enabled) return NULL;
+    if (key_request->level != REQUEST_LEVEL_KEY || db == NULL ||
+            key_request->key == NULL) return NULL;
+    if (key_request->type != KEYREQUEST_TYPE_SUBKEY ||
+            key_request->b.num_subkeys != 1) return NULL;
+    if (key_request->cmd_intention != SWAP_IN ||
+            key_request->cmd_intention_flags != 0 ||
+            !(key_request->cmd_flags & CMD_READONLY)) return NULL;
+    if (!(key_request->cmd_flags & (CMD_SWAP_DATATYPE_HASH|
+                    CMD_SWAP_DATATYPE_SET|CMD_SWAP_DATATYPE_ZSET)) ||
+            (key_request->cmd_flags & CMD_SWAP_DATATYPE_KEYSPACE))
+        return NULL;
+
+    subkey = key_request->b.subkeys[0];
+    if (!sdsEncodedObject(subkey)) return NULL;
+
+    value = lookupKey(db,key_request->key,LOOKUP_NOTOUCH);
+    if (value == NULL || (value->type != OBJ_HASH &&
+                value->type != OBJ_SET && value->type != OBJ_ZSET))
+        return NULL;
+    if (getExpire(db,key_request->key) != -1) return NULL;
+
+    return subkey;
+}
+
+/* Swap in requests queued on a cold key wait for the one ahead of them
+ * (readers only till it's proceeded, see lockLinkShared), then find the key
+ * hot without io: that's how identical swap ins are coalesced. */
+static int keyRequestKeyCold(redisDb *db, keyRequest *key_request) {
+    if (key_request->level != REQUEST_LEVEL_KEY || db == NULL ||
+            key_request->key == NULL || key_request->cmd_intention != SWAP_IN)
+        return 0;
+    return !keyIsHot(lookupMeta(db,key_request->key),
+            lookupKey(db,key_request->key,LOOKUP_NOTOUCH));
+}
+
+/* Track subkeys requested so that eviction of big hash/set/zset prefers cold
+ * subkeys. */
+static void keyRequestTouchSubkeys(keyRequest *key_request) {
+    if (!server.swap_evict_subkey_hotness) return;
+    if (key_request->level != REQUEST_LEVEL_KEY ||
+            key_request->type != KEYREQUEST_TYPE_SUBKEY ||
+            key_request->cmd_intention != SWAP_IN) return;
+    if (!(key_request->cmd_flags & (CMD_SWAP_DATATYPE_HASH|
+                    CMD_SWAP_DATATYPE_SET|CMD_SWAP_DATATYPE_ZSET)) ||
+            (key_request->cmd_flags & CMD_SWAP_DATATYPE_KEYSPACE))
+        return;
+
+    for (int i = 0; i < key_request->b.num_subkeys; i++)
+        swapSubkeyHotnessTouch(key_request->key,key_request->b.subkeys[i]);
+}
+
 void _submitClientKeyRequests(client *c, getKeyRequestsResult *result,
         clientKeyRequestFinished cb, void* ctx_pd, int deferred) {
     int64_t txid = server.swap_txid++;
@@ -502,8 +615,11 @@ void _submitClientKeyRequests(client *c, getKeyRequestsResult *result,
         DEBUG_MSGS_APPEND(&ctx->msgs,"request-wait", "key=%s",
                 key ? (sds)key->ptr : "<nil>");
 
+        keyRequestTouchSubkeys(key_request);
+        ctx->cold_when_locked = keyRequestKeyCold(db,key_request);
         if (key_request->trace) swapTraceLock(key_request->trace);
-        lockLock(txid,db,key,keyRequestProceed,c,ctx,
+        lockLockSubkey(txid,db,key,keyRequestLockSubkey(db,key_request),
+                keyRequestLockMode(db,key_request),keyRequestProceed,c,ctx,
                 (freefunc)swapCtxFree,msgs);
     }
 }
@@ -735,6 +851,10 @@ int swapTest(int argc, char **argv, int accurate) {
   result += swapDataBitmapTest(argc, argv, accurate);
   result += wtdigestTest(argc, argv, accurate);
   result += swapReplTest(argc, argv, accurate);
+  result += swapThreadTest(argc, argv, accurate);
+  result += swapAsyncTest(argc, argv, accurate);
+  result += swapLoadTest(argc, argv, accurate);
+  result += swapEvictTest(argc, argv, accurate);
   return result;
 }
 #endif
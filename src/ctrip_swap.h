@@ -237,6 +237,7 @@ void copyKeyRequest(keyRequest *dst, keyRequest *src);
 void moveKeyRequest(keyRequest *dst, keyRequest *src);
 void keyRequestDeinit(keyRequest *key_request);
 void getKeyRequests(client *c, struct getKeyRequestsResult *result);
+void getCmdKeyRequests(int dbid, struct redisCommand *cmd, robj **argv, int argc, struct getKeyRequestsResult *result);
 void releaseKeyRequests(struct getKeyRequestsResult *result);
 int getKeyRequestsNone(int dbid, struct redisCommand *cmd, robj **argv, int argc, struct getKeyRequestsResult *result);
 int getKeyRequestsGlobal(int dbid, struct redisCommand *cmd, robj **argv, int argc, struct getKeyRequestsResult *result);
@@ -317,6 +318,10 @@ int getKeyRequestsGetbit(int dbid, struct redisCommand *cmd, robj **argv, int ar
 int getKeyRequestsBitcount(int dbid, struct redisCommand *cmd, robj **argv, int argc, struct getKeyRequestsResult *result);
 int getKeyRequestsBitpos(int dbid, struct redisCommand *cmd, robj **argv, int argc, struct getKeyRequestsResult *result);
 int getKeyRequestsBitop(int dbid, struct redisCommand *cmd, robj **argv, int argc, struct getKeyRequestsResult *result);
+int getKeyRequestsGetrange(int dbid, struct redisCommand *cmd, robj **argv, int argc, struct getKeyRequestsResult *result);
+int getKeyRequestsSetrange(int dbid, struct redisCommand *cmd, robj **argv, int argc, struct getKeyRequestsResult *result);
+int getKeyRequestsAppend(int dbid, struct redisCommand *cmd, robj **argv, int argc, struct getKeyRequestsResult *result);
+int getKeyRequestsStrlen(int dbid, struct redisCommand *cmd, robj **argv, int argc, struct getKeyRequestsResult *result);
 int getKeyRequestsBitField(int dbid, struct redisCommand *cmd, robj **argv, int argc, struct getKeyRequestsResult *result);
 
 int getKeyRequestsMemory(int dbid, struct redisCommand *cmd, robj **argv, int argc, struct getKeyRequestsResult *result);
@@ -843,6 +848,8 @@ typedef struct swapCtx {
   void *datactx;
   clientKeyRequestFinished finished;
   int errcode;
+  int admission; /* SWAP_ADMISSION_XXX decided for cold key swap in */
+  int cold_when_locked; /* key not hot when lock requested. */
   void *swap_lock;
 #ifdef SWAP_DEBUG
   swapDebugMsgs msgs;
@@ -910,6 +917,9 @@ typedef struct wholeKeySwapData {
 } wholeKeySwapData;
 
 int swapDataSetupWholeKey(swapData *d, OUT void **datactx);
+int stringChunkedEnabled(void);
+int stringIsChunked(robj *o);
+void tryTransStringToChunked(redisDb *db, robj *key, robj *o);
 
 /* Set */
 typedef struct setSwapData {
@@ -1065,7 +1075,8 @@ typedef struct metaScanDataCtx {
     metaScanDataCtxType *type;
     client *c;
     int limit;
-    sds seek;
+    sds seek; /* tagged with key format, see metaScanSeekNew. */
+    int seek_format;
     void *extend;
 } metaScanDataCtx;
 
@@ -1191,6 +1202,7 @@ typedef struct swapRequest {
   swapData *data;
   void *datactx;
   void *result; /* ref (create in decodeData, moved to swapIn) */
+  int merge_in_main; /* result decoded only, merged by main thread. */
   swapRequestFinishedCallback finish_cb;
   void *finish_pd;
   redisAtomic size_t swap_memory;
@@ -1247,14 +1259,19 @@ typedef struct swapRequestBatch {
   void *notify_pd;
   monotime notify_queue_timer;
   monotime swap_queue_timer;
+  int priority; /* min priority class of reqs. */
+  monotime dispatch_time;
 } swapRequestBatch;
 
 swapRequestBatch *swapRequestBatchNew(void);
 void swapRequestBatchFree(swapRequestBatch *reqs);
 void swapRequestBatchAppend(swapRequestBatch *reqs, swapRequest *req);
+int swapRequestPriority(swapRequest *req);
 void swapRequestBatchExecute(swapRequestBatch *reqs);
 void swapRequestBatchProcess(swapRequestBatch *reqs);
 void swapRequestBatchCallback(swapRequestBatch *reqs);
+void swapRequestBatchStartTimers(swapRequestBatch *reqs);
+swapRequestBatch *swapRequestBatchSplitNew(swapRequestBatch *reqs);
 void swapRequestBatchDispatched(swapRequestBatch *reqs);
 void swapRequestBatchStart(swapRequestBatch *reqs);
 void swapRequestBatchEnd(swapRequestBatch *reqs);
@@ -1318,22 +1335,107 @@ static inline int swapThreadsCoreNum() {
     return EXTRA_SWAP_THREADS_NUM + server.swap_threads_auto_scale_min;
 }
 
+/* Per swap thread arena reused by rio, so that write batch and scratch
+ * arrays are not malloc'ed & freed for each rio. */
+#define RIO_ARENA_WB_MAX_SIZE (4*1024*1024)
+#define RIO_ARENA_SCRATCH_MAX_SIZE (1024*1024)
+
+typedef struct RIOArena {
+    rocksdb_writebatch_t *wb; /* cleared & reused by put/del. */
+    char *scratch; /* scratch arrays bump allocated from here. */
+    size_t scratch_used;
+    size_t scratch_capacity;
+    size_t scratch_hwm; /* scratch grows to high-water mark. */
+} RIOArena;
+
+void RIOArenaBind(RIOArena *arena);
+void RIOArenaDeinit(RIOArena *arena);
+
+/* Bounded lock-free multi-producer single-consumer ring queue (cells tagged
+ * with sequence, see Vyukov's bounded mpmc queue). Pushes spill to a locked
+ * overflow list when ring is full, so that producers never block. */
+#define SWAP_RING_QUEUE_CAPACITY 4096
+
+typedef struct swapRingQueueCell {
+    size_t seq;
+    void *data;
+} swapRingQueueCell;
+
+typedef struct swapRingQueue {
+    swapRingQueueCell *cells;
+    size_t mask;
+    size_t head; /* next push position, shared by producers. */
+    size_t tail; /* next pop position, owned by consumer. */
+    pthread_mutex_t overflow_lock;
+    list *overflow;
+    size_t overflow_len;
+    redisAtomic long long overflows;
+} swapRingQueue;
+
+swapRingQueue *swapRingQueueNew(size_t capacity);
+void swapRingQueueFree(swapRingQueue *q);
+void swapRingQueuePush(swapRingQueue *q, void *data);
+void *swapRingQueuePop(swapRingQueue *q);
+size_t swapRingQueueDepth(swapRingQueue *q);
+
+/* Swap priority classes, smaller value served first. */
+#define SWAP_PRIORITY_CLIENT    0
+#define SWAP_PRIORITY_METASCAN  1
+#define SWAP_PRIORITY_EXPIRE    2
+#define SWAP_PRIORITY_EVICT     3
+#define SWAP_PRIORITY_PERSIST   4
+#define SWAP_PRIORITY_UTIL      5
+#define SWAP_PRIORITY_TYPES     6
+
+static inline const char *swapPriorityName(int priority) {
+  const char *name = "?";
+  const char *names[] = {"client", "metascan", "expire", "evict", "persist", "util"};
+  if (priority >= 0 && (size_t)priority < sizeof(names)/sizeof(char*))
+    name = names[priority];
+  return name;
+}
+static inline int getSwapPriorityByName(char *name) {
+  for (int priority = 0; priority < SWAP_PRIORITY_TYPES; priority++) {
+    if (!strcasecmp(swapPriorityName(priority), name)) {
+      return priority;
+    }
+  }
+  return -1;
+}
+
+extern swapPriorityWeightsConfig swapPriorityWeightsDefaults[SWAP_PRIORITY_TYPES];
+
 typedef struct swapThread {
     int id;
     pthread_t thread_id;
-    pthread_mutex_t lock;
-    pthread_cond_t cond;
-    list *pending_reqs;
+    swapRingQueue *pending_reqs[SWAP_PRIORITY_TYPES]; /* one queue per class. */
+    int credits[SWAP_PRIORITY_TYPES]; /* weighted round robin, owned by thread. */
+    monotime waiting_since[SWAP_PRIORITY_TYPES]; /* class pending since, owned by thread. */
+    int stealable; /* could steal & be stolen from, guarded by steal_lock. */
+    pthread_mutex_t steal_lock; /* held while stealing by or from thread. */
+    redisAtomic long long steals; /* batches stolen from other threads. */
+    redisAtomic long long stolen; /* batches stolen by other threads. */
+    redisAtomic long long busy_us; /* time spent processing batches. */
+    monotime create_time;
+    int eventfd; /* idle thread parks on eventfd. */
+    int parked;
+    redisAtomic long long wakeups; /* eventfd writes to wake parked thread. */
+    redisAtomic long long parks;
     redisAtomic unsigned long is_running_rio;
     redisAtomic size_t inflight_reqs;
-    bool stop;
-    long long start_idle_time;
+    redisAtomic int stop;
+    redisAtomic long long start_idle_time;
+    RIOArena arena;
 } swapThread;
 
 int swapThreadsInit(void);
 void swapThreadsDeinit(void);
 void swapThreadsDispatch(struct swapRequestBatch *reqs, int idx);
 int swapThreadsDrained(void);
+void swapThreadsDispatchByKey(struct swapRequestBatch *reqs);
+
+#define SWAP_DISPATCH_LEAST_LOADED 0
+#define SWAP_DISPATCH_KEY_AFFINITY 1
 int swapThreadsAutoScaleDownIfNeeded(void);
 void swapThreadDestroy(swapThread* thread);
 sds genSwapThreadInfoString(sds info);
@@ -1467,11 +1569,12 @@ void RIOBatchUpdateStatsDataNotFound(RIOBatch *rios);
 #define SWAP_BATCH_FLUSH_THREAD_SWITCH  3
 #define SWAP_BATCH_FLUSH_INTENT_SWITCH  4
 #define SWAP_BATCH_FLUSH_BEFORE_SLEEP   5
-#define SWAP_BATCH_FLUSH_TYPES          6
+#define SWAP_BATCH_FLUSH_REACH_MEM_LIMIT 6
+#define SWAP_BATCH_FLUSH_TYPES          7
 
 static inline const char *swapBatchFlushTypeName(int type) {
     const char *name = "?";
-    const char *names[] = {"FORCE_FLUSH", "REACH_LIMIT", "UTILS_TYPE", "THREAD_SWITCH", "INTENT_SWITCH", "BEFORE_SLEEP"};
+    const char *names[] = {"FORCE_FLUSH", "REACH_LIMIT", "UTILS_TYPE", "THREAD_SWITCH", "INTENT_SWITCH", "BEFORE_SLEEP", "REACH_MEM_LIMIT"};
     if (type >= 0 && (size_t)type < sizeof(names)/sizeof(char*))
         name = names[type];
     return name;
@@ -1485,17 +1588,34 @@ typedef struct swapBatchCtxStat {
   long long submit_batch_flush[SWAP_BATCH_FLUSH_TYPES];
 } swapBatchCtxStat;
 
+#define SWAP_BATCH_ADAPT_INTERVAL_MS 100
+
+/* Effective batch count limit adapted (AIMD) by rio latency & queue depth,
+ * swap-batch-limit count is the upper bound. */
+typedef struct swapBatchAdaptiveLimit {
+  int count;
+  long long rio_batch; /* rio stats snapshot at last adaption. */
+  long long rio_time;
+  long long increases;
+  long long decreases;
+} swapBatchAdaptiveLimit;
+
 typedef struct swapBatchCtx {
   swapBatchCtxStat stat;
   swapRequestBatch *batch;
   int thread_idx;
   int cmd_intention;
+  unsigned long long mem; /* estimated payload of current batch. */
+  swapBatchAdaptiveLimit adaptive[SWAP_TYPES];
+  mstime_t adapt_time;
 } swapBatchCtx;
 
 swapBatchCtx *swapBatchCtxNew(void);
 void swapBatchCtxFree(swapBatchCtx *batch_ctx);
 void swapBatchCtxFeed(swapBatchCtx *batch_ctx, int force_flush, swapRequest *req, int thread_idx);
 size_t swapBatchCtxFlush(swapBatchCtx *batch_ctx, int reason);
+void swapBatchCtxAdaptLimits(swapBatchCtx *batch_ctx);
+int swapBatchCtxCountLimit(swapBatchCtx *batch_ctx, int intention);
 
 void trackSwapBatchInstantaneousMetrics(void);
 void resetSwapBatchInstantaneousMetrics(void);
@@ -1504,16 +1624,32 @@ sds genSwapBatchInfoString(sds info);
 extern swapBatchLimitsConfig swapBatchLimitsDefaults[SWAP_TYPES];
 
 /* Async */
+#define SWAP_CQ_DRAIN_HIST_BUCKETS 9
+
+/* Swap threads notify main thread only if it's not notified since last
+ * drain, so main thread wakes up once per drain rather than per batch. */
 typedef struct asyncCompleteQueue {
     int eventfd;
-    pthread_mutex_t lock;
-    list *complete_queue;
+    swapRingQueue *complete_queue;
+    int notified;
+    redisAtomic long long notifies; /* eventfd writes */
+    redisAtomic long long wakeups; /* eventfd handler invoked */
+    redisAtomic long long batches;
+    /* drains are done in main thread */
+    long long drains;
+    long long drain_us;
+    long long drain_max_us;
+    long long budget_exhausted; /* drains stopped by budget, remains requeued. */
+    long long unpublished; /* drains stopped at a pushed but unpublished cell. */
+    long long drain_hist[SWAP_CQ_DRAIN_HIST_BUCKETS];
 } asyncCompleteQueue;
 
 int asyncCompleteQueueInit(void);
 void asyncCompleteQueueDeinit(asyncCompleteQueue *cq);
 void asyncCompleteQueueAppend(asyncCompleteQueue *cq, swapRequestBatch *reqs);
 int asyncCompleteQueueDrain(mstime_t time_limit);
+int asyncCompleteQueueProcess(asyncCompleteQueue *cq);
+sds genAsyncCompleteQueueDrainInfoString(sds info);
 
 void asyncSwapRequestBatchSubmit(swapRequestBatch *reqs, int idx);
 
@@ -1555,6 +1691,21 @@ static inline void submitSwapRequest(int mode,swapRequest *req, int idx) {
 /* Lock */
 #define LOCK_LINKS_BUF_SIZE 2
 
+/* Readers of the same key proceed together: a reader waits only for the
+ * previous reader to proceed (swap io finished), writers are exclusive. */
+#define LOCK_MODE_WRITE 0
+#define LOCK_MODE_READ  1
+#define LOCK_MODE_TYPES 2
+
+static inline const char *lockModeName(int mode) {
+  return mode == LOCK_MODE_READ ? "read" : "write";
+}
+
+/* Subkey locks hang under key locks (internal to lock module): requests on
+ * different subkeys of the same key proceed concurrently, whole key locks
+ * wait for all of them. */
+#define LOCKS_LEVEL_SUBKEY (REQUEST_LEVEL_KEY+1)
+
 typedef void (*lockProceedCallback)(void *lock, int flush, redisDb *db, robj *key, client *c, void *pd);
 
 typedef struct lockLinkTarget {
@@ -1569,11 +1720,13 @@ typedef struct lockLinks {
   int count;
   unsigned proceeded:1;
   unsigned unlocked:1;
-  unsigned reserved:30;
+  unsigned unshared:1; /* reader that signals next reader at unlock. */
+  unsigned reserved:29;
 } lockLinks;
 
 typedef struct lockLink {
   int64_t txid;
+  int mode;
   lockLinkTarget target;
   lockLinks links;
 } lockLink;
@@ -1581,9 +1734,11 @@ typedef struct lockLink {
 typedef struct lock {
   lockLink link;
   struct locks *locks;
-  listNode* locks_ln;
+  struct lock *prev; /* wait queue of locks, linked inline. */
+  struct lock *next;
   redisDb *db;
   robj *key;
+  robj *subkey;
   client *c;
   lockProceedCallback proceed;
   void *pd;
@@ -1596,9 +1751,18 @@ typedef struct lock {
 #endif
 } lock;
 
+/* Open addressing (linear probing) table of key/subkey level locks. */
+typedef struct lockTable {
+  struct locks **slots;
+  size_t size; /* power of 2, 0 if slots not allocated. */
+  size_t used;
+} lockTable;
+
 typedef struct locks {
   int level;
-  list *lock_list;
+  struct lock *head;
+  struct lock *tail;
+  long lock_count;
   struct locks *parent;
   union {
     struct {
@@ -1607,11 +1771,17 @@ typedef struct locks {
     } svr;
     struct {
       redisDb *db;
-      dict *keys;
+      lockTable keys;
     } db;
     struct {
       robj *key;
+      uint64_t hash;
+      lockTable subkeys; /* subkey locks, allocated on demand. */
     } key;
+    struct {
+      robj *subkey;
+      uint64_t hash;
+    } subkey;
   };
 } locks;
 
@@ -1634,9 +1804,18 @@ typedef struct lockCumulativeStat {
   size_t conflict_count;
 } lockCumulativeStat;
 
+typedef struct lockModeStat {
+  long long request_count;
+  long long conflict_count;
+  long long shared_count; /* readers linked right after another reader. */
+} lockModeStat;
+
 typedef struct lockStat {
   lockCumulativeStat cumulative;
   lockInstantaneouStat *instant; /* array of swap lock stats (one for each level). */
+  lockModeStat modes[LOCK_MODE_TYPES];
+  long long subkey_request_count;
+  long long subkey_conflict_count;
 } lockStat;
 
 typedef struct swapLock {
@@ -1648,8 +1827,14 @@ void swapLockCreate(void);
 void swapLockDestroy(void);
 int lockWouldBlock(int64_t txid, redisDb *db, robj *key);
 int lockLock(int64_t txid, redisDb *db, robj *key, lockProceedCallback cb, client *c, void *pd, freefunc pdfree, void *msgs);
+int lockLockWithMode(int64_t txid, redisDb *db, robj *key, int mode, lockProceedCallback cb, client *c, void *pd, freefunc pdfree, void *msgs);
+int lockLockSubkey(int64_t txid, redisDb *db, robj *key, robj *subkey, int mode, lockProceedCallback cb, client *c, void *pd, freefunc pdfree, void *msgs);
 void lockProceeded(void *lock);
 void lockUnlock(void *lock);
+int lockConflicted(void *lock);
+int lockIsSubkey(void *lock);
+int lockUnshare(void *lock);
+int lockHasWaiters(void *lock);
 
 void trackSwapLockInstantaneousMetrics(void);
 void resetSwapLockInstantaneousMetrics(void);
@@ -1686,14 +1871,65 @@ static inline int evictResultIsFreed(int evict_result) {
 
 typedef struct swapEvictionStat {
     long long evict_result[EVICT_RESULT_TYPES];
+    long long freed_bytes; /* estimated memory freed by evicted keys */
+    long long written_bytes; /* estimated bytes written for dirty keys */
+    long long pre_evicted_bytes; /* estimated memory freed by pre-eviction */
+    long long pre_evicted_keys;
+    long long above_low_ms; /* time used memory above low watermark */
+    long long above_high_ms; /* time used memory above high watermark */
+    long long hot_subkeys_kept; /* hot subkeys skipped by eviction */
+    long long reswapin_avoided; /* kept subkeys accessed afterwards */
 } swapEvictionStat;
 
+/* Pre-eviction starts once used memory exceeds high watermark, and keeps
+ * evicting in background until it drops below low watermark. */
+typedef struct swapPreEvictionState {
+    int evicting;
+    long long last_mstime;
+    size_t last_mem_used;
+    double mem_growth_rate; /* bytes per second (smoothed), may be negative */
+    size_t mem_low; /* low watermark in bytes, evicting stops below it */
+} swapPreEvictionState;
+
+/* Approximate hotness of subkeys of big hash/set/zset, 2 bits (accessed &
+ * kept) per slot indexed by hash of key and subkey. Accessed bit is cleared
+ * (second chance) when eviction skips subkey, just like clock algorithm. */
+#define SWAP_SUBKEY_HOTNESS_SLOTS (1<<20)
+#define SWAP_SUBKEY_HOTNESS_ACCESSED 1
+#define SWAP_SUBKEY_HOTNESS_KEPT 2
+typedef struct swapSubkeyHotness {
+    uint8_t *bits; /* 4 slots per byte, allocated on first access */
+} swapSubkeyHotness;
+
+/* TinyLFU style admission of cold keys swapped in by read commands: a
+ * count-min sketch of 4bit counters estimates access frequency, and a
+ * doorkeeper bitmap absorbs keys accessed only once. Counters are halved
+ * and doorkeeper cleared every SAMPLE_SIZE accesses, so that frequency
+ * reflects recent accesses only. */
+#define SWAP_ADMISSION_DEPTH 4
+#define SWAP_ADMISSION_WIDTH (1<<16)
+#define SWAP_ADMISSION_DOORKEEPER_BITS (1<<19)
+#define SWAP_ADMISSION_SAMPLE_SIZE (SWAP_ADMISSION_WIDTH*10)
+#define SWAP_ADMISSION_MAX_FREQ 16
+typedef struct swapAdmissionFilter {
+    uint8_t *counters; /* DEPTH rows of WIDTH counters, 2 per byte */
+    uint8_t *doorkeeper; /* allocated on first access with counters */
+    long long accesses; /* accesses since last aging */
+} swapAdmissionFilter;
+
+#define SWAP_ADMISSION_NONE 0
+#define SWAP_ADMISSION_ADMITTED 1
+#define SWAP_ADMISSION_REJECTED 2
+
 typedef struct swapEvictionCtx {
     long long inprogress_count; /* current inprogrss evict count */
     long long inprogress_limit; /* current inprogress limit,
                                    updated on performEviction start */
     long long failed_inrow;
     long long freed_inrow;
+    swapPreEvictionState pre_evict;
+    swapSubkeyHotness hotness;
+    swapAdmissionFilter admission;
     swapEvictionStat stat;
 } swapEvictionCtx;
 
@@ -1713,6 +1949,20 @@ void updateMaxMemoryScaleFrom(void);
 int swapEvictGetInprogressLimit(size_t mem_tofree);
 int swapEvictionReachedInprogressLimit(void);
 sds genSwapEvictionInfoString(sds info);
+size_t swapEvictionEstimateFreed(objectMeta *object_meta, robj *o);
+unsigned long long swapEvictionCostAwareIdle(redisDb *db, sds key, robj *o, unsigned long long idle);
+unsigned long long swapEvictionCostAwareIdleMax(robj *o, unsigned long long idle);
+int swapPreEvictionEnabled(void);
+size_t swapPreEvictionUsedMemory(void);
+size_t swapPreEvictionMemToFree(swapEvictionCtx *ctx, size_t mem_used, long long mstime);
+void swapPreEvictionCron(void);
+void swapSubkeyHotnessTouch(robj *key, robj *subkey);
+int swapSubkeyHotnessApplicable(uint32_t cmd_intention_flags, size_t len);
+int swapSubkeyHotnessEvictSkip(robj *key, sds subkey);
+int swapAdmissionFilterAccess(swapAdmissionFilter *filter, sds key);
+void swapAdmissionFilterDeinit(swapAdmissionFilter *filter);
+int swapAdmissionDecide(client *c, keyRequest *key_request);
+void swapAdmissionSwapFinished(redisDb *db, robj *key, int admission, int queued);
 
 #define EVICT_ASAP_OK 0
 #define EVICT_ASAP_AGAIN 1
@@ -1724,15 +1974,18 @@ typedef struct swapEvictKeysCtx {
     long long keys_scanned;
     long long swap_trigged;
     int ended;
+    int pre_evict;
 } swapEvictKeysCtx;
 
 void swap_startEvictionTimeProc(void);
 size_t swap_getMemoryToFree(size_t mem_used);
+int swap_performEvictions(size_t pre_evict_tofree);
 void swap_performEvictionStart(swapEvictKeysCtx *sectx);
 int swap_performEvictionLoopStartShouldBreak(swapEvictKeysCtx *sectx);
 size_t performEvictionSwapSelectedKey(swapEvictKeysCtx *sectx, redisDb *db, robj *keyobj);
 int swap_performEvictionLoopCheckShouldBreak(swapEvictKeysCtx *sectx);
 void swap_performEvictionEnd(swapEvictKeysCtx *sectx);
+int swap_performEvictionMemoryReached(swapEvictKeysCtx *sectx);
 static inline int swap_performEvictionLoopCheckInterval(int keys_freed) {
     return keys_freed % server.swap_evict_loop_check_interval == 0;
 }
@@ -1801,10 +2054,57 @@ typedef struct rocks {
     rocksdb_writeoptions_t *wopts;
     rocksdb_readoptions_t *filter_meta_ropts;
     rocksdb_readoptions_t * iter_ropts;
+    rocksdb_readoptions_t *prefix_iter_ropts; /* iterate within one key version. */
     const rocksdb_snapshot_t *snapshot;
+    rocksdb_cache_t *block_cache; /* block cache shared by all cfs. */
+    struct rocksKeyFormatMigration {
+        redisAtomic int status;
+        redisAtomic int stop;
+        int source; /* key format migrated from. */
+        pthread_t thread;
+        pthread_mutex_t lock; /* serializes moving keys & flushing db. */
+        rocksdb_readoptions_t *ropts;
+        long long estimated_keys;
+        redisAtomic long long scanned;
+        redisAtomic long long keys;
+        redisAtomic long long failed;
+        redisAtomic long long bytes_before;
+        redisAtomic long long bytes_after;
+        mstime_t start_time;
+        redisAtomic long long time_ms;
+    } key_format_migration; /* keys rewritten to swap-key-format in background. */
     pthread_rwlock_t rwlock[1];
 } rocks;
 
+#define ROCKS_KEY_FORMAT_MIGRATION_NONE 0
+#define ROCKS_KEY_FORMAT_MIGRATION_RUNNING 1
+#define ROCKS_KEY_FORMAT_MIGRATION_DONE 2
+
+#define ROCKS_KEY_FORMAT_MIGRATE_BATCH 128
+
+static inline int rocksKeyFormatMigrationStatus(rocks *rocks) {
+    int status;
+    atomicGet(rocks->key_format_migration.status,status);
+    return status;
+}
+
+static inline int rocksKeyFormatMigrating(rocks *rocks) {
+    return rocksKeyFormatMigrationStatus(rocks) == ROCKS_KEY_FORMAT_MIGRATION_RUNNING;
+}
+
+int rocksKeyFormatMigrationStart(rocks *rocks);
+void rocksKeyFormatMigrationStop(rocks *rocks);
+void rocksKeyFormatMigrateKey(rocks *rocks, int dbid, sds key);
+void rocksKeyFormatMigrationLock(rocks *rocks);
+void rocksKeyFormatMigrationUnlock(rocks *rocks);
+const char *rocksKeyFormatMigrationStatusName(int status);
+
+#define ROCKS_BLOCK_CACHE_LRU 0
+#define ROCKS_BLOCK_CACHE_HYPER_CLOCK 1
+
+size_t rocksGetBlockCacheCapacity(void);
+int rocksUpdateBlockCacheCapacity(void);
+
 rocks *serverRocksGetReadLock(void);
 rocks *serverRocksGetTryReadLock(void);
 rocks *serverRocksGetWriteLock(void);
@@ -2124,19 +2424,31 @@ typedef struct compactionFilterStat {
     const char *name;
     redisAtomic long long filt_count;
     redisAtomic long long scan_count;
-    redisAtomic long long rio_count;
+    redisAtomic long long rio_count; /* meta point reads. */
+    redisAtomic long long seek_count; /* meta iterator seeks. */
+    redisAtomic long long next_count; /* meta iterator nexts. */
     int stats_metric_idx_filt;
     int stats_metric_idx_scan;
     int stats_metric_idx_rio;
 } compactionFilterStat;
 
+typedef struct rocksCacheStat {
+    const char *name;
+    redisAtomic long long hit;
+    redisAtomic long long block_read; /* blocks read from sst (cache miss or bypass) */
+    redisAtomic long long read_bytes;
+} rocksCacheStat;
+
 typedef struct swapHitStat {
     redisAtomic long long stat_swapin_attempt_count;
     redisAtomic long long stat_swapin_not_found_coldfilter_cuckoofilter_filt_count;
     redisAtomic long long stat_swapin_not_found_coldfilter_absentcache_filt_count;
     redisAtomic long long stat_swapin_not_found_coldfilter_miss_count;
     redisAtomic long long stat_swapin_no_io_count;
+    redisAtomic long long stat_swapin_coalesced_count; /* no io: waited for in-flight swap in of the key. */
     redisAtomic long long stat_swapin_data_not_found_count;
+    redisAtomic long long stat_swapin_admission_hit_count;
+    redisAtomic long long stat_swapin_admission_miss_count;
     redisAtomic long long stat_absent_subkey_query_count;
     redisAtomic long long stat_absent_subkey_filt_count;
 } swapHitStat;
@@ -2149,10 +2461,47 @@ static inline int isSwapHitStatKeyRequest(keyRequest *kr) {
 void resetSwapHitStat(void);
 sds genSwapHitInfoString(sds info);
 
+typedef struct rioPinnedStat {
+    redisAtomic long long batch;
+    redisAtomic long long count;
+    redisAtomic long long memory;
+} rioPinnedStat;
+
+typedef struct rioIterateStat {
+    redisAtomic long long batch;
+    redisAtomic long long ranges;
+    redisAtomic long long iterators;
+    redisAtomic long long seeks;
+} rioIterateStat;
+
+typedef struct swapDispatchStat {
+    redisAtomic long long affinity_batches; /* batches dispatched by key. */
+    redisAtomic long long affinity_splits; /* batches split to threads by key. */
+    redisAtomic long long affinity_overflows; /* reqs sent to least loaded since thread busy. */
+} swapDispatchStat;
+
+typedef struct swapPriorityStat {
+    redisAtomic long long batches; /* batches popped by swap threads. */
+    redisAtomic long long wait_us; /* total time waited in thread queue. */
+    redisAtomic long long starved; /* batches served by starvation protection. */
+} swapPriorityStat;
+
+typedef struct keyFormatStat {
+    redisAtomic long long keys; /* data & score keys put. */
+    redisAtomic long long bytes; /* key bytes in swap-key-format. */
+    redisAtomic long long v1_bytes; /* key bytes if encoded in v1 format. */
+} keyFormatStat;
+
 typedef struct rorStat {
     struct swapStat *swap_stats; /* array of swap stats (one for each swap type). */
     struct swapStat *rio_stats; /* array of rio stats (one for each rio type). */
     struct compactionFilterStat *compaction_filter_stats; /* array of compaction filter stats (one for each column family). */
+    rioPinnedStat rio_pinned_get_stats; /* multiget served by pinned slices. */
+    rioIterateStat rio_iterate_stats; /* iterators & seeks used by iterate rio. */
+    keyFormatStat key_format_stats; /* subkey bytes put, compared with v1. */
+    swapDispatchStat dispatch_stats; /* key affinity dispatch. */
+    swapPriorityStat priority_stats[SWAP_PRIORITY_TYPES]; /* queue wait by class. */
+    struct rocksCacheStat *rocks_cache_stats; /* array of block cache stats (one for each column family). */
 } rorStat;
 
 void initStatsSwap(void);
@@ -2167,6 +2516,12 @@ static inline void updateCompactionFiltScanCount(int cf) {
 static inline void updateCompactionFiltRioCount(int cf) {
     atomicIncr(server.ror_stats->compaction_filter_stats[cf].rio_count, 1);
 }
+static inline void updateCompactionFiltSeekCount(int cf) {
+    atomicIncr(server.ror_stats->compaction_filter_stats[cf].seek_count, 1);
+}
+static inline void updateCompactionFiltNextCount(int cf, long long count) {
+    if (count) atomicIncr(server.ror_stats->compaction_filter_stats[cf].next_count, count);
+}
 
 typedef
 struct swapDebugInfo {
@@ -2217,6 +2572,12 @@ typedef struct rocksIter{
     rocksdb_t* checkpoint_db;
     sds data_endkey;
     sds meta_endkey;
+    /* db range in the other key format, iterated after the configured one
+     * if key format migration happened. */
+    sds source_startkey;
+    sds source_endkey;
+    rocksdb_readoptions_t *ropts;
+    const rocksdb_snapshot_t *snapshot;
 } rocksIter;
 
 rocksIter *rocksCreateIter(struct rocks *rocks, redisDb *db);
@@ -2250,6 +2611,7 @@ void sendSwapChildErr(swapRdbSaveErrType err_type, int dbid, sds key);
 void receiveSwapChildErrs(void);
 void swapLoadCommand(client *c);
 int tryLoadKey(redisDb *db, robj *key, int oom_sensitive);
+void swapPrefetchClientQueryBuffer(client *c);
 
 /* result that decoded from current rocksIter value */
 typedef struct decodedResult {
@@ -2573,6 +2935,7 @@ int coldFilterMayContainKey(coldFilter *filter, sds key, int *filt_by);
 void coldFilterSubkeyAdded(coldFilter *filter, sds key);
 void coldFilterSubkeyNotFound(coldFilter *filter, sds key, sds subkey);
 int coldFilterMayContainSubkey(coldFilter *filter, sds key, sds subkey);
+void coldFiltersCron(void);
 
 typedef void (*newauxfn)(void*);
 typedef void (*freeauxfn)(void*);
@@ -2592,12 +2955,16 @@ typedef struct bufferedAllocator {
     size_t occupied;
     size_t size; /* size of buffered element */
     size_t unbuffered; /* # of unbuffered ptr */
+    bufferedAllocatorPtr **spare; /* freed unbuffered ptr kept for reuse */
+    size_t spare_count;
+    size_t spare_limit; /* 0 if unbuffered ptr freed right away */
     newauxfn newauxcb; /* callback to create child ptr member */
     freeauxfn freeauxcb; /* callback to free child ptr member */
 } bufferedAllocator;
 
 bufferedAllocator *bufferedAllocatorCreate(size_t capacity, size_t size, newauxfn newauxcb, freeauxfn freeauxcb);
 void bufferedAllocatorDestroy(bufferedAllocator *ba);
+void bufferedAllocatorSetSpareLimit(bufferedAllocator *ba, size_t spare_limit);
 void *bufferedAllocatorAlloc(struct bufferedAllocator *ba);
 void bufferedAllocatorFree(struct bufferedAllocator *ba, void *content);
 
@@ -2607,6 +2974,17 @@ void bufferedAllocatorFree(struct bufferedAllocator *ba, void *content);
 #define ROCKS_KEY_FLAG_SUBKEY 0x1
 #define ROCKS_KEY_FLAG_DELETE 0xff
 
+#define SWAP_KEY_FORMAT_V1 0 /* fixed width dbid/keylen/version. */
+#define SWAP_KEY_FORMAT_V2 1 /* compact, varint dbid/keylen/version. */
+/* v2 keys are tagged with 0xff, which v1 dbid never starts with. */
+#define ROCKS_KEY_V2_MAX_DBNUM 255
+#define SWAP_KEY_FORMAT_OTHER(format) ((format) == SWAP_KEY_FORMAT_V1 ? SWAP_KEY_FORMAT_V2 : SWAP_KEY_FORMAT_V1)
+
+int rocksKeyFormat(const char *raw, size_t rawlen);
+size_t rocksKeyEncodedLen(int cf, const char *raw, size_t rawlen, int format);
+sds rocksTranscodeKey(int cf, const char *raw, size_t rawlen, int format);
+
+sds encodeMetaKeyWithFormat(int format, int dbid, const char* key, size_t key_len);
 sds encodeMetaKey(int dbid, const char* key, size_t key_len);
 sds rocksEncodeMetaKey(redisDb *db, sds key);
 int rocksDecodeMetaKey(const char *raw, size_t rawlen, int *dbid, const char **key, size_t *keylen);
@@ -2615,18 +2993,31 @@ sds rocksEncodeDataRangeStartKey(redisDb *db, sds key, uint64_t version);
 sds rocksEncodeDataRangeEndKey(redisDb *db, sds key, uint64_t version);
 #define rocksEncodeDataScanPrefix(db,key,version) rocksEncodeDataRangeStartKey(db,key,version)
 int rocksDecodeDataKey(const char *raw, size_t rawlen, int *dbid, const char **key, size_t *keylen, uint64_t *version, const char **subkey, size_t *subkeylen);
+size_t rocksDataKeyPrefixLen(const char *raw, size_t rawlen);
 sds rocksEncodeMetaVal(int swap_type, long long expire, uint64_t version, sds extend);
 int rocksDecodeMetaVal(const char* raw, size_t rawlen, int *swap_type, long long *expire, uint64_t *version, const char **extend, size_t *extend_len);
 sds rocksEncodeValRdb(robj *value);
 robj *rocksDecodeValRdb(sds raw);
+#define ROCKS_VAL_NATIVE_RAW 0xf0
+#define ROCKS_VAL_NATIVE_INT 0xf1
+static inline int rocksValIsNative(unsigned char type) {
+    return type == ROCKS_VAL_NATIVE_RAW || type == ROCKS_VAL_NATIVE_INT;
+}
+sds rocksEncodeVal(robj *value);
+robj *rocksDecodeVal(sds raw);
+int rocksValNativeToRdb(unsigned char *ptype, sds *ppayload);
 sds rocksEncodeObjectMetaLen(unsigned long len);
 long rocksDecodeObjectMetaLen(const char *raw, size_t rawlen);
 sds encodeMetaScanKey(unsigned long cursor, int limit, sds seek);
 int decodeMetaScanKey(sds meta_scan_key, unsigned long *cursor, int *limit, const char **seek, size_t *seeklen);
+sds rocksEncodeDbRangeStartKeyWithFormat(int format, int dbid);
+sds rocksEncodeDbRangeEndKeyWithFormat(int format, int dbid);
 sds rocksEncodeDbRangeStartKey(int dbid);
 sds rocksEncodeDbRangeEndKey(int dbid);
 
 #define sizeOfDouble (BYTE_ORDER == BIG_ENDIAN? sizeof(double):8)
+int encodeFixed64(char* buf, uint64_t value);
+uint64_t decodeFixed64(const char *ptr);
 int encodeDouble(char* buf, double value);
 int decodeDouble(const char* val, double* score);
 int decodeScoreKey(const char* raw, int rawlen, int* dbid, const char** key, size_t* keylen, uint64_t *version, double* score, const char** subkey, size_t* subkeylen);
@@ -2855,6 +3246,10 @@ int roaringBitmapTest(int argc, char *argv[], int accurate);
 int swapDataBitmapTest(int argc, char **argv, int accurate);
 int wtdigestTest(int argc, char **argv, int accurate);
 int swapReplTest(int argc, char **argv, int accurate);
+int swapThreadTest(int argc, char **argv, int accurate);
+int swapAsyncTest(int argc, char **argv, int accurate);
+int swapLoadTest(int argc, char **argv, int accurate);
+int swapEvictTest(int argc, char **argv, int accurate);
 
 int swapTest(int argc, char **argv, int accurate);
 
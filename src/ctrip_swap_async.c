@@ -29,44 +29,122 @@
 #include <sys/eventfd.h>
 
 /* --- Async rocks io --- */
-int asyncCompleteQueueProcess(asyncCompleteQueue *cq) {
-    int processed;
-    listIter li;
-    listNode *ln;
-    list *processing_reqs = listCreate();
-    monotime process_timer = 0;
-    if (server.swap_debug_trace_latency) elapsedStart(&process_timer);
-
-    pthread_mutex_lock(&cq->lock);
-    listRewind(cq->complete_queue, &li);
-    while ((ln = listNext(&li))) {
-        listAddNodeTail(processing_reqs, listNodeValue(ln));
-        listDelNode(cq->complete_queue, ln);
+/* Upper bound (us) of drain time histogram buckets, last one unbounded. */
+static const long long asyncCompleteQueueDrainHistBounds[SWAP_CQ_DRAIN_HIST_BUCKETS-1] = {
+    10, 50, 100, 500, 1000, 5000, 10000, 50000,
+};
+
+static void asyncCompleteQueueDrainUpdateStats(asyncCompleteQueue *cq,
+        long long elapsed) {
+    int i;
+    for (i = 0; i < SWAP_CQ_DRAIN_HIST_BUCKETS-1; i++) {
+        if (elapsed <= asyncCompleteQueueDrainHistBounds[i]) break;
+    }
+    cq->drain_hist[i]++;
+    cq->drains++;
+    cq->drain_us += elapsed;
+    if (elapsed > cq->drain_max_us) cq->drain_max_us = elapsed;
+}
+
+static void asyncCompleteQueueNotify(asyncCompleteQueue *cq) {
+    uint64_t val = 1;
+    if (__atomic_exchange_n(&cq->notified,1,__ATOMIC_SEQ_CST)) return;
+    atomicIncr(cq->notifies,1);
+    if (write(cq->eventfd, &val, sizeof(val)) < 0 && errno != EAGAIN) {
+        static mstime_t prev_log;
+        if (server.mstime - prev_log >= 1000) {
+            prev_log = server.mstime;
+            serverLog(LL_NOTICE, "[rocks] notify rio finish failed: %s",
+                    strerror(errno));
+        }
     }
-    pthread_mutex_unlock(&cq->lock);
+}
 
-    listRewind(processing_reqs, &li);
-    while ((ln = listNext(&li))) {
-        swapRequestBatch *reqs = listNodeValue(ln);
+static inline int asyncCompleteQueueBudgetExhausted(int processed,
+        monotime process_timer) {
+    if (processed == 0) return 0; /* make progress anyway */
+    if (server.swap_complete_queue_drain_max_batches > 0 &&
+            processed >= server.swap_complete_queue_drain_max_batches)
+        return 1;
+    if (server.swap_complete_queue_drain_max_us > 0 &&
+            elapsedUs(process_timer) >= (uint64_t)server.swap_complete_queue_drain_max_us)
+        return 1;
+    return 0;
+}
+
+/* Callbacks (merge, call deferred commands) of a burst might hold the event
+ * loop for long, so drain stops once budget exhausted and notifies itself
+ * to process the remains in next event loop, after network events. */
+int asyncCompleteQueueProcess(asyncCompleteQueue *cq) {
+    int processed = 0, exhausted = 0;
+    size_t depth;
+    long long elapsed;
+    swapRequestBatch *reqs;
+    monotime process_timer;
+
+    elapsedStart(&process_timer);
+
+    /* reset before pop, so that reqs completed from now on notify again. */
+    __atomic_store_n(&cq->notified,0,__ATOMIC_SEQ_CST);
+    depth = swapRingQueueDepth(cq->complete_queue);
+
+    /* process reqs completed before this drain, later ones are notified. */
+    while (processed < (int)depth) {
+        if (asyncCompleteQueueBudgetExhausted(processed,process_timer)) {
+            exhausted = 1;
+            break;
+        }
+        if ((reqs = swapRingQueuePop(cq->complete_queue)) == NULL) {
+            /* pushed but not published yet: don't spin on it, producer
+             * notifies after publishing since notified is reset above. */
+            if (swapRingQueueDepth(cq->complete_queue)) cq->unpublished++;
+            break;
+        }
         if (reqs->notify_queue_timer) {
             metricDebugInfo(SWAP_DEBUG_NOTIFY_QUEUE_WAIT, elapsedUs(reqs->notify_queue_timer));
         }
         swapRequestBatchCallback(reqs);
         swapRequestBatchFree(reqs);
+        processed++;
     }
 
-    processed = listLength(processing_reqs);
-    listRelease(processing_reqs);
-    if (server.swap_debug_trace_latency) {
-        metricDebugInfo(SWAP_DEBUG_NOTIFY_QUEUE_HANDLES, processed);
-        metricDebugInfo(SWAP_DEBUG_NOTIFY_QUEUE_HANDLE_TIME, elapsedUs(process_timer));
+    if (exhausted) {
+        cq->budget_exhausted++;
+        asyncCompleteQueueNotify(cq);
     }
+
+    elapsed = elapsedUs(process_timer);
+    atomicIncr(cq->batches,processed);
+    if (processed) asyncCompleteQueueDrainUpdateStats(cq,elapsed);
+    metricDebugInfo(SWAP_DEBUG_NOTIFY_QUEUE_HANDLES, processed);
+    metricDebugInfo(SWAP_DEBUG_NOTIFY_QUEUE_HANDLE_TIME, elapsed);
     return processed;
 }
 
+sds genAsyncCompleteQueueDrainInfoString(sds info) {
+    asyncCompleteQueue *cq = server.swap_CQ;
+    int i;
+
+    info = sdscatprintf(info,
+            "swap_async_drain:drains=%lld,avg_us=%.2f,max_us=%lld,budget_exhausted=%lld,unpublished=%lld\r\n",
+            cq->drains, cq->drains ? (double)cq->drain_us/cq->drains : 0,
+            cq->drain_max_us, cq->budget_exhausted, cq->unpublished);
+
+    info = sdscatprintf(info,"swap_async_drain_time_hist:");
+    for (i = 0; i < SWAP_CQ_DRAIN_HIST_BUCKETS-1; i++) {
+        info = sdscatprintf(info,"le_%lldus=%lld,",
+                asyncCompleteQueueDrainHistBounds[i],cq->drain_hist[i]);
+    }
+    info = sdscatprintf(info,"gt_%lldus=%lld\r\n",
+            asyncCompleteQueueDrainHistBounds[SWAP_CQ_DRAIN_HIST_BUCKETS-2],
+            cq->drain_hist[SWAP_CQ_DRAIN_HIST_BUCKETS-1]);
+
+    return info;
+}
+
 /* read before unlink clients so that main thread won't miss notify event:
- * rocksb thread: 1. link req; 2. send notify byte;
- * main thread: 1. read notify bytes; 2. unlink req;
+ * rocksb thread: 1. link req; 2. send notify byte if not notified;
+ * main thread: 1. read notify bytes; 2. reset notified; 3. unlink req;
  * if main thread read less notify bytes than unlink clients num (e.g. rockdb
  * thread link more clients when , main thread would still be triggered because
  * epoll LT-triggering mode. */
@@ -84,16 +162,15 @@ void asyncCompleteQueueHanlder(aeEventLoop *el, int eventfd, void *privdata, int
                 strerror(errno));
     }
 
+    atomicIncr(((asyncCompleteQueue*)privdata)->wakeups,1);
     asyncCompleteQueueProcess(privdata);
 }
 
 int asyncCompleteQueueInit() {
     asyncCompleteQueue *cq = zcalloc(sizeof(asyncCompleteQueue));
 
-
-    pthread_mutex_init(&cq->lock, NULL);
-
-    cq->complete_queue = listCreate();
+    cq->complete_queue = swapRingQueueNew(SWAP_RING_QUEUE_CAPACITY);
+    cq->notified = 0;
     cq->eventfd = eventfd(0, EFD_NONBLOCK);
 
     if (aeCreateFileEvent(server.el, cq->eventfd,
@@ -109,8 +186,7 @@ int asyncCompleteQueueInit() {
 
 void asyncCompleteQueueDeinit(asyncCompleteQueue *cq) {
     close(cq->eventfd);
-    pthread_mutex_destroy(&cq->lock);
-    listRelease(cq->complete_queue);
+    swapRingQueueFree(cq->complete_queue);
 }
 
 void asyncSwapRequestNotifyCallback(swapRequestBatch *reqs, void *pd) {
@@ -119,33 +195,24 @@ void asyncSwapRequestNotifyCallback(swapRequestBatch *reqs, void *pd) {
 }
 
 void asyncCompleteQueueAppend(asyncCompleteQueue *cq, swapRequestBatch *reqs) {
-    uint64_t val = 1;
-    pthread_mutex_lock(&cq->lock);
-    listAddNodeTail(cq->complete_queue, reqs);
-    pthread_mutex_unlock(&cq->lock);
-    if (write(cq->eventfd, &val, sizeof(val)) < 0 && errno != EAGAIN) {
-        static mstime_t prev_log;
-        if (server.mstime - prev_log >= 1000) {
-            prev_log = server.mstime;
-            serverLog(LL_NOTICE, "[rocks] notify rio finish failed: %s",
-                    strerror(errno));
-        }
-    }
+    swapRingQueuePush(cq->complete_queue, reqs);
+    asyncCompleteQueueNotify(cq);
 }
 
 void asyncSwapRequestBatchSubmit(swapRequestBatch *reqs, int idx) {
     reqs->notify_cb = asyncSwapRequestNotifyCallback;
     reqs->notify_pd = NULL;
-    swapThreadsDispatch(reqs, idx);
+    if (idx == -1 && server.swap_dispatch_policy == SWAP_DISPATCH_KEY_AFFINITY)
+        swapThreadsDispatchByKey(reqs);
+    else
+        swapThreadsDispatch(reqs, idx);
 }
 
 static int asyncCompleteQueueDrained() {
     int drained = 1;
 
     if (!swapThreadsDrained()) return 0;
-    pthread_mutex_lock(&server.swap_CQ->lock);
-    if (listLength(server.swap_CQ->complete_queue)) drained = 0;
-    pthread_mutex_unlock(&server.swap_CQ->lock);
+    if (swapRingQueueDepth(server.swap_CQ->complete_queue)) drained = 0;
 
     return drained;
 }
@@ -170,3 +237,75 @@ int asyncCompleteQueueDrain(mstime_t time_limit) {
     return result;
 }
 
+#ifdef REDIS_TEST
+
+int swapAsyncTest(int argc, char *argv[], int accurate) {
+    UNUSED(argc), UNUSED(argv), UNUSED(accurate);
+    int error = 0;
+
+    TEST("async: drain budget & histogram") {
+        asyncCompleteQueue *cq = zcalloc(sizeof(asyncCompleteQueue));
+        int max_batches = server.swap_complete_queue_drain_max_batches;
+        int max_us = server.swap_complete_queue_drain_max_us;
+        uint64_t val;
+
+        monotonicInit();
+        cq->complete_queue = swapRingQueueNew(SWAP_RING_QUEUE_CAPACITY);
+        cq->eventfd = eventfd(0, EFD_NONBLOCK);
+        for (int i = 0; i < 5; i++) {
+            swapRequestBatch *reqs = swapRequestBatchNew();
+            swapRequestBatchDispatched(reqs);
+            asyncCompleteQueueAppend(cq,reqs);
+        }
+        test_assert(cq->notified == 1 && cq->notifies == 1);
+        test_assert(read(cq->eventfd,&val,sizeof(val)) == sizeof(val));
+
+        /* budget exhausted: remains requeued and notified again. */
+        server.swap_complete_queue_drain_max_batches = 2;
+        server.swap_complete_queue_drain_max_us = 0;
+        test_assert(asyncCompleteQueueProcess(cq) == 2);
+        test_assert(cq->budget_exhausted == 1);
+        test_assert(swapRingQueueDepth(cq->complete_queue) == 3);
+        test_assert(cq->notified == 1 && cq->notifies == 2);
+        test_assert(read(cq->eventfd,&val,sizeof(val)) == sizeof(val));
+
+        server.swap_complete_queue_drain_max_batches = 0;
+        test_assert(asyncCompleteQueueProcess(cq) == 3);
+        test_assert(cq->budget_exhausted == 1);
+        test_assert(cq->notified == 0);
+        test_assert(asyncCompleteQueueProcess(cq) == 0);
+
+        /* empty drains are not counted. */
+        long long hist_total = 0;
+        for (int i = 0; i < SWAP_CQ_DRAIN_HIST_BUCKETS; i++)
+            hist_total += cq->drain_hist[i];
+        test_assert(cq->drains == 2 && hist_total == 2);
+        test_assert(cq->batches == 5);
+
+        /* unpublished cell: drain stops instead of spinning, producer
+         * notifies once published. */
+        swapRequestBatch *reqs = swapRequestBatchNew();
+        swapRingQueue *q = cq->complete_queue;
+        size_t pos = q->head++;
+        swapRingQueueCell *cell = q->cells + (pos & q->mask);
+        swapRequestBatchDispatched(reqs);
+        test_assert(asyncCompleteQueueProcess(cq) == 0);
+        test_assert(cq->unpublished == 1 && cq->notified == 0);
+        cell->data = reqs;
+        cell->seq = pos+1;
+        asyncCompleteQueueNotify(cq);
+        test_assert(cq->notified == 1);
+        test_assert(read(cq->eventfd,&val,sizeof(val)) == sizeof(val));
+        test_assert(asyncCompleteQueueProcess(cq) == 1);
+
+        server.swap_complete_queue_drain_max_batches = max_batches;
+        server.swap_complete_queue_drain_max_us = max_us;
+        close(cq->eventfd);
+        swapRingQueueFree(cq->complete_queue);
+        zfree(cq);
+    }
+
+    return error;
+}
+
+#endif
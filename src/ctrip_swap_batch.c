@@ -122,6 +122,8 @@ swapRequestBatch *swapRequestBatchNew() {
     reqs->count = 0;
     reqs->swap_queue_timer = 0;
     reqs->notify_queue_timer = 0;
+    reqs->priority = SWAP_PRIORITY_TYPES-1;
+    reqs->dispatch_time = 0;
     return reqs;
 }
 
@@ -142,7 +144,43 @@ static inline int swapRequestBatchEmpty(swapRequestBatch *reqs) {
     return reqs->count == 0;
 }
 
+/* Classify request by the (special) client that issued it, so that swap
+ * threads could serve foreground requests ahead of background ones. */
+int swapRequestPriority(swapRequest *req) {
+    client *c;
+    uint32_t cmd_intention_flags;
+
+    if (req->intention == SWAP_UTILS) return SWAP_PRIORITY_UTIL;
+    if (req->swap_ctx == NULL) return SWAP_PRIORITY_CLIENT;
+
+    c = req->swap_ctx->c;
+    cmd_intention_flags = req->swap_ctx->key_request->cmd_intention_flags;
+    if (isMetaScanRequest(cmd_intention_flags))
+        return SWAP_PRIORITY_METASCAN;
+    if (c == NULL || c->cmd == NULL)
+        return SWAP_PRIORITY_CLIENT;
+
+    if (c->cmd->proc == swapEvictCommand) {
+        return (cmd_intention_flags & SWAP_OUT_PERSIST) ?
+            SWAP_PRIORITY_PERSIST : SWAP_PRIORITY_EVICT;
+    } else if (c->cmd->proc == swapExpiredCommand ||
+            c->cmd->proc == swapScanexpireCommand ||
+            (c->db && c == server.swap_ttl_clients[c->db->id])) {
+        return SWAP_PRIORITY_EXPIRE;
+    } else if (c->db && server.swap_prefetch_clients &&
+            c == server.swap_prefetch_clients[c->db->id]) {
+        /* prefetch swaps in on behalf of a pipelining client. */
+        return SWAP_PRIORITY_CLIENT;
+    } else if (c->cmd->proc == swapLoadCommand) {
+        return SWAP_PRIORITY_UTIL;
+    } else {
+        return SWAP_PRIORITY_CLIENT;
+    }
+}
+
 void swapRequestBatchAppend(swapRequestBatch *reqs, swapRequest *req) {
+    int priority = swapRequestPriority(req);
+    if (priority < reqs->priority) reqs->priority = priority;
     if (reqs->count == reqs->capacity) {
         reqs->capacity = reqs->capacity < SWAP_BATCH_LINEAR_SIZE ? reqs->capacity*2 : reqs->capacity + SWAP_BATCH_LINEAR_SIZE;
         serverAssert(reqs->capacity > reqs->count);
@@ -179,10 +217,30 @@ void swapRequestBatchCallback(swapRequestBatch *reqs) {
     atomicDecr(server.swap_inprogress_memory,swap_memory);
 }
 
+/* Start queue timers once: batch split before dispatched (e.g. by key
+ * affinity) is timed since split. */
+void swapRequestBatchStartTimers(swapRequestBatch *reqs) {
+    if (server.swap_debug_trace_latency && !reqs->swap_queue_timer)
+        elapsedStart(&reqs->swap_queue_timer);
+    if (!reqs->dispatch_time) reqs->dispatch_time = getMonotonicUs();
+}
+
+/* Sub batch split off reqs is notified the same way and inherits timers
+ * already started for reqs. */
+swapRequestBatch *swapRequestBatchSplitNew(swapRequestBatch *reqs) {
+    swapRequestBatch *sub = swapRequestBatchNew();
+    sub->notify_cb = reqs->notify_cb;
+    sub->notify_pd = reqs->notify_pd;
+    sub->swap_queue_timer = reqs->swap_queue_timer;
+    sub->notify_queue_timer = reqs->notify_queue_timer;
+    sub->dispatch_time = reqs->dispatch_time;
+    return sub;
+}
+
 void swapRequestBatchDispatched(swapRequestBatch *reqs) {
     size_t swap_memory = 0;
 
-    if (server.swap_debug_trace_latency) elapsedStart(&reqs->swap_queue_timer);
+    swapRequestBatchStartTimers(reqs);
 
     for (size_t i = 0; i < reqs->count; i++) {
         swapRequest *req = reqs->reqs[i];
@@ -249,8 +307,24 @@ void swapRequestBatchPreprocess(swapRequestBatch *reqs) {
     swapExecBatchDeinit(&meta_batch);
 }
 
+/* Keys not yet moved by key format migration are moved before swapped, so
+ * that swap always reads & writes keys in swap-key-format. */
+static void swapRequestBatchMigrateKeyFormat(swapRequestBatch *reqs) {
+    if (!rocksKeyFormatMigrating(server.rocks)) return;
+    for (size_t i = 0; i < reqs->count; i++) {
+        swapRequest *req = reqs->reqs[i];
+        swapData *data = req->data;
+        if (data == NULL || data->key == NULL) continue;
+        if (req->key_request &&
+                isMetaScanRequest(req->key_request->cmd_intention_flags))
+            continue;
+        rocksKeyFormatMigrateKey(server.rocks,data->db->id,data->key->ptr);
+    }
+}
+
 void swapRequestBatchProcess(swapRequestBatch *reqs) {
     swapRequestBatchProcessStart(reqs);
+    swapRequestBatchMigrateKeyFormat(reqs);
     swapRequestBatchPreprocess(reqs);
     swapRequestBatchExecute(reqs);
     swapRequestBatchProcessEnd(reqs);
@@ -320,6 +394,20 @@ sds genSwapBatchInfoString(sds info) {
     }
     info = sdscatprintf(info,"\r\n");
 
+    long long increases = 0, decreases = 0;
+    for (int i = SWAP_IN; i <= SWAP_DEL; i++) {
+        increases += server.swap_batch_ctx->adaptive[i].increases;
+        decreases += server.swap_batch_ctx->adaptive[i].decreases;
+    }
+    info = sdscatprintf(info,
+            "swap_batch_adaptive:enabled=%d,latency_slo_us=%d,increases=%lld,decreases=%lld\r\n"
+            "swap_batch_effective_limit:IN=%d,OUT=%d,DEL=%d\r\n",
+            server.swap_batch_adaptive,server.swap_batch_latency_slo_us,
+            increases,decreases,
+            swapBatchCtxCountLimit(server.swap_batch_ctx,SWAP_IN),
+            swapBatchCtxCountLimit(server.swap_batch_ctx,SWAP_OUT),
+            swapBatchCtxCountLimit(server.swap_batch_ctx,SWAP_DEL));
+
     return info;
 }
 
@@ -330,6 +418,9 @@ swapBatchCtx *swapBatchCtxNew() {
     batch_ctx->batch = swapRequestBatchNew();
     batch_ctx->thread_idx = -1;
     batch_ctx->cmd_intention = SWAP_UNSET;
+    batch_ctx->mem = 0;
+    memset(batch_ctx->adaptive,0,sizeof(batch_ctx->adaptive));
+    batch_ctx->adapt_time = 0;
     return batch_ctx;
 }
 
@@ -346,10 +437,92 @@ static inline swapRequestBatch *swapBatchCtxShift(swapBatchCtx *batch_ctx) {
     serverAssert(batch_ctx->batch != NULL);
     swapRequestBatch *reqs = batch_ctx->batch;
     batch_ctx->batch = swapRequestBatchNew();
+    batch_ctx->mem = 0;
     return reqs;
 }
 
+/* Rio batches & time spent for requests of intention. */
+static void swapIntentionRIOStat(int intention, long long *batch, long long *time) {
+    int actions[2] = {ROCKS_NOP, ROCKS_NOP}, i;
+    long long action_batch, action_time;
+
+    switch (intention) {
+    case SWAP_IN: actions[0] = ROCKS_GET, actions[1] = ROCKS_ITERATE; break;
+    case SWAP_OUT: actions[0] = ROCKS_PUT; break;
+    case SWAP_DEL: actions[0] = ROCKS_DEL; break;
+    default: break;
+    }
+
+    *batch = 0, *time = 0;
+    for (i = 0; i < 2; i++) {
+        if (actions[i] == ROCKS_NOP) continue;
+        atomicGet(server.ror_stats->rio_stats[actions[i]].batch,action_batch);
+        atomicGet(server.ror_stats->rio_stats[actions[i]].time,action_time);
+        *batch += action_batch, *time += action_time;
+    }
+}
+
+int swapBatchCtxCountLimit(swapBatchCtx *batch_ctx, int intention) {
+    int limit = server.swap_batch_limits[intention].count;
+    int adaptive = batch_ctx->adaptive[intention].count;
+    if (server.swap_batch_adaptive && adaptive > 0 && adaptive < limit)
+        limit = adaptive;
+    return limit;
+}
+
+/* AIMD every SWAP_BATCH_ADAPT_INTERVAL_MS:
+ * - rio latency per batch exceeds slo: halve effective limit.
+ * - swap threads congested: grow effective limit by one so that rio
+ *   overhead (e.g. multiget) is amortized by more requests.
+ * - otherwise hold steady: batches flush every event loop anyway, so a
+ *   large limit costs nothing under light load, and decaying would end up
+ *   at 1 whenever load is light. */
+void swapBatchCtxAdaptLimits(swapBatchCtx *batch_ctx) {
+    size_t inprogress_batch;
+    int workers, congested, intention, first;
+
+    if (!server.swap_batch_adaptive) return;
+    if (server.mstime - batch_ctx->adapt_time < SWAP_BATCH_ADAPT_INTERVAL_MS)
+        return;
+    first = batch_ctx->adapt_time == 0; /* only take stats snapshot */
+    batch_ctx->adapt_time = server.mstime;
+
+    atomicGet(server.swap_inprogress_batch,inprogress_batch);
+    workers = server.swap_total_threads_num - EXTRA_SWAP_THREADS_NUM;
+    if (workers <= 0) workers = 1;
+    congested = inprogress_batch >= (size_t)workers;
+
+    for (intention = SWAP_IN; intention <= SWAP_DEL; intention++) {
+        swapBatchAdaptiveLimit *adaptive = batch_ctx->adaptive+intention;
+        int ceiling = server.swap_batch_limits[intention].count;
+        long long rio_batch, rio_time, batches, latency = 0;
+
+        swapIntentionRIOStat(intention,&rio_batch,&rio_time);
+        batches = rio_batch - adaptive->rio_batch;
+        if (batches > 0) latency = (rio_time - adaptive->rio_time)/batches;
+        adaptive->rio_batch = rio_batch, adaptive->rio_time = rio_time;
+
+        if (ceiling <= 0) continue; /* no limit */
+        if (adaptive->count <= 0 || adaptive->count > ceiling)
+            adaptive->count = ceiling;
+        if (first || batches < 0) continue; /* stats reset */
+
+        if (latency > server.swap_batch_latency_slo_us) {
+            if (adaptive->count > 1) {
+                adaptive->count /= 2;
+                adaptive->decreases++;
+            }
+        } else if (congested) {
+            if (adaptive->count < ceiling) {
+                adaptive->count++;
+                adaptive->increases++;
+            }
+        }
+    }
+}
+
 size_t swapBatchCtxFlush(swapBatchCtx *batch_ctx, int reason) {
+    swapBatchCtxAdaptLimits(batch_ctx);
     if (swapRequestBatchEmpty(batch_ctx->batch)) return 0;
     int thread_idx = batch_ctx->thread_idx;
     swapRequestBatch *reqs = swapBatchCtxShift(batch_ctx);
@@ -361,25 +534,82 @@ size_t swapBatchCtxFlush(swapBatchCtx *batch_ctx, int reason) {
     return reqs_count;
 }
 
+static inline size_t swapTypeEstimateEleSize(int swap_type) {
+    switch (swap_type) {
+    case SWAP_TYPE_HASH: return DEFAULT_HASH_FIELD_SIZE;
+    case SWAP_TYPE_SET: return DEFAULT_SET_MEMBER_SIZE;
+    case SWAP_TYPE_ZSET: return DEFAULT_ZSET_MEMBER_SIZE;
+    case SWAP_TYPE_LIST: return DEFAULT_LIST_ELE_SIZE;
+    default: return DEFAULT_STRING_SIZE;
+    }
+}
+
+/* Average payload of swapped requests, which is estimated by
+ * RIOEstimatePayloadSize when rio finished. */
+static inline size_t swapIntentionAvgPayloadSize(int intention) {
+    long long count, memory;
+    swapStat *stat = server.ror_stats->swap_stats+intention;
+    atomicGet(stat->count,count);
+    atomicGet(stat->memory,memory);
+    return count > 0 ? (size_t)(memory/count) : DEFAULT_KEY_SIZE+DEFAULT_STRING_SIZE;
+}
+
+/* Payload of request is not known until rio finished in swap thread, so
+ * we estimate by what main thread knows:
+ * - OUT: hot value to be swapped out.
+ * - DEL: only keys are deleted.
+ * - IN: requested subkeys, or cold subkeys if whole key swapped in, or
+ *   average payload of recent swap in requests otherwise (e.g. meta
+ *   not loaded yet). */
+static size_t swapRequestEstimatePayloadSize(swapRequest *req, int cmd_intention) {
+    swapData *data = req->data;
+    keyRequest *key_request;
+
+    if (data == NULL) return 0;
+
+    switch (cmd_intention) {
+    case SWAP_OUT:
+        return data->value ? objectEstimateSize(data->value) : 0;
+    case SWAP_DEL:
+        return DEFAULT_KEY_SIZE;
+    case SWAP_IN:
+        key_request = req->swap_ctx ? req->swap_ctx->key_request : req->key_request;
+        if (key_request && key_request->type == KEYREQUEST_TYPE_SUBKEY &&
+                key_request->b.num_subkeys > 0) {
+            return key_request->b.num_subkeys*swapTypeEstimateEleSize(data->swap_type);
+        }
+        if (key_request && key_request->type == KEYREQUEST_TYPE_KEY &&
+                data->object_meta && data->omtype == &lenObjectMetaType &&
+                data->object_meta->len > 0) {
+            return data->object_meta->len*swapTypeEstimateEleSize(data->swap_type);
+        }
+        return swapIntentionAvgPayloadSize(SWAP_IN);
+    default:
+        return 0;
+    }
+}
+
 static
 inline int swapBatchCtxExceedsLimit(swapBatchCtx *batch_ctx) {
-    int exceeded = 0;
+    int exceeded = 0, count;
     swapBatchLimitsConfig *limit;
 
     serverAssert(swapIntentionInOutDel(batch_ctx->cmd_intention));
 
     limit = server.swap_batch_limits+batch_ctx->cmd_intention;
-    if (limit->count > 0 && batch_ctx->batch->count >= (size_t)limit->count) {
-        exceeded = 1;
+    count = swapBatchCtxCountLimit(batch_ctx,batch_ctx->cmd_intention);
+    if (count > 0 && batch_ctx->batch->count >= (size_t)count) {
+        exceeded = SWAP_BATCH_FLUSH_REACH_LIMIT;
+    } else if (limit->mem > 0 && batch_ctx->mem >= limit->mem) {
+        exceeded = SWAP_BATCH_FLUSH_REACH_MEM_LIMIT;
     }
 
-    /* TODO account for mem as well. */
     return exceeded;
 }
 
 void swapBatchCtxFeed(swapBatchCtx *batch_ctx, int flush,
         swapRequest *req, int thread_idx) {
-    int cmd_intention;
+    int cmd_intention, reason;
 
     if (req->intention == SWAP_UNSET) {
         cmd_intention = req->key_request->cmd_intention;
@@ -400,6 +630,7 @@ void swapBatchCtxFeed(swapBatchCtx *batch_ctx, int flush,
     batch_ctx->cmd_intention = cmd_intention;
 
     swapRequestBatchAppend(batch_ctx->batch,req);
+    batch_ctx->mem += swapRequestEstimatePayloadSize(req,cmd_intention);
 
     /* flush after handling req if flush hint set. */
     /* execute after append req if exceeded swap-batch-limit */
@@ -407,8 +638,8 @@ void swapBatchCtxFeed(swapBatchCtx *batch_ctx, int flush,
         swapBatchCtxFlush(batch_ctx,SWAP_BATCH_FLUSH_FORCE_FLUSH);
     } else if (!swapIntentionInOutDel(batch_ctx->cmd_intention)) {
         swapBatchCtxFlush(batch_ctx,SWAP_BATCH_FLUSH_UTILS_TYPE);
-    } else if (swapBatchCtxExceedsLimit(batch_ctx)) {
-        swapBatchCtxFlush(batch_ctx,SWAP_BATCH_FLUSH_REACH_LIMIT);
+    } else if ((reason = swapBatchCtxExceedsLimit(batch_ctx))) {
+        swapBatchCtxFlush(batch_ctx,reason);
     } else {
         /* no need to flush afterwards */
     }
@@ -572,6 +803,23 @@ int swapBatchTest(int argc, char *argv[], int accurate) {
         swapDataFree(data,wholekey_ctx);
     }
 
+    TEST("batch: split batch inherits timers") {
+        swapRequestBatch *reqs = swapRequestBatchNew(), *sub;
+        reqs->notify_cb = mockNotifyCallback;
+        reqs->notify_pd = NULL;
+        swapRequestBatchStartTimers(reqs);
+        test_assert(reqs->dispatch_time != 0);
+        sub = swapRequestBatchSplitNew(reqs);
+        test_assert(sub->notify_cb == mockNotifyCallback);
+        test_assert(sub->dispatch_time == reqs->dispatch_time);
+        test_assert(sub->swap_queue_timer == reqs->swap_queue_timer);
+        /* timers started before split are kept once dispatched. */
+        swapRequestBatchStartTimers(sub);
+        test_assert(sub->dispatch_time == reqs->dispatch_time);
+        swapRequestBatchFree(sub);
+        swapRequestBatchFree(reqs);
+    }
+
     TEST("batch: request batch ctx") {
         swapData *data;
         swapBatchCtx *batch_ctx = swapBatchCtxNew();
@@ -614,7 +862,79 @@ int swapBatchTest(int argc, char *argv[], int accurate) {
         }
         test_assert(batch_ctx->stat.submit_batch_count == 3);
         test_assert(batch_ctx->stat.submit_request_count == 3+SWAP_BATCH_DEFAULT_SIZE);
+        test_assert(batch_ctx->stat.submit_batch_flush[SWAP_BATCH_FLUSH_REACH_LIMIT] == 1);
+        test_assert(batch_ctx->mem == 0);
+
+        /* exceeds swap batch mem limit triggers flush after append. */
+        unsigned long long mem_limit = server.swap_batch_limits[SWAP_OUT].mem;
+        size_t req_mem = objectEstimateSize(val1);
+        server.swap_batch_limits[SWAP_OUT].mem = req_mem*2;
+        swapBatchCtxFeed(batch_ctx,0,out_req2,-1);
+        test_assert(batch_ctx->stat.submit_batch_count == 3);
+        test_assert(batch_ctx->mem == req_mem);
+        swapBatchCtxFeed(batch_ctx,0,out_req2,-1);
+        test_assert(batch_ctx->stat.submit_batch_count == 4);
+        test_assert(batch_ctx->stat.submit_request_count == 5+SWAP_BATCH_DEFAULT_SIZE);
+        test_assert(batch_ctx->stat.submit_batch_flush[SWAP_BATCH_FLUSH_REACH_MEM_LIMIT] == 1);
+        test_assert(batch_ctx->mem == 0);
+        server.swap_batch_limits[SWAP_OUT].mem = mem_limit;
+
+        swapBatchCtxFree(batch_ctx);
+    }
 
+    TEST("batch: adaptive batch limit") {
+        swapBatchCtx *batch_ctx = swapBatchCtxNew();
+        swapStat *get_stat = server.ror_stats->rio_stats+ROCKS_GET;
+        size_t inprogress_batch = server.swap_inprogress_batch;
+        int limit = server.swap_batch_limits[SWAP_IN].count;
+
+        server.swap_batch_adaptive = 1;
+        server.swap_batch_latency_slo_us = 1000;
+        server.swap_inprogress_batch = 0;
+        server.mstime = SWAP_BATCH_ADAPT_INTERVAL_MS;
+        swapBatchCtxAdaptLimits(batch_ctx);
+        test_assert(swapBatchCtxCountLimit(batch_ctx,SWAP_IN) == limit);
+        /* light load: hold steady. */
+        server.mstime += SWAP_BATCH_ADAPT_INTERVAL_MS;
+        swapBatchCtxAdaptLimits(batch_ctx);
+        test_assert(swapBatchCtxCountLimit(batch_ctx,SWAP_IN) == limit);
+
+        /* rio latency exceeds slo: halve. */
+        get_stat->batch += 10;
+        get_stat->time += 10*2000;
+        server.mstime += SWAP_BATCH_ADAPT_INTERVAL_MS;
+        swapBatchCtxAdaptLimits(batch_ctx);
+        test_assert(swapBatchCtxCountLimit(batch_ctx,SWAP_IN) == limit/2);
+        /* not adapted until interval passed. */
+        swapBatchCtxAdaptLimits(batch_ctx);
+        test_assert(swapBatchCtxCountLimit(batch_ctx,SWAP_IN) == limit/2);
+
+        /* congested & latency within slo: grow by one. */
+        server.swap_inprogress_batch = 1024;
+        get_stat->batch += 10;
+        get_stat->time += 10*100;
+        server.mstime += SWAP_BATCH_ADAPT_INTERVAL_MS;
+        swapBatchCtxAdaptLimits(batch_ctx);
+        test_assert(swapBatchCtxCountLimit(batch_ctx,SWAP_IN) == limit/2+1);
+        test_assert(batch_ctx->adaptive[SWAP_IN].increases == 1);
+        test_assert(batch_ctx->adaptive[SWAP_IN].decreases == 1);
+
+        /* light load after congestion: not decayed. */
+        server.swap_inprogress_batch = 0;
+        server.mstime += SWAP_BATCH_ADAPT_INTERVAL_MS;
+        swapBatchCtxAdaptLimits(batch_ctx);
+        server.mstime += SWAP_BATCH_ADAPT_INTERVAL_MS;
+        swapBatchCtxAdaptLimits(batch_ctx);
+        test_assert(swapBatchCtxCountLimit(batch_ctx,SWAP_IN) == limit/2+1);
+
+        /* swap-batch-limit is the upper bound. */
+        server.swap_batch_limits[SWAP_IN].count = 2;
+        test_assert(swapBatchCtxCountLimit(batch_ctx,SWAP_IN) == 2);
+        server.swap_batch_adaptive = 0;
+        server.swap_batch_limits[SWAP_IN].count = limit;
+        test_assert(swapBatchCtxCountLimit(batch_ctx,SWAP_IN) == limit);
+
+        server.swap_inprogress_batch = inprogress_batch;
         swapBatchCtxFree(batch_ctx);
     }
 
@@ -595,6 +595,14 @@ void bitmapSwapAnaInSelectSubKeys(swapData *data, bitmapDataCtx *datactx,
            and required_subkey_end_idx should keep integer. */
         required_subkey_start_idx = start / meta->subkey_size;
 
+        /* setrange beyond string end extends the last subkey, so it must be
+         * swapped in (same as setbit). */
+        if ((req->cmd_flags & CMD_WRITE) &&
+                (req->cmd_flags & CMD_SWAP_DATATYPE_STRING) &&
+                required_subkey_start_idx > (int)(subkeys_num - 1)) {
+            required_subkey_start_idx = subkeys_num - 1;
+        }
+
         long long end = req->br.end;
         if (req->br.end < 0) {
             end = req->br.end + meta->size;
@@ -876,7 +884,7 @@ static inline sds bitmapEncodeSubkey(redisDb *db, sds key, uint64_t version,
 }
 
 static inline sds bitmapEncodeSubval(robj *subval) {
-    return rocksEncodeValRdb(subval);
+    return rocksEncodeVal(subval);
 }
 
 int bitmapEncodeKeys(swapData *data, int intention, void *datactx_,
@@ -996,7 +1004,7 @@ int bitmapDecodeData(swapData *data, int num, int *cfs, sds *rawkeys,
 
         delta_bm->subkeys_logic_idx[subkeys_cursor] = subkey_idx;
 
-        subvalobj = rocksDecodeValRdb(rawvals[i]);
+        subvalobj = rocksDecodeVal(rawvals[i]);
         serverAssert(subvalobj->type == OBJ_STRING);
         /* subvalobj might be shared integer, unshared it before
          * add to decoded. */
@@ -1308,8 +1316,11 @@ int bitmapBeforeCall(swapData *data, keyRequest *key_request, client *c,
      *       key space set command: sunionstore,sdiffstore
      *       key space zset command:zunionstore,zinterstore,zdiffstore
      *                    georadius ... STORE key,
-     * it's sure no need to rewrite. */
-    if (key_request && (key_request->cmd_flags & CMD_SWAP_DATATYPE_STRING ||
+     * it's sure no need to rewrite.
+     * note: string range commands (getrange,setrange,append,strlen) are
+     *       flagged bitmap too, they work on chunked strings. */
+    if (key_request && ((key_request->cmd_flags & CMD_SWAP_DATATYPE_STRING &&
+        !(key_request->cmd_flags & CMD_SWAP_DATATYPE_BITMAP)) ||
         ((key_request->cmd_flags & CMD_SWAP_DATATYPE_SET) && (key_request->cmd_flags & CMD_SWAP_DATATYPE_KEYSPACE)) ||
         ((key_request->cmd_flags & CMD_SWAP_DATATYPE_ZSET) && (key_request->cmd_flags & CMD_SWAP_DATATYPE_KEYSPACE)))) {
         int res = bitmapClearObjectMarkerIfExist(data->db,data->key);
@@ -2619,6 +2630,18 @@ int swapDataBitmapTest(int argc, char **argv, int accurate) {
         test_assert(cold_ctx1->subkeys_logic_idx[1] == 2);
         bitmapDataCtxReset(cold_ctx1);
 
+        cold_keyReq1->br.start = BITMAP_SUBKEY_SIZE * 5;            /* out of range, setrange extends last subkey. */
+        cold_keyReq1->br.end = BITMAP_SUBKEY_SIZE * 5 + 9;
+        cold_keyReq1->type = KEYREQUEST_TYPE_BTIMAP_RANGE;
+        cold_keyReq1->cmd_flags |= CMD_WRITE|CMD_SWAP_DATATYPE_STRING;
+        cold_keyReq1->cmd_intention = SWAP_IN, cold_keyReq1->cmd_intention_flags = 0;
+        swapDataAna(cold_data1,0,cold_keyReq1,&intention,&intention_flags,cold_ctx1);
+        test_assert(intention == SWAP_IN && intention_flags == 0);
+        test_assert(cold_ctx1->subkeys_num == 1);
+        test_assert(cold_ctx1->subkeys_logic_idx[0] == 2);
+        cold_keyReq1->cmd_flags &= ~(CMD_WRITE|CMD_SWAP_DATATYPE_STRING);
+        bitmapDataCtxReset(cold_ctx1);
+
         /* in : for persist data,  specific flags*/
         cold_keyReq1->b.num_subkeys = 0;
         cold_keyReq1->type = KEYREQUEST_TYPE_SUBKEY;
@@ -67,11 +67,11 @@ struct redisCommand redisCommandTable[SWAP_CMD_COUNT] = {
 
     {"append",appendCommand,3,
      "write use-memory fast @string @swap_string",
-     0,NULL,NULL,SWAP_IN,0,1,1,1,0,0,0},
+     0,NULL,getKeyRequestsAppend,SWAP_IN,0,1,1,1,0,0,0},
 
     {"strlen",strlenCommand,2,
      "read-only fast @string @swap_string",
-     0,NULL,NULL,SWAP_IN,0,1,1,1,0,0,0},
+     0,NULL,getKeyRequestsStrlen,SWAP_IN,0,1,1,1,0,0,0},
 
     {"del",delCommand,-2,
      "write @keyspace @swap_keyspace",
@@ -103,15 +103,15 @@ struct redisCommand redisCommandTable[SWAP_CMD_COUNT] = {
 
     {"setrange",setrangeCommand,4,
      "write use-memory @string @swap_string",
-     0,NULL,NULL,SWAP_IN,0,1,1,1,0,0,0},
+     0,NULL,getKeyRequestsSetrange,SWAP_IN,0,1,1,1,0,0,0},
 
     {"getrange",getrangeCommand,4,
      "read-only @string @swap_string",
-     0,NULL,NULL,SWAP_IN,0,1,1,1,0,0,0},
+     0,NULL,getKeyRequestsGetrange,SWAP_IN,0,1,1,1,0,0,0},
 
     {"substr",getrangeCommand,4,
      "read-only @string @swap_string",
-     0,NULL,NULL,SWAP_IN,0,1,1,1,0,0,0},
+     0,NULL,getKeyRequestsGetrange,SWAP_IN,0,1,1,1,0,0,0},
 
     {"incr",incrCommand,2,
      "write use-memory fast @string @swap_string",
@@ -1386,6 +1386,13 @@ static void getSingleCmdKeyRequests(client *c, getKeyRequestsResult *result) {
     _getSingleCmdKeyRequests(c->db->id,c->cmd,c->argv,c->argc,result);
 }
 
+/* Get key requests of a command not bound to client (e.g. parsed ahead). */
+void getCmdKeyRequests(int dbid, struct redisCommand *cmd, robj **argv,
+        int argc, getKeyRequestsResult *result) {
+    getKeyRequestsPrepareResult(result, MAX_KEYREQUESTS_BUFFER);
+    _getSingleCmdKeyRequests(dbid,cmd,argv,argc,result);
+}
+
 static inline int clientSwitchDb(client *c, int argidx) {
     long long dbid;
     if (getLongLongFromObject(c->argv[argidx],&dbid)) return C_ERR;
@@ -2242,6 +2249,82 @@ int getKeyRequestsBitpos(int dbid, struct redisCommand *cmd, robj **argv,
     return 0;
 }
 
+/* Range commands on big (chunked) strings only need the chunks covered,
+ * see swap-string-chunked-threshold. Such requests are flagged bitmap so
+ * that chunked strings stay chunked. Whole string is swapped in if chunking
+ * disabled (same as commands without getkeyrequests_proc), reads on hot
+ * strings not chunked need no swap either, they could share key lock. */
+static int stringRangeRequestChunked(int dbid, robj *key, int write) {
+    redisDb *db = server.db+dbid;
+    objectMeta *object_meta;
+
+    if (!stringChunkedEnabled()) return 0;
+    if (write) return 1;
+    if (dictFind(db->dict,key->ptr) == NULL) return 1;
+    object_meta = lookupMeta(db,key);
+    return object_meta != NULL && object_meta->swap_type == SWAP_TYPE_BITMAP;
+}
+
+static void getKeyRequestsStringRange(int dbid, struct redisCommand *cmd,
+        robj **argv, int argc, struct getKeyRequestsResult *result,
+        int chunked, long long start, long long end) {
+    if (chunked) {
+        getKeyRequestsSingleKeyWithBitmapRange(dbid,cmd,argv,argc,
+                result,1,start,end);
+        result->key_requests[result->num-1].cmd_flags |= CMD_SWAP_DATATYPE_BITMAP;
+    } else {
+        getKeyRequestsSingleKey(result,argv[1],cmd->intention,
+                cmd->intention_flags,cmd->flags,dbid);
+    }
+}
+
+int getKeyRequestsGetrange(int dbid, struct redisCommand *cmd, robj **argv,
+                         int argc, struct getKeyRequestsResult *result) {
+    long long start = 0, end = 0;
+    /* GETRANGE key start end, invalid range replied by command. */
+    int chunked = stringRangeRequestChunked(dbid,argv[1],0) &&
+        getLongLongFromObject(argv[2],&start) == C_OK &&
+        getLongLongFromObject(argv[3],&end) == C_OK;
+    getKeyRequestsStringRange(dbid,cmd,argv,argc,result,chunked,start,end);
+    return 0;
+}
+
+int getKeyRequestsSetrange(int dbid, struct redisCommand *cmd, robj **argv,
+                         int argc, struct getKeyRequestsResult *result) {
+    long long offset = 0;
+    size_t len = stringObjectLen(argv[3]);
+    /* SETRANGE key offset value, chunks beyond string end are created from
+     * the last one (which is swapped in as well). */
+    int chunked = stringRangeRequestChunked(dbid,argv[1],1) &&
+        getLongLongFromObject(argv[2],&offset) == C_OK && offset >= 0;
+    getKeyRequestsStringRange(dbid,cmd,argv,argc,result,chunked,
+            offset,len > 0 ? offset+(long long)len-1 : offset);
+    return 0;
+}
+
+int getKeyRequestsAppend(int dbid, struct redisCommand *cmd, robj **argv,
+                         int argc, struct getKeyRequestsResult *result) {
+    /* APPEND key value: only last chunk is extended. */
+    int chunked = stringRangeRequestChunked(dbid,argv[1],1);
+    getKeyRequestsStringRange(dbid,cmd,argv,argc,result,chunked,-1,-1);
+    return 0;
+}
+
+int getKeyRequestsStrlen(int dbid, struct redisCommand *cmd, robj **argv,
+                         int argc, struct getKeyRequestsResult *result) {
+    UNUSED(argc);
+    /* STRLEN key: chunked string length is answered from meta, only meta
+     * (and first chunk if key is cold) is swapped in. */
+    if (stringRangeRequestChunked(dbid,argv[1],0)) {
+        getKeyRequestsSingleKey(result,argv[1],SWAP_IN,SWAP_IN_META,
+                cmd->flags|CMD_SWAP_DATATYPE_BITMAP,dbid);
+    } else {
+        getKeyRequestsSingleKey(result,argv[1],cmd->intention,
+                cmd->intention_flags,cmd->flags,dbid);
+    }
+    return 0;
+}
+
 int getKeyRequestsBitop(int dbid, struct redisCommand *cmd, robj **argv,
                         int argc, struct getKeyRequestsResult *result) {
     return getKeyRequestsOneDestKeyMultiSrcKeys(dbid, cmd, argv, argc, result, 2, 3, -1);
@@ -2763,6 +2846,91 @@ int swapCmdTest(int argc, char *argv[], int accurate) {
         getKeyRequestsFreeResult(&result);
     }
 
+    TEST("cmd: string range") {
+        getKeyRequestsResult result = GET_KEYREQUESTS_RESULT_INIT;
+        size_t threshold = server.swap_string_chunked_threshold;
+        int subkeys_enabled = server.swap_bitmap_subkeys_enabled;
+        robj *key = createStringObject("KEY",3);
+
+        /* chunking disabled: whole string swapped in, read shares lock. */
+        server.swap_string_chunked_threshold = 0;
+        rewriteResetClientCommandCString(c,4,"GETRANGE","KEY","5","-2");
+        getKeyRequests(c,&result);
+        test_assert(result.num == 1);
+        test_assert(result.key_requests[0].type == KEYREQUEST_TYPE_KEY);
+        test_assert(!(result.key_requests[0].cmd_flags & CMD_SWAP_DATATYPE_BITMAP));
+        releaseKeyRequests(&result);
+        getKeyRequestsFreeResult(&result);
+
+        rewriteResetClientCommandCString(c,3,"APPEND","KEY","abc");
+        getKeyRequests(c,&result);
+        test_assert(result.num == 1);
+        test_assert(result.key_requests[0].type == KEYREQUEST_TYPE_KEY);
+        releaseKeyRequests(&result);
+        getKeyRequestsFreeResult(&result);
+
+        /* chunking enabled: go by range unless reading hot string. */
+        server.swap_string_chunked_threshold = 1024*1024;
+        server.swap_bitmap_subkeys_enabled = 1;
+        rewriteResetClientCommandCString(c,4,"GETRANGE","KEY","5","-2");
+        getKeyRequests(c,&result);
+        test_assert(result.num == 1);
+        test_assert(result.key_requests[0].type == KEYREQUEST_TYPE_BTIMAP_RANGE);
+        releaseKeyRequests(&result);
+        getKeyRequestsFreeResult(&result);
+
+        dbAdd(c->db,key,createStringObject("value",5));
+        rewriteResetClientCommandCString(c,4,"GETRANGE","KEY","5","-2");
+        getKeyRequests(c,&result);
+        test_assert(result.num == 1);
+        test_assert(result.key_requests[0].type == KEYREQUEST_TYPE_KEY);
+        test_assert(!(result.key_requests[0].cmd_flags & CMD_SWAP_DATATYPE_BITMAP));
+        releaseKeyRequests(&result);
+        getKeyRequestsFreeResult(&result);
+
+        rewriteResetClientCommandCString(c,4,"SETRANGE","KEY","10","abc");
+        getKeyRequests(c,&result);
+        test_assert(result.num == 1);
+        test_assert(result.key_requests[0].type == KEYREQUEST_TYPE_BTIMAP_RANGE);
+        test_assert(result.key_requests[0].cmd_flags & CMD_SWAP_DATATYPE_BITMAP);
+        test_assert(result.key_requests[0].br.start == 10 && result.key_requests[0].br.end == 12);
+        releaseKeyRequests(&result);
+        getKeyRequestsFreeResult(&result);
+
+        rewriteResetClientCommandCString(c,3,"APPEND","KEY","abc");
+        getKeyRequests(c,&result);
+        test_assert(result.num == 1);
+        test_assert(result.key_requests[0].type == KEYREQUEST_TYPE_BTIMAP_RANGE);
+        test_assert(result.key_requests[0].br.start == -1 && result.key_requests[0].br.end == -1);
+        releaseKeyRequests(&result);
+        getKeyRequestsFreeResult(&result);
+
+        dbAddMeta(c->db,key,createBitmapObjectMarker());
+        rewriteResetClientCommandCString(c,4,"GETRANGE","KEY","5","-2");
+        getKeyRequests(c,&result);
+        test_assert(result.num == 1);
+        test_assert(result.key_requests[0].type == KEYREQUEST_TYPE_BTIMAP_RANGE);
+        test_assert(result.key_requests[0].cmd_flags & CMD_SWAP_DATATYPE_BITMAP);
+        test_assert(result.key_requests[0].br.start == 5 && result.key_requests[0].br.end == -2);
+        releaseKeyRequests(&result);
+        getKeyRequestsFreeResult(&result);
+
+        rewriteResetClientCommandCString(c,2,"STRLEN","KEY");
+        getKeyRequests(c,&result);
+        test_assert(result.num == 1);
+        test_assert(result.key_requests[0].type == KEYREQUEST_TYPE_KEY);
+        test_assert(result.key_requests[0].cmd_intention_flags == SWAP_IN_META);
+        test_assert(result.key_requests[0].cmd_flags & CMD_SWAP_DATATYPE_BITMAP);
+        releaseKeyRequests(&result);
+        getKeyRequestsFreeResult(&result);
+
+        dbDeleteMeta(c->db,key);
+        dictDelete(c->db->dict,key->ptr);
+        decrRefCount(key);
+        server.swap_string_chunked_threshold = threshold;
+        server.swap_bitmap_subkeys_enabled = subkeys_enabled;
+    }
+
     return error;
 }
 
@@ -56,14 +56,23 @@ static sds rocksdbGet(rocksdb_readoptions_t* ropts, int cf, sds rawkey, char** e
     return result;
 }
 
+/* Compaction feeds filter with keys in order, and meta key is prefix of
+ * data/score key, so metas could be merge-joined with a forward meta iterator
+ * instead of one random meta point read per data key: iterator steps with
+ * Next until it reaches meta key, seeks only if meta key is far ahead. */
+#define META_VERSION_FILTER_MAX_NEXT 16
+
 typedef struct metaVersionFilter {
     uint64_t cached_keyversion;
     sds cached_metakey;
     uint64_t cached_metaversion;
+    int scan_meta;
+    rocksdb_iterator_t *meta_iter;
 } metaVersionFilter;
 
 static inline metaVersionFilter *metaVersionFilterCreate() {
     metaVersionFilter *mvfilter = zcalloc(sizeof(metaVersionFilter));
+    mvfilter->scan_meta = server.swap_compaction_filter_scan_meta;
     return mvfilter;
 }
 
@@ -75,9 +84,12 @@ static inline void metaVersionFilterUpdateCache(metaVersionFilter *mvfilter,
     mvfilter->cached_metaversion = metaversion;
 }
 
+/* meta version of cached meta key applies to all versions in scan mode,
+ * because meta version only grows: stale meta never filters live data. */
 static inline int metaVersionFilterMatchCache(metaVersionFilter *mvfilter,
         uint64_t keyversion, sds metakey) {
-    return mvfilter->cached_keyversion == keyversion &&
+    return (mvfilter->scan_meta || mvfilter->cached_keyversion == keyversion) &&
+        mvfilter->cached_metakey != NULL &&
         sdscmp(mvfilter->cached_metakey, metakey) == 0;
 }
 
@@ -88,9 +100,62 @@ static inline void metaVersionFilterDestroy(void* mvfilter_) {
         sdsfree(mvfilter->cached_metakey);
         mvfilter->cached_metakey = NULL;
     }
+    if (mvfilter->meta_iter) {
+        rocksdb_iter_destroy(mvfilter->meta_iter);
+        mvfilter->meta_iter = NULL;
+    }
     zfree(mvfilter);
 }
 
+static inline int metaVersionFilterIterCmp(rocksdb_iterator_t *iter,
+        sds metakey) {
+    size_t itkeylen;
+    const char *itkey = rocksdb_iter_key(iter,&itkeylen);
+    size_t minlen = itkeylen < sdslen(metakey) ? itkeylen : sdslen(metakey);
+    int cmp = memcmp(itkey,metakey,minlen);
+    if (cmp == 0) cmp = itkeylen < sdslen(metakey) ? -1 : (itkeylen > sdslen(metakey));
+    return cmp;
+}
+
+/* Position meta iterator at metakey, returns meta val if found (NULL if not
+ * found), sets *err if iterator failed. */
+static sds metaVersionFilterScanMeta(metaVersionFilter *mvfilter, int cf,
+        sds metakey, char **err) {
+    int cmp = -1, nexts = 0, seek = 0;
+    rocksdb_iterator_t *iter = mvfilter->meta_iter;
+    const char *val;
+    size_t vallen;
+
+    *err = NULL;
+    if (iter == NULL) {
+        iter = rocksdb_create_iterator_cf(server.rocks->db,
+                server.rocks->filter_meta_ropts,server.rocks->cf_handles[META_CF]);
+        mvfilter->meta_iter = iter;
+        seek = 1;
+    } else if (rocksdb_iter_valid(iter)) {
+        while ((cmp = metaVersionFilterIterCmp(iter,metakey)) < 0 &&
+                nexts < META_VERSION_FILTER_MAX_NEXT) {
+            rocksdb_iter_next(iter);
+            nexts++;
+            if (!rocksdb_iter_valid(iter)) break;
+        }
+        updateCompactionFiltNextCount(cf,nexts);
+        /* meta key too far ahead, seek to it. */
+        seek = rocksdb_iter_valid(iter) && cmp < 0;
+    } /* else iterator exhausted: no meta beyond. */
+
+    if (seek) {
+        rocksdb_iter_seek(iter,metakey,sdslen(metakey));
+        updateCompactionFiltSeekCount(cf);
+    }
+    if (rocksdb_iter_valid(iter)) cmp = metaVersionFilterIterCmp(iter,metakey);
+
+    rocksdb_iter_get_error(iter,err);
+    if (*err != NULL || !rocksdb_iter_valid(iter) || cmp != 0) return NULL;
+    val = rocksdb_iter_value(iter,&vallen);
+    return sdsnewlen(val,vallen);
+}
+
 static unsigned char metaVersionFilterFilt(void* mvfilter_, int level, int cf, const char* rawkey,
                                    size_t rawkey_length,
                                    int (*decodekey)(const char*, size_t , int* , const char**, size_t* ,uint64_t*)) {
@@ -120,6 +185,9 @@ static unsigned char metaVersionFilterFilt(void* mvfilter_, int level, int cf, c
     /* Skip compaction filter to speed up compaction process. */
     if (level <= server.swap_compaction_filter_skip_level) return 0;
 
+    /* Keys in other format are being migrated, meta not reachable yet. */
+    if (rocksKeyFormat(rawkey,rawkey_length) != server.swap_key_format) return 0;
+
     int retval = decodekey(rawkey, rawkey_length, &dbid, &key, &key_len, &key_version);
     if (retval != 0) return 0;
 
@@ -134,8 +202,21 @@ static unsigned char metaVersionFilterFilt(void* mvfilter_, int level, int cf, c
     if (metaVersionFilterMatchCache(mvfilter,key_version,meta_key)) {
         meta_version = mvfilter->cached_metaversion;
     } else {
-        updateCompactionFiltRioCount(cf);
-        meta_val = rocksdbGet(server.rocks->filter_meta_ropts, META_CF, meta_key, &err);
+        if (mvfilter->scan_meta) {
+            meta_val = metaVersionFilterScanMeta(mvfilter,cf,meta_key,&err);
+            if (err != NULL) {
+                serverLog(LL_NOTICE, "[metaVersionFilter] scan (%s) meta val fail: %s ", meta_key, err);
+                /* fallback to point read if iterator failed. */
+                zlibc_free(err), err = NULL;
+                mvfilter->scan_meta = 0;
+            }
+        }
+        /* Meta iterator sees metas as of its creation, confirm that meta not
+         * found is not written since then by point read. */
+        if (meta_val == NULL) {
+            updateCompactionFiltRioCount(cf);
+            meta_val = rocksdbGet(server.rocks->filter_meta_ropts, META_CF, meta_key, &err);
+        }
         if (err != NULL) {
             serverLog(LL_NOTICE, "[metaVersionFilter] rockget (%s) meta val fail: %s ", meta_key, err);
             /* if error happened, key will not be filtered. */
@@ -1120,6 +1201,135 @@ int swapFilterTest(int argc, char **argv, int accurate) {
         }
     }
 
+    TEST("exec: data compaction filter scan meta") {
+        int i, nkeys = 64, nsubkeys = 4, scan_meta;
+        long long rio_count, seek_count;
+
+        for (scan_meta = 1; scan_meta >= 0; scan_meta--) {
+            server.swap_compaction_filter_scan_meta = scan_meta;
+            rocksdb_compact_range_cf(server.rocks->db, server.rocks->cf_handles[DATA_CF], NULL, 0, NULL, 0);
+            resetStatsSwap();
+            /* even keys live (meta version 2), odd keys retired (meta version 3). */
+            for (i = 0; i < nkeys; i++) {
+                sds keystr = sdscatprintf(sdsempty(),"scankey%03d",i);
+                sds rawmetakey = rocksEncodeMetaKey(db, keystr);
+                sds extend = rocksEncodeObjectMetaLen(nsubkeys);
+                sds rawmetaval = rocksEncodeMetaVal(OBJ_HASH, -1, i%2 ? 3 : 2, extend);
+                rocksdbPut(META_CF, rawmetakey, rawmetaval, &err);
+                test_assert(err == NULL);
+                for (int j = 0; j < nsubkeys; j++) {
+                    sds sub = sdscatprintf(sdsempty(),"subkey%d",j);
+                    sds rawkey = rocksEncodeDataKey(db, keystr, 2, sub);
+                    rocksdbPut(DATA_CF,rawkey,val1->ptr, &err);
+                    test_assert(err == NULL);
+                    sdsfree(rawkey), sdsfree(sub);
+                }
+                sdsfree(keystr), sdsfree(rawmetakey), sdsfree(extend), sdsfree(rawmetaval);
+            }
+            rocksdb_compact_range_cf(server.rocks->db, server.rocks->cf_handles[DATA_CF], NULL, 0, NULL, 0);
+            atomicGet(server.ror_stats->compaction_filter_stats[DATA_CF].filt_count, filt_count);
+            atomicGet(server.ror_stats->compaction_filter_stats[DATA_CF].scan_count, scan_count);
+            atomicGet(server.ror_stats->compaction_filter_stats[DATA_CF].rio_count, rio_count);
+            atomicGet(server.ror_stats->compaction_filter_stats[DATA_CF].seek_count, seek_count);
+            test_assert(scan_count == nkeys*nsubkeys);
+            test_assert(filt_count == nkeys/2*nsubkeys);
+            if (scan_meta) {
+                test_assert(rio_count == 0);
+                test_assert(seek_count == 1);
+            } else {
+                test_assert(rio_count == nkeys);
+                test_assert(seek_count == 0);
+            }
+            for (i = 0; i < nkeys; i++) {
+                sds keystr = sdscatprintf(sdsempty(),"scankey%03d",i);
+                sds rawmetakey = rocksEncodeMetaKey(db, keystr);
+                rocksdbDelete(META_CF, rawmetakey, &err);
+                test_assert(err == NULL);
+                sdsfree(keystr), sdsfree(rawmetakey);
+            }
+            rocksdb_compact_range_cf(server.rocks->db, server.rocks->cf_handles[DATA_CF], NULL, 0, NULL, 0);
+        }
+        server.swap_compaction_filter_scan_meta = 1;
+    }
+
+    TEST("exec: meta version filter merge-join") {
+        metaVersionFilter *mvfilter;
+        long long rio_count, seek_count;
+        sds keystr, rawkey, rawmetakey, rawmetaval, extend;
+        int i;
+
+#define mvfilt(idx,version) do { \
+        keystr = sdscatprintf(sdsempty(),"mjoin-%03d",idx); \
+        rawkey = rocksEncodeDataKey(db,keystr,version,subkey); \
+        result = metaVersionFilterFilt(mvfilter,1,DATA_CF,rawkey, \
+                sdslen(rawkey),decodeDataVersion); \
+        sdsfree(keystr), sdsfree(rawkey); \
+    } while (0)
+#define mvput(idx,version) do { \
+        keystr = sdscatprintf(sdsempty(),"mjoin-%03d",idx); \
+        rawmetakey = rocksEncodeMetaKey(db,keystr); \
+        extend = rocksEncodeObjectMetaLen(1); \
+        rawmetaval = rocksEncodeMetaVal(OBJ_HASH,-1,version,extend); \
+        rocksdbPut(META_CF,rawmetakey,rawmetaval,&err); \
+        test_assert(err == NULL); \
+        sdsfree(keystr), sdsfree(rawmetakey), sdsfree(extend), sdsfree(rawmetaval); \
+    } while (0)
+
+        unsigned char result;
+        server.swap_compaction_filter_scan_meta = 1;
+        resetStatsSwap();
+        /* metas 1~40 of version 3, except that meta 10 is missing. */
+        for (i = 1; i <= 40; i++) if (i != 10) mvput(i,3);
+
+        mvfilter = metaVersionFilterCreate();
+        /* before first meta: missing meta confirmed by point read. */
+        mvfilt(0,2);
+        test_assert(result == 1);
+        /* stale version filtered, current & newer versions kept. */
+        mvfilt(1,2);
+        test_assert(result == 1);
+        mvfilt(1,3);
+        test_assert(result == 0);
+        mvfilt(2,4);
+        test_assert(result == 0);
+        /* missing meta in the middle, iterator stepped past it. */
+        mvfilt(10,2);
+        test_assert(result == 1);
+        /* meta too far ahead: seek instead of next. */
+        mvfilt(35,2);
+        test_assert(result == 1);
+        mvfilt(40,3);
+        test_assert(result == 0);
+        /* meta iterator exhausted. */
+        mvfilt(50,2);
+        test_assert(result == 1);
+        /* meta written after iterator created is found by point read. */
+        mvput(60,1);
+        mvfilt(60,1);
+        test_assert(result == 0);
+
+        atomicGet(server.ror_stats->compaction_filter_stats[DATA_CF].filt_count, filt_count);
+        atomicGet(server.ror_stats->compaction_filter_stats[DATA_CF].scan_count, scan_count);
+        atomicGet(server.ror_stats->compaction_filter_stats[DATA_CF].rio_count, rio_count);
+        atomicGet(server.ror_stats->compaction_filter_stats[DATA_CF].seek_count, seek_count);
+        test_assert(scan_count == 9 && filt_count == 5);
+        test_assert(rio_count == 4);
+        test_assert(seek_count == 2);
+
+        /* data ends before metas: iterator released with filter. */
+        metaVersionFilterDestroy(mvfilter);
+
+        for (i = 1; i <= 60; i++) {
+            keystr = sdscatprintf(sdsempty(),"mjoin-%03d",i);
+            rawmetakey = rocksEncodeMetaKey(db,keystr);
+            rocksdbDelete(META_CF,rawmetakey,&err);
+            test_assert(err == NULL);
+            sdsfree(keystr), sdsfree(rawmetakey);
+        }
+#undef mvfilt
+#undef mvput
+    }
+
     TEST("compactTask - new free") {
         compactTask *task1 = mockFullCompactTask();
         test_assert(task1->count == 3);
@@ -426,8 +426,10 @@ NULL
             for (int i = EXTRA_SWAP_THREADS_NUM; i < server.swap_total_threads_num; i++) {
                 swapThread *thread = server.swap_threads+i;
                 size_t inflight_reqs;
+                long long start_idle_time;
                 atomicGet(thread->inflight_reqs, inflight_reqs);
-                info = sdscatprintf(info, "swap_thread%d:inflight_reqs=%ld,idle_time=%lld\r\n", i, inflight_reqs, thread->start_idle_time != -1? now_time - thread->start_idle_time: -1);
+                atomicGet(thread->start_idle_time, start_idle_time);
+                info = sdscatprintf(info, "swap_thread%d:inflight_reqs=%ld,idle_time=%lld\r\n", i, inflight_reqs, start_idle_time != -1? now_time - start_idle_time: -1);
             }
             return addReplyBulkSds(c, info);
         } else if (!strcasecmp(c->argv[2]->ptr,"auto-scale-up")) {
@@ -27,6 +27,7 @@
  */
 
 #include "ctrip_swap.h"
+#include <math.h>
 
 
 void evictClientKeyRequestFinished(client *c, swapCtx *ctx) {
@@ -90,6 +91,8 @@ int tryEvictKey(redisDb *db, robj *key, int *evict_result) {
         return 0;
     }
 
+    if (o->type == OBJ_STRING) tryTransStringToChunked(db,key,o);
+
     dirty = objectIsDirty(o);
     old_keyrequests_count = evict_client->keyrequests_count;
     submitEvictClientRequest(evict_client,key,0,SWAP_PERSIST_VERSION_NO);
@@ -216,9 +219,9 @@ inline void swap_performEvictionStart(swapEvictKeysCtx *sectx) {
 }
 
 inline int swap_performEvictionLoopStartShouldBreak(swapEvictKeysCtx *sectx) {
-    UNUSED(sectx);
     if (swapEvictionReachedInprogressLimit()) {
-        swap_startEvictionTimeProc();
+        /* pre-eviction continues in next cron instead. */
+        if (!sectx->pre_evict) swap_startEvictionTimeProc();
         return 1;
     } else {
         return 0;
@@ -232,6 +235,8 @@ swapEvictionCtx *swapEvictionCtxCreate() {
 
 void swapEvictionCtxFree(swapEvictionCtx *ctx) {
     if (ctx == NULL) return;
+    if (ctx->hotness.bits) zfree(ctx->hotness.bits);
+    swapAdmissionFilterDeinit(&ctx->admission);
     zfree(ctx);
 }
 
@@ -239,10 +244,98 @@ static inline void swapEvictionCtxUpdateStat(swapEvictionCtx *ctx, int evict_res
     ctx->stat.evict_result[evict_result]++;
 }
 
+/* Per request overhead of swap out (meta, rio...), counted as io bytes. */
+#define SWAP_EVICT_COST_REQUEST_BYTES 256
+/* Fixed point unit of cost aware score. */
+#define SWAP_EVICT_COST_SCORE_UNIT 16
+/* Elements sampled to estimate element size of collections. */
+#define SWAP_EVICT_COST_SAMPLES 5
+
+size_t objectComputeSize(robj *o, size_t sample_size);
+
+/* Memory freed by evicting o once: only hot subkeys are freed, and big
+ * hash/set/zset/list (or bitmap) are evicted in steps of at most
+ * swap-evict-step-max-subkeys subkeys and swap-evict-step-max-memory bytes. */
+size_t swapEvictionEstimateFreed(objectMeta *object_meta, robj *o) {
+    size_t hot_size, hot_len, step_len, freed;
+
+    hot_size = objectComputeSize(o,SWAP_EVICT_COST_SAMPLES);
+    switch (o->type) {
+    case OBJ_HASH:
+        hot_len = hashTypeLength(o);
+        break;
+    case OBJ_SET:
+        hot_len = setTypeSize(o);
+        break;
+    case OBJ_ZSET:
+        hot_len = zsetLength(o);
+        break;
+    case OBJ_LIST:
+        hot_len = listTypeLength(o);
+        break;
+    default:
+        /* string evicted as a whole, bitmap by fragments. */
+        if (object_meta && object_meta->swap_type == SWAP_TYPE_BITMAP &&
+                server.swap_evict_step_max_memory)
+            return MIN(hot_size,server.swap_evict_step_max_memory);
+        return hot_size;
+    }
+
+    if (hot_len == 0) return hot_size;
+    step_len = MIN(hot_len,(size_t)server.swap_evict_step_max_subkeys);
+    freed = (double)hot_size*step_len/hot_len;
+    if (server.swap_evict_step_max_memory)
+        freed = MIN(freed,server.swap_evict_step_max_memory);
+    return freed;
+}
+
+/* Scale eviction pool score (idle time or inverted LFU counter) by memory
+ * freed per byte of swap io: clean keys are freed without writing rocksdb,
+ * dirty keys are written out, and keys are likely to be swapped in again
+ * (read back) if recently or frequently accessed. Weight is log scaled so
+ * that idleness still dominates the score. */
+static unsigned long long swapEvictionCostAwareScore(double freed, int dirty,
+        unsigned long long idle) {
+    double written, reload, access_prob, weight;
+
+    written = dirty ? freed : 0;
+    if (server.maxmemory_policy & MAXMEMORY_FLAG_LFU) {
+        access_prob = idle >= 255 ? 0 : (255.0-idle)/255;
+    } else {
+        access_prob = 1000.0/(1000.0+idle);
+    }
+    reload = freed*access_prob;
+
+    weight = log2(2+freed/(SWAP_EVICT_COST_REQUEST_BYTES+written+reload));
+    return (unsigned long long)(idle*weight*SWAP_EVICT_COST_SCORE_UNIT);
+}
+
+unsigned long long swapEvictionCostAwareIdle(redisDb *db, sds key, robj *o,
+        unsigned long long idle) {
+    if (!server.swap_evict_cost_aware || o == NULL) return idle;
+    return swapEvictionCostAwareScore(
+            swapEvictionEstimateFreed(dictFetchValue(db->meta,key),o),
+            objectIsDataDirty(o),idle);
+}
+
+/* Upper bound of swapEvictionCostAwareIdle without sizing o (score grows
+ * with memory freed, which is capped by swap-evict-step-max-memory for
+ * collections), so that keys that can't enter eviction pool are not sized.
+ * Strings are sized in O(1), no bound needed. */
+unsigned long long swapEvictionCostAwareIdleMax(robj *o,
+        unsigned long long idle) {
+    if (!server.swap_evict_cost_aware || o == NULL) return idle;
+    if (o->type == OBJ_STRING || !server.swap_evict_step_max_memory)
+        return ULLONG_MAX;
+    return swapEvictionCostAwareScore(server.swap_evict_step_max_memory,
+            objectIsDataDirty(o),idle);
+}
+
 inline size_t performEvictionSwapSelectedKey(swapEvictKeysCtx *sectx, redisDb *db,
         robj *keyobj) {
-    int evict_result;
-    size_t mem_freed;
+    int evict_result, dirty;
+    size_t mem_freed, step_freed;
+    robj *o;
     mstime_t eviction_latency;
     swapEvictionCtx *ctx = server.swap_eviction_ctx;
 
@@ -250,13 +343,23 @@ inline size_t performEvictionSwapSelectedKey(swapEvictKeysCtx *sectx, redisDb *d
 
     /* Key might be directly freed if not dirty, so we need to compute key
      * size beforehand. */
-    mem_freed = keyEstimateSize(db, keyobj);
+    o = lookupKey(db,keyobj,LOOKUP_NOTOUCH);
+    mem_freed = o ? objectEstimateSize(o) : 0;
+    step_freed = o ? swapEvictionEstimateFreed(lookupMeta(db,keyobj),o) : 0;
+    dirty = o ? objectIsDataDirty(o) : 0;
     sectx->swap_trigged += tryEvictKey(db, keyobj, &evict_result);
 
     if (evictResultIsFreed(evict_result))
         swapEvictionFreedInrowIncr(ctx);
 
     if (evictResultIsSucc(evict_result)) {
+        ctx->stat.freed_bytes += step_freed;
+        if (dirty && evict_result == EVICT_SUCC_SWAPPED)
+            ctx->stat.written_bytes += step_freed;
+        if (sectx->pre_evict) {
+            ctx->stat.pre_evicted_bytes += mem_freed;
+            ctx->stat.pre_evicted_keys++;
+        }
         ctx->failed_inrow = 0;
         notifyKeyspaceEvent(NOTIFY_EVICTED, "swap-evicted", keyobj, db->id);
     } else {
@@ -301,6 +404,18 @@ inline void swap_performEvictionEnd(swapEvictKeysCtx *sectx) {
     sectx->ended = 1;
 }
 
+/* Checked periodically by eviction loop with lazyfree eviction, because
+ * memory freed by lazyfree thread is not counted in mem_freed. Pre-eviction
+ * runs below maxmemory already, so check against low watermark instead. */
+int swap_performEvictionMemoryReached(swapEvictKeysCtx *sectx) {
+    if (sectx->pre_evict) {
+        return swapPreEvictionUsedMemory() <=
+            server.swap_eviction_ctx->pre_evict.mem_low;
+    } else {
+        return getMaxmemoryState(NULL,NULL,NULL,NULL) == C_OK;
+    }
+}
+
 sds genSwapEvictionInfoString(sds info) {
     swapEvictionCtx *ctx = server.swap_eviction_ctx;
 
@@ -317,9 +432,280 @@ sds genSwapEvictionInfoString(sds info) {
         }
     }
     info = sdscatprintf(info,"\r\n");
+
+    info = sdscatprintf(info,
+            "swap_evict_cost:freed_bytes=%lld,written_bytes=%lld,freed_per_written=%.2f\r\n",
+            ctx->stat.freed_bytes,ctx->stat.written_bytes,
+            ctx->stat.written_bytes ?
+            (double)ctx->stat.freed_bytes/ctx->stat.written_bytes : 0);
+
+    info = sdscatprintf(info,
+            "swap_pre_evict:enabled=%d,watermark_low=%d,watermark_high=%d,evicting=%d,"
+            "mem_growth_rate=%.0f,above_low_ms=%lld,above_high_ms=%lld,"
+            "evicted_bytes=%lld,evicted_keys=%lld\r\n",
+            swapPreEvictionEnabled(),
+            server.swap_evict_watermark_low,server.swap_evict_watermark_high,
+            ctx->pre_evict.evicting,ctx->pre_evict.mem_growth_rate,
+            ctx->stat.above_low_ms,ctx->stat.above_high_ms,
+            ctx->stat.pre_evicted_bytes,ctx->stat.pre_evicted_keys);
+
+    info = sdscatprintf(info,
+            "swap_evict_subkey_hotness:hot_subkeys_kept=%lld,reswapin_avoided=%lld\r\n",
+            ctx->stat.hot_subkeys_kept,ctx->stat.reswapin_avoided);
     return info;
 }
 
+/* ----------------------------- pre evict ------------------------------ */
+#define SWAP_PRE_EVICT_GROWTH_RATE_ALPHA 0.3
+
+int swapPreEvictionEnabled(void) {
+    return server.maxmemory && server.maxmemory_policy != MAXMEMORY_NO_EVICTION &&
+        server.swap_evict_watermark_low > 0 &&
+        server.swap_evict_watermark_high > server.swap_evict_watermark_low;
+}
+
+size_t swapPreEvictionUsedMemory(void) {
+    size_t mem_used = swap_getUsedMemory();
+    size_t overhead = freeMemoryGetNotCountedMemory();
+    return mem_used > overhead ? mem_used - overhead : 0;
+}
+
+/* Updates pre-eviction state with used memory sampled at mstime, returns
+ * bytes to evict: used memory exceeds high watermark (percentage of
+ * maxmemory) until it drops below low watermark. Memory expected to grow
+ * before next cron is evicted as well, which also raises eviction inprogress
+ * limit if memory grows fast. Returns 0 if disabled: no maxmemory or evict
+ * policy, high watermark is 0 or not above low watermark. */
+size_t swapPreEvictionMemToFree(swapEvictionCtx *ctx, size_t mem_used,
+        long long mstime) {
+    swapPreEvictionState *pe = &ctx->pre_evict;
+    size_t low, high, mem_tofree;
+    long long elapsed;
+
+    if (!swapPreEvictionEnabled()) {
+        pe->evicting = 0;
+        pe->last_mstime = 0;
+        pe->mem_growth_rate = 0;
+        pe->mem_low = 0;
+        return 0;
+    }
+
+    elapsed = pe->last_mstime ? mstime - pe->last_mstime : 0;
+    if (elapsed > 0) {
+        double rate = ((double)mem_used - pe->last_mem_used)*1000/elapsed;
+        pe->mem_growth_rate = pe->mem_growth_rate*(1-SWAP_PRE_EVICT_GROWTH_RATE_ALPHA) +
+            rate*SWAP_PRE_EVICT_GROWTH_RATE_ALPHA;
+    }
+    pe->last_mstime = mstime;
+    pe->last_mem_used = mem_used;
+
+    high = server.maxmemory/100*server.swap_evict_watermark_high;
+    low = server.maxmemory/100*server.swap_evict_watermark_low;
+    pe->mem_low = low;
+
+    if (mem_used > low) ctx->stat.above_low_ms += elapsed;
+    if (mem_used > high) ctx->stat.above_high_ms += elapsed;
+
+    if (mem_used > high) pe->evicting = 1;
+    else if (mem_used <= low) pe->evicting = 0;
+    if (!pe->evicting) return 0;
+
+    /* memory grows until next run, which is at least one cron away. */
+    mem_tofree = mem_used - low;
+    if (pe->mem_growth_rate > 0)
+        mem_tofree += (size_t)(pe->mem_growth_rate/1000*
+                MAX(server.swap_pre_evict_period_ms,1000/server.hz));
+    return mem_tofree;
+}
+
+/* Called every swap-pre-evict-period-ms: evicts in background so that
+ * foreground eviction and ratelimit are rarely needed. */
+void swapPreEvictionCron(void) {
+    swapEvictionCtx *ctx = server.swap_eviction_ctx;
+    size_t mem_tofree = swapPreEvictionMemToFree(ctx,
+            swapPreEvictionUsedMemory(),server.mstime);
+    if (mem_tofree) swap_performEvictions(mem_tofree);
+}
+
+/* ----------------------------- subkey hotness ------------------------------ */
+static inline uint64_t swapSubkeyHotnessSlot(robj *key, const char *subkey,
+        size_t len) {
+    uint64_t h = dictGenHashFunction(key->ptr,sdslen(key->ptr));
+    h ^= dictGenHashFunction(subkey,len) + 0x9e3779b97f4a7c15ULL + (h<<6) + (h>>2);
+    return h & (SWAP_SUBKEY_HOTNESS_SLOTS-1);
+}
+
+static inline int swapSubkeyHotnessGet(uint8_t *bits, uint64_t slot) {
+    return (bits[slot>>2] >> ((slot&3)<<1)) & 3;
+}
+
+static inline void swapSubkeyHotnessSet(uint8_t *bits, uint64_t slot, int v) {
+    int shift = (slot&3)<<1;
+    bits[slot>>2] = (bits[slot>>2] & ~(3<<shift)) | (v<<shift);
+}
+
+/* Mark subkey accessed, subkeys kept by eviction and accessed afterwards
+ * would have been swapped in again if evicted. */
+void swapSubkeyHotnessTouch(robj *key, robj *subkey) {
+    swapEvictionCtx *ctx = server.swap_eviction_ctx;
+    char buf[LONG_STR_SIZE];
+    const char *str;
+    size_t len;
+    uint64_t slot;
+    int v;
+
+    if (!server.swap_evict_subkey_hotness || ctx == NULL ||
+            key == NULL || subkey == NULL) return;
+
+    if (sdsEncodedObject(subkey)) {
+        str = subkey->ptr;
+        len = sdslen(subkey->ptr);
+    } else {
+        len = ll2string(buf,sizeof(buf),(long)subkey->ptr);
+        str = buf;
+    }
+
+    if (ctx->hotness.bits == NULL)
+        ctx->hotness.bits = zcalloc(SWAP_SUBKEY_HOTNESS_SLOTS/4);
+
+    slot = swapSubkeyHotnessSlot(key,str,len);
+    v = swapSubkeyHotnessGet(ctx->hotness.bits,slot);
+    if (v & SWAP_SUBKEY_HOTNESS_KEPT) ctx->stat.reswapin_avoided++;
+    swapSubkeyHotnessSet(ctx->hotness.bits,slot,SWAP_SUBKEY_HOTNESS_ACCESSED);
+}
+
+/* Hotness only matters for big objects evicted in steps (persist needs all
+ * dirty subkeys), small ones are evicted as a whole anyway. */
+int swapSubkeyHotnessApplicable(uint32_t cmd_intention_flags, size_t len) {
+    return server.swap_evict_subkey_hotness &&
+        server.swap_eviction_ctx != NULL &&
+        server.swap_eviction_ctx->hotness.bits != NULL &&
+        !(cmd_intention_flags & SWAP_OUT_PERSIST) &&
+        len > (size_t)server.swap_evict_step_max_subkeys;
+}
+
+/* Returns 1 if subkey accessed since last evict step and should be kept
+ * in memory, accessed bit is cleared so that it would be evicted next time
+ * unless accessed again. */
+int swapSubkeyHotnessEvictSkip(robj *key, sds subkey) {
+    swapEvictionCtx *ctx = server.swap_eviction_ctx;
+    uint64_t slot = swapSubkeyHotnessSlot(key,subkey,sdslen(subkey));
+    int v = swapSubkeyHotnessGet(ctx->hotness.bits,slot);
+
+    if (v & SWAP_SUBKEY_HOTNESS_ACCESSED) {
+        swapSubkeyHotnessSet(ctx->hotness.bits,slot,SWAP_SUBKEY_HOTNESS_KEPT);
+        ctx->stat.hot_subkeys_kept++;
+        return 1;
+    } else {
+        if (v) swapSubkeyHotnessSet(ctx->hotness.bits,slot,0);
+        return 0;
+    }
+}
+
+/* ---------------------------- swapin admission ---------------------------- */
+static inline uint8_t swapAdmissionCounterGet(uint8_t *counters, size_t idx) {
+    return (counters[idx>>1] >> ((idx&1)<<2)) & 0xf;
+}
+
+static inline void swapAdmissionCounterIncr(uint8_t *counters, size_t idx) {
+    counters[idx>>1] += 1 << ((idx&1)<<2);
+}
+
+/* Halve all counters (both nibbles of a byte at once) and reset doorkeeper,
+ * so that keys once popular but not accessed recently fade out. */
+static void swapAdmissionFilterAge(swapAdmissionFilter *filter) {
+    for (size_t i = 0; i < SWAP_ADMISSION_DEPTH*SWAP_ADMISSION_WIDTH/2; i++)
+        filter->counters[i] = (filter->counters[i] >> 1) & 0x77;
+    memset(filter->doorkeeper,0,SWAP_ADMISSION_DOORKEEPER_BITS/8);
+    filter->accesses /= 2;
+}
+
+/* Record one access of key, returns estimated access frequency (including
+ * this one) in range [1, SWAP_ADMISSION_MAX_FREQ]. */
+int swapAdmissionFilterAccess(swapAdmissionFilter *filter, sds key) {
+    uint64_t h = dictGenHashFunction(key,sdslen(key));
+    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h>>32) | 1;
+    size_t idx[SWAP_ADMISSION_DEPTH], dk = h1 & (SWAP_ADMISSION_DOORKEEPER_BITS-1);
+    int i, freq = 0xf;
+
+    if (filter->counters == NULL) {
+        filter->counters = zcalloc(SWAP_ADMISSION_DEPTH*SWAP_ADMISSION_WIDTH/2);
+        filter->doorkeeper = zcalloc(SWAP_ADMISSION_DOORKEEPER_BITS/8);
+    }
+
+    for (i = 0; i < SWAP_ADMISSION_DEPTH; i++) {
+        idx[i] = (size_t)i*SWAP_ADMISSION_WIDTH +
+            ((h1 + (uint32_t)i*h2) & (SWAP_ADMISSION_WIDTH-1));
+        uint8_t c = swapAdmissionCounterGet(filter->counters,idx[i]);
+        if (c < freq) freq = c;
+    }
+
+    if (!(filter->doorkeeper[dk>>3] & (1<<(dk&7)))) {
+        /* first access goes to doorkeeper only. */
+        filter->doorkeeper[dk>>3] |= 1<<(dk&7);
+    } else if (freq < 0xf) {
+        /* conservative update: only increase the minimal counters. */
+        for (i = 0; i < SWAP_ADMISSION_DEPTH; i++) {
+            if (swapAdmissionCounterGet(filter->counters,idx[i]) == freq)
+                swapAdmissionCounterIncr(filter->counters,idx[i]);
+        }
+        freq++;
+    }
+
+    if (++filter->accesses >= SWAP_ADMISSION_SAMPLE_SIZE)
+        swapAdmissionFilterAge(filter);
+
+    return freq + 1;
+}
+
+void swapAdmissionFilterDeinit(swapAdmissionFilter *filter) {
+    if (filter->counters) zfree(filter->counters);
+    if (filter->doorkeeper) zfree(filter->doorkeeper);
+    filter->counters = NULL;
+    filter->doorkeeper = NULL;
+    filter->accesses = 0;
+}
+
+/* Decide whether cold key swapped in by key_request should stay in memory.
+ * Only reads are filtered: keys swapped in by writes are dirty and will be
+ * admitted anyway. Admission only makes sense under maxmemory, since
+ * rejected keys are dropped by evict asap. Keys prefetched for pipelined
+ * commands are always admitted (access still counted): dropping them before
+ * the command reads them swaps them in again. */
+int swapAdmissionDecide(client *c, keyRequest *key_request) {
+    if (!server.swap_swapin_admission || !server.maxmemory ||
+            server.swap_eviction_ctx == NULL) return SWAP_ADMISSION_NONE;
+    if (!isSwapHitStatKeyRequest(key_request) || key_request->key == NULL ||
+            !(key_request->cmd_flags & CMD_READONLY) ||
+            (key_request->cmd_intention_flags & SWAP_IN_FORCE_HOT))
+        return SWAP_ADMISSION_NONE;
+
+    int freq = swapAdmissionFilterAccess(&server.swap_eviction_ctx->admission,
+            key_request->key->ptr);
+    if (c && c->db && server.swap_prefetch_clients &&
+            c == server.swap_prefetch_clients[c->db->id])
+        return SWAP_ADMISSION_NONE;
+    return freq >= server.swap_swapin_admission_min_freq ?
+        SWAP_ADMISSION_ADMITTED : SWAP_ADMISSION_REJECTED;
+}
+
+/* Key swapped in could be served as usual, rejected key is dropped right
+ * after command finishes (no io needed since it's clean), unless queued
+ * requests are waiting to access it. */
+void swapAdmissionSwapFinished(redisDb *db, robj *key, int admission,
+        int queued) {
+    if (admission == SWAP_ADMISSION_NONE) return;
+    /* key not exists in rocksdb either. */
+    if (lookupKey(db,key,LOOKUP_NOTOUCH) == NULL) return;
+
+    if (admission == SWAP_ADMISSION_ADMITTED || queued) {
+        atomicIncr(server.swap_hit_stats->stat_swapin_admission_hit_count,1);
+    } else {
+        atomicIncr(server.swap_hit_stats->stat_swapin_admission_miss_count,1);
+        tryEvictKeyAsapLater(db,key);
+    }
+}
+
 /* ----------------------------- evict asap ------------------------------ */
 #define EVICT_ASAP_KEYS_LIMIT 256
 
@@ -514,3 +900,153 @@ sds genSwapRateLimitInfoString(sds info) {
     return info;
 }
 
+
+#ifdef REDIS_TEST
+
+int swapEvictTest(int argc, char **argv, int accurate) {
+    UNUSED(argc), UNUSED(argv), UNUSED(accurate);
+    int error = 0;
+
+    TEST("evict: admission filter estimates frequency") {
+        swapAdmissionFilter filter = {0};
+        sds hot = sdsnew("hot"), cold = sdsnew("cold");
+
+        test_assert(swapAdmissionFilterAccess(&filter,hot) == 1);
+        test_assert(swapAdmissionFilterAccess(&filter,hot) == 2);
+        test_assert(swapAdmissionFilterAccess(&filter,hot) == 3);
+        test_assert(swapAdmissionFilterAccess(&filter,cold) == 1);
+        for (int i = 0; i < 32; i++) swapAdmissionFilterAccess(&filter,hot);
+        test_assert(swapAdmissionFilterAccess(&filter,hot) == SWAP_ADMISSION_MAX_FREQ);
+
+        /* frequency halved and doorkeeper cleared after aging. */
+        filter.accesses = SWAP_ADMISSION_SAMPLE_SIZE-1;
+        swapAdmissionFilterAccess(&filter,cold);
+        test_assert(filter.accesses == SWAP_ADMISSION_SAMPLE_SIZE/2);
+        test_assert(swapAdmissionFilterAccess(&filter,cold) == 1);
+        test_assert(swapAdmissionFilterAccess(&filter,hot) == 8);
+
+        swapAdmissionFilterDeinit(&filter);
+        test_assert(filter.counters == NULL && filter.doorkeeper == NULL);
+        sdsfree(hot), sdsfree(cold);
+    }
+
+    TEST("evict: cost aware score ordering") {
+        int cost_aware = server.swap_evict_cost_aware;
+        int policy = server.maxmemory_policy;
+        int step_subkeys = server.swap_evict_step_max_subkeys;
+        unsigned long long step_memory = server.swap_evict_step_max_memory;
+        char buf[4096];
+        sds key = sdsnew("key");
+        robj *small, *big, *dirty, *step_hash, *big_hash;
+        size_t step_freed, big_freed;
+        int i;
+
+        initTestRedisDb();
+        server.swap_evict_cost_aware = 1;
+        server.maxmemory_policy = MAXMEMORY_ALLKEYS_LRU;
+        server.swap_evict_step_max_subkeys = 1024;
+        server.swap_evict_step_max_memory = 1024*1024;
+
+        memset(buf,'x',sizeof(buf));
+        small = createStringObject(buf,16);
+        big = createStringObject(buf,sizeof(buf));
+        dirty = createStringObject(buf,sizeof(buf));
+        setObjectDirty(dirty);
+
+        /* more idle, more memory freed, no write back scores higher. */
+        test_assert(swapEvictionCostAwareIdle(server.db,key,big,10000) >
+                swapEvictionCostAwareIdle(server.db,key,big,1000));
+        test_assert(swapEvictionCostAwareIdle(server.db,key,big,10000) >
+                swapEvictionCostAwareIdle(server.db,key,small,10000));
+        test_assert(swapEvictionCostAwareIdle(server.db,key,big,10000) >
+                swapEvictionCostAwareIdle(server.db,key,dirty,10000));
+
+        /* big hash frees one step per eviction, not the whole hash. */
+        step_hash = createHashObject(), big_hash = createHashObject();
+        hashTypeConvert(step_hash,OBJ_ENCODING_HT);
+        hashTypeConvert(big_hash,OBJ_ENCODING_HT);
+        for (i = 0; i < 8*1024; i++) {
+            sds field = sdscatprintf(sdsempty(),"field-%06d",i);
+            sds val = sdsnewlen(buf,64);
+            if (i < 1024) hashTypeSet(step_hash,field,val,HASH_SET_COPY);
+            hashTypeSet(big_hash,field,val,HASH_SET_TAKE_VALUE);
+            sdsfree(field);
+        }
+        step_freed = swapEvictionEstimateFreed(NULL,step_hash);
+        big_freed = swapEvictionEstimateFreed(NULL,big_hash);
+        test_assert(step_freed > 1024*64);
+        test_assert(big_freed < step_freed*2);
+        test_assert(big_freed < objectComputeSize(big_hash,5)/4);
+
+        server.swap_evict_step_max_memory = 4096;
+        test_assert(swapEvictionEstimateFreed(NULL,big_hash) <= 4096);
+        /* bound never below actual score, strings not bounded. */
+        test_assert(swapEvictionCostAwareIdleMax(big_hash,10000) >=
+                swapEvictionCostAwareIdle(server.db,key,big_hash,10000));
+        test_assert(swapEvictionCostAwareIdleMax(step_hash,10000) >=
+                swapEvictionCostAwareIdle(server.db,key,step_hash,10000));
+        test_assert(swapEvictionCostAwareIdleMax(big,10000) == ULLONG_MAX);
+        test_assert(swapEvictionEstimateFreed(NULL,big) == objectComputeSize(big,5));
+
+        server.swap_evict_cost_aware = cost_aware;
+        server.maxmemory_policy = policy;
+        server.swap_evict_step_max_subkeys = step_subkeys;
+        server.swap_evict_step_max_memory = step_memory;
+        decrRefCount(small), decrRefCount(big), decrRefCount(dirty);
+        decrRefCount(step_hash), decrRefCount(big_hash);
+        sdsfree(key);
+    }
+
+    TEST("evict: pre-eviction watermarks") {
+        unsigned long long maxmemory = server.maxmemory;
+        int policy = server.maxmemory_policy, hz = server.hz;
+        int period = server.swap_pre_evict_period_ms;
+        int low = server.swap_evict_watermark_low;
+        int high = server.swap_evict_watermark_high;
+        swapEvictionCtx *ctx = swapEvictionCtxCreate();
+        size_t mem_tofree;
+
+        server.maxmemory = 100000;
+        server.maxmemory_policy = MAXMEMORY_ALLKEYS_LRU;
+        server.hz = 10;
+        server.swap_pre_evict_period_ms = 100;
+
+        /* disabled if high watermark not above low watermark. */
+        server.swap_evict_watermark_low = 85;
+        server.swap_evict_watermark_high = 0;
+        test_assert(swapPreEvictionMemToFree(ctx,99000,1000) == 0);
+        server.swap_evict_watermark_high = 85;
+        test_assert(swapPreEvictionMemToFree(ctx,99000,1000) == 0);
+        test_assert(!ctx->pre_evict.evicting && !ctx->pre_evict.last_mstime);
+
+        /* starts above high watermark, stops below low watermark. */
+        server.swap_evict_watermark_high = 95;
+        test_assert(swapPreEvictionMemToFree(ctx,90000,1000) == 0);
+        test_assert(!ctx->pre_evict.evicting);
+        /* memory grown by 6000 in one second, smoothed rate is 1800/s. */
+        mem_tofree = swapPreEvictionMemToFree(ctx,96000,2000);
+        test_assert(mem_tofree >= 11000+179 && mem_tofree <= 11000+180);
+        test_assert(ctx->pre_evict.evicting);
+        test_assert(ctx->stat.above_high_ms == 1000);
+        test_assert(swapPreEvictionMemToFree(ctx,90000,3000) == 5000);
+        test_assert(ctx->pre_evict.evicting);
+        test_assert(swapPreEvictionMemToFree(ctx,85000,4000) == 0);
+        test_assert(!ctx->pre_evict.evicting);
+        test_assert(ctx->stat.above_low_ms == 2000);
+
+        server.maxmemory_policy = MAXMEMORY_NO_EVICTION;
+        test_assert(swapPreEvictionMemToFree(ctx,99000,5000) == 0);
+
+        server.maxmemory = maxmemory;
+        server.maxmemory_policy = policy;
+        server.hz = hz;
+        server.swap_pre_evict_period_ms = period;
+        server.swap_evict_watermark_low = low;
+        server.swap_evict_watermark_high = high;
+        zfree(ctx);
+    }
+
+    return error;
+}
+
+#endif
@@ -41,6 +41,7 @@ swapRequest *swapRequestNew(keyRequest *key_request, int intention,
     req->data = data;
     req->datactx = datactx;
     req->result = NULL;
+    req->merge_in_main = 0;
     req->finish_cb = cb;
     req->finish_pd = pd;
     req->swap_memory = 0;
@@ -288,6 +289,8 @@ void swapRequestMerge(swapRequest *req) {
 
         break;
     case SWAP_IN:
+        if (req->merge_in_main)
+            req->result = swapDataCreateOrMergeObject(data,req->result,datactx);
         retval = swapDataSwapIn(data,req->result,datactx);
         if (retval == 0) {
             if (swapDataIsCold(data) && req->result) {
@@ -615,7 +618,12 @@ void swapExecBatchExecuteIn(swapExecBatch *exec_batch) {
             zfree(tmpcfs);
         }
 
-        req->result = swapDataCreateOrMergeObject(req->data,decoded,req->datactx);
+        /* subkey locked requests of the same key swap concurrently, merging
+         * into the live value is left to main thread. */
+        if (req->merge_in_main)
+            req->result = decoded;
+        else
+            req->result = swapDataCreateOrMergeObject(req->data,decoded,req->datactx);
     }
 
     swapExecBatchExecuteIntentionDel(exec_batch,rios);
@@ -1000,6 +1008,43 @@ int swapExecTest(int argc, char *argv[], int accurate) {
         swapDataFree(in_del_data,wholekey_ctx);
     }
 
+    TEST("exec: subkey locked swap-in merged by main thread") {
+        robj *hkey = createStringObject("hash1",5), *hash, *decoded;
+        sds f1 = sdsnew("f1"), f2 = sdsnew("f2"), v = sdsnew("v");
+        objectMeta *meta;
+        void *hash_ctx;
+
+        /* warm hash: f1 in memory, f2 in rocksdb. */
+        hash = createHashObject();
+        hashTypeSet(hash,f1,v,HASH_SET_COPY);
+        dbAdd(db,hkey,hash);
+        dbAddMeta(db,hkey,createHashObjectMeta(0,1));
+        meta = lookupMeta(db,hkey);
+
+        swapData *data = createSwapData(db,hkey,hash,NULL);
+        swapDataSetupMeta(data,SWAP_TYPE_HASH,-1,&hash_ctx);
+        swapDataSetObjectMeta(data,meta);
+        swapRequest *req = swapRequestNew(NULL,SWAP_IN,0,ctx,data,hash_ctx,NULL,NULL,NULL,NULL);
+        req->merge_in_main = 1;
+
+        /* swap thread leaves decoded f2 as result, value untouched. */
+        decoded = createHashObject();
+        hashTypeSet(decoded,f2,v,HASH_SET_COPY);
+        req->result = decoded;
+        test_assert(hashTypeLength(hash) == 1 && meta->len == 1);
+
+        swapRequestMerge(req);
+        test_assert(swapRequestGetError(req) == 0);
+        test_assert(hashTypeLength(hash) == 2 && hashTypeExists(hash,f2));
+        test_assert(meta->len == 0);
+
+        swapRequestFree(req);
+        swapDataFree(data,hash_ctx);
+        dbDelete(db,hkey);
+        decrRefCount(hkey);
+        sdsfree(f1), sdsfree(f2), sdsfree(v);
+    }
+
     swapCtxSetSwapData(ctx,NULL,NULL);
     swapCtxFree(ctx);
     decrRefCount(key1);
@@ -89,15 +89,23 @@ void coldFilterAddKey(coldFilter *filter, sds key) {
     coldFilterInitCuckooFilter(filter);
 
     if (filter->filter) {
+        int ntables = filter->filter->ntables;
         if (cuckooFilterInsert(filter->filter,key,sdslen(key)) == CUCKOO_ERR) {
             cuckooFilterStat stat;
             cuckooFilterGetStat(filter->filter,&stat);
 
+            /* Only if grown tables exhausted, key can't be filtered anymore. */
             coldFilterDisableCuckooFilters();
 
             serverLog(LL_WARNING,
                     "Insert key(%s) to cuckoo filter(ntables=%ld,ntags=%ld,used_memory=%ld,load_factor=%.2f) failed, cuckoo filter turned off.",
                     key,stat.ntables,stat.ntags,stat.used_memory,stat.load_factor);
+        } else if (filter->filter->ntables > ntables &&
+                filter->filter->ntables > CUCKOO_FILTER_MAX_TABLES) {
+            serverLog(LL_NOTICE,
+                    "Cuckoo filter grown to %d tables, used_memory=%ld.",
+                    filter->filter->ntables,
+                    cuckooFilterUsedMemory(filter->filter));
         }
     }
 
@@ -174,6 +182,19 @@ size_t coldFiltersUsedMemory() {
     return used_memory;
 }
 
+/* Grown cuckoo filters are rebuilt incrementally in cron, lookups are
+ * served as usual meanwhile. */
+#define COLDFILTER_REBUILD_BUCKETS_PER_CRON (64*1024)
+
+void coldFiltersCron() {
+    for (int i = 0; i < server.dbnum; i++) {
+        coldFilter *cold_filter = (server.db+i)->cold_filter;
+        if (cold_filter == NULL || cold_filter->filter == NULL) continue;
+        cuckooFilterRebuildStep(cold_filter->filter,
+                COLDFILTER_REBUILD_BUCKETS_PER_CRON);
+    }
+}
+
 void swapCuckooFilterStatInit(swapCuckooFilterStat *stat) {
     stat->lookup_count = 0;
     stat->false_positive_count = 0;
@@ -234,8 +255,10 @@ sds genSwapCuckooFilterInfoString(sds info) {
         if (db->cold_filter->filter == NULL) continue;
         cuckooFilterGetStat(db->cold_filter->filter,cuckoo_stat);
         info = sdscatprintf(info,
-                "swap_cuckoo_filter%d:used_memory=%ld,tags=%ld,load_factor=%.2f\r\n",
-                i,cuckoo_stat->used_memory,cuckoo_stat->ntags,cuckoo_stat->load_factor);
+                "swap_cuckoo_filter%d:used_memory=%ld,tags=%ld,load_factor=%.2f,tables=%ld,fpr=%.4f%%,rebuilding=%d,rebuild_progress=%.2f%%\r\n",
+                i,cuckoo_stat->used_memory,cuckoo_stat->ntags,cuckoo_stat->load_factor,
+                cuckoo_stat->ntables,cuckoo_stat->fpr*100,cuckoo_stat->rebuilding,
+                cuckoo_stat->rebuild_progress*100);
     }
 
     return info;
@@ -40,9 +40,9 @@ static void createFakeHashForDeleteIfCold(swapData *data) {
 
 /* return 1 if noswap needed */
 static int hashSwapAnaOutSelectSubkeys(swapData *data, hashDataCtx *datactx,
-        int *may_keep_data) {
-    int select_type, noswap;
-    size_t count;
+        uint32_t cmd_intention_flags, int *may_keep_data) {
+    int select_type, noswap, hotness;
+    size_t count, skipped = 0;
     robj *subkeys;
     unsigned long long evict_memory = 0;
 
@@ -80,6 +80,8 @@ static int hashSwapAnaOutSelectSubkeys(swapData *data, hashDataCtx *datactx,
 
     *may_keep_data = 1;
     if (select_type == SELECT_MAIN) {
+        hotness = swapSubkeyHotnessApplicable(cmd_intention_flags,
+                hashTypeLength(subkeys));
         hashTypeIterator *hi = hashTypeInitIterator(subkeys);
         while (hashTypeNext(hi) != C_ERR) {
             robj *subkey;
@@ -103,6 +105,13 @@ static int hashSwapAnaOutSelectSubkeys(swapData *data, hashDataCtx *datactx,
                 subkey = createStringObjectFromLongLong(vll);
                 subkey = unshareStringValue(subkey);
             }
+            /* Keep hot subkeys (no more than a step) in memory. */
+            if (hotness && skipped < count &&
+                    swapSubkeyHotnessEvictSkip(data->key,subkey->ptr)) {
+                decrRefCount(subkey);
+                skipped++;
+                continue;
+            }
             datactx->ctx.sub.subkeys[datactx->ctx.sub.num++] = subkey;
 
             hashTypeCurrentObject(hi,OBJ_HASH_VALUE,&vstr,&vlen,&vll);
@@ -112,6 +121,7 @@ static int hashSwapAnaOutSelectSubkeys(swapData *data, hashDataCtx *datactx,
                 evict_memory += sizeof(vll);
         }
         hashTypeReleaseIterator(hi);
+        if (skipped && !noswap) *may_keep_data = 0;
     } else {
         robj *subkey;
         size_t sublen;
@@ -255,7 +265,8 @@ int hashSwapAna(swapData *data, int thd, struct keyRequest *req,
             /* may_keep_data is true if we could keep data in memory and clear dirty
              * after persisting data to rocksdb. */
             int may_keep_data;
-            int noswap = hashSwapAnaOutSelectSubkeys(data,datactx,&may_keep_data);
+            int noswap = hashSwapAnaOutSelectSubkeys(data,datactx,
+                    cmd_intention_flags,&may_keep_data);
             int keep_data = swapDataPersistKeepData(data,cmd_intention_flags,may_keep_data);
 
             /* create new meta if needed */
@@ -348,7 +359,7 @@ int hashEncodeKeys(swapData *data, int intention, void *datactx_,
 }
 
 static inline sds hashEncodeSubval(robj *subval) {
-    return rocksEncodeValRdb(subval);
+    return rocksEncodeVal(subval);
 }
 
 int hashEncodeRange(struct swapData *data, int intention, void *datactx_, int *limit,
@@ -432,7 +443,7 @@ int hashDecodeData(swapData *data, int num, int *cfs, sds *rawkeys,
             continue;
         subkey = sdsnewlen(subkeystr,slen);
 
-        subvalobj = rocksDecodeValRdb(rawvals[i]);
+        subvalobj = rocksDecodeVal(rawvals[i]);
         serverAssert(subvalobj->type == OBJ_STRING);
         /* subvalobj might be shared integer, unshared it before
          * add to decoded. */
@@ -1035,6 +1046,42 @@ int swapDataHashTest(int argc, char **argv, int accurate) {
         test_assert(cold1_ctx->ctx.sub.num == SWAP_EVICT_STEP && cold1_ctx->ctx.sub.subkeys != NULL);
     }
 
+    TEST("hash - swapAna evict cold subkeys first") {
+        int hotness = server.swap_evict_subkey_hotness;
+        long long avoided;
+        robj *hot = createStringObject(f1,sdslen(f1));
+
+        if (server.swap_eviction_ctx == NULL)
+            server.swap_eviction_ctx = swapEvictionCtxCreate();
+        server.swap_evict_subkey_hotness = 1;
+        swapSubkeyHotnessTouch(key1,hot);
+
+        kr1->cmd_intention = SWAP_OUT, kr1->cmd_intention_flags = 0;
+        zfree(hash1_ctx->ctx.sub.subkeys), hash1_ctx->ctx.sub.num = 0;
+        swapDataAna(hash1_data,0,kr1,&intention,&intention_flags,hash1_ctx);
+        test_assert(intention == SWAP_OUT && intention_flags == 0);
+        test_assert(hash1_ctx->ctx.sub.num == SWAP_EVICT_STEP);
+        for (int i = 0; i < hash1_ctx->ctx.sub.num; i++) {
+            test_assert(sdscmp(hash1_ctx->ctx.sub.subkeys[i]->ptr,f1));
+            decrRefCount(hash1_ctx->ctx.sub.subkeys[i]);
+        }
+
+        /* kept subkey accessed again: swap in avoided. */
+        avoided = server.swap_eviction_ctx->stat.reswapin_avoided;
+        swapSubkeyHotnessTouch(key1,hot);
+        test_assert(server.swap_eviction_ctx->stat.reswapin_avoided == avoided+1);
+
+        /* second chance used up: evicted unless accessed again. */
+        swapSubkeyHotnessEvictSkip(key1,f1);
+        zfree(hash1_ctx->ctx.sub.subkeys), hash1_ctx->ctx.sub.num = 0;
+        swapDataAna(hash1_data,0,kr1,&intention,&intention_flags,hash1_ctx);
+        test_assert(hash1_ctx->ctx.sub.num == SWAP_EVICT_STEP);
+        test_assert(!sdscmp(hash1_ctx->ctx.sub.subkeys[0]->ptr,f1));
+
+        decrRefCount(hot);
+        server.swap_evict_subkey_hotness = hotness;
+    }
+
     TEST("hash - encodeData/DecodeData") {
         void *decoded;
         size_t old = server.swap_evict_step_max_subkeys;
@@ -119,6 +119,22 @@ static inline int rocksdbIterValid(rocksdb_iterator_t *iter, sds endkey) {
     return memcmp(endkey,rawkey,len) > 0;
 }
 
+/* Keys are moved atomically by key format migration, so each key is either
+ * in configured db range or in source db range of the same snapshot. */
+static void rocksIterSwitchToSourceRange(rocksIter *it) {
+    rocksdb_iter_seek(it->data_iter,it->source_startkey,
+            sdslen(it->source_startkey));
+    rocksdb_iter_seek(it->meta_iter,it->source_startkey,
+            sdslen(it->source_startkey));
+    sdsfree(it->data_endkey);
+    sdsfree(it->meta_endkey);
+    it->data_endkey = sdsdup(it->source_endkey);
+    it->meta_endkey = it->source_endkey;
+    sdsfree(it->source_startkey);
+    it->source_startkey = NULL;
+    it->source_endkey = NULL;
+}
+
 void *rocksIterIOThreadMain(void *arg) {
     rocksIter *it = arg;
     size_t meta_itered = 0, data_itered = 0, accumulated_memory = 0;
@@ -142,6 +158,11 @@ void *rocksIterIOThreadMain(void *arg) {
 
             meta_valid = rocksdbIterValid(it->meta_iter,it->meta_endkey);
             data_valid = rocksdbIterValid(it->data_iter,it->data_endkey);
+            if (!meta_valid && !data_valid && it->source_startkey) {
+                rocksIterSwitchToSourceRange(it);
+                meta_valid = rocksdbIterValid(it->meta_iter,it->meta_endkey);
+                data_valid = rocksdbIterValid(it->data_iter,it->data_endkey);
+            }
             if (!meta_valid && !data_valid) {
                 rocksIterNotifyFinshed(it);
                 if (meta_itered || data_itered) {
@@ -320,6 +341,19 @@ rocksIter *rocksCreateIter(rocks *rocks, redisDb *db) {
                 it->cf_handles[DATA_CF]);
         meta_iter = rocksdb_create_iterator_cf(it->checkpoint_db, rocks->iter_ropts,
                 it->cf_handles[META_CF]);
+    } else if (rocksKeyFormatMigrating(rocks)) {
+        /* keys are moving between formats, meta & data iterators must
+         * share the same snapshot. */
+        it->snapshot = rocksdb_create_snapshot(rocks->db);
+        it->ropts = rocksdb_readoptions_create();
+        rocksdb_readoptions_set_verify_checksums(it->ropts, 0);
+        rocksdb_readoptions_set_fill_cache(it->ropts, 1);
+        rocksdb_readoptions_set_total_order_seek(it->ropts, 1);
+        rocksdb_readoptions_set_snapshot(it->ropts, it->snapshot);
+        data_iter = rocksdb_create_iterator_cf(rocks->db, it->ropts,
+                rocks->cf_handles[DATA_CF]);
+        meta_iter = rocksdb_create_iterator_cf(rocks->db, it->ropts,
+                rocks->cf_handles[META_CF]);
     } else {
         data_iter = rocksdb_create_iterator_cf(rocks->db, rocks->iter_ropts,
                 rocks->cf_handles[DATA_CF]);
@@ -344,6 +378,13 @@ rocksIter *rocksCreateIter(rocks *rocks, redisDb *db) {
     it->data_endkey = rocksEncodeDbRangeEndKey(db->id);
     it->meta_endkey = rocksEncodeDbRangeEndKey(db->id);
 
+    /* Checkpoint might be created before migration finished. */
+    if (rocksKeyFormatMigrationStatus(rocks) != ROCKS_KEY_FORMAT_MIGRATION_NONE) {
+        int source = rocks->key_format_migration.source;
+        it->source_startkey = rocksEncodeDbRangeStartKeyWithFormat(source,db->id);
+        it->source_endkey = rocksEncodeDbRangeEndKeyWithFormat(source,db->id);
+    }
+
     it->buffered_cq = bufferedIterCompleteQueueNew(ITER_BUFFER_CAPACITY_DEFAULT);
 
     if ((error = pthread_create(&it->io_thread, NULL, rocksIterIOThreadMain, it))) {
@@ -449,6 +490,26 @@ void rocksReleaseIter(rocksIter *it) {
         it->meta_endkey = NULL;
     }
 
+    if (it->source_startkey) {
+        sdsfree(it->source_startkey);
+        it->source_startkey = NULL;
+    }
+
+    if (it->source_endkey) {
+        sdsfree(it->source_endkey);
+        it->source_endkey = NULL;
+    }
+
+    if (it->ropts) {
+        rocksdb_readoptions_destroy(it->ropts);
+        it->ropts = NULL;
+    }
+
+    if (it->snapshot) {
+        rocksdb_release_snapshot(it->rocks->db,it->snapshot);
+        it->snapshot = NULL;
+    }
+
     if (it->checkpoint_db != NULL) {
         rocksdb_close(it->checkpoint_db);
         it->checkpoint_db = NULL;
@@ -474,6 +535,10 @@ int rocksDecodeDataCF(sds rawkey, unsigned char rdbtype, sds rdbraw,
             &version,&subkey,&subkeylen);
     if (retval) return retval;
 
+    /* rdb save writes rdbraw as is, native value must be rdb encoded. */
+    retval = rocksValNativeToRdb(&rdbtype,&rdbraw);
+    if (retval) return retval;
+
     decoded->cf = DATA_CF;
     decoded->dbid = dbid;
     decoded->key = sdsnewlen(key,keylen);
@@ -657,6 +722,16 @@ void validateRocksIterForDb(redisDb *db) {
     sdsfree(ha), sdsfree(h), sdsfree(field_a);
 }
 
+static int rocksRawKeyExists(int cf, const char *rawkey, size_t rawlen) {
+    char *err = NULL, *val;
+    size_t vallen;
+    val = rocksdb_get_cf(server.rocks->db,server.rocks->ropts,
+            server.rocks->cf_handles[cf],rawkey,rawlen,&vallen,&err);
+    serverAssert(err == NULL);
+    if (val) zlibc_free(val);
+    return val != NULL;
+}
+
 int swapIterTest(int argc, char *argv[], int accurate) {
     UNUSED(argc), UNUSED(argv), UNUSED(accurate);
 
@@ -685,6 +760,50 @@ int swapIterTest(int argc, char *argv[], int accurate) {
         validateRocksIterForDb(db1);
     }
 
+    TEST("iter: key format migration") {
+        sds mk = sdsnew("mk"), field_a = sdsnew("a"), metakey, datakey;
+        robj *val = createStringObject("val", 4);
+        const char badkey[] = "\x00\x01";
+        char *err = NULL;
+        int status;
+
+        doRocksdbFlush();
+        server.swap_key_format = SWAP_KEY_FORMAT_V1;
+        PUT_META(db,OBJ_HASH,mk,-1);
+        PUT_DATA(db,mk,field_a,val);
+        /* undecodable source key must be left in place. */
+        rocksdb_put_cf(server.rocks->db,server.rocks->wopts,
+                server.rocks->cf_handles[DATA_CF],badkey,sizeof(badkey)-1,
+                "x",1,&err);
+        serverAssert(err == NULL);
+
+        server.swap_key_format = SWAP_KEY_FORMAT_V2;
+        rocksKeyFormatMigrationStop(server.rocks);
+        test_assert(!rocksKeyFormatMigrationStart(server.rocks));
+        while ((status = rocksKeyFormatMigrationStatus(server.rocks)) ==
+                ROCKS_KEY_FORMAT_MIGRATION_RUNNING) usleep(1000);
+        test_assert(status == ROCKS_KEY_FORMAT_MIGRATION_DONE);
+        test_assert(server.rocks->key_format_migration.keys >= 1);
+        test_assert(server.rocks->key_format_migration.failed == 1);
+
+        metakey = rocksEncodeMetaKey(db,mk);
+        datakey = rocksEncodeDataKey(db,mk,0,field_a);
+        test_assert(rocksRawKeyExists(META_CF,metakey,sdslen(metakey)));
+        test_assert(rocksRawKeyExists(DATA_CF,datakey,sdslen(datakey)));
+        test_assert(rocksRawKeyExists(DATA_CF,badkey,sizeof(badkey)-1));
+        sdsfree(metakey), sdsfree(datakey);
+
+        server.swap_key_format = SWAP_KEY_FORMAT_V1;
+        metakey = rocksEncodeMetaKey(db,mk);
+        test_assert(!rocksRawKeyExists(META_CF,metakey,sdslen(metakey)));
+        sdsfree(metakey);
+
+        rocksKeyFormatMigrationStop(server.rocks);
+        doRocksdbFlush();
+        sdsfree(mk), sdsfree(field_a);
+        decrRefCount(val);
+    }
+
     return error;
 }
 
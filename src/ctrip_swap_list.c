@@ -1579,7 +1579,7 @@ int listEncodeKeys(swapData *data, int intention, void *datactx_,
 }
 
 static inline sds listEncodeSubval(robj *subval) {
-    return rocksEncodeValRdb(subval);
+    return rocksEncodeVal(subval);
 }
 
 typedef struct encodeElementPd {
@@ -1680,7 +1680,7 @@ int listDecodeData(swapData *data, int num, int *cfs, sds *rawkeys,
             continue;
         ridx = listDecodeRidx(subkeystr,slen);
 
-        subvalobj = rocksDecodeValRdb(rawvals[i]);
+        subvalobj = rocksDecodeVal(rawvals[i]);
         serverAssert(subvalobj->type == OBJ_STRING);
         /* subvalobj might be shared integer, unshared it before
          * add to decoded. */
@@ -97,6 +97,165 @@ void swapLoadCommand(client *c) {
     addReplyLongLong(c, nload);
 }
 
+/* Lookahead prefetch: while a pipelining client waits for current command to
+ * swap in, commands already buffered in querybuf are parsed ahead and swap
+ * in of their cold keys are submitted by prefetch client, so that they get
+ * batched together rather than taking one rio round trip each. Prefetch only
+ * swaps in (just like swap.load), command execution order is kept by key
+ * locks so semantics does not change. */
+void prefetchClientKeyRequestFinished(client *c, swapCtx *ctx) {
+    robj *key = ctx->key_request->key;
+    if (ctx->errcode) {
+        serverLog(LL_VERBOSE, "swap.prefetch fail,code=%d,key=%s", ctx->errcode, (char*)key->ptr);
+    }
+    incrRefCount(key);
+    c->keyrequests_count--;
+    clientReleaseLocks(c,ctx);
+    decrRefCount(key);
+
+    server.swap_prefetch_inprogress_count--;
+}
+
+/* Parse a multibulk command at buf[*pos,len) without touching client state.
+ * Returns 1 with argv/argc filled and *pos advanced if a complete command
+ * parsed (argc might be 0 for empty multibulk), otherwise returns 0 (inline,
+ * incomplete or malformed command). */
+static int swapPrefetchParseCommand(const char *buf, size_t len, size_t *pos,
+        robj ***pargv, int *pargc) {
+    size_t p = *pos;
+    const char *newline;
+    long long ll, multibulklen;
+    robj **argv;
+    int argc = 0;
+
+    if (p >= len || buf[p] != '*') return 0;
+    newline = memchr(buf+p,'\r',len-p);
+    if (newline == NULL || (size_t)(newline-buf)+1 >= len) return 0;
+    if (!string2ll(buf+p+1,newline-(buf+p+1),&multibulklen)) return 0;
+    p = newline-buf+2;
+    /* each bulk takes at least 6 bytes: "$0\r\n\r\n". */
+    if (multibulklen > (long long)(len-p)/6) return 0;
+
+    if (multibulklen <= 0) {
+        *pos = p;
+        *pargv = NULL;
+        *pargc = 0;
+        return 1;
+    }
+
+    argv = zmalloc(sizeof(robj*)*multibulklen);
+    while (argc < multibulklen) {
+        if (p >= len || buf[p] != '$') goto incomplete;
+        newline = memchr(buf+p,'\r',len-p);
+        if (newline == NULL || (size_t)(newline-buf)+1 >= len) goto incomplete;
+        if (!string2ll(buf+p+1,newline-(buf+p+1),&ll) || ll < 0 ||
+                ll > server.proto_max_bulk_len) goto incomplete;
+        p = newline-buf+2;
+        if ((long long)(len-p) < ll+2) goto incomplete;
+        argv[argc++] = createStringObject(buf+p,ll);
+        p += ll+2;
+    }
+
+    *pos = p;
+    *pargv = argv;
+    *pargc = argc;
+    return 1;
+
+incomplete:
+    while (argc) decrRefCount(argv[--argc]);
+    zfree(argv);
+    return 0;
+}
+
+static inline int isPrefetchableKeyRequest(keyRequest *kr) {
+    return kr->level == REQUEST_LEVEL_KEY && kr->key != NULL &&
+        kr->cmd_intention == SWAP_IN &&
+        (kr->cmd_intention_flags & ~SWAP_IN_META) == 0 &&
+        (kr->type == KEYREQUEST_TYPE_KEY || kr->type == KEYREQUEST_TYPE_SUBKEY);
+}
+
+/* Returns 0 if lookahead should stop at this command. */
+static int swapPrefetchCommand(client *c, robj **argv, int argc) {
+    int i, num = 0;
+    struct redisCommand *cmd;
+    getKeyRequestsResult result = GET_KEYREQUESTS_RESULT_INIT;
+    client *prefetch_client = server.swap_prefetch_clients[c->db->id];
+
+    if (argc == 0) return 1;
+
+    cmd = lookupCommand(argv[0]->ptr);
+    if (cmd == NULL || (cmd->arity > 0 && cmd->arity != argc) ||
+            argc < -cmd->arity) return 0;
+    /* commands after a write (or select, multi...) might see different
+     * keyspace, stop lookahead there. */
+    if (!(cmd->flags & CMD_READONLY) || (cmd->flags & CMD_MODULE) ||
+            cmd->intention != SWAP_IN) return 0;
+
+    getCmdKeyRequests(c->db->id,cmd,argv,argc,&result);
+    for (i = 0; i < result.num; i++) {
+        keyRequest *kr = result.key_requests+i;
+        redisDb *db = server.db+kr->dbid;
+
+        if (isPrefetchableKeyRequest(kr) && !keyIsPureHot(
+                    lookupMeta(db,kr->key),lookupKey(db,kr->key,LOOKUP_NOTOUCH))) {
+            if (i != num) moveKeyRequest(result.key_requests+num,kr);
+            num++;
+        } else {
+            keyRequestDeinit(kr);
+        }
+    }
+    result.num = num;
+
+    if (num) {
+        prefetch_client->keyrequests_count += num;
+        server.swap_prefetch_inprogress_count += num;
+        submitClientKeyRequests(prefetch_client,&result,
+                prefetchClientKeyRequestFinished,NULL);
+        server.stat_swap_prefetch_cmds++;
+        server.stat_swap_prefetch_keys += num;
+    }
+
+    releaseKeyRequests(&result);
+    getKeyRequestsFreeResult(&result);
+    return 1;
+}
+
+void swapPrefetchClientQueryBuffer(client *c) {
+    size_t pos, len;
+    int i, argc, ncmds = 0, stop = 0;
+    robj **argv;
+
+    if (server.swap_prefetch_lookahead <= 0 ||
+            server.swap_prefetch_clients == NULL) return;
+    if (c->conn == NULL || c->multibulklen || c->flags & (CLIENT_MASTER|
+                CLIENT_SLAVE|CLIENT_MONITOR|CLIENT_MULTI|CLIENT_PENDING_READ|
+                CLIENT_CLOSE_AFTER_REPLY|CLIENT_CLOSE_ASAP)) return;
+    if (c->swap_prefetch_ahead >= server.swap_prefetch_lookahead) return;
+    /* prefetch is best effort, don't make memory pressure worse. */
+    if (server.maxmemory && swap_getUsedMemory() > server.maxmemory) return;
+    /* skip clients that may not be allowed to touch the keys prefetched. */
+    if (authRequired(c) || (c->user && (!(c->user->flags & USER_FLAG_ALLKEYS) ||
+                    !(c->user->flags & USER_FLAG_ALLCOMMANDS)))) return;
+
+    pos = c->qb_pos;
+    len = sdslen(c->querybuf);
+    if (len - pos > (size_t)server.swap_prefetch_lookahead_bytes)
+        len = pos + server.swap_prefetch_lookahead_bytes;
+
+    while (!stop && ncmds < server.swap_prefetch_lookahead) {
+        if (!swapPrefetchParseCommand(c->querybuf,len,&pos,&argv,&argc)) break;
+        /* commands already looked ahead are skipped. */
+        if (++ncmds > c->swap_prefetch_ahead) {
+            if (swapPrefetchCommand(c,argv,argc))
+                c->swap_prefetch_ahead = ncmds;
+            else
+                stop = 1;
+        }
+        for (i = 0; i < argc; i++) decrRefCount(argv[i]);
+        zfree(argv);
+    }
+}
+
 void openSwapChildErrPipe(void) {
     if (pipe(server.swap_child_err_pipe) == -1) {
         /* On error our two file descriptors should be still set to -1,
@@ -223,3 +382,49 @@ void receiveSwapChildErrs(void) {
         if (reachedSwapLoadInprogressLimit(mem_tofree)) break;
     }
 }
+
+#ifdef REDIS_TEST
+
+int swapLoadTest(int argc, char *argv[], int accurate) {
+    UNUSED(argc), UNUSED(argv), UNUSED(accurate);
+    int error = 0;
+
+    initServerConfig4Test();
+
+    TEST("load: prefetch parse pipelined commands") {
+        const char *buf = "*2\r\n$3\r\nGET\r\n$2\r\nk1\r\n*0\r\n*3\r\n$4\r\nHGET\r\n$1\r\nh\r\n$1\r\nf\r\n*2\r\n$3\r\nGET";
+        size_t len = strlen(buf), pos = 0;
+        robj **cargv;
+        int cargc, i;
+
+        test_assert(swapPrefetchParseCommand(buf,len,&pos,&cargv,&cargc));
+        test_assert(cargc == 2);
+        test_assert(!strcmp(cargv[0]->ptr,"GET") && !strcmp(cargv[1]->ptr,"k1"));
+        for (i = 0; i < cargc; i++) decrRefCount(cargv[i]);
+        zfree(cargv);
+
+        test_assert(swapPrefetchParseCommand(buf,len,&pos,&cargv,&cargc));
+        test_assert(cargc == 0 && cargv == NULL);
+
+        test_assert(swapPrefetchParseCommand(buf,len,&pos,&cargv,&cargc));
+        test_assert(cargc == 3 && !strcmp(cargv[2]->ptr,"f"));
+        for (i = 0; i < cargc; i++) decrRefCount(cargv[i]);
+        zfree(cargv);
+
+        /* incomplete command keeps pos untouched. */
+        size_t prev_pos = pos;
+        test_assert(!swapPrefetchParseCommand(buf,len,&pos,&cargv,&cargc));
+        test_assert(pos == prev_pos);
+
+        /* inline & malformed commands are not parsed. */
+        pos = 0;
+        test_assert(!swapPrefetchParseCommand("GET k1\r\n",8,&pos,&cargv,&cargc));
+        test_assert(!swapPrefetchParseCommand("*1\r\n$x\r\nGET\r\n",13,&pos,&cargv,&cargc));
+        test_assert(!swapPrefetchParseCommand("*100000\r\n$3\r\n",13,&pos,&cargv,&cargc));
+        test_assert(pos == 0);
+    }
+
+    return error;
+}
+
+#endif
@@ -29,6 +29,10 @@
 #include "ctrip_swap.h"
 
 #define LOCK_LINKS_LINER_SIZE 4096
+/* links arrays up to this size are pooled, most locks have few links. */
+#define LOCK_LINKS_POOLED_SIZE 8
+
+#define LOCK_TABLE_MIN_SIZE 8
 
 #define LINK_SIGNAL_PROCEEDED 0
 #define LINK_SIGNAL_UNLOCK 1
@@ -77,9 +81,11 @@ static inline void lock_free(void *ptr) {
 
 #define BUFFERED_ALLOCATOR_CAPACITY_LOCK 4096
 #define BUFFERED_ALLOCATOR_CAPACITY_KEYLOCKS 4096
+#define BUFFERED_ALLOCATOR_CAPACITY_LINKS 1024
 
 struct bufferedAllocator *buffered_allocator_lock;
 struct bufferedAllocator *buffered_allocator_keylocks;
+struct bufferedAllocator *buffered_allocator_links;
 
 
 static void lockLinksInit(lockLinks *links) {
@@ -89,34 +95,50 @@ static void lockLinksInit(lockLinks *links) {
     links->count = 0;
     links->proceeded = 0;
     links->unlocked = 0;
+    links->unshared = 0;
     links->reserved = 0;
 }
 
 static void lockLinksDeinit(lockLinks *links) {
-    if (links->links && links->links != links->buf)
-        lock_free(links->links);
+    if (links->links && links->links != links->buf) {
+        if (links->capacity == LOCK_LINKS_POOLED_SIZE)
+            bufferedAllocatorFree(buffered_allocator_links,links->links);
+        else
+            lock_free(links->links);
+    }
     lockLinksInit(links);
 }
 
 static void lockLinksMakeRoomFor(lockLinks *links, int count) {
-    if (count <= links->capacity) return;
+    int capacity = links->capacity;
+    lockLink **newlinks;
+
+    if (count <= capacity) return;
 
-    while (links->capacity < count &&
-            links->capacity < LOCK_LINKS_LINER_SIZE) {
-        links->capacity *= 2;
+    while (capacity < count && capacity < LOCK_LINKS_LINER_SIZE) {
+        capacity *= 2;
     }
-    while (links->capacity < count &&
-            links->capacity >= LOCK_LINKS_LINER_SIZE) {
-        links->capacity += LOCK_LINKS_LINER_SIZE;
+    while (capacity < count && capacity >= LOCK_LINKS_LINER_SIZE) {
+        capacity += LOCK_LINKS_LINER_SIZE;
     }
-    serverAssert(links->capacity >= count);
+    serverAssert(capacity >= count);
+    if (capacity < LOCK_LINKS_POOLED_SIZE) capacity = LOCK_LINKS_POOLED_SIZE;
 
     if (links->links == links->buf) {
-        links->links = lock_malloc(sizeof(lock*)*links->capacity);
-        memcpy(links->links,links->buf,sizeof(lock*)*LOCK_LINKS_BUF_SIZE);
+        if (capacity == LOCK_LINKS_POOLED_SIZE)
+            newlinks = bufferedAllocatorAlloc(buffered_allocator_links);
+        else
+            newlinks = lock_malloc(sizeof(lock*)*capacity);
+        memcpy(newlinks,links->buf,sizeof(lock*)*LOCK_LINKS_BUF_SIZE);
+    } else if (links->capacity == LOCK_LINKS_POOLED_SIZE) {
+        newlinks = lock_malloc(sizeof(lock*)*capacity);
+        memcpy(newlinks,links->links,sizeof(lock*)*links->count);
+        bufferedAllocatorFree(buffered_allocator_links,links->links);
     } else {
-        links->links = lock_realloc(links->links,sizeof(lock*)*links->capacity);
+        newlinks = lock_realloc(links->links,sizeof(lock*)*capacity);
     }
+    links->links = newlinks;
+    links->capacity = capacity;
 }
 
 static inline void lockLinksPush(lockLinks *links, void *target) {
@@ -124,6 +146,14 @@ static inline void lockLinksPush(lockLinks *links, void *target) {
     links->links[links->count++] = target;
 }
 
+static void lockLinksCompact(lockLinks *links) {
+    int j = 0;
+    for (int i = 0; i < links->count; i++) {
+        if (links->links[i]) links->links[j++] = links->links[i];
+    }
+    links->count = j;
+}
+
 static inline void lockLinkTargetInit(lockLinkTarget *target) {
     target->linked = 0;
     target->signaled = 0;
@@ -144,21 +174,32 @@ static inline int lockLinkTargetReady(lockLinkTarget *target) {
     return target->signaled == target->linked;
 }
 
-void lockLinkInit(lockLink *link, int64_t txid) {
+void lockLinkInit(lockLink *link, int64_t txid, int mode) {
     link->txid = txid;
+    link->mode = mode;
     lockLinksInit(&link->links);
     lockLinkTargetInit(&link->target);
 }
 
 void lockLinkDeinit(lockLink *link) {
     link->txid = 0;
+    link->mode = LOCK_MODE_WRITE;
     lockLinksDeinit(&link->links);
     lockLinkTargetInit(&link->target);
 }
 
+/* reader linked right after reader is signaled once 'from' proceeded (swap
+ * io finished and key merged), instead of unlocked (command called), unless
+ * 'from' is unshared. */
+static inline int lockLinkShared(lockLink *from, lockLink *to) {
+    return from->mode == LOCK_MODE_READ && !from->links.unshared &&
+        to->mode == LOCK_MODE_READ;
+}
+
 void lockLinkLink(lockLink *from, lockLink *to, int *test_would_block) {
     serverAssert(from->txid <= to->txid);
-    int wont_block = (from->links.proceeded && from->txid == to->txid) ||
+    int wont_block = (from->links.proceeded &&
+            (from->txid == to->txid || lockLinkShared(from,to))) ||
             from->links.unlocked;
 
     if (test_would_block) {
@@ -168,6 +209,9 @@ void lockLinkLink(lockLink *from, lockLink *to, int *test_would_block) {
        return;
     }
 
+    /* shared link is already signaled, no need to keep it. */
+    if (from->links.proceeded && lockLinkShared(from,to)) return;
+
     lockLinksPush(&from->links,to);
     lockLinkTargetLinked(&to->target);
     if (wont_block) {
@@ -186,10 +230,19 @@ static void lockLinkSignal(lockLink *link, int type, linkProceed cb,
         link->links.unlocked = 1;
     }
 
+    int dropped = 0;
     for (int i = 0; i < link->links.count; i++) {
         lockLink *to = link->links.links[i];
+        if (to == NULL) continue;
         serverAssert(link->txid <= to->txid);
-        if ((type == LINK_SIGNAL_PROCEEDED && link->txid == to->txid) ||
+        int shared = lockLinkShared(link,to);
+        if (type == LINK_SIGNAL_PROCEEDED && shared) {
+            /* shared reader might unlock before current one, drop the link
+             * once signaled so that it's never touched again. */
+            link->links.links[i] = NULL;
+            dropped++;
+        }
+        if ((type == LINK_SIGNAL_PROCEEDED && (link->txid == to->txid || shared)) ||
                 (type == LINK_SIGNAL_UNLOCK && link->txid < to->txid)) {
             lockLinkTargetSignaled(&to->target);
             if (lockLinkTargetReady(&to->target)) {
@@ -197,6 +250,7 @@ static void lockLinkSignal(lockLink *link, int type, linkProceed cb,
             }
         }
     }
+    if (dropped) lockLinksCompact(&link->links);
 }
 
 void lockLinkProceeded(lockLink *link, linkProceed cb, void *pd) {
@@ -208,39 +262,115 @@ void lockLinkUnlock(lockLink *link, linkProceed cb, void *pd) {
 }
 
 uint64_t dictObjHash(const void *key);
-int dictObjKeyCompare(void *privdata, const void *key1, const void *key2);
-void dictObjectDestructor(void *privdata, void *val);
-
-dictType keyLevelLockDictType = {
-    dictObjHash,                    /* hash function */
-    NULL,                           /* key dup */
-    NULL,                           /* val dup */
-    dictObjKeyCompare,              /* key compare */
-    NULL,                           /* key destructor */
-    NULL,                           /* val destructor */
-    NULL                            /* allow to expand */
-};
-
-void keylocksNewAux(void *_locks) {
-    locks *locks = _locks;
-    locks->lock_list = listCreate();
-}
-
-void keylocksFreeAux(void *_locks) {
-    locks *locks = _locks;
-    serverAssert(locks->level == REQUEST_LEVEL_KEY);
-    serverAssert(listLength(locks->lock_list) == 0);
-    listRelease(locks->lock_list);
-    locks->lock_list = NULL;
+
+static inline uint64_t lockTableHash(robj *key) {
+    return dictObjHash(key);
+}
+
+/* key & subkey level locks share the same layout of key and hash. */
+static inline robj *locksTableKey(locks *locks) {
+    return locks->level == REQUEST_LEVEL_KEY ?
+        locks->key.key : locks->subkey.subkey;
+}
+
+static inline uint64_t locksTableHash(locks *locks) {
+    return locks->level == REQUEST_LEVEL_KEY ?
+        locks->key.hash : locks->subkey.hash;
+}
+
+static inline int locksTableKeyMatch(locks *locks, robj *key, uint64_t hash) {
+    robj *k;
+    if (locksTableHash(locks) != hash) return 0;
+    k = locksTableKey(locks);
+    return sdslen(k->ptr) == sdslen(key->ptr) &&
+        memcmp(k->ptr,key->ptr,sdslen(key->ptr)) == 0;
+}
+
+static inline void lockTableInit(lockTable *table) {
+    table->slots = NULL;
+    table->size = 0;
+    table->used = 0;
+}
+
+static inline void lockTableDeinit(lockTable *table) {
+    serverAssert(table->used == 0);
+    if (table->slots) lock_free(table->slots);
+    lockTableInit(table);
+}
+
+static locks *lockTableFind(lockTable *table, robj *key, uint64_t hash) {
+    size_t mask, i;
+    if (table->used == 0) return NULL;
+    mask = table->size-1;
+    for (i = hash & mask; table->slots[i] != NULL; i = (i+1) & mask) {
+        if (locksTableKeyMatch(table->slots[i],key,hash))
+            return table->slots[i];
+    }
+    return NULL;
+}
+
+static inline void lockTableInsert(lockTable *table, locks *locks) {
+    size_t mask = table->size-1, i = locksTableHash(locks) & mask;
+    while (table->slots[i] != NULL) i = (i+1) & mask;
+    table->slots[i] = locks;
+}
+
+static void lockTableResize(lockTable *table, size_t size) {
+    locks **slots = table->slots;
+    size_t oldsize = table->size;
+
+    table->slots = lock_malloc(sizeof(locks*)*size);
+    memset(table->slots,0,sizeof(locks*)*size);
+    table->size = size;
+    for (size_t i = 0; i < oldsize; i++) {
+        if (slots[i]) lockTableInsert(table,slots[i]);
+    }
+    if (slots) lock_free(slots);
+}
+
+static void lockTableAdd(lockTable *table, locks *locks) {
+    /* keep load factor under 1/2 so that probe sequences stay short. */
+    if ((table->used+1)*2 > table->size) {
+        lockTableResize(table,table->size ? table->size*2 : LOCK_TABLE_MIN_SIZE);
+    }
+    lockTableInsert(table,locks);
+    table->used++;
+}
+
+/* backward shift deletion: entries after the hole are moved back unless
+ * their home slot lies in (hole, entry], so no tombstone needed. */
+static void lockTableDelete(lockTable *table, locks *locks) {
+    size_t mask = table->size-1, i, j, k;
+
+    for (i = locksTableHash(locks) & mask; table->slots[i] != locks;
+            i = (i+1) & mask) {
+        serverAssert(table->slots[i] != NULL);
+    }
+
+    for (j = (i+1) & mask; table->slots[j] != NULL; j = (j+1) & mask) {
+        k = locksTableHash(table->slots[j]) & mask;
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+        table->slots[i] = table->slots[j];
+        i = j;
+    }
+    table->slots[i] = NULL;
+    table->used--;
+
+    if (table->size > LOCK_TABLE_MIN_SIZE && table->used*8 < table->size)
+        lockTableResize(table,table->size/2);
 }
 
 static inline void locksSetLevelParent(locks *locks, int level,
         struct locks *parent) {
     locks->level = level;
     locks->parent = parent;
+    locks->head = NULL;
+    locks->tail = NULL;
+    locks->lock_count = 0;
 }
 
-locks *locksCreate(int level, redisDb *db, robj *key, locks *parent) {
+locks *locksCreate(int level, redisDb *db, robj *key, uint64_t hash,
+        locks *parent) {
     locks *locks = NULL;
 
     switch (level) {
@@ -248,7 +378,6 @@ locks *locksCreate(int level, redisDb *db, robj *key, locks *parent) {
         serverAssert(parent == NULL);
         locks = lock_malloc(sizeof(struct locks));
         locksSetLevelParent(locks,level,parent);
-        locks->lock_list = listCreate();
         locks->svr.dbnum = server.dbnum;
         locks->svr.dbs = lock_malloc(locks->svr.dbnum*sizeof(struct locks));
         break;
@@ -257,9 +386,8 @@ locks *locksCreate(int level, redisDb *db, robj *key, locks *parent) {
         serverAssert(db);
         locks = lock_malloc(sizeof(struct locks));
         locksSetLevelParent(locks,level,parent);
-        locks->lock_list = listCreate();
         locks->db.db = db;
-        locks->db.keys = dictCreate(&keyLevelLockDictType, NULL);
+        lockTableInit(&locks->db.keys);
         break;
     case REQUEST_LEVEL_KEY:
         serverAssert(parent->level == REQUEST_LEVEL_DB);
@@ -268,7 +396,19 @@ locks *locksCreate(int level, redisDb *db, robj *key, locks *parent) {
         locksSetLevelParent(locks,level,parent);
         incrRefCount(key);
         locks->key.key = key;
-        dictAdd(parent->db.keys,key/*ref*/,locks);
+        locks->key.hash = hash;
+        lockTableInit(&locks->key.subkeys);
+        lockTableAdd(&parent->db.keys,locks);
+        break;
+    case LOCKS_LEVEL_SUBKEY:
+        serverAssert(parent->level == REQUEST_LEVEL_KEY);
+        serverAssert(key);
+        locks = bufferedAllocatorAlloc(buffered_allocator_keylocks);
+        locksSetLevelParent(locks,level,parent);
+        incrRefCount(key);
+        locks->subkey.subkey = key;
+        locks->subkey.hash = hash;
+        lockTableAdd(&parent->key.subkeys,locks);
         break;
     default:
         serverPanic("unexpected lock level");
@@ -281,25 +421,32 @@ locks *locksCreate(int level, redisDb *db, robj *key, locks *parent) {
 static void locksRelease(locks *locks) {
     if (!locks) return;
 
-    serverAssert(listLength(locks->lock_list) == 0);
+    serverAssert(locks->lock_count == 0);
 
     switch (locks->level) {
     case REQUEST_LEVEL_SVR:
         lock_free(locks->svr.dbs);
-        listRelease(locks->lock_list), locks->lock_list = NULL;
         lock_free(locks);
         break;
     case REQUEST_LEVEL_DB:
-        dictRelease(locks->db.keys);
-        listRelease(locks->lock_list), locks->lock_list = NULL;
+        lockTableDeinit(&locks->db.keys);
         lock_free(locks);
         break;
     case REQUEST_LEVEL_KEY:
         serverAssert(locks->parent->level == REQUEST_LEVEL_DB);
-        dictDelete(locks->parent->db.keys,locks->key.key);
+        lockTableDeinit(&locks->key.subkeys);
+        lockTableDelete(&locks->parent->db.keys,locks);
         decrRefCount(locks->key.key);
         bufferedAllocatorFree(buffered_allocator_keylocks,locks);
         break;
+    case LOCKS_LEVEL_SUBKEY:
+        serverAssert(locks->parent->level == REQUEST_LEVEL_KEY);
+        lockTableDelete(&locks->parent->key.subkeys,locks);
+        if (locks->parent->key.subkeys.used == 0)
+            lockTableDeinit(&locks->parent->key.subkeys);
+        decrRefCount(locks->subkey.subkey);
+        bufferedAllocatorFree(buffered_allocator_keylocks,locks);
+        break;
     default:
         serverPanic("unexpected lock level");
         break;
@@ -308,8 +455,6 @@ static void locksRelease(locks *locks) {
 
 const char *lockDump(lock *lock);
 sds locksDump(locks *locks) {
-    listIter li;
-    listNode *ln;
     sds result = sdsempty();
     char *key;
     redisDb *db;
@@ -327,20 +472,23 @@ sds locksDump(locks *locks) {
         db = locks->parent->db.db;
         key = locks->key.key->ptr;
         break;
+    case LOCKS_LEVEL_SUBKEY:
+        db = locks->parent->parent->db.db;
+        key = locks->subkey.subkey->ptr;
+        break;
     default:
         db = NULL;
         key = "?";
         break;
     }
     result = sdscatprintf(result,"(level=%s,db=%d,key=%s,lock_count=%ld):",
+            locks->level == LOCKS_LEVEL_SUBKEY ? "SUBKEY" :
             requestLevelName(locks->level),
-            db ? db->id : -1, key, listLength(locks->lock_list));
+            db ? db->id : -1, key, locks->lock_count);
 
     result = sdscat(result, "[");
-    listRewind(locks->lock_list,&li);
-    while ((ln = listNext(&li))) {
-        lock *lock = listNodeValue(ln);
-        if (ln != listFirst(locks->lock_list))
+    for (lock *lock = locks->head; lock; lock = lock->next) {
+        if (lock != locks->head)
             result = sdscat(result,",");
         result = sdscat(result,lockDump(lock));
     }
@@ -349,9 +497,7 @@ sds locksDump(locks *locks) {
 }
 
 static inline lock *locksLastLock(locks *locks) {
-    if (locks == NULL) return NULL;
-    listNode *ln = listLast(locks->lock_list);
-    return ln ? listNodeValue(ln) : NULL;
+    return locks ? locks->tail : NULL;
 }
 
 /* create link with upper or current level lock (if exits). */
@@ -362,16 +508,66 @@ static inline void locksLinkLock(locks *locks, lock* lock, int *would_block) {
     }
 }
 
+/* create link with current key (or subkey) level locks: reader links with
+ * the last lock only (proceeds together with it if it's also a reader);
+ * writer links with all readers at tail since they might unlock in any
+ * order, or with the last writer if no reader follows it. */
+static void keyLocksLinkLock(locks *keylocks, lock *lock, int *would_block) {
+    struct lock *last, *prev;
+
+    if (keylocks == NULL) return;
+    serverAssert(keylocks->level >= REQUEST_LEVEL_KEY);
+
+    last = keylocks->tail;
+    if (last && lock->link.mode == LOCK_MODE_READ) {
+        /* reader proceeds right after writer of the same tx, it can't be
+         * shared by later readers before that writer unlocks. */
+        if (last->link.mode != LOCK_MODE_READ &&
+                last->link.txid == lock->link.txid)
+            lock->link.mode = LOCK_MODE_WRITE;
+    }
+
+    for (prev = last; prev; prev = prev->prev) {
+        int prev_reader = prev->link.mode == LOCK_MODE_READ;
+
+        /* readers at tail already wait for the writer ahead of them. */
+        if (!prev_reader && prev != last) break;
+
+        lockLinkLink(&prev->link,&lock->link,would_block);
+        if (would_block && *would_block) break;
+
+        if (lock->link.mode == LOCK_MODE_READ) {
+            if (prev_reader && would_block == NULL)
+                server.swap_lock->stat->modes[LOCK_MODE_READ].shared_count++;
+            break;
+        }
+        if (!prev_reader) break;
+    }
+}
+
+static void keyLocksChildrenLinkLock(locks *locks, lock* lock, int *would_block) {
+    lockTable *subkeys = &locks->key.subkeys;
+    serverAssert(locks->level == REQUEST_LEVEL_KEY);
+    if (subkeys->used == 0) return;
+    for (size_t i = 0; i < subkeys->size; i++) {
+        struct locks *subkeylocks = subkeys->slots[i];
+        if (subkeylocks == NULL) continue;
+        keyLocksLinkLock(subkeylocks,lock,would_block);
+        if (would_block && *would_block) break;
+    }
+}
+
 static void dbLocksChildrenLinkLock(locks *locks, lock* lock, int *would_block) {
-    dictEntry *de;
-    dictIterator *di = dictGetIterator(locks->db.keys);
+    lockTable *keys = &locks->db.keys;
     serverAssert(locks->level == REQUEST_LEVEL_DB);
-    while ((de = dictNext(di)) != NULL) {
-        struct locks *keylocks = dictGetVal(de);
-        locksLinkLock(keylocks,lock,would_block);
+    for (size_t i = 0; i < keys->size; i++) {
+        struct locks *keylocks = keys->slots[i];
+        if (keylocks == NULL) continue;
+        keyLocksLinkLock(keylocks,lock,would_block);
+        if (would_block && *would_block) break;
+        keyLocksChildrenLinkLock(keylocks,lock,would_block);
         if (would_block && *would_block) break;
     }
-    dictReleaseIterator(di);
 }
 
 static void svrLocksChildrenLinkLock(locks *locks, lock* lock, int *would_block) {
@@ -395,6 +591,9 @@ void locksChildrenLinksLock(locks *locks, lock* lock, int *would_block) {
         dbLocksChildrenLinkLock(locks,lock,would_block);
         break;
     case REQUEST_LEVEL_KEY:
+        keyLocksChildrenLinkLock(locks,lock,would_block);
+        break;
+    case LOCKS_LEVEL_SUBKEY:
         break;
     default:
         serverPanic("unexpected locks level");
@@ -406,6 +605,7 @@ void locksChildrenLinksLock(locks *locks, lock* lock, int *would_block) {
 void lockMigrateChildrenLinks(lock *left, lock *lock, int *would_block) {
     int level = left->locks->level;
     for (int i = 0; i < left->link.links.count; i++) {
+        if (left->link.links.links[i] == NULL) continue;
         struct lock *from = LINK_TO_LOCK(left->link.links.links[i]);
         if (from->locks == NULL || from->locks->level <= level) {
             /* skip lower level or current (locks is NULL) lock */
@@ -419,7 +619,9 @@ void lockMigrateChildrenLinks(lock *left, lock *lock, int *would_block) {
 static inline void locksChildrenLinkLock(locks* locks, lock *lock,
         int *would_block) {
     struct lock *last = locksLastLock(locks);
-    if (last == NULL) {
+    /* key level links all subkey locks: they are not linked from shared
+     * readers other than the last one, so last->links is not complete. */
+    if (last == NULL || locks->level >= REQUEST_LEVEL_KEY) {
         if (locks) {
             locksChildrenLinksLock(locks,lock,would_block);
         } else {
@@ -490,6 +692,9 @@ bufferedAllocator *bufferedAllocatorCreate(size_t capacity, size_t size, newauxf
     ba->occupied = capacity;
     ba->capacity = capacity;
     ba->unbuffered = 0;
+    ba->spare = NULL;
+    ba->spare_count = 0;
+    ba->spare_limit = 0;
     ba->size = size;
     ba->newauxcb = newauxcb;
     ba->freeauxcb = freeauxcb;
@@ -507,7 +712,26 @@ bufferedAllocator *bufferedAllocatorCreate(size_t capacity, size_t size, newauxf
     return ba;
 }
 
+/* Unbuffered ptr freed are kept (up to spare_limit) instead of returned to
+ * malloc, so that allocations beyond capacity are pooled as well. */
+void bufferedAllocatorSetSpareLimit(bufferedAllocator *ba, size_t spare_limit) {
+    while (ba->spare_count > spare_limit) {
+        bufferedAllocatorPtr *ptr = ba->spare[--ba->spare_count];
+        bufferedAllocatorFreeAux(ba,ptr);
+        zfree(ptr);
+        ba->unbuffered--;
+    }
+    if (spare_limit == 0) {
+        zfree(ba->spare);
+        ba->spare = NULL;
+    } else {
+        ba->spare = zrealloc(ba->spare,sizeof(bufferedAllocatorPtr*)*spare_limit);
+    }
+    ba->spare_limit = spare_limit;
+}
+
 void bufferedAllocatorDestroy(bufferedAllocator *ba) {
+    bufferedAllocatorSetSpareLimit(ba,0);
     assert(ba->unbuffered == 0);
     assert(bufferedAllocatorFull(ba));
     for (size_t i = 0; i < ba->capacity; i++) {
@@ -523,6 +747,7 @@ void *bufferedAllocatorAlloc(bufferedAllocator *ba) {
     bufferedAllocatorPtr *ptr;
 
     if (bufferedAllocatorEmpty(ba)) {
+        if (ba->spare_count > 0) return ba->spare[--ba->spare_count]->content;
         ptr = zcalloc(sizeof(bufferedAllocatorPtr)+ba->size);
         bufferedAllocatorNewAux(ba,ptr);
         bufferedAllocatorSetBuffered(ptr,0);
@@ -539,6 +764,8 @@ void bufferedAllocatorFree(bufferedAllocator *ba, void *content) {
     bufferedAllocatorPtr *ptr = bufferedAllocatorPtrFromContent(content);
     if (bufferedAllocatorGetBuffered(ptr)) {
         bufferedAllocatorPushPtr(ba,ptr);
+    } else if (ba->spare_count < ba->spare_limit) {
+        ba->spare[ba->spare_count++] = ptr;
     } else {
         bufferedAllocatorFreeAux(ba,ptr);
         zfree(ptr);
@@ -546,18 +773,21 @@ void bufferedAllocatorFree(bufferedAllocator *ba, void *content) {
     }
 }
 
-lock *lockNew(int64_t txid, redisDb *db, robj *key, client *c,
+lock *lockNew(int64_t txid, redisDb *db, robj *key, robj *subkey, int mode, client *c,
         lockProceedCallback proceed, void *pd, freefunc pdfree,
         void *msgs) {
     lock *lock = bufferedAllocatorAlloc(buffered_allocator_lock);
 
-    lockLinkInit(&lock->link,txid);
+    lockLinkInit(&lock->link,txid,mode);
 
     lock->locks = NULL;
-    lock->locks_ln = NULL;
+    lock->prev = NULL;
+    lock->next = NULL;
     lock->db = db;
     if (key) incrRefCount(key);
     lock->key = key;
+    if (subkey) incrRefCount(subkey);
+    lock->subkey = subkey;
     lock->c = c;
     lock->proceed = proceed;
     lock->pd = pd;
@@ -580,7 +810,7 @@ lock *lockNew(int64_t txid, redisDb *db, robj *key, client *c,
 
 void lockFree(lock *lock) {
     serverAssert(lockLinkTargetReady(&lock->link.target));
-    serverAssert(lock->locks_ln == NULL);
+    serverAssert(lock->prev == NULL && lock->next == NULL);
     serverAssert(lock->locks == NULL);
 
     lockLinkDeinit(&lock->link);
@@ -588,6 +818,10 @@ void lockFree(lock *lock) {
         decrRefCount(lock->key);
         lock->key = NULL;
     }
+    if (lock->subkey) {
+        decrRefCount(lock->subkey);
+        lock->subkey = NULL;
+    }
     if (lock->pdfree) {
         lock->pdfree(lock->pd);
     }
@@ -606,12 +840,14 @@ const char *lockDump(lock *lock) {
     char *ptr = repr, *end = repr + sizeof(repr) - 1;
 
     ptr += snprintf(ptr,end-ptr,
-            "txid=%ld,target=(linked=%d,signaled=%d),links=(proceed=%s,unlocked=%s,[",
-            lock->link.txid,lock->link.target.linked,lock->link.target.signaled,
+            "txid=%ld,mode=%s,target=(linked=%d,signaled=%d),links=(proceed=%s,unlocked=%s,[",
+            lock->link.txid,lockModeName(lock->link.mode),
+            lock->link.target.linked,lock->link.target.signaled,
             booleanRepr(lock->link.links.proceeded),booleanRepr(lock->link.links.unlocked));
 
     for (int i = 0; i < lock->link.links.count && ptr < end; i++) {
         struct lockLink *target_link = lock->link.links.links[i];
+        if (target_link == NULL) continue;
         struct lock *target = LINK_TO_LOCK(target_link);
         ptr += snprintf(ptr,end-ptr,"(txid=%ld,db=%d,key=%s),",
                 target_link->txid,
@@ -626,14 +862,22 @@ const char *lockDump(lock *lock) {
 static void lockStatUpdateLocked(lock *lock) {
     int level = lock->locks->level;
     lockStat *stat = server.swap_lock->stat;
+    if (level == LOCKS_LEVEL_SUBKEY) {
+        level = REQUEST_LEVEL_KEY;
+        stat->subkey_request_count++;
+        if (lock->conflict) stat->subkey_conflict_count++;
+    }
     lockInstantaneouStat *inst_stat = stat->instant+level;
     lockCumulativeStat *cumu_stat = &stat->cumulative;
+    lockModeStat *mode_stat = stat->modes+lock->link.mode;
 
     cumu_stat->request_count++;
     inst_stat->request_count++;
+    mode_stat->request_count++;
     if (lock->conflict) {
         cumu_stat->conflict_count++;
         inst_stat->conflict_count++;
+        mode_stat->conflict_count++;
     }
 }
 
@@ -700,23 +944,37 @@ void lockProceeded(void *lock_) {
 }
 
 static inline void lockAttachToLocks(lock *lock, locks *locks) {
-    listAddNodeTail(locks->lock_list,lock);
     lock->locks = locks;
-    lock->locks_ln = listLast(locks->lock_list);
+    lock->prev = locks->tail;
+    lock->next = NULL;
+    if (locks->tail) locks->tail->next = lock;
+    else locks->head = lock;
+    locks->tail = lock;
+    locks->lock_count++;
 }
 
 static inline void lockDetachFromLocks(lock *lock) {
     locks *locks = lock->locks;
     lock->locks = NULL;
-    listDelNode(locks->lock_list,lock->locks_ln);
-    lock->locks_ln = NULL;
+    if (lock->prev) lock->prev->next = lock->next;
+    else locks->head = lock->next;
+    if (lock->next) lock->next->prev = lock->prev;
+    else locks->tail = lock->prev;
+    lock->prev = NULL;
+    lock->next = NULL;
+    locks->lock_count--;
 }
 
 static inline void locksFreeIfEmptyKeyLevel(locks *locks) {
-    if (locks->level == REQUEST_LEVEL_KEY &&
-            listLength(locks->lock_list) == 0) {
-        locksRelease(locks);
-    }
+    struct locks *parent = locks->parent;
+    int level = locks->level;
+
+    if (level < REQUEST_LEVEL_KEY || locks->lock_count != 0)
+        return;
+    if (level == REQUEST_LEVEL_KEY && locks->key.subkeys.used != 0)
+        return;
+    locksRelease(locks);
+    if (level == LOCKS_LEVEL_SUBKEY) locksFreeIfEmptyKeyLevel(parent);
 }
 
 void lockUnlock(void *lock_) {
@@ -729,6 +987,36 @@ void lockUnlock(void *lock_) {
     lockFree(lock);
 }
 
+/* lock waited for others (e.g. in-flight swap of the same key). */
+int lockConflicted(void *lock_) {
+    lock *lock = lock_;
+    return lock->conflict;
+}
+
+int lockIsSubkey(void *lock_) {
+    lock *lock = lock_;
+    return lock->subkey != NULL;
+}
+
+/* Other requests queued on the same key (or subkey), they are about to
+ * access it once this one unlocks. */
+int lockHasWaiters(void *lock_) {
+    lock *lock = lock_;
+    return lock->next != NULL;
+}
+
+/* Stop sharing a read lock that has not proceeded yet: next reader will be
+ * signaled at unlock instead of proceeded, so that it won't swap in (or
+ * expire) the key while current command is pending. Lock is still grouped
+ * with readers ahead of writers. Returns 1 if lock is a read lock. */
+int lockUnshare(void *lock_) {
+    lock *lock = lock_;
+    if (lock->link.mode != LOCK_MODE_READ) return 0;
+    serverAssert(!lock->link.links.proceeded);
+    lock->link.links.unshared = 1;
+    return 1;
+}
+
 /* return 1 if lock proceeded */
 static inline int lockProceedIfReady(lock *lock) {
     lock->conflict = !lockLinkTargetReady(&lock->link.target);
@@ -742,11 +1030,31 @@ static inline int lockProceedIfReady(lock *lock) {
     }
 }
 
+/* subkey lock is granted only if no svr/db/key level lock is queued: such
+ * lock might turn key cold (evict, del, flush...) while subkey requests of
+ * the same key swap concurrently; later subkey requests fallback to key lock
+ * until then, so that whole key lock won't starve. */
+static int subkeyLockable(redisDb *db, robj *key, uint64_t hash) {
+    locks *svrlocks = server.swap_lock->svrlocks, *dblocks, *keylocks;
+    if (locksLastLock(svrlocks)) return 0;
+    dblocks = svrlocks->svr.dbs[db->id];
+    if (locksLastLock(dblocks)) return 0;
+    keylocks = lockTableFind(&dblocks->db.keys,key,hash);
+    if (locksLastLock(keylocks)) return 0;
+    return 1;
+}
+
 static int _lockLock(int *would_block,
-        int64_t txid, redisDb *db, robj *key, lockProceedCallback cb,
-        client *c, void *pd, freefunc pdfree, void *msgs) {
-    lock *lock = lockNew(txid,db,key,c,cb,pd,pdfree,msgs);
-    locks *svrlocks = server.swap_lock->svrlocks, *dblocks, *keylocks, *locks;
+        int64_t txid, redisDb *db, robj *key, robj *subkey, int mode,
+        lockProceedCallback cb, client *c, void *pd, freefunc pdfree,
+        void *msgs) {
+    /* only key (or subkey) level lock could be shared. */
+    if (key == NULL) mode = LOCK_MODE_WRITE, subkey = NULL;
+    uint64_t hash = key ? lockTableHash(key) : 0;
+    if (subkey && !subkeyLockable(db,key,hash)) subkey = NULL;
+    lock *lock = lockNew(txid,db,key,subkey,mode,c,cb,pd,pdfree,msgs);
+    locks *svrlocks = server.swap_lock->svrlocks, *dblocks, *keylocks,
+          *subkeylocks, *locks;
 
     locksLinkLock(svrlocks,lock,would_block);
     if (db == NULL) {
@@ -761,18 +1069,32 @@ static int _lockLock(int *would_block,
         goto end;
     }
 
-    keylocks = dictFetchValue(dblocks->db.keys,key);
+    keylocks = lockTableFind(&dblocks->db.keys,key,hash);
     if (keylocks == NULL) {
         if (would_block == NULL) {
-            keylocks = locksCreate(REQUEST_LEVEL_KEY,db,key,dblocks);
+            keylocks = locksCreate(REQUEST_LEVEL_KEY,db,key,hash,dblocks);
         } else {
             /* keylocks will remain NULL if testing would block. */
         }
     } else {
-        serverAssert(locksLastLock(keylocks)!= NULL);
+        serverAssert(locksLastLock(keylocks) != NULL ||
+                keylocks->key.subkeys.used != 0);
+    }
+    keyLocksLinkLock(keylocks,lock,would_block);
+    if (subkey == NULL) {
+        locks = keylocks;
+        goto end;
     }
-    locksLinkLock(keylocks,lock,would_block);
-    locks = keylocks;
+
+    uint64_t subkey_hash = lockTableHash(subkey);
+    subkeylocks = keylocks ?
+        lockTableFind(&keylocks->key.subkeys,subkey,subkey_hash) : NULL;
+    if (subkeylocks == NULL && would_block == NULL) {
+        subkeylocks = locksCreate(LOCKS_LEVEL_SUBKEY,db,subkey,subkey_hash,
+                keylocks);
+    }
+    keyLocksLinkLock(subkeylocks,lock,would_block);
+    locks = subkeylocks;
 
 end:
     locksChildrenLinkLock(locks,lock,would_block);
@@ -793,14 +1115,29 @@ end:
 }
 
 /* return 1 if lock proceeded */
+int lockLockWithMode(int64_t txid, redisDb *db, robj *key, int mode,
+        lockProceedCallback cb, client *c, void *pd, freefunc pdfree,
+        void *msgs) {
+    return _lockLock(NULL,txid,db,key,NULL,mode,cb,c,pd,pdfree,msgs);
+}
+
+/* return 1 if lock proceeded, fallback to key lock if subkey lock is not
+ * grantable for now. */
+int lockLockSubkey(int64_t txid, redisDb *db, robj *key, robj *subkey,
+        int mode, lockProceedCallback cb, client *c, void *pd,
+        freefunc pdfree, void *msgs) {
+    return _lockLock(NULL,txid,db,key,subkey,mode,cb,c,pd,pdfree,msgs);
+}
+
 int lockLock(int64_t txid, redisDb *db, robj *key, lockProceedCallback cb,
         client *c, void *pd, freefunc pdfree, void *msgs) {
-    return _lockLock(NULL,txid,db,key,cb,c,pd,pdfree,msgs);
+    return _lockLock(NULL,txid,db,key,NULL,LOCK_MODE_WRITE,cb,c,pd,pdfree,msgs);
 }
 
+/* Note that would block is tested as writer. */
 int lockWouldBlock(int64_t txid, redisDb *db, robj *key) {
     int would_block = 0;
-    _lockLock(&would_block,txid,db,key,NULL,NULL,NULL,NULL,NULL);
+    _lockLock(&would_block,txid,db,key,NULL,LOCK_MODE_WRITE,NULL,NULL,NULL,NULL,NULL);
     return would_block;
 }
 
@@ -838,6 +1175,9 @@ static void lockStatInitCumulative(lockCumulativeStat *cumu_stat) {
 void lockStatInit(lockStat *stat) {
     lockStatInitCumulative(&stat->cumulative);
     stat->instant = lockStatCreateInstantaneou();
+    memset(stat->modes,0,sizeof(stat->modes));
+    stat->subkey_request_count = 0;
+    stat->subkey_conflict_count = 0;
 }
 
 void lockStatDeinit(lockStat *stat) {
@@ -872,6 +1212,9 @@ void resetSwapLockInstantaneousMetrics() {
         inst_stat->request_count = 0;
         inst_stat->conflict_count = 0;
     }
+    memset(server.swap_lock->stat->modes,0,sizeof(server.swap_lock->stat->modes));
+    server.swap_lock->stat->subkey_request_count = 0;
+    server.swap_lock->stat->subkey_conflict_count = 0;
 }
 
 sds genSwapLockInfoString(sds info) {
@@ -884,7 +1227,7 @@ sds genSwapLockInfoString(sds info) {
     memory_used = lock_memory_used;
 #else
     memory_used = cumu_stat->request_count*(
-            sizeof(locks)+sizeof(lock)+sizeof(list));
+            sizeof(locks)+sizeof(lock)+sizeof(locks*)*2);
 #endif
 
     info = sdscatprintf(info,
@@ -920,6 +1263,19 @@ sds genSwapLockInfoString(sds info) {
                     lock_stat->name,request,conflict,rps,cps);
         }
     }
+
+    for (j = 0; j < LOCK_MODE_TYPES; j++) {
+        lockModeStat *mode_stat = server.swap_lock->stat->modes+j;
+        info = sdscatprintf(info,
+                "swap_lock_mode_%s:request=%lld,conflict=%lld,shared=%lld\r\n",
+                lockModeName(j),mode_stat->request_count,
+                mode_stat->conflict_count,mode_stat->shared_count);
+    }
+
+    info = sdscatprintf(info,
+            "swap_lock_subkey:request=%lld,conflict=%lld\r\n",
+            server.swap_lock->stat->subkey_request_count,
+            server.swap_lock->stat->subkey_conflict_count);
     return info;
 }
 
@@ -930,12 +1286,22 @@ void swapLockCreate() {
             BUFFERED_ALLOCATOR_CAPACITY_LOCK,sizeof(struct lock),NULL,NULL);
     buffered_allocator_keylocks = bufferedAllocatorCreate(
             BUFFERED_ALLOCATOR_CAPACITY_KEYLOCKS,sizeof(struct locks),
-            keylocksNewAux,keylocksFreeAux);
-
-    locks *svrlocks = locksCreate(REQUEST_LEVEL_SVR,NULL,NULL,NULL);
+            NULL,NULL);
+    buffered_allocator_links = bufferedAllocatorCreate(
+            BUFFERED_ALLOCATOR_CAPACITY_LINKS,
+            sizeof(lockLink*)*LOCK_LINKS_POOLED_SIZE,NULL,NULL);
+    /* keep locks allocated beyond capacity for reuse under bursts. */
+    bufferedAllocatorSetSpareLimit(buffered_allocator_lock,
+            BUFFERED_ALLOCATOR_CAPACITY_LOCK);
+    bufferedAllocatorSetSpareLimit(buffered_allocator_keylocks,
+            BUFFERED_ALLOCATOR_CAPACITY_KEYLOCKS);
+    bufferedAllocatorSetSpareLimit(buffered_allocator_links,
+            BUFFERED_ALLOCATOR_CAPACITY_LINKS);
+
+    locks *svrlocks = locksCreate(REQUEST_LEVEL_SVR,NULL,NULL,0,NULL);
     for (i = 0; i < svrlocks->svr.dbnum; i++) {
         redisDb *db = server.db + i;
-        svrlocks->svr.dbs[i] = locksCreate(REQUEST_LEVEL_DB,db,NULL,svrlocks);
+        svrlocks->svr.dbs[i] = locksCreate(REQUEST_LEVEL_DB,db,NULL,0,svrlocks);
     }
 
     lockStat *stat = lock_malloc(sizeof(lockStat));
@@ -952,7 +1318,7 @@ void swapLockDestroy() {
     locks *svrlocks = server.swap_lock->svrlocks;
     for (i = 0; i < svrlocks->svr.dbnum; i++) {
         locks *dblocks = svrlocks->svr.dbs[i];
-        serverAssert(dictSize(dblocks->db.keys) == 0);
+        serverAssert(dblocks->db.keys.used == 0);
         locksRelease(dblocks);
     }
     locksRelease(svrlocks);
@@ -976,6 +1342,13 @@ void proceedLater(void *lock, int flush, redisDb *db, robj *key, client *c, void
     lockProceeded(lock);
 }
 
+/* proceed without swap io finished, lockProceeded called by test. */
+void proceedNotProceeded(void *lock, int flush, redisDb *db, robj *key, client *c, void *pd_) {
+    UNUSED(flush), UNUSED(db), UNUSED(key), UNUSED(c);
+    void **pd = pd_;
+    *pd = lock;
+}
+
 #define wait_init_suite() do {  \
     if (server.hz != 10) {  \
         server.hz = 10; \
@@ -1113,6 +1486,234 @@ int swapLockTest(int argc, char *argv[], int accurate) {
         test_assert(!lockWouldBlock(txid++,NULL,NULL));
     }
 
+    TEST("lock: shared readers") {
+        void *r1 = NULL, *r2 = NULL, *r3 = NULL, *w1 = NULL;
+        long long shared = server.swap_lock->stat->modes[LOCK_MODE_READ].shared_count;
+        lockLockWithMode(txid++,db,key1,LOCK_MODE_READ,proceedLater,NULL,&r1,NULL,NULL), blocked++;
+        lockLockWithMode(txid++,db,key1,LOCK_MODE_READ,proceedLater,NULL,&r2,NULL,NULL), blocked++;
+        /* consecutive readers proceed together */
+        test_assert(!blocked && r1 && r2);
+        test_assert(server.swap_lock->stat->modes[LOCK_MODE_READ].shared_count == shared+1);
+        lockLockWithMode(txid++,db,key1,LOCK_MODE_WRITE,proceedLater,NULL,&w1,NULL,NULL), blocked++;
+        lockLockWithMode(txid++,db,key1,LOCK_MODE_READ,proceedLater,NULL,&r3,NULL,NULL), blocked++;
+        test_assert(blocked == 2);
+        /* writer waits for all readers ahead, in any unlock order */
+        lockUnlock(r2);
+        test_assert(blocked == 2 && w1 == NULL);
+        lockUnlock(r1);
+        test_assert(blocked == 1 && w1 != NULL && r3 == NULL);
+        test_assert(lockWouldBlock(txid++,db,key1));
+        lockUnlock(w1);
+        test_assert(!blocked && r3 != NULL);
+        lockUnlock(r3);
+        test_assert(!lockWouldBlock(txid++,db,key1));
+    }
+
+    TEST("lock: shared readers wait for previous reader proceeded") {
+        void *r1 = NULL, *r2 = NULL;
+        lockLockWithMode(txid++,db,key1,LOCK_MODE_READ,proceedNotProceeded,NULL,&r1,NULL,NULL);
+        lockLockWithMode(txid++,db,key1,LOCK_MODE_READ,proceedLater,NULL,&r2,NULL,NULL), blocked++;
+        test_assert(r1 != NULL && r2 == NULL && blocked == 1);
+        /* r1 swap finished, r2 proceeds without waiting r1 unlock */
+        lockProceeded(r1);
+        test_assert(r2 != NULL && !blocked);
+        lockUnlock(r1);
+        lockUnlock(r2);
+        test_assert(!lockWouldBlock(txid++,db,key1));
+    }
+
+    TEST("lock: unshared reader signals next reader at unlock") {
+        void *r1 = NULL, *r2 = NULL, *r3 = NULL, *w1 = NULL;
+        lockLockWithMode(txid++,db,key1,LOCK_MODE_READ,proceedLater,NULL,&r1,NULL,NULL), blocked++;
+        lockLockWithMode(txid++,db,key1,LOCK_MODE_READ,proceedNotProceeded,NULL,&r2,NULL,NULL);
+        lockLockWithMode(txid++,db,key1,LOCK_MODE_READ,proceedLater,NULL,&r3,NULL,NULL), blocked++;
+        test_assert(r1 && r2 && r3 == NULL && blocked == 1);
+        test_assert(lockUnshare(r2));
+        lockProceeded(r2);
+        test_assert(r3 == NULL && blocked == 1);
+        lockLockWithMode(txid++,db,key1,LOCK_MODE_WRITE,proceedLater,NULL,&w1,NULL,NULL), blocked++;
+        lockUnlock(r2);
+        test_assert(r3 != NULL && blocked == 1);
+        /* writer still waits for reader proceeded before unshared one */
+        lockUnlock(r3);
+        test_assert(w1 == NULL && blocked == 1);
+        lockUnlock(r1);
+        test_assert(w1 != NULL && !blocked);
+        lockUnlock(w1);
+        test_assert(!lockWouldBlock(txid++,db,key1));
+    }
+
+    TEST("lock: has waiters") {
+        void *w1 = NULL, *w2 = NULL;
+        lockLock(txid++,db,key1,proceedLater,NULL,&w1,NULL,NULL), blocked++;
+        test_assert(w1 && !lockHasWaiters(w1));
+        lockLock(txid++,db,key1,proceedLater,NULL,&w2,NULL,NULL), blocked++;
+        test_assert(lockHasWaiters(w1) && !lockHasWaiters(w2));
+        lockUnlock(w1);
+        test_assert(!blocked && !lockHasWaiters(w2));
+        lockUnlock(w2);
+    }
+
+    TEST("lock: reader after writer of the same tx is not shared") {
+        void *w1 = NULL, *r1 = NULL, *r2 = NULL;
+        int64_t tx = txid++;
+        lockLockWithMode(tx,db,key1,LOCK_MODE_WRITE,proceedLater,NULL,&w1,NULL,NULL), blocked++;
+        lockLockWithMode(tx,db,key1,LOCK_MODE_READ,proceedLater,NULL,&r1,NULL,NULL), blocked++;
+        test_assert(!blocked && w1 && r1);
+        lockLockWithMode(txid++,db,key1,LOCK_MODE_READ,proceedLater,NULL,&r2,NULL,NULL), blocked++;
+        test_assert(blocked == 1 && r2 == NULL);
+        lockUnlock(w1);
+        test_assert(blocked == 1 && r2 == NULL);
+        lockUnlock(r1);
+        test_assert(!blocked && r2 != NULL);
+        lockUnlock(r2);
+        test_assert(!lockWouldBlock(txid++,db,key1));
+    }
+
+    TEST("lock: db lock waits for shared readers") {
+        void *r1 = NULL, *r2 = NULL;
+        handledb = NULL;
+        lockLockWithMode(txid++,db,key1,LOCK_MODE_READ,proceedLater,NULL,&r1,NULL,NULL), blocked++;
+        lockLockWithMode(txid++,db,key1,LOCK_MODE_READ,proceedLater,NULL,&r2,NULL,NULL), blocked++;
+        lockLock(txid++,db,NULL,proceedLater,NULL,&handledb,NULL,NULL), blocked++;
+        test_assert(blocked == 1 && handledb == NULL);
+        lockUnlock(r2);
+        test_assert(blocked == 1 && handledb == NULL);
+        lockUnlock(r1);
+        test_assert(!blocked && handledb != NULL);
+        lockUnlock(handledb);
+        test_assert(!lockWouldBlock(txid++,db,NULL));
+    }
+
+    TEST("lock: subkey locks") {
+        void *s1 = NULL, *s2 = NULL, *s3 = NULL, *s4 = NULL, *w1 = NULL;
+        robj *f1 = createStringObject("f1",2), *f2 = createStringObject("f2",2);
+        long long subkey_request = server.swap_lock->stat->subkey_request_count;
+        lockLockSubkey(txid++,db,key1,f1,LOCK_MODE_WRITE,proceedLater,NULL,&s1,NULL,NULL), blocked++;
+        lockLockSubkey(txid++,db,key1,f2,LOCK_MODE_WRITE,proceedLater,NULL,&s2,NULL,NULL), blocked++;
+        /* different subkeys of the same key proceed concurrently */
+        test_assert(!blocked && s1 && s2);
+        lockLockSubkey(txid++,db,key1,f1,LOCK_MODE_WRITE,proceedLater,NULL,&s3,NULL,NULL), blocked++;
+        test_assert(blocked == 1 && s3 == NULL);
+        test_assert(server.swap_lock->stat->subkey_request_count == subkey_request+3);
+        test_assert(lockWouldBlock(txid++,db,key1));
+        lockLock(txid++,db,key1,proceedLater,NULL,&w1,NULL,NULL), blocked++;
+        /* subkey lock fallbacks to key lock once whole key lock queued */
+        lockLockSubkey(txid++,db,key1,f2,LOCK_MODE_WRITE,proceedLater,NULL,&s4,NULL,NULL), blocked++;
+        test_assert(blocked == 3);
+        test_assert(server.swap_lock->stat->subkey_request_count == subkey_request+3);
+        lockUnlock(s1);
+        test_assert(blocked == 2 && s3 != NULL);
+        lockUnlock(s2);
+        test_assert(blocked == 2 && w1 == NULL);
+        lockUnlock(s3);
+        test_assert(blocked == 1 && w1 != NULL && s4 == NULL);
+        lockUnlock(w1);
+        test_assert(!blocked && s4 != NULL);
+        lockUnlock(s4);
+        test_assert(!lockWouldBlock(txid++,db,key1));
+        decrRefCount(f1), decrRefCount(f2);
+    }
+
+    TEST("lock: shared subkey readers and whole key writer") {
+        void *r1 = NULL, *r2 = NULL, *r3 = NULL, *w1 = NULL;
+        robj *f1 = createStringObject("f1",2);
+        lockLockSubkey(txid++,db,key1,f1,LOCK_MODE_READ,proceedLater,NULL,&r1,NULL,NULL), blocked++;
+        lockLockSubkey(txid++,db,key1,f1,LOCK_MODE_READ,proceedLater,NULL,&r2,NULL,NULL), blocked++;
+        test_assert(!blocked && r1 && r2);
+        lockLockWithMode(txid++,db,key1,LOCK_MODE_READ,proceedLater,NULL,&r3,NULL,NULL), blocked++;
+        lockLock(txid++,db,key1,proceedLater,NULL,&w1,NULL,NULL), blocked++;
+        /* whole key reader shares with subkey readers, writer waits all */
+        test_assert(blocked == 1 && r3 != NULL && w1 == NULL);
+        lockUnlock(r1);
+        lockUnlock(r3);
+        test_assert(blocked == 1 && w1 == NULL);
+        lockUnlock(r2);
+        test_assert(!blocked && w1 != NULL);
+        lockUnlock(w1);
+        test_assert(!lockWouldBlock(txid++,db,key1));
+        decrRefCount(f1);
+    }
+
+    TEST("lock: db lock waits for subkey locks") {
+        void *s1 = NULL, *s2 = NULL;
+        robj *f1 = createStringObject("f1",2), *f2 = createStringObject("f2",2);
+        handledb = NULL;
+        lockLockSubkey(txid++,db,key1,f1,LOCK_MODE_WRITE,proceedLater,NULL,&s1,NULL,NULL), blocked++;
+        lockLockSubkey(txid++,db,key1,f2,LOCK_MODE_WRITE,proceedLater,NULL,&s2,NULL,NULL), blocked++;
+        lockLock(txid++,db,NULL,proceedLater,NULL,&handledb,NULL,NULL), blocked++;
+        test_assert(blocked == 1 && handledb == NULL);
+        lockUnlock(s2);
+        test_assert(blocked == 1 && handledb == NULL);
+        lockUnlock(s1);
+        test_assert(!blocked && handledb != NULL);
+        lockUnlock(handledb);
+        test_assert(!lockWouldBlock(txid++,db,NULL));
+        decrRefCount(f1), decrRefCount(f2);
+    }
+
+    TEST("lock: lock table grow & shrink") {
+#define LOCK_TABLE_TEST_KEYS 200
+        robj *keys[LOCK_TABLE_TEST_KEYS];
+        void *handles[LOCK_TABLE_TEST_KEYS];
+        for (int i = 0; i < LOCK_TABLE_TEST_KEYS; i++) {
+            sds k = sdscatprintf(sdsempty(),"table-key-%d",i);
+            keys[i] = createStringObject(k,sdslen(k));
+            sdsfree(k);
+            lockLock(txid++,db,keys[i],proceedLater,NULL,&handles[i],NULL,NULL), blocked++;
+        }
+        test_assert(!blocked);
+        test_assert(server.swap_lock->svrlocks->svr.dbs[db->id]->db.keys.used == LOCK_TABLE_TEST_KEYS);
+        for (int i = 1; i < LOCK_TABLE_TEST_KEYS; i += 2) lockUnlock(handles[i]);
+        for (int i = 0; i < LOCK_TABLE_TEST_KEYS; i++) {
+            test_assert(lockWouldBlock(txid++,db,keys[i]) == (i % 2 == 0));
+        }
+        for (int i = 0; i < LOCK_TABLE_TEST_KEYS; i += 2) lockUnlock(handles[i]);
+        test_assert(server.swap_lock->svrlocks->svr.dbs[db->id]->db.keys.used == 0);
+        for (int i = 0; i < LOCK_TABLE_TEST_KEYS; i++) decrRefCount(keys[i]);
+    }
+
+    TEST("lock: lock/unlock ns/op") {
+#define LOCK_BENCH_KEYS 1024
+        robj *keys[LOCK_BENCH_KEYS];
+        void *handles[LOCK_BENCH_KEYS];
+        long long start, elapsed, ops;
+        int rounds = accurate ? 1000 : 100;
+
+        for (int i = 0; i < LOCK_BENCH_KEYS; i++) {
+            sds k = sdscatprintf(sdsempty(),"bench-key-%d",i);
+            keys[i] = createStringObject(k,sdslen(k));
+            sdsfree(k);
+        }
+
+        /* uncontended: distinct keys locked then unlocked. */
+        start = ustime();
+        for (int r = 0; r < rounds; r++) {
+            for (int i = 0; i < LOCK_BENCH_KEYS; i++)
+                lockLock(txid++,db,keys[i],proceedLater,NULL,&handles[i],NULL,NULL), blocked++;
+            for (int i = 0; i < LOCK_BENCH_KEYS; i++)
+                lockUnlock(handles[i]);
+        }
+        elapsed = ustime() - start, ops = (long long)rounds*LOCK_BENCH_KEYS;
+        printf("lock/unlock distinct keys: %.1f ns/op\n",(double)elapsed*1000/ops);
+        test_assert(!blocked);
+
+        /* contended: waiters queued on the same key. */
+        start = ustime();
+        for (int r = 0; r < rounds; r++) {
+            for (int i = 0; i < LOCK_BENCH_KEYS; i++)
+                lockLock(txid++,db,key1,proceedLater,NULL,&handles[i],NULL,NULL), blocked++;
+            for (int i = 0; i < LOCK_BENCH_KEYS; i++)
+                lockUnlock(handles[i]);
+        }
+        elapsed = ustime() - start;
+        printf("lock/unlock same key: %.1f ns/op\n",(double)elapsed*1000/ops);
+        test_assert(!blocked);
+        test_assert(!lockWouldBlock(txid++,db,NULL));
+
+        for (int i = 0; i < LOCK_BENCH_KEYS; i++) decrRefCount(keys[i]);
+    }
+
     TEST("lock: deinit") {
         decrRefCount(key1), decrRefCount(key2), decrRefCount(key3);
     }
@@ -1141,7 +1742,7 @@ locks *searchLocks(redisDb *db, robj *key) {
     if (db == NULL) return svrlocks;
     dblocks = svrlocks->svr.dbs[db->id];
     if (key == NULL) return dblocks;
-    keylocks = dictFetchValue(dblocks->db.keys,key);
+    keylocks = lockTableFind(&dblocks->db.keys,key,lockTableHash(key));
     return keylocks;
 }
 
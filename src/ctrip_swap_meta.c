@@ -345,9 +345,42 @@ int SwapAnaAction(swapData *data, int intention, void *datactx_, int *action) {
     return 0;
 }
 
+/* Seek is tagged with key format of the db range it's in. While key format
+ * migration running, db range in source format is scanned before the one in
+ * swap-key-format, keys only move from source to swap-key-format so that
+ * keys existed during scan are not missed. */
+#define METASCAN_SEEK_CONFIGURED 'c'
+#define METASCAN_SEEK_SOURCE 's'
+
+static sds metaScanSeekNew(int format, const char *key, size_t keylen) {
+    sds seek = sdsnewlen(SDS_NOINIT,keylen+1);
+    seek[0] = format == server.swap_key_format ?
+        METASCAN_SEEK_CONFIGURED : METASCAN_SEEK_SOURCE;
+    if (keylen) memcpy(seek+1,key,keylen);
+    return seek;
+}
+
+static int metaScanSeekFormat(metaScanDataCtx *datactx) {
+    rocks *rocks = server.rocks;
+    int status = rocksKeyFormatMigrationStatus(rocks);
+    if (datactx->seek == NULL) {
+        if (status == ROCKS_KEY_FORMAT_MIGRATION_RUNNING)
+            return rocks->key_format_migration.source;
+    } else if (datactx->seek[0] == METASCAN_SEEK_SOURCE) {
+        if (status != ROCKS_KEY_FORMAT_MIGRATION_NONE)
+            return rocks->key_format_migration.source;
+        /* rocksdb reopened, rescan in configured format. */
+        sdsfree(datactx->seek);
+        datactx->seek = metaScanSeekNew(server.swap_key_format,NULL,0);
+    }
+    return server.swap_key_format;
+}
+
 int metaScanEncodeRange(struct swapData *data, int intention, void *datactx_, int *limit,
         uint32_t *flags, int *pcf, sds *start, sds *end) {
     metaScanDataCtx *datactx = datactx_;
+    const char *seek = NULL;
+    size_t seeklen = 0;
     serverAssert(SWAP_IN == intention);
     *pcf = META_CF;
     /* IMPORTANT:
@@ -358,8 +391,10 @@ int metaScanEncodeRange(struct swapData *data, int intention, void *datactx_, in
      *
      * So we set an explicit high bound (dbid+1) for the meta scan range. */
     *flags |= ROCKS_ITERATE_CONTINUOUSLY_SEEK;
-    *start = rocksEncodeMetaKey(data->db,datactx->seek);
-    *end = rocksEncodeDbRangeEndKey(data->db->id);
+    datactx->seek_format = metaScanSeekFormat(datactx);
+    if (datactx->seek) seek = datactx->seek+1, seeklen = sdslen(datactx->seek)-1;
+    *start = encodeMetaKeyWithFormat(datactx->seek_format,data->db->id,seek,seeklen);
+    *end = rocksEncodeDbRangeEndKeyWithFormat(datactx->seek_format,data->db->id);
     *limit = datactx->limit;
     return 0;
 }
@@ -377,7 +412,9 @@ int metaScanDecodeData(swapData *data, int num, int *cfs, sds *rawkeys,
         int dbid = -1;
         if (rocksDecodeMetaKey(nextseek_rawkey,sdslen(nextseek_rawkey),&dbid,
                 &nextseek,&seeklen) == 0 && dbid == data->db->id) {
-            metaScanResultSetNextSeek(result, sdsnewlen(nextseek,seeklen));
+            int format = rocksKeyFormat(nextseek_rawkey,sdslen(nextseek_rawkey));
+            metaScanResultSetNextSeek(result,
+                    metaScanSeekNew(format,nextseek,seeklen));
         } else {
             /* Out of current db's range: treat as EOF for this db scan. */
             metaScanResultSetNextSeek(result, NULL);
@@ -390,12 +427,16 @@ int metaScanDecodeData(swapData *data, int num, int *cfs, sds *rawkeys,
         const char *key;
         size_t keylen;
         long long expire;
-        int swap_type;
+        int swap_type, source;
         int dbid = -1;
 
         serverAssert(cfs[i] == META_CF);
+        /* keys left by key format migration are skipped. */
+        source = rocksKeyFormat(rawkeys[i],sdslen(rawkeys[i])) !=
+            server.swap_key_format;
         if (rocksDecodeMetaKey(rawkeys[i],sdslen(rawkeys[i]),
                 &dbid,&key,&keylen)) {
+            if (source) continue;
             retval = SWAP_ERR_DATA_DECODE_FAIL;
             break;
         }
@@ -404,6 +445,7 @@ int metaScanDecodeData(swapData *data, int num, int *cfs, sds *rawkeys,
         if (dbid != data->db->id) continue;
         if (rocksDecodeMetaVal(rawvals[i],sdslen(rawvals[i]),
                 &swap_type,&expire,NULL,NULL,NULL)) {
+            if (source) continue;
             retval = SWAP_ERR_DATA_DECODE_FAIL;
             break;
         }
@@ -428,6 +470,9 @@ int metaScanSwapIn(swapData *data, void *result_, void *datactx_) {
     UNUSED(data);
     if (c->swap_metas) freeScanMetaResult(c->swap_metas);
     c->swap_metas = result;
+    /* source format range exhausted, continue with configured format. */
+    if (result->nextseek == NULL && datactx->seek_format != server.swap_key_format)
+        result->nextseek = metaScanSeekNew(server.swap_key_format,NULL,0);
     metaScanDataCtxSwapIn(datactx,result);
     return 0;
 }
@@ -486,6 +531,7 @@ int swapDataSetupMetaScan(swapData *data, uint32_t intention_flags,
     datactx->c = c;
     datactx->limit = METASCAN_DEFAULT_LIMIT;
     datactx->seek = NULL;
+    datactx->seek_format = server.swap_key_format;
     datactx->extend = NULL;
 
     if (c == NULL) {
@@ -741,6 +787,7 @@ int metaScanTest(int argc, char *argv[], int accurate) {
         server.swap_repl_worker_clients_free = listCreate();
         server.swap_repl_worker_clients_used = listCreate();
         initTestRedisDb();
+        if (!server.rocks) serverRocksInit();
         c = createClient(NULL);
         selectDb(c,0);
         db = server.db+0;
@@ -772,6 +819,7 @@ int metaScanTest(int argc, char *argv[], int accurate) {
         swapData *data;
         metaScanResult *result;
         swapScanSession *session;
+        sds expected_seek;
 
         data = createSwapData(db,NULL,NULL,NULL);
         session = swapScanSessionsAssign(server.swap_scan_sessions);
@@ -807,7 +855,8 @@ int metaScanTest(int argc, char *argv[], int accurate) {
         test_assert(result->metas[0].expire == -1);
         test_assert(result->metas[0].swap_type == SWAP_TYPE_HASH);
         test_assert(!strcmp(result->metas[0].key,"0"));
-        test_assert(!sdscmp(result->nextseek,lastkey));
+        expected_seek = metaScanSeekNew(server.swap_key_format,lastkey,sdslen(lastkey));
+        test_assert(!sdscmp(result->nextseek,expected_seek));
         for (i = 0; i < onumkeys; i++) {
             if (orawkeys[i]) sdsfree(orawkeys[i]);
             if (orawvals[i]) sdsfree(orawvals[i]);
@@ -824,7 +873,7 @@ int metaScanTest(int argc, char *argv[], int accurate) {
         test_assert(retval == 0);
 
         test_assert(session->nextcursor == 0x80);
-        test_assert(!sdscmp(session->nextseek,lastkey));
+        test_assert(!sdscmp(session->nextseek,expected_seek));
         test_assert((void*)c->swap_metas == (void*)decoded);
 
         /* finish session */
@@ -837,6 +886,7 @@ int metaScanTest(int argc, char *argv[], int accurate) {
         swapDataFree(data,datactx);
         freeClient(c);
         sdsfree(lastkey);
+        sdsfree(expected_seek);
     }
 
     TEST("metascan - scan session cursor manipulate") {
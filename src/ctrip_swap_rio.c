@@ -127,31 +127,241 @@ void RIODeinit(RIO *rio) {
     }
 }
 
+/* Swap thread binds its arena, so that rio reuse write batch and scratch
+ * arrays; other threads (main, rdb save...) have no arena bound and
+ * fallback to allocate & free for each rio. */
+static __thread RIOArena *rio_arena;
+
+void RIOArenaBind(RIOArena *arena) {
+    rio_arena = arena;
+}
+
+void RIOArenaDeinit(RIOArena *arena) {
+    if (arena->wb) rocksdb_writebatch_destroy(arena->wb);
+    if (arena->scratch) zfree(arena->scratch);
+    memset(arena,0,sizeof(RIOArena));
+}
+
+static rocksdb_writebatch_t *RIOWriteBatchGet(void) {
+    if (rio_arena == NULL) return rocksdb_writebatch_create();
+    if (rio_arena->wb == NULL) rio_arena->wb = rocksdb_writebatch_create();
+    return rio_arena->wb;
+}
+
+static void RIOWriteBatchRelease(rocksdb_writebatch_t *wb) {
+    size_t size;
+    if (rio_arena == NULL || rio_arena->wb != wb) {
+        rocksdb_writebatch_destroy(wb);
+        return;
+    }
+    /* writebatch keeps its buffer after clear, recreate if it grows too
+     * big so that one huge batch won't pin memory forever. */
+    rocksdb_writebatch_data(wb,&size);
+    if (size > RIO_ARENA_WB_MAX_SIZE) {
+        rocksdb_writebatch_destroy(wb);
+        rio_arena->wb = NULL;
+    } else {
+        rocksdb_writebatch_clear(wb);
+    }
+}
+
+/* Scratch arrays are bump allocated from arena and released all at once by
+ * RIOScratchRelease(mark); arrays that can't fit fallback to zmalloc and
+ * arena grows to the high-water mark when it's empty again. */
+static inline size_t RIOScratchMark(void) {
+    return rio_arena ? rio_arena->scratch_used : 0;
+}
+
+static void *RIOScratchAlloc(size_t size) {
+    RIOArena *arena = rio_arena;
+    void *ptr;
+    size = (size+sizeof(void*)-1) & ~(sizeof(void*)-1);
+    if (arena == NULL) return zmalloc(size);
+    if (arena->scratch_used + size > arena->scratch_capacity) {
+        arena->scratch_hwm = MAX(arena->scratch_hwm,arena->scratch_used+size);
+        return zmalloc(size);
+    }
+    ptr = arena->scratch + arena->scratch_used;
+    arena->scratch_used += size;
+    arena->scratch_hwm = MAX(arena->scratch_hwm,arena->scratch_used);
+    return ptr;
+}
+
+static inline void RIOScratchFree(void *ptr) {
+    RIOArena *arena = rio_arena;
+    if (ptr == NULL) return;
+    if (arena && (char*)ptr >= arena->scratch &&
+            (char*)ptr < arena->scratch + arena->scratch_capacity) return;
+    zfree(ptr);
+}
+
+static void RIOScratchRelease(size_t mark) {
+    RIOArena *arena = rio_arena;
+    if (arena == NULL) return;
+    arena->scratch_used = mark;
+    if (mark == 0 && arena->scratch_hwm > arena->scratch_capacity &&
+            arena->scratch_hwm <= RIO_ARENA_SCRATCH_MAX_SIZE) {
+        zfree(arena->scratch);
+        arena->scratch_capacity = arena->scratch_hwm;
+        arena->scratch = zmalloc(arena->scratch_capacity);
+    }
+}
+
+/* Block cache is shared by all column families, rocksdb only reports
+ * hit/miss for the whole cache, so per-cf block cache hits and sst block
+ * reads are collected with the (thread local) perf context around each
+ * rocksdb read. Perf context has no block cache miss counter, block read
+ * is counted instead. */
+typedef struct RIOCacheStatsCtx {
+    uint64_t hit;
+    uint64_t block_read;
+    uint64_t read_bytes;
+} RIOCacheStatsCtx;
+
+static __thread rocksdb_perfcontext_t *rio_perf_context;
+static pthread_key_t rio_perf_context_key;
+static pthread_once_t rio_perf_context_key_once = PTHREAD_ONCE_INIT;
+
+static void RIOPerfContextDestroy(void *perf_context) {
+    rocksdb_perfcontext_destroy(perf_context);
+}
+
+static void RIOPerfContextKeyCreate(void) {
+    pthread_key_create(&rio_perf_context_key,RIOPerfContextDestroy);
+}
+
+/* Perf context is destroyed on thread exit (swap threads exit on scale
+ * down), so that it won't leak. */
+static inline void RIOCacheStatsBegin(RIOCacheStatsCtx *ctx) {
+    if (rio_perf_context == NULL) {
+        rocksdb_set_perf_level(rocksdb_enable_count);
+        rio_perf_context = rocksdb_perfcontext_create();
+        pthread_once(&rio_perf_context_key_once,RIOPerfContextKeyCreate);
+        pthread_setspecific(rio_perf_context_key,rio_perf_context);
+    }
+    ctx->hit = rocksdb_perfcontext_metric(rio_perf_context,rocksdb_block_cache_hit_count);
+    ctx->block_read = rocksdb_perfcontext_metric(rio_perf_context,rocksdb_block_read_count);
+    ctx->read_bytes = rocksdb_perfcontext_metric(rio_perf_context,rocksdb_block_read_byte);
+}
+
+static inline void RIOCacheStatsEnd(RIOCacheStatsCtx *ctx, int cf) {
+    rocksCacheStat *stat = server.ror_stats->rocks_cache_stats+cf;
+    uint64_t hit = rocksdb_perfcontext_metric(rio_perf_context,rocksdb_block_cache_hit_count);
+    uint64_t block_read = rocksdb_perfcontext_metric(rio_perf_context,rocksdb_block_read_count);
+    uint64_t read_bytes = rocksdb_perfcontext_metric(rio_perf_context,rocksdb_block_read_byte);
+    if (hit > ctx->hit) atomicIncr(stat->hit,hit-ctx->hit);
+    if (block_read > ctx->block_read) atomicIncr(stat->block_read,block_read-ctx->block_read);
+    if (read_bytes > ctx->read_bytes) atomicIncr(stat->read_bytes,read_bytes-ctx->read_bytes);
+}
+
+/* Multiget count keys in one shot, values are returned as (vals,vals_sizes)
+ * views which stay valid until RIOMultiGetRelease. If pinned, values are
+ * pinned slices that points to rocksdb block cache or memtable, so that we
+ * skip the malloc+memcpy that rocksdb_multi_get_cf does for every value.
+ * Keys are grouped by cf, so that pinned multiget (which is per-cf) could
+ * be used and block cache stats could be accounted per cf. */
+static void RIOMultiGet(int pinned, size_t count, int *cfs, char **keys_list,
+        size_t *keys_list_sizes, const char **vals, size_t *vals_sizes,
+        void **handles, char **errs) {
+    size_t i;
+    RIOCacheStatsCtx cache_stats;
+    size_t *idx = RIOScratchAlloc(count*sizeof(size_t));
+    const char **cf_keys = RIOScratchAlloc(count*sizeof(char*));
+    size_t *cf_keys_sizes = RIOScratchAlloc(count*sizeof(size_t));
+    size_t *cf_vals_sizes = RIOScratchAlloc(count*sizeof(size_t));
+    void **cf_vals = RIOScratchAlloc(count*sizeof(void*));
+    char **cf_errs = RIOScratchAlloc(count*sizeof(char*));
+    rocksdb_column_family_handle_t **cf_handles = NULL;
+
+    if (!pinned) cf_handles = RIOScratchAlloc(count*sizeof(rocksdb_column_family_handle_t*));
+
+    for (int cf = 0; cf < CF_COUNT; cf++) {
+        size_t cf_count = 0;
+        for (i = 0; i < count; i++) {
+            if (cfs[i] != cf) continue;
+            idx[cf_count] = i;
+            cf_keys[cf_count] = keys_list[i];
+            cf_keys_sizes[cf_count] = keys_list_sizes[i];
+            if (!pinned) cf_handles[cf_count] = swapGetCF(cf);
+            cf_count++;
+        }
+        if (cf_count == 0) continue;
+
+        RIOCacheStatsBegin(&cache_stats);
+        if (pinned) {
+            rocksdb_batched_multi_get_cf(server.rocks->db,server.rocks->ropts,
+                    swapGetCF(cf),cf_count,cf_keys,cf_keys_sizes,
+                    (rocksdb_pinnableslice_t**)cf_vals,cf_errs,false);
+        } else {
+            rocksdb_multi_get_cf(server.rocks->db,server.rocks->ropts,
+                    (const rocksdb_column_family_handle_t *const *)cf_handles,
+                    cf_count,cf_keys,cf_keys_sizes,(char**)cf_vals,
+                    cf_vals_sizes,cf_errs);
+        }
+        RIOCacheStatsEnd(&cache_stats,cf);
+
+        for (i = 0; i < cf_count; i++) {
+            size_t x = idx[i];
+            handles[x] = cf_vals[i];
+            errs[x] = cf_errs[i];
+            if (cf_vals[i] == NULL) {
+                vals[x] = NULL;
+                vals_sizes[x] = 0;
+            } else if (pinned) {
+                vals[x] = rocksdb_pinnableslice_value(cf_vals[i],vals_sizes+x);
+            } else {
+                vals[x] = cf_vals[i];
+                vals_sizes[x] = cf_vals_sizes[i];
+            }
+        }
+    }
+
+    RIOScratchFree(idx);
+    RIOScratchFree(cf_keys);
+    RIOScratchFree(cf_keys_sizes);
+    RIOScratchFree(cf_vals_sizes);
+    RIOScratchFree(cf_vals);
+    RIOScratchFree(cf_errs);
+    RIOScratchFree(cf_handles);
+}
+
+static inline void RIOMultiGetRelease(int pinned, void *handle) {
+    if (handle == NULL) return;
+    if (pinned) rocksdb_pinnableslice_destroy(handle);
+    else zlibc_free(handle);
+}
+
+static inline void RIOMultiGetUpdateStatsPinned(int pinned, size_t count,
+        size_t *vals_sizes) {
+    size_t memory = 0;
+    if (!pinned) return;
+    for (size_t i = 0; i < count; i++) memory += vals_sizes[i];
+    atomicIncr(server.ror_stats->rio_pinned_get_stats.batch,1);
+    atomicIncr(server.ror_stats->rio_pinned_get_stats.count,count);
+    atomicIncr(server.ror_stats->rio_pinned_get_stats.memory,memory);
+}
+
 /* server.rocks can be used without lock here because they are exclusive:
  *   server.rocks changed with global lock
  *   RIO called with key lock */
 void RIODoGet(RIO *rio) {
-    int i;
-    rocksdb_column_family_handle_t **cfs_list;
-    char **keys_list = zmalloc(rio->get.numkeys*sizeof(char*));
-    char **values_list = zmalloc(rio->get.numkeys*sizeof(char*));
-    size_t *keys_list_sizes = zmalloc(rio->get.numkeys*sizeof(size_t));
-    size_t *values_list_sizes = zmalloc(rio->get.numkeys*sizeof(size_t));
-    char **errs = zmalloc(rio->get.numkeys*sizeof(char*));
-    cfs_list = zmalloc(rio->get.numkeys*sizeof(rocksdb_column_family_handle_t*));
+    int i, pinned = server.swap_rio_pinned_get;
+    size_t scratch_mark = RIOScratchMark();
+    char **keys_list = RIOScratchAlloc(rio->get.numkeys*sizeof(char*));
+    const char **values_list = RIOScratchAlloc(rio->get.numkeys*sizeof(char*));
+    void **handles = RIOScratchAlloc(rio->get.numkeys*sizeof(void*));
+    size_t *keys_list_sizes = RIOScratchAlloc(rio->get.numkeys*sizeof(size_t));
+    size_t *values_list_sizes = RIOScratchAlloc(rio->get.numkeys*sizeof(size_t));
+    char **errs = RIOScratchAlloc(rio->get.numkeys*sizeof(char*));
 
     for (i = 0; i < rio->get.numkeys; i++) {
-        cfs_list[i] = swapGetCF(rio->get.cfs[i]);
         keys_list[i] = rio->get.rawkeys[i];
         keys_list_sizes[i] = sdslen(rio->get.rawkeys[i]);
     }
 
-    rocksdb_multi_get_cf(server.rocks->db, server.rocks->ropts,
-            (const rocksdb_column_family_handle_t *const *)cfs_list,
-            rio->get.numkeys,
-            (const char**)keys_list, (const size_t*)keys_list_sizes,
-            values_list, values_list_sizes, errs);
-    
+    RIOMultiGet(pinned,rio->get.numkeys,rio->get.cfs,keys_list,
+            keys_list_sizes,values_list,values_list_sizes,handles,errs);
+    RIOMultiGetUpdateStatsPinned(pinned,rio->get.numkeys,values_list_sizes);
 
     if (rio->oom_check) {
         size_t payload_size = 0;
@@ -159,7 +369,10 @@ void RIODoGet(RIO *rio) {
         if (rioMayOOM(payload_size)) {
             RIOSetError(rio,SWAP_ERR_RIO_OOM,sdsnew("rio get oom"));
             serverLog(LL_WARNING,"[rocks] do rocksdb get failed: may OOM");
-            for (i = 0; i < rio->get.numkeys; i++) zlibc_free(values_list[i]);
+            for (i = 0; i < rio->get.numkeys; i++) {
+                RIOMultiGetRelease(pinned,handles[i]);
+                if (errs[i]) zlibc_free(errs[i]);
+            }
             goto end;
         }
     }
@@ -172,7 +385,7 @@ void RIODoGet(RIO *rio) {
         } else {
             rio->get.rawvals[i] = sdsnewlen(values_list[i],
                     values_list_sizes[i]);
-            zlibc_free(values_list[i]);
+            RIOMultiGetRelease(pinned,handles[i]);
         }
         if (errs[i]) {
             if (!RIOGetError(rio)) {
@@ -185,23 +398,42 @@ void RIODoGet(RIO *rio) {
     }
 
 end:
-    zfree(cfs_list);
-    zfree(keys_list);
-    zfree(values_list);
-    zfree(keys_list_sizes);
-    zfree(values_list_sizes);
-    zfree(errs);
+    RIOScratchFree(keys_list);
+    RIOScratchFree(values_list);
+    RIOScratchFree(handles);
+    RIOScratchFree(keys_list_sizes);
+    RIOScratchFree(values_list_sizes);
+    RIOScratchFree(errs);
+    RIOScratchRelease(scratch_mark);
+}
+
+/* Key bytes of data & score put, compared with v1 format. */
+static void RIOPutUpdateStatsKeyFormat(RIO *rio) {
+    long long keys = 0, bytes = 0, v1_bytes = 0;
+    for (int i = 0; i < rio->put.numkeys; i++) {
+        sds rawkey = rio->put.rawkeys[i];
+        if (rio->put.cfs[i] == META_CF) continue;
+        keys++;
+        bytes += sdslen(rawkey);
+        v1_bytes += server.swap_key_format == SWAP_KEY_FORMAT_V1 ? sdslen(rawkey) :
+            rocksKeyEncodedLen(rio->put.cfs[i],rawkey,sdslen(rawkey),SWAP_KEY_FORMAT_V1);
+    }
+    if (keys == 0) return;
+    atomicIncr(server.ror_stats->key_format_stats.keys,keys);
+    atomicIncr(server.ror_stats->key_format_stats.bytes,bytes);
+    atomicIncr(server.ror_stats->key_format_stats.v1_bytes,v1_bytes);
 }
 
 static void RIODoPut(RIO *rio) {
     char *err = NULL;
-    rocksdb_writebatch_t *wb = rocksdb_writebatch_create();
+    rocksdb_writebatch_t *wb = RIOWriteBatchGet();
 
     for (int i = 0; i < rio->put.numkeys; i++) {
         rocksdb_writebatch_put_cf(wb,swapGetCF(rio->put.cfs[i]),
                 rio->put.rawkeys[i],sdslen(rio->put.rawkeys[i]),
                 rio->put.rawvals[i],sdslen(rio->put.rawvals[i]));
     }
+    RIOPutUpdateStatsKeyFormat(rio);
 
     rocksdb_write(server.rocks->db,server.rocks->wopts,wb,&err);
     if (err != NULL) {
@@ -209,12 +441,12 @@ static void RIODoPut(RIO *rio) {
         serverLog(LL_WARNING,"[rocks] do rocksdb put failed: %s",rio->err);
         zlibc_free(err);
     }
-    rocksdb_writebatch_destroy(wb);
+    RIOWriteBatchRelease(wb);
 }
 
 static void RIODoDel(RIO *rio) {
     char *err = NULL;
-    rocksdb_writebatch_t *wb = rocksdb_writebatch_create();
+    rocksdb_writebatch_t *wb = RIOWriteBatchGet();
 
     for (int i = 0; i < rio->del.numkeys; i++) {
         rocksdb_writebatch_delete_cf(wb,swapGetCF(rio->del.cfs[i]),
@@ -227,23 +459,71 @@ static void RIODoDel(RIO *rio) {
         serverLog(LL_WARNING,"[rocks] do rocksdb put failed: %s",rio->err);
         zlibc_free(err);
     }
-    rocksdb_writebatch_destroy(wb);
+    RIOWriteBatchRelease(wb);
 }
 
-static void RIODoIterate(RIO *rio) {
+static inline int RIOIterateWithinPrefix(int cf, const char *start,
+        size_t start_len, const char *end, size_t end_len) {
+    size_t prefix_len;
+    if (!server.rocksdb_data_prefix_bloom || cf == META_CF) return 0;
+    if (start == NULL || end == NULL) return 0;
+    prefix_len = rocksDataKeyPrefixLen(start,start_len);
+    return prefix_len > 0 && prefix_len == rocksDataKeyPrefixLen(end,end_len) &&
+        memcmp(start,end,prefix_len) == 0;
+}
+
+/* Read options an iterate rio requires, rios with same cf and ropts type
+ * could share one iterator. */
+#define RIO_ITERATE_ROPTS_PREFIX (1<<0)
+#define RIO_ITERATE_ROPTS_NOCACHE (1<<1)
+
+static int RIOIterateRoptsType(RIO *rio) {
+    sds start = rio->iterate.start, end = rio->iterate.end;
+    int ropts_type = 0;
+    /* Iterate within one key version (subkeys of a big key) could use
+     * prefix seek, so that prefix bloom skips sst without that key. */
+    if (RIOIterateWithinPrefix(rio->iterate.cf,start,start?sdslen(start):0,
+                end,end?sdslen(end):0))
+        ropts_type |= RIO_ITERATE_ROPTS_PREFIX;
+    if (rio->iterate.flags & ROCKS_ITERATE_DISABLE_CACHE)
+        ropts_type |= RIO_ITERATE_ROPTS_NOCACHE;
+    return ropts_type;
+}
+
+/* Returned ropts (if any) owned by caller, destroy after iter destroyed. */
+static rocksdb_iterator_t *RIOIterateCreateIter(int cf, int ropts_type,
+        rocksdb_readoptions_t **ropts) {
+    rocksdb_readoptions_t *ropts_shared = server.rocks->iter_ropts;
+    int prefix_seek = ropts_type & RIO_ITERATE_ROPTS_PREFIX;
+
+    *ropts = NULL;
+    if (ropts_type & RIO_ITERATE_ROPTS_NOCACHE) {
+        *ropts = rocksdb_readoptions_create();
+        rocksdb_readoptions_set_verify_checksums(*ropts, 0);
+        rocksdb_readoptions_set_fill_cache(*ropts, 0);
+        if (prefix_seek) rocksdb_readoptions_set_prefix_same_as_start(*ropts, 1);
+        else rocksdb_readoptions_set_total_order_seek(*ropts, 1);
+    } else if (prefix_seek) {
+        ropts_shared = server.rocks->prefix_iter_ropts;
+    }
+    atomicIncr(server.ror_stats->rio_iterate_stats.iterators,1);
+    return rocksdb_create_iterator_cf(server.rocks->db,
+            NULL!=*ropts?*ropts:ropts_shared,swapGetCF(cf));
+}
+
+/* Seek and iterate rio range with iter, iter might be positioned anywhere
+ * (reused by previous range) since we always seek first. */
+static void RIODoIterateWithIter(RIO *rio, rocksdb_iterator_t *iter) {
     size_t numkeys = 0;
     char *err = NULL;
-    rocksdb_iterator_t *iter = NULL;
     sds start = rio->iterate.start;
     sds end = rio->iterate.end;
     size_t limit = rio->iterate.limit;
-    rocksdb_readoptions_t *ropts = NULL;
 
     int reverse = rio->iterate.flags & ROCKS_ITERATE_REVERSE;
     int low_bound_exclude = rio->iterate.flags & ROCKS_ITERATE_LOW_BOUND_EXCLUDE;
     int high_bound_exclude = rio->iterate.flags & ROCKS_ITERATE_HIGH_BOUND_EXCLUDE;
     int next_seek = rio->iterate.flags & ROCKS_ITERATE_CONTINUOUSLY_SEEK;
-    int disable_cache = rio->iterate.flags & ROCKS_ITERATE_DISABLE_CACHE;
     int prefix_match = rio->iterate.flags & ROCKS_ITERATE_PREFIX_MATCH;
 
     size_t numalloc = ROCKS_ITERATE_NO_LIMIT == limit ? RIO_ITERATE_NUMKEYS_ALLOC_INIT : limit;
@@ -256,15 +536,9 @@ static void RIODoIterate(RIO *rio) {
     const char *rawkey, *rawval;
     size_t start_len = start ? sdslen(start) : 0, end_len = end ? sdslen(end) : 0;
 
-    if (start == NULL && end == NULL) goto end;
-
-    if (disable_cache) {
-        ropts = rocksdb_readoptions_create();
-        rocksdb_readoptions_set_verify_checksums(ropts, 0);
-        rocksdb_readoptions_set_fill_cache(ropts, 0);
-    }
-    iter = rocksdb_create_iterator_cf(server.rocks->db,NULL!=ropts?ropts:server.rocks->iter_ropts,swapGetCF(rio->iterate.cf));
+    if (iter == NULL) goto end;
 
+    atomicIncr(server.ror_stats->rio_iterate_stats.seeks,1);
     if (reverse) rocksdb_iter_seek_for_prev(iter,end,end_len);
     else rocksdb_iter_seek(iter, start, start_len);
     if (!rocksdb_iter_valid(iter)) goto end;
@@ -356,8 +630,26 @@ static void RIODoIterate(RIO *rio) {
     rio->iterate.numkeys = numkeys;
     rio->iterate.rawkeys = rawkeys;
     rio->iterate.rawvals = rawvals;
+}
+
+static void RIODoIterate(RIO *rio) {
+    rocksdb_iterator_t *iter = NULL;
+    rocksdb_readoptions_t *ropts = NULL;
+    RIOCacheStatsCtx cache_stats;
+
+    atomicIncr(server.ror_stats->rio_iterate_stats.batch,1);
+    atomicIncr(server.ror_stats->rio_iterate_stats.ranges,1);
 
-    if (iter) rocksdb_iter_destroy(iter);
+    if (rio->iterate.start == NULL && rio->iterate.end == NULL) {
+        RIODoIterateWithIter(rio,NULL);
+        return;
+    }
+
+    RIOCacheStatsBegin(&cache_stats);
+    iter = RIOIterateCreateIter(rio->iterate.cf,RIOIterateRoptsType(rio),&ropts);
+    RIODoIterateWithIter(rio,iter);
+    rocksdb_iter_destroy(iter);
+    RIOCacheStatsEnd(&cache_stats,rio->iterate.cf);
     if (ropts) rocksdb_readoptions_destroy(ropts);
 }
 
@@ -566,26 +858,28 @@ RIO *RIOBatchAlloc(RIOBatch *rios) {
 void RIOBatchDoGet(RIOBatch *rios) {
     RIO *rio;
     size_t count = 0, x;
+    int pinned = server.swap_rio_pinned_get;
 
     serverAssert(rios->action == ROCKS_GET);
     for (size_t i = 0; i < rios->count; i++) {
         count += rios->rios[i].get.numkeys;
     }
 
-    rocksdb_column_family_handle_t **cfs_list;
-    char **keys_list = zmalloc(count*sizeof(char*));
-    char **values_list = zmalloc(count*sizeof(char*));
-    size_t *keys_list_sizes = zmalloc(count*sizeof(size_t));
-    size_t *values_list_sizes = zmalloc(count*sizeof(size_t));
-    char **errs = zmalloc(count*sizeof(char*));
-    cfs_list = zmalloc(count*sizeof(rocksdb_column_family_handle_t*));
+    size_t scratch_mark = RIOScratchMark();
+    int *cfs = RIOScratchAlloc(count*sizeof(int));
+    char **keys_list = RIOScratchAlloc(count*sizeof(char*));
+    const char **values_list = RIOScratchAlloc(count*sizeof(char*));
+    void **handles = RIOScratchAlloc(count*sizeof(void*));
+    size_t *keys_list_sizes = RIOScratchAlloc(count*sizeof(size_t));
+    size_t *values_list_sizes = RIOScratchAlloc(count*sizeof(size_t));
+    char **errs = RIOScratchAlloc(count*sizeof(char*));
 
     x = 0;
     for (size_t i = 0; i < rios->count; i++) {
         rio = rios->rios+i;
         serverAssert(rio->action == rios->action);
         for (int j = 0; j < rio->get.numkeys; j++) {
-            cfs_list[x] = swapGetCF(rio->get.cfs[j]);
+            cfs[x] = rio->get.cfs[j];
             keys_list[x] = rio->get.rawkeys[j];
             keys_list_sizes[x] = sdslen(rio->get.rawkeys[j]);
             x++;
@@ -593,10 +887,9 @@ void RIOBatchDoGet(RIOBatch *rios) {
     }
     serverAssert(x == count);
 
-    rocksdb_multi_get_cf(server.rocks->db, server.rocks->ropts,
-            (const rocksdb_column_family_handle_t *const *)cfs_list,count,
-            (const char**)keys_list, (const size_t*)keys_list_sizes,
-            values_list, values_list_sizes, errs);
+    RIOMultiGet(pinned,count,cfs,keys_list,keys_list_sizes,values_list,
+            values_list_sizes,handles,errs);
+    RIOMultiGetUpdateStatsPinned(pinned,count,values_list_sizes);
 
     x = 0;
     for (size_t i = 0; i < rios->count; i++) {
@@ -609,7 +902,10 @@ void RIOBatchDoGet(RIOBatch *rios) {
             if (rioMayOOM(payload_size)) {
                 RIOSetError(rio,SWAP_ERR_RIO_OOM,sdsnew("rio batch get oom"));
                 serverLog(LL_WARNING,"[rocks] do rocksdb batch get failed: may OOM");
-                for (int j = 0; j < rio->get.numkeys; j++) zlibc_free(values_list[x++]);
+                for (int j = 0; j < rio->get.numkeys; j++, x++) {
+                    RIOMultiGetRelease(pinned,handles[x]);
+                    if (errs[x]) zlibc_free(errs[x]);
+                }
                 continue;
             }
         }
@@ -622,7 +918,7 @@ void RIOBatchDoGet(RIOBatch *rios) {
             } else {
                 rio->get.rawvals[j] = sdsnewlen(values_list[x],
                         values_list_sizes[x]);
-                zlibc_free(values_list[x]);
+                RIOMultiGetRelease(pinned,handles[x]);
             }
             if (errs[x]) {
                 if (!RIOGetError(rio)) {
@@ -637,12 +933,14 @@ void RIOBatchDoGet(RIOBatch *rios) {
     }
     serverAssert(x == count);
 
-    zfree(cfs_list);
-    zfree(keys_list);
-    zfree(values_list);
-    zfree(keys_list_sizes);
-    zfree(values_list_sizes);
-    zfree(errs);
+    RIOScratchFree(cfs);
+    RIOScratchFree(keys_list);
+    RIOScratchFree(values_list);
+    RIOScratchFree(handles);
+    RIOScratchFree(keys_list_sizes);
+    RIOScratchFree(values_list_sizes);
+    RIOScratchFree(errs);
+    RIOScratchRelease(scratch_mark);
 }
 
 static void RIOBatchSetError(RIOBatch *rios, int errcode, const char *err) {
@@ -654,7 +952,7 @@ static void RIOBatchSetError(RIOBatch *rios, int errcode, const char *err) {
 
 void RIOBatchDoPut(RIOBatch *rios) {
     char *err = NULL;
-    rocksdb_writebatch_t *wb = rocksdb_writebatch_create();
+    rocksdb_writebatch_t *wb = RIOWriteBatchGet();
 
     serverAssert(rios->action == ROCKS_PUT);
 
@@ -666,6 +964,7 @@ void RIOBatchDoPut(RIOBatch *rios) {
                     rio->put.rawkeys[j],sdslen(rio->put.rawkeys[j]),
                     rio->put.rawvals[j],sdslen(rio->put.rawvals[j]));
         }
+        RIOPutUpdateStatsKeyFormat(rio);
     }
 
     rocksdb_write(server.rocks->db,server.rocks->wopts,wb,&err);
@@ -675,12 +974,12 @@ void RIOBatchDoPut(RIOBatch *rios) {
         zlibc_free(err);
     }
 
-    rocksdb_writebatch_destroy(wb);
+    RIOWriteBatchRelease(wb);
 }
 
 void RIOBatchDoDel(RIOBatch *rios) {
     char *err = NULL;
-    rocksdb_writebatch_t *wb = rocksdb_writebatch_create();
+    rocksdb_writebatch_t *wb = RIOWriteBatchGet();
 
     serverAssert(rios->action == ROCKS_DEL);
 
@@ -700,7 +999,90 @@ void RIOBatchDoDel(RIOBatch *rios) {
         zlibc_free(err);
     }
 
-    rocksdb_writebatch_destroy(wb);
+    RIOWriteBatchRelease(wb);
+}
+
+typedef struct RIOIterateRange {
+    RIO *rio;
+    int ropts_type;
+    sds seek; /* ref */
+} RIOIterateRange;
+
+static inline int RIOIterateRangeCompareSeek(sds a, sds b) {
+    size_t alen = a ? sdslen(a) : 0, blen = b ? sdslen(b) : 0;
+    int cmp = (alen && blen) ? memcmp(a,b,MIN(alen,blen)) : 0;
+    if (cmp == 0) cmp = alen < blen ? -1 : (alen > blen ? 1 : 0);
+    return cmp;
+}
+
+static int RIOIterateRangeCompare(const void *a_, const void *b_) {
+    const RIOIterateRange *a = a_, *b = b_;
+    if (a->rio->iterate.cf != b->rio->iterate.cf)
+        return a->rio->iterate.cf - b->rio->iterate.cf;
+    if (a->ropts_type != b->ropts_type)
+        return a->ropts_type - b->ropts_type;
+    return RIOIterateRangeCompareSeek(a->seek,b->seek);
+}
+
+/* Ranges are grouped by (cf,ropts type) and sorted by seek key, so that
+ * each group shares one iterator and seeks move forward in key order
+ * (which is friendly to block cache & readahead). Each range still
+ * keeps its own limit/reverse/bound-exclude semantics. */
+void RIOBatchDoIterate(RIOBatch *rios) {
+    size_t i, count = 0, scratch_mark;
+    rocksdb_iterator_t *iter = NULL;
+    rocksdb_readoptions_t *ropts = NULL;
+    RIOIterateRange *ranges;
+    RIOIterateRange *group = NULL;
+    RIOCacheStatsCtx cache_stats;
+
+    serverAssert(rios->action == ROCKS_ITERATE);
+
+    scratch_mark = RIOScratchMark();
+    ranges = RIOScratchAlloc(rios->count*sizeof(RIOIterateRange));
+    for (i = 0; i < rios->count; i++) {
+        RIO *rio = rios->rios+i;
+        serverAssert(rio->action == rios->action);
+        if (rio->iterate.start == NULL && rio->iterate.end == NULL) {
+            RIODoIterateWithIter(rio,NULL);
+            continue;
+        }
+        ranges[count].rio = rio;
+        ranges[count].ropts_type = RIOIterateRoptsType(rio);
+        ranges[count].seek = (rio->iterate.flags & ROCKS_ITERATE_REVERSE) ?
+            rio->iterate.end : rio->iterate.start;
+        count++;
+    }
+
+    if (count > 1) qsort(ranges,count,sizeof(RIOIterateRange),RIOIterateRangeCompare);
+
+    for (i = 0; i < count; i++) {
+        RIOIterateRange *range = ranges+i;
+        if (group == NULL || group->rio->iterate.cf != range->rio->iterate.cf ||
+                group->ropts_type != range->ropts_type) {
+            if (iter) {
+                rocksdb_iter_destroy(iter);
+                RIOCacheStatsEnd(&cache_stats,group->rio->iterate.cf);
+            }
+            if (ropts) rocksdb_readoptions_destroy(ropts);
+            group = range;
+            RIOCacheStatsBegin(&cache_stats);
+            iter = RIOIterateCreateIter(range->rio->iterate.cf,
+                    range->ropts_type,&ropts);
+        }
+        RIODoIterateWithIter(range->rio,iter);
+    }
+
+    if (iter) {
+        rocksdb_iter_destroy(iter);
+        RIOCacheStatsEnd(&cache_stats,group->rio->iterate.cf);
+    }
+    if (ropts) rocksdb_readoptions_destroy(ropts);
+    RIOScratchFree(ranges);
+    RIOScratchRelease(scratch_mark);
+
+    atomicIncr(server.ror_stats->rio_iterate_stats.batch,1);
+    atomicIncr(server.ror_stats->rio_iterate_stats.ranges,rios->count);
 }
 
 void RIOBatchDump(RIOBatch *rios) {
@@ -719,12 +1101,12 @@ static void RIOBatchDoIndividually(RIOBatch *rios) {
     }
 }
 
-/* GET -- multiget; PUT/DEL -- write; ITERATE -- cant batch; */
+/* GET -- multiget; PUT/DEL -- write; ITERATE -- shared iterator; */
 void RIOBatchDo(RIOBatch *rios) {
     monotime io_timer;
 
-    /* Fallback to RIODo for actions that cant batch */
-    if (rios->action == ROCKS_ITERATE) {
+    /* Fallback to RIODo if batch iterate disabled */
+    if (rios->action == ROCKS_ITERATE && !server.swap_rio_batch_iterate) {
         RIOBatchDoIndividually(rios);
         return;
     }
@@ -752,6 +1134,9 @@ void RIOBatchDo(RIOBatch *rios) {
     case ROCKS_DEL:
         RIOBatchDoDel(rios);
         break;
+    case ROCKS_ITERATE:
+        RIOBatchDoIterate(rios);
+        break;
     default:
         serverPanic("[RIOBatch] Unknown io action %d", rios->action);
         break;
@@ -788,7 +1173,8 @@ void RIOBatchUpdateStatsDataNotFound(RIOBatch *rios) {
     for (size_t i = 0; i < rios->count; i++) {
         RIO *rio = rios->rios+i;
         int cf = RIOGetCF(rio);
-        if (cf != META_CF) notfound += rio->get.notfound;
+        if (rio->action == ROCKS_GET && cf != META_CF)
+            notfound += rio->get.notfound;
     }
     if (notfound) {
         atomicIncr(server.swap_hit_stats->stat_swapin_data_not_found_count,
@@ -836,6 +1222,28 @@ void resetRIOStats() {
 }
 
 void initServerConfig(void);
+/* ranges over bi-0..bi-5 covering bound excludes, limit, next seek, empty
+ * & unbounded ranges and a range requiring its own read options. */
+static void initBatchIterateEdgeRanges(RIOBatch *rios) {
+    RIO *rio;
+    RIOBatchInit(rios,ROCKS_ITERATE);
+    rio = RIOBatchAlloc(rios);
+    RIOInitIterate(rio,DATA_CF,ROCKS_ITERATE_HIGH_BOUND_EXCLUDE,
+            sdsnew("bi-1"),sdsnew("bi-3"),0);
+    rio = RIOBatchAlloc(rios);
+    RIOInitIterate(rio,DATA_CF,ROCKS_ITERATE_REVERSE,sdsnew("bi-4"),sdsnew("bi-9"),1);
+    rio = RIOBatchAlloc(rios);
+    RIOInitIterate(rio,DATA_CF,ROCKS_ITERATE_CONTINUOUSLY_SEEK,
+            sdsnew("bi-2"),sdsnew("bi-4"),1);
+    rio = RIOBatchAlloc(rios);
+    RIOInitIterate(rio,DATA_CF,0,sdsnew("bi-20"),sdsnew("bi-29"),0);
+    rio = RIOBatchAlloc(rios);
+    RIOInitIterate(rio,DATA_CF,0,NULL,NULL,0);
+    rio = RIOBatchAlloc(rios);
+    RIOInitIterate(rio,DATA_CF,ROCKS_ITERATE_DISABLE_CACHE,
+            sdsnew("bi-0"),sdsnew("bi-1"),0);
+}
+
 int swapRIOTest(int argc, char *argv[], int accurate) {
     UNUSED(argc);
     UNUSED(argv);
@@ -1017,6 +1425,413 @@ int swapRIOTest(int argc, char *argv[], int accurate) {
         sdsfree(hello), sdsfree(world);
     }
 
+    TEST("RIO: pinned batch get") {
+        RIOBatch _rios, *rios = &_rios;
+        RIO _rio, *rio = &_rio;
+        sds foo = sdsnew("foo"), bar = sdsnew("bar"), miss = sdsnew("miss"),
+            hello = sdsnew("hello"), world = sdsnew("world");
+        sds *rawkeys, *rawvals;
+        int *cfs;
+        long long pinned_batch, pinned_count, pinned_memory;
+
+        resetRIOStats();
+        server.ror_stats->rio_pinned_get_stats.batch = 0;
+        server.ror_stats->rio_pinned_get_stats.count = 0;
+        server.ror_stats->rio_pinned_get_stats.memory = 0;
+
+        /* put : data(foo:bar),score(hello:world)
+         * get : data(foo),score(hello),data(miss),data(hello) (pinned)
+         *       => (bar),(world),(<nil>),(<nil>) */
+        cfs = genIntArray(2,DATA_CF,SCORE_CF);
+        rawkeys = genSdsArray(2,foo,hello);
+        rawvals = genSdsArray(2,bar,world);
+        RIOInitPut(rio,2,cfs,rawkeys,rawvals);
+        RIODo(rio);
+        RIODeinit(rio);
+
+        server.swap_rio_pinned_get = 1;
+        RIOBatchInit(rios,ROCKS_GET);
+        rio = RIOBatchAlloc(rios);
+        cfs = genIntArray(2,DATA_CF,SCORE_CF);
+        rawkeys = genSdsArray(2,foo,hello);
+        RIOInitGet(rio,2,cfs,rawkeys);
+        rio = RIOBatchAlloc(rios);
+        cfs = genIntArray(2,DATA_CF,DATA_CF);
+        rawkeys = genSdsArray(2,miss,hello);
+        RIOInitGet(rio,2,cfs,rawkeys);
+        RIOBatchDo(rios);
+
+        rio = rios->rios+0;
+        test_assert(rio->err == NULL);
+        test_assert(!sdscmp(rio->get.rawvals[0],bar));
+        test_assert(!sdscmp(rio->get.rawvals[1],world));
+        rio = rios->rios+1;
+        test_assert(rio->err == NULL);
+        test_assert(rio->get.rawvals[0] == NULL);
+        test_assert(rio->get.rawvals[1] == NULL);
+
+        atomicGet(server.ror_stats->rio_pinned_get_stats.batch,pinned_batch);
+        atomicGet(server.ror_stats->rio_pinned_get_stats.count,pinned_count);
+        atomicGet(server.ror_stats->rio_pinned_get_stats.memory,pinned_memory);
+        test_assert(pinned_batch == 1);
+        test_assert(pinned_count == 4);
+        test_assert(pinned_memory == (long long)(sdslen(bar)+sdslen(world)));
+        test_assert(getStatsRIO(ROCKS_GET,count) == 4);
+        test_assert(getStatsDataNotFound() == 2);
+        RIOBatchDeinit(rios);
+
+        /* pinned and copied path must agree. */
+        server.swap_rio_pinned_get = 0;
+        rio = &_rio;
+        cfs = genIntArray(2,DATA_CF,SCORE_CF);
+        rawkeys = genSdsArray(2,foo,hello);
+        RIOInitGet(rio,2,cfs,rawkeys);
+        RIODo(rio);
+        test_assert(!sdscmp(rio->get.rawvals[0],bar));
+        test_assert(!sdscmp(rio->get.rawvals[1],world));
+        RIODeinit(rio);
+        atomicGet(server.ror_stats->rio_pinned_get_stats.batch,pinned_batch);
+        test_assert(pinned_batch == 1);
+
+        sdsfree(foo), sdsfree(bar), sdsfree(miss);
+        sdsfree(hello), sdsfree(world);
+    }
+
+    TEST("RIO: prefix seek within key version") {
+        RIO _rio, *rio = &_rio;
+        redisDb *db = server.db;
+        sds a = sdsnew("a"), ab = sdsnew("ab"), b = sdsnew("b"),
+            f1 = sdsnew("f1"), f2 = sdsnew("f2"), val = sdsnew("val");
+        sds a1f1 = rocksEncodeDataKey(db,a,1,f1),
+            a1f2 = rocksEncodeDataKey(db,a,1,f2),
+            a2f1 = rocksEncodeDataKey(db,a,2,f1),
+            ab1f1 = rocksEncodeDataKey(db,ab,1,f1);
+        sds start = rocksEncodeDataRangeStartKey(db,a,1),
+            end = rocksEncodeDataRangeEndKey(db,a,1),
+            end2 = rocksEncodeDataRangeEndKey(db,a,2);
+
+        RIOInitPut(rio,4,genIntArray(4,DATA_CF,DATA_CF,DATA_CF,DATA_CF),
+                genSdsArray(4,a1f1,a1f2,a2f1,ab1f1),genSdsArray(4,val,val,val,val));
+        RIODo(rio);
+        test_assert(rio->err == NULL);
+        RIODeinit(rio);
+
+        /* prefix seek only if both bounds within the same key version. */
+        test_assert(RIOIterateWithinPrefix(DATA_CF,start,sdslen(start),end,sdslen(end)));
+        test_assert(RIOIterateWithinPrefix(SCORE_CF,start,sdslen(start),end,sdslen(end)));
+        test_assert(!RIOIterateWithinPrefix(META_CF,start,sdslen(start),end,sdslen(end)));
+        test_assert(!RIOIterateWithinPrefix(DATA_CF,start,sdslen(start),NULL,0));
+        test_assert(!RIOIterateWithinPrefix(DATA_CF,start,sdslen(start),end2,sdslen(end2)));
+        server.rocksdb_data_prefix_bloom = 0;
+        test_assert(!RIOIterateWithinPrefix(DATA_CF,start,sdslen(start),end,sdslen(end)));
+        server.rocksdb_data_prefix_bloom = 1;
+
+        /* neither other version nor key sharing leading bytes is seen. */
+        RIOInitIterate(rio,DATA_CF,0,sdsdup(start),sdsdup(end),0);
+        RIODo(rio);
+        test_assert(rio->err == NULL && rio->iterate.numkeys == 2);
+        test_assert(!sdscmp(rio->iterate.rawkeys[0],a1f1));
+        test_assert(!sdscmp(rio->iterate.rawkeys[1],a1f2));
+        RIODeinit(rio);
+
+        RIOInitIterate(rio,DATA_CF,ROCKS_ITERATE_REVERSE,sdsdup(start),sdsdup(end),0);
+        RIODo(rio);
+        test_assert(rio->err == NULL && rio->iterate.numkeys == 2);
+        test_assert(!sdscmp(rio->iterate.rawkeys[0],a1f2));
+        test_assert(!sdscmp(rio->iterate.rawkeys[1],a1f1));
+        RIODeinit(rio);
+
+        /* absent key: nothing found. */
+        RIOInitIterate(rio,DATA_CF,0,rocksEncodeDataRangeStartKey(db,b,1),
+                rocksEncodeDataRangeEndKey(db,b,1),0);
+        RIODo(rio);
+        test_assert(rio->err == NULL && rio->iterate.numkeys == 0);
+        RIODeinit(rio);
+
+        RIOInitDel(rio,4,genIntArray(4,DATA_CF,DATA_CF,DATA_CF,DATA_CF),
+                genSdsArray(4,a1f1,a1f2,a2f1,ab1f1));
+        RIODo(rio);
+        RIODeinit(rio);
+        sdsfree(a1f1), sdsfree(a1f2), sdsfree(a2f1), sdsfree(ab1f1);
+        sdsfree(start), sdsfree(end), sdsfree(end2);
+        sdsfree(a), sdsfree(ab), sdsfree(b);
+        sdsfree(f1), sdsfree(f2), sdsfree(val);
+    }
+
+    TEST("RIO: batch iterate") {
+        RIOBatch _rios, *rios = &_rios;
+        RIO _rio, *rio = &_rio;
+        sds k[6], v[6];
+        int *cfs;
+        long long iter_batch, iter_ranges, iter_iterators, iter_seeks;
+
+        for (int i = 0; i < 6; i++) {
+            k[i] = sdscatprintf(sdsempty(),"iter-%d",i);
+            v[i] = sdscatprintf(sdsempty(),"val-%d",i);
+        }
+        cfs = genIntArray(6,DATA_CF,DATA_CF,DATA_CF,DATA_CF,DATA_CF,SCORE_CF);
+        RIOInitPut(rio,6,cfs,genSdsArray(6,k[0],k[1],k[2],k[3],k[4],k[5]),
+                genSdsArray(6,v[0],v[1],v[2],v[3],v[4],v[5]));
+        RIODo(rio);
+        RIODeinit(rio);
+
+        server.ror_stats->rio_iterate_stats.batch = 0;
+        server.ror_stats->rio_iterate_stats.ranges = 0;
+        server.ror_stats->rio_iterate_stats.iterators = 0;
+        server.ror_stats->rio_iterate_stats.seeks = 0;
+
+        /* ranges fed in reverse key order, sorted before iterate:
+         * data [iter-3,iter-4]    => iter-3,iter-4
+         * data (iter-1,iter-4] r  => iter-4,iter-3,iter-2
+         * data [iter-0,) limit 2  => iter-0,iter-1
+         * score [iter-0,iter-9]   => iter-5 */
+        RIOBatchInit(rios,ROCKS_ITERATE);
+        rio = RIOBatchAlloc(rios);
+        RIOInitIterate(rio,DATA_CF,0,sdsdup(k[3]),sdsdup(k[4]),0);
+        rio = RIOBatchAlloc(rios);
+        RIOInitIterate(rio,DATA_CF,ROCKS_ITERATE_REVERSE|ROCKS_ITERATE_LOW_BOUND_EXCLUDE,
+                sdsdup(k[1]),sdsdup(k[4]),0);
+        rio = RIOBatchAlloc(rios);
+        RIOInitIterate(rio,DATA_CF,0,sdsdup(k[0]),NULL,2);
+        rio = RIOBatchAlloc(rios);
+        RIOInitIterate(rio,SCORE_CF,0,sdsdup(k[0]),sdsnew("iter-9"),0);
+
+        server.swap_rio_batch_iterate = 1;
+        RIOBatchDo(rios);
+
+        rio = rios->rios+0;
+        test_assert(rio->err == NULL && rio->iterate.numkeys == 2);
+        test_assert(!sdscmp(rio->iterate.rawkeys[0],k[3]));
+        test_assert(!sdscmp(rio->iterate.rawvals[1],v[4]));
+        rio = rios->rios+1;
+        test_assert(rio->err == NULL && rio->iterate.numkeys == 3);
+        test_assert(!sdscmp(rio->iterate.rawkeys[0],k[4]));
+        test_assert(!sdscmp(rio->iterate.rawkeys[2],k[2]));
+        rio = rios->rios+2;
+        test_assert(rio->err == NULL && rio->iterate.numkeys == 2);
+        test_assert(!sdscmp(rio->iterate.rawkeys[0],k[0]));
+        test_assert(!sdscmp(rio->iterate.rawkeys[1],k[1]));
+        rio = rios->rios+3;
+        test_assert(rio->err == NULL && rio->iterate.numkeys == 1);
+        test_assert(!sdscmp(rio->iterate.rawvals[0],v[5]));
+
+        atomicGet(server.ror_stats->rio_iterate_stats.batch,iter_batch);
+        atomicGet(server.ror_stats->rio_iterate_stats.ranges,iter_ranges);
+        atomicGet(server.ror_stats->rio_iterate_stats.iterators,iter_iterators);
+        atomicGet(server.ror_stats->rio_iterate_stats.seeks,iter_seeks);
+        test_assert(iter_batch == 1);
+        test_assert(iter_ranges == 4);
+        test_assert(iter_iterators == 2); /* one for each cf */
+        test_assert(iter_seeks == 4);
+        RIOBatchDeinit(rios);
+
+        /* individually iterate must agree, but with one iterator each. */
+        server.swap_rio_batch_iterate = 0;
+        RIOBatchInit(rios,ROCKS_ITERATE);
+        rio = RIOBatchAlloc(rios);
+        RIOInitIterate(rio,DATA_CF,ROCKS_ITERATE_REVERSE|ROCKS_ITERATE_LOW_BOUND_EXCLUDE,
+                sdsdup(k[1]),sdsdup(k[4]),0);
+        rio = RIOBatchAlloc(rios);
+        RIOInitIterate(rio,DATA_CF,0,sdsdup(k[0]),NULL,2);
+        RIOBatchDo(rios);
+        test_assert(rios->rios[0].iterate.numkeys == 3);
+        test_assert(!sdscmp(rios->rios[0].iterate.rawkeys[1],k[3]));
+        test_assert(rios->rios[1].iterate.numkeys == 2);
+        atomicGet(server.ror_stats->rio_iterate_stats.iterators,iter_iterators);
+        test_assert(iter_iterators == 4);
+        RIOBatchDeinit(rios);
+        server.swap_rio_batch_iterate = 1;
+
+        for (int i = 0; i < 6; i++) {
+            sdsfree(k[i]);
+            sdsfree(v[i]);
+        }
+    }
+
+    TEST("RIO: batch iterate edge cases") {
+        RIOBatch _rios, *rios = &_rios, _rios2, *rios2 = &_rios2;
+        RIO _rio, *rio = &_rio;
+        sds k[6];
+        long long iter_iterators, iter_seeks, iterators, seeks;
+        int expected_numkeys[6] = {2,1,1,0,0,2};
+
+        for (int i = 0; i < 6; i++) k[i] = sdscatprintf(sdsempty(),"bi-%d",i);
+        RIOInitPut(rio,6,genIntArray(6,DATA_CF,DATA_CF,DATA_CF,DATA_CF,DATA_CF,DATA_CF),
+                genSdsArray(6,k[0],k[1],k[2],k[3],k[4],k[5]),
+                genSdsArray(6,k[0],k[1],k[2],k[3],k[4],k[5]));
+        RIODo(rio);
+        RIODeinit(rio);
+
+        atomicGet(server.ror_stats->rio_iterate_stats.iterators,iterators);
+        atomicGet(server.ror_stats->rio_iterate_stats.seeks,seeks);
+        server.swap_rio_batch_iterate = 1;
+        initBatchIterateEdgeRanges(rios);
+        RIOBatchDo(rios);
+        atomicGet(server.ror_stats->rio_iterate_stats.iterators,iter_iterators);
+        atomicGet(server.ror_stats->rio_iterate_stats.seeks,iter_seeks);
+        /* plain & no-cache groups, unbounded range never seeks. */
+        test_assert(iter_iterators - iterators == 2);
+        test_assert(iter_seeks - seeks == 5);
+
+        for (int i = 0; i < 6; i++) {
+            rio = rios->rios+i;
+            test_assert(rio->err == NULL);
+            test_assert(rio->iterate.numkeys == expected_numkeys[i]);
+        }
+        test_assert(!sdscmp(rios->rios[0].iterate.rawkeys[1],k[2]));
+        test_assert(!sdscmp(rios->rios[1].iterate.rawkeys[0],k[5]));
+        test_assert(!sdscmp(rios->rios[2].iterate.rawkeys[0],k[2]));
+        test_assert(!sdscmp(rios->rios[2].iterate.nextseek,k[3]));
+        test_assert(!sdscmp(rios->rios[5].iterate.rawvals[1],k[1]));
+
+        /* shared iterator returns exactly what individual iterators do. */
+        server.swap_rio_batch_iterate = 0;
+        initBatchIterateEdgeRanges(rios2);
+        RIOBatchDo(rios2);
+        for (int i = 0; i < 6; i++) {
+            RIO *a = rios->rios+i, *b = rios2->rios+i;
+            test_assert(a->iterate.numkeys == b->iterate.numkeys);
+            for (int j = 0; j < a->iterate.numkeys; j++) {
+                test_assert(!sdscmp(a->iterate.rawkeys[j],b->iterate.rawkeys[j]));
+                test_assert(!sdscmp(a->iterate.rawvals[j],b->iterate.rawvals[j]));
+            }
+            test_assert((a->iterate.nextseek == NULL) == (b->iterate.nextseek == NULL));
+        }
+        server.swap_rio_batch_iterate = 1;
+        RIOBatchDeinit(rios);
+        RIOBatchDeinit(rios2);
+
+        rio = &_rio;
+        RIOInitDel(rio,6,genIntArray(6,DATA_CF,DATA_CF,DATA_CF,DATA_CF,DATA_CF,DATA_CF),
+                genSdsArray(6,k[0],k[1],k[2],k[3],k[4],k[5]));
+        RIODo(rio);
+        RIODeinit(rio);
+        for (int i = 0; i < 6; i++) sdsfree(k[i]);
+    }
+
+    TEST("RIO: arena reuse") {
+        RIOArena arena = {0};
+        RIOBatch _rios, *rios = &_rios;
+        RIO _rio, *rio = &_rio;
+        sds foo = sdsnew("foo"), bar = sdsnew("bar"), hello = sdsnew("hello");
+        rocksdb_writebatch_t *wb;
+        size_t scratch_capacity;
+
+        RIOArenaBind(&arena);
+
+        RIOInitPut(rio,2,genIntArray(2,DATA_CF,DATA_CF),genSdsArray(2,foo,hello),
+                genSdsArray(2,bar,bar));
+        RIODo(rio);
+        test_assert(rio->err == NULL);
+        RIODeinit(rio);
+        test_assert(arena.wb != NULL);
+        wb = arena.wb;
+
+        RIOInitDel(rio,1,genIntArray(1,DATA_CF),genSdsArray(1,hello));
+        RIODo(rio);
+        RIODeinit(rio);
+        test_assert(arena.wb == wb);
+
+        /* scratch overflows first time, then grows to high-water mark. */
+        for (int round = 0; round < 2; round++) {
+            RIOBatchInit(rios,ROCKS_GET);
+            for (int i = 0; i < 4; i++) {
+                rio = RIOBatchAlloc(rios);
+                RIOInitGet(rio,2,genIntArray(2,DATA_CF,DATA_CF),genSdsArray(2,foo,hello));
+            }
+            RIOBatchDo(rios);
+            for (int i = 0; i < 4; i++) {
+                rio = rios->rios+i;
+                test_assert(!sdscmp(rio->get.rawvals[0],bar));
+                test_assert(rio->get.rawvals[1] == NULL);
+            }
+            RIOBatchDeinit(rios);
+            test_assert(arena.scratch_used == 0);
+            test_assert(arena.scratch_capacity == arena.scratch_hwm);
+            if (round == 0) scratch_capacity = arena.scratch_capacity;
+        }
+        test_assert(arena.scratch_capacity == scratch_capacity);
+
+        RIOArenaBind(NULL);
+        RIOArenaDeinit(&arena);
+        test_assert(arena.wb == NULL && arena.scratch == NULL);
+        rio = &_rio;
+        sdsfree(foo), sdsfree(bar), sdsfree(hello);
+    }
+
+    TEST("RIO: arena scratch & write batch") {
+        RIOArena arena = {0};
+        rocksdb_writebatch_t *wb, *wb2;
+        char *a, *b, *big;
+        size_t mark, size;
+        sds val;
+
+        /* unbound thread allocates per call. */
+        RIOArenaBind(NULL);
+        a = RIOScratchAlloc(16);
+        test_assert(a != NULL && RIOScratchMark() == 0);
+        RIOScratchFree(a);
+        wb = RIOWriteBatchGet();
+        wb2 = RIOWriteBatchGet();
+        test_assert(wb != wb2);
+        RIOWriteBatchRelease(wb);
+        RIOWriteBatchRelease(wb2);
+
+        RIOArenaBind(&arena);
+
+        /* empty arena: falls back to zmalloc, grows to hwm once released. */
+        a = RIOScratchAlloc(20);
+        test_assert(arena.scratch_used == 0 && arena.scratch_hwm == 24);
+        RIOScratchFree(a);
+        RIOScratchRelease(0);
+        test_assert(arena.scratch_capacity == 24 && arena.scratch != NULL);
+
+        /* bump allocated & pointer aligned, nested marks released in order. */
+        a = RIOScratchAlloc(5);
+        test_assert(a == arena.scratch && arena.scratch_used == sizeof(void*));
+        mark = RIOScratchMark();
+        b = RIOScratchAlloc(8);
+        test_assert(b == a + sizeof(void*));
+        big = RIOScratchAlloc(64);
+        test_assert(big < arena.scratch || big >= arena.scratch+arena.scratch_capacity);
+        RIOScratchFree(big);
+        RIOScratchFree(b);
+        RIOScratchRelease(mark);
+        test_assert(arena.scratch_used == mark);
+        /* not grown until released to empty. */
+        test_assert(arena.scratch_capacity == 24);
+        RIOScratchFree(a);
+        RIOScratchRelease(0);
+        test_assert(arena.scratch_used == 0);
+        test_assert(arena.scratch_capacity == arena.scratch_hwm);
+        test_assert(arena.scratch_capacity == sizeof(void*)+8+64);
+
+        /* growth capped. */
+        size = arena.scratch_capacity;
+        big = RIOScratchAlloc(RIO_ARENA_SCRATCH_MAX_SIZE+1);
+        RIOScratchFree(big);
+        RIOScratchRelease(0);
+        test_assert(arena.scratch_capacity == size);
+
+        /* write batch cleared & reused, dropped once it grew too big. */
+        wb = RIOWriteBatchGet();
+        test_assert(arena.wb == wb && RIOWriteBatchGet() == wb);
+        rocksdb_writebatch_put_cf(wb,swapGetCF(DATA_CF),"foo",3,"bar",3);
+        RIOWriteBatchRelease(wb);
+        test_assert(arena.wb == wb && rocksdb_writebatch_count(wb) == 0);
+        val = sdsnewlen(NULL,RIO_ARENA_WB_MAX_SIZE);
+        rocksdb_writebatch_put_cf(wb,swapGetCF(DATA_CF),"foo",3,val,sdslen(val));
+        RIOWriteBatchRelease(wb);
+        test_assert(arena.wb == NULL);
+        test_assert(RIOWriteBatchGet() != NULL && arena.wb != NULL);
+        sdsfree(val);
+
+        RIOArenaBind(NULL);
+        RIOArenaDeinit(&arena);
+        test_assert(arena.wb == NULL && arena.scratch == NULL);
+        test_assert(arena.scratch_capacity == 0 && arena.scratch_hwm == 0);
+    }
+
     return error;
 }
 #endif
@@ -85,6 +85,480 @@ void serverRocksUnlock(rocks *rocks) {
     pthread_rwlock_unlock(rocks->rwlock);
 }
 
+/* One block cache is shared by all column families, so that idle cf
+ * won't hold memory while busy cf thrashes. Meta cf index/filter blocks
+ * are inserted with high priority to stay resident under pressure. */
+size_t rocksGetBlockCacheCapacity(void) {
+    if (server.rocksdb_shared_block_cache_size) return server.rocksdb_shared_block_cache_size;
+    /* data & score cf used to have one cache each. */
+    return server.rocksdb_data_block_cache_size*2 + server.rocksdb_meta_block_cache_size;
+}
+
+/* High priority pool must be reserved in lru cache, otherwise blocks
+ * inserted with high priority are treated the same as others. */
+static rocksdb_cache_t *rocksCreateBlockCache(void) {
+    rocksdb_cache_t *block_cache;
+    rocksdb_lru_cache_options_t *lru_opts;
+    size_t capacity = rocksGetBlockCacheCapacity();
+
+    if (server.rocksdb_block_cache_type == ROCKS_BLOCK_CACHE_HYPER_CLOCK)
+        return rocksdb_cache_create_hyper_clock(capacity,server.rocksdb_data_block_size);
+
+    lru_opts = rocksdb_lru_cache_options_create();
+    rocksdb_lru_cache_options_set_capacity(lru_opts,capacity);
+    rocksdb_lru_cache_options_set_high_pri_pool_ratio(lru_opts,
+            (double)server.rocksdb_block_cache_high_pri_pool_percent/100);
+    block_cache = rocksdb_cache_create_lru_opts(lru_opts);
+    rocksdb_lru_cache_options_destroy(lru_opts);
+    return block_cache;
+}
+
+static void rocksSetBlockCache(rocksdb_block_based_table_options_t *block_opts,
+        rocksdb_cache_t *block_cache, int high_priority) {
+    rocksdb_block_based_options_set_block_cache(block_opts, block_cache);
+    rocksdb_block_based_options_set_cache_index_and_filter_blocks_with_high_priority(block_opts, high_priority);
+    rocksdb_block_based_options_set_pin_l0_filter_and_index_blocks_in_cache(block_opts, high_priority);
+}
+
+/* Data and score keys are encoded as dbid|keylen|key|version|..., extract
+ * dbid|keylen|key|version as prefix so that prefix bloom could skip sst
+ * files without any subkey of the iterating key. */
+static char *rocksDataKeyPrefixTransform(void *state, const char *key,
+        size_t length, size_t *dst_length) {
+    UNUSED(state);
+    *dst_length = rocksDataKeyPrefixLen(key,length);
+    return (char*)key;
+}
+
+static unsigned char rocksDataKeyPrefixInDomain(void *state,
+        const char *key, size_t length) {
+    UNUSED(state);
+    return rocksDataKeyPrefixLen(key,length) > 0;
+}
+
+static unsigned char rocksDataKeyPrefixInRange(void *state,
+        const char *key, size_t length) {
+    UNUSED(state), UNUSED(key), UNUSED(length);
+    return 0;
+}
+
+static const char *rocksDataKeyPrefixName(void *state) {
+    UNUSED(state);
+    return "ror.DataKeyPrefix";
+}
+
+static void rocksDataKeyPrefixDestroy(void *state) {
+    UNUSED(state);
+}
+
+static void rocksSetDataKeyPrefixExtractor(rocksdb_options_t *cf_opts) {
+    if (!server.rocksdb_data_prefix_bloom) return;
+    rocksdb_options_set_prefix_extractor(cf_opts,
+            rocksdb_slicetransform_create(NULL,rocksDataKeyPrefixDestroy,
+                rocksDataKeyPrefixTransform,rocksDataKeyPrefixInDomain,
+                rocksDataKeyPrefixInRange,rocksDataKeyPrefixName));
+    rocksdb_options_set_memtable_prefix_bloom_size_ratio(cf_opts,0.05);
+}
+
+int rocksUpdateBlockCacheCapacity(void) {
+    rocks *rocks = serverRocksGetTryReadLock();
+    if (rocks == NULL) return C_ERR;
+    if (rocks->block_cache) rocksdb_cache_set_capacity(rocks->block_cache,rocksGetBlockCacheCapacity());
+    serverRocksUnlock(rocks);
+    return C_OK;
+}
+
+/* Keys not in swap-key-format (data persisted or rordb saved by server
+ * with another format) are moved to the configured format in background
+ * after rocksdb opened. All meta/data/score keys of one redis key are moved
+ * in one write batch, so that a key is either in source or in target format:
+ * - swap moves the key on demand before reading or writing it (see
+ *   swapRequestBatchProcess), so swap always works in configured format.
+ * - rdb save and metascan visit db range of both formats.
+ * Keys that could not be moved (invalid or already exists in target format)
+ * are left untouched, migration is resumed on next open if interrupted. */
+const char *rocksKeyFormatMigrationStatusName(int status) {
+    switch (status) {
+    case ROCKS_KEY_FORMAT_MIGRATION_NONE: return "none";
+    case ROCKS_KEY_FORMAT_MIGRATION_RUNNING: return "running";
+    case ROCKS_KEY_FORMAT_MIGRATION_DONE: return "done";
+    default: return "unknown";
+    }
+}
+
+void rocksKeyFormatMigrationLock(rocks *rocks) {
+    pthread_mutex_lock(&rocks->key_format_migration.lock);
+}
+
+void rocksKeyFormatMigrationUnlock(rocks *rocks) {
+    pthread_mutex_unlock(&rocks->key_format_migration.lock);
+}
+
+/* v2 keys are tagged with 0xff and followed by varint (never 0xff). */
+static void rocksKeyFormatRange(int format, const char **lower,
+        size_t *lower_len, const char **upper, size_t *upper_len) {
+    if (format == SWAP_KEY_FORMAT_V1) {
+        *lower = "", *lower_len = 0;
+        *upper = "\xff", *upper_len = 1;
+    } else {
+        *lower = "\xff", *lower_len = 1;
+        *upper = "\xff\xff", *upper_len = 2;
+    }
+}
+
+static inline int rocksKeyBeyond(const char *rawkey, size_t klen,
+        const char *upper, size_t upper_len) {
+    int cmp = memcmp(rawkey,upper,MIN(klen,upper_len));
+    return cmp > 0 || (cmp == 0 && klen >= upper_len);
+}
+
+static void rocksKeyFormatMigrationLogFailed(rocks *rocks, int cf,
+        const char *rawkey, size_t klen, const char *reason) {
+    long long failed;
+    atomicGetIncr(rocks->key_format_migration.failed,failed,1);
+    if (failed >= 10) return;
+    sds repr = sdscatrepr(sdsempty(),rawkey,klen);
+    serverLog(LL_WARNING,"[ROCKS] key format migration left %s key %s: %s.",
+            swap_cf_names[cf],repr,reason);
+    sdsfree(repr);
+}
+
+/* Move meta/data/score keys of redis key (metakey in source format) to
+ * swap-key-format, must be called with migration lock held. Returns 1 if
+ * moved, 0 if not found, -1 if left untouched. */
+static int rocksKeyFormatMoveKey(rocks *rocks, const char *metakey,
+        size_t metalen) {
+    struct rocksKeyFormatMigration *m = &rocks->key_format_migration;
+    int i, retval = 1, subcfs[2] = {DATA_CF,SCORE_CF};
+    char *err = NULL, *metaval = NULL, *existed = NULL;
+    size_t metavlen, vlen, klen;
+    long long bytes_before = 0, bytes_after = 0;
+    rocksdb_writebatch_t *wb = NULL;
+    sds newkey = NULL;
+
+    metaval = rocksdb_get_cf(rocks->db,m->ropts,rocks->cf_handles[META_CF],
+            metakey,metalen,&metavlen,&err);
+    if (err != NULL) goto rocks_err;
+    if (metaval == NULL) return 0;
+
+    if ((newkey = rocksTranscodeKey(META_CF,metakey,metalen,
+                    server.swap_key_format)) == NULL) {
+        rocksKeyFormatMigrationLogFailed(rocks,META_CF,metakey,metalen,"invalid key");
+        retval = -1;
+        goto end;
+    }
+    existed = rocksdb_get_cf(rocks->db,m->ropts,rocks->cf_handles[META_CF],
+            newkey,sdslen(newkey),&vlen,&err);
+    if (err != NULL) goto rocks_err;
+    if (existed != NULL) {
+        rocksKeyFormatMigrationLogFailed(rocks,META_CF,metakey,metalen,
+                "key exists in target format");
+        retval = -1;
+        goto end;
+    }
+
+    wb = rocksdb_writebatch_create();
+    rocksdb_writebatch_put_cf(wb,rocks->cf_handles[META_CF],newkey,
+            sdslen(newkey),metaval,metavlen);
+    rocksdb_writebatch_delete_cf(wb,rocks->cf_handles[META_CF],metakey,metalen);
+    bytes_before += metalen, bytes_after += sdslen(newkey);
+    sdsfree(newkey), newkey = NULL;
+
+    /* metakey is prefix of data/score keys of the same redis key. */
+    for (i = 0; i < 2 && retval > 0; i++) {
+        int cf = subcfs[i];
+        rocksdb_iterator_t *iter = rocksdb_create_iterator_cf(rocks->db,
+                m->ropts,rocks->cf_handles[cf]);
+        for (rocksdb_iter_seek(iter,metakey,metalen);
+                rocksdb_iter_valid(iter); rocksdb_iter_next(iter)) {
+            const char *rawkey = rocksdb_iter_key(iter,&klen);
+            const char *rawval = rocksdb_iter_value(iter,&vlen);
+            if (klen < metalen || memcmp(rawkey,metakey,metalen)) break;
+            if ((newkey = rocksTranscodeKey(cf,rawkey,klen,
+                            server.swap_key_format)) == NULL) {
+                rocksKeyFormatMigrationLogFailed(rocks,cf,rawkey,klen,"invalid key");
+                retval = -1;
+                break;
+            }
+            rocksdb_writebatch_put_cf(wb,rocks->cf_handles[cf],newkey,
+                    sdslen(newkey),rawval,vlen);
+            rocksdb_writebatch_delete_cf(wb,rocks->cf_handles[cf],rawkey,klen);
+            bytes_before += klen, bytes_after += sdslen(newkey);
+            sdsfree(newkey), newkey = NULL;
+        }
+        if (retval > 0) rocksdb_iter_get_error(iter,&err);
+        rocksdb_iter_destroy(iter);
+        if (err != NULL) goto rocks_err;
+    }
+
+    if (retval > 0) {
+        rocksdb_write(rocks->db,rocks->wopts,wb,&err);
+        if (err != NULL) goto rocks_err;
+        atomicIncr(m->keys,1);
+        atomicIncr(m->bytes_before,bytes_before);
+        atomicIncr(m->bytes_after,bytes_after);
+    }
+    goto end;
+
+rocks_err:
+    serverLog(LL_WARNING,"[ROCKS] key format migration move key failed: %s",err);
+    zlibc_free(err);
+    atomicIncr(m->failed,1);
+    retval = -1;
+
+end:
+    if (newkey) sdsfree(newkey);
+    if (metaval) zlibc_free(metaval);
+    if (existed) zlibc_free(existed);
+    if (wb) rocksdb_writebatch_destroy(wb);
+    return retval;
+}
+
+/* Called by swap threads before key swapped. */
+void rocksKeyFormatMigrateKey(rocks *rocks, int dbid, sds key) {
+    struct rocksKeyFormatMigration *m = &rocks->key_format_migration;
+    char *err = NULL, *metaval;
+    size_t metavlen;
+    sds metakey;
+
+    if (!rocksKeyFormatMigrating(rocks)) return;
+
+    /* keys never move back to source format, so lock is needed only if key
+     * found in source format. */
+    metakey = encodeMetaKeyWithFormat(m->source,dbid,key,sdslen(key));
+    metaval = rocksdb_get_cf(rocks->db,m->ropts,rocks->cf_handles[META_CF],
+            metakey,sdslen(metakey),&metavlen,&err);
+    if (metaval != NULL || err != NULL) {
+        rocksKeyFormatMigrationLock(rocks);
+        rocksKeyFormatMoveKey(rocks,metakey,sdslen(metakey));
+        rocksKeyFormatMigrationUnlock(rocks);
+    }
+    if (metaval) zlibc_free(metaval);
+    if (err) zlibc_free(err);
+    sdsfree(metakey);
+}
+
+static int rocksKeyFormatMetaExists(rocks *rocks, int format, int dbid,
+        const char *key, size_t keylen) {
+    struct rocksKeyFormatMigration *m = &rocks->key_format_migration;
+    char *err = NULL, *metaval;
+    size_t metavlen;
+    sds metakey = encodeMetaKeyWithFormat(format,dbid,key,keylen);
+    metaval = rocksdb_get_cf(rocks->db,m->ropts,rocks->cf_handles[META_CF],
+            metakey,sdslen(metakey),&metavlen,&err);
+    sdsfree(metakey);
+    if (metaval) zlibc_free(metaval);
+    if (err) {
+        zlibc_free(err);
+        return 1;
+    }
+    return metaval != NULL;
+}
+
+/* Data/score keys left in source format after metas moved are orphans,
+ * which could only be reclaimed by compaction filter in target format. They
+ * are left untouched if meta of the same redis key exists in any format. */
+static int rocksKeyFormatMoveOrphan(rocks *rocks, rocksdb_writebatch_t *wb,
+        int cf, const char *rawkey, size_t klen, const char *rawval,
+        size_t vlen) {
+    struct rocksKeyFormatMigration *m = &rocks->key_format_migration;
+    int dbid;
+    const char *key;
+    size_t keylen;
+    uint64_t version;
+    sds newkey;
+
+    if (rocksDecodeDataKey(rawkey,klen,&dbid,&key,&keylen,&version,
+                NULL,NULL) ||
+            (newkey = rocksTranscodeKey(cf,rawkey,klen,
+                server.swap_key_format)) == NULL) {
+        rocksKeyFormatMigrationLogFailed(rocks,cf,rawkey,klen,"invalid key");
+        return -1;
+    }
+
+    if (rocksKeyFormatMetaExists(rocks,m->source,dbid,key,keylen) ||
+            rocksKeyFormatMetaExists(rocks,server.swap_key_format,dbid,key,keylen)) {
+        rocksKeyFormatMigrationLogFailed(rocks,cf,rawkey,klen,"meta not moved");
+        sdsfree(newkey);
+        return -1;
+    }
+
+    rocksdb_writebatch_put_cf(wb,rocks->cf_handles[cf],newkey,sdslen(newkey),
+            rawval,vlen);
+    rocksdb_writebatch_delete_cf(wb,rocks->cf_handles[cf],rawkey,klen);
+    atomicIncr(m->bytes_before,klen);
+    atomicIncr(m->bytes_after,sdslen(newkey));
+    sdsfree(newkey);
+    return 1;
+}
+
+/* Migrate one batch of keys in cf starting from cursor, returns 1 if source
+ * range exhausted, -1 on error. */
+static int rocksKeyFormatMigrateBatch(rocks *rocks, int cf, sds *cursor) {
+    struct rocksKeyFormatMigration *m = &rocks->key_format_migration;
+    int batch = 0, retval = 0;
+    char *err = NULL;
+    const char *lower, *upper;
+    size_t lower_len, upper_len, klen, vlen;
+    rocksdb_writebatch_t *wb = rocksdb_writebatch_create();
+    rocksdb_iterator_t *iter;
+
+    rocksKeyFormatRange(m->source,&lower,&lower_len,&upper,&upper_len);
+
+    rocksKeyFormatMigrationLock(rocks);
+    iter = rocksdb_create_iterator_cf(rocks->db,m->ropts,rocks->cf_handles[cf]);
+    for (rocksdb_iter_seek(iter,*cursor,sdslen(*cursor));
+            rocksdb_iter_valid(iter) && batch < ROCKS_KEY_FORMAT_MIGRATE_BATCH;
+            rocksdb_iter_next(iter), batch++) {
+        const char *rawkey = rocksdb_iter_key(iter,&klen);
+        const char *rawval = rocksdb_iter_value(iter,&vlen);
+        if (rocksKeyBeyond(rawkey,klen,upper,upper_len)) break;
+
+        if (cf == META_CF) {
+            atomicIncr(m->scanned,1);
+            rocksKeyFormatMoveKey(rocks,rawkey,klen);
+        } else {
+            rocksKeyFormatMoveOrphan(rocks,wb,cf,rawkey,klen,rawval,vlen);
+        }
+        /* resume from the next key, keys left untouched are skipped. */
+        *cursor = sdscpylen(*cursor,rawkey,klen);
+        *cursor = sdscatlen(*cursor,"\0",1);
+    }
+
+    if (!rocksdb_iter_valid(iter) ||
+            rocksKeyBeyond(rocksdb_iter_key(iter,&klen),klen,upper,upper_len)) {
+        retval = 1;
+    }
+    rocksdb_iter_get_error(iter,&err);
+    if (err == NULL) rocksdb_write(rocks->db,rocks->wopts,wb,&err);
+    rocksdb_iter_destroy(iter);
+    rocksKeyFormatMigrationUnlock(rocks);
+    rocksdb_writebatch_destroy(wb);
+
+    if (err != NULL) {
+        serverLog(LL_WARNING,"[ROCKS] key format migration %s failed: %s",
+                swap_cf_names[cf],err);
+        zlibc_free(err);
+        retval = -1;
+    }
+    return retval;
+}
+
+static void *rocksKeyFormatMigrationMain(void *arg) {
+    rocks *rocks = arg;
+    struct rocksKeyFormatMigration *m = &rocks->key_format_migration;
+    /* metas first, data/score keys left after that are orphans. */
+    int i, ret = 0, stop = 0, cfs[CF_COUNT] = {META_CF,DATA_CF,SCORE_CF};
+    const char *lower, *upper;
+    size_t lower_len, upper_len;
+    long long keys, failed;
+
+    redis_set_thread_title("rocks_migrate");
+    rocksKeyFormatRange(m->source,&lower,&lower_len,&upper,&upper_len);
+
+    for (i = 0; i < CF_COUNT && ret >= 0 && !stop; i++) {
+        sds cursor = sdsnewlen(lower,lower_len);
+        while ((ret = rocksKeyFormatMigrateBatch(rocks,cfs[i],&cursor)) == 0) {
+            atomicGet(m->stop,stop);
+            if (stop) break;
+        }
+        sdsfree(cursor);
+    }
+
+    atomicSet(m->time_ms,mstime()-m->start_time);
+    if (stop) return NULL;
+
+    atomicGet(m->keys,keys);
+    atomicGet(m->failed,failed);
+    if (ret < 0) {
+        /* migration stays running so that keys in source format are still
+         * visible, it will be resumed on next open. */
+        serverLog(LL_WARNING,
+                "[ROCKS] key format migration aborted: %lld keys moved, %lld keys left.",
+                keys,failed);
+    } else {
+        atomicSet(m->status,ROCKS_KEY_FORMAT_MIGRATION_DONE);
+        serverLog(LL_NOTICE,
+                "[ROCKS] migrated %lld keys to key format v%d (%lld keys left), took %lld ms.",
+                keys,server.swap_key_format+1,failed,mstime()-m->start_time);
+    }
+    return NULL;
+}
+
+static int rocksKeyFormatSourceExists(rocks *rocks) {
+    struct rocksKeyFormatMigration *m = &rocks->key_format_migration;
+    int i, exists = 0;
+    const char *lower, *upper;
+    size_t lower_len, upper_len, klen;
+
+    rocksKeyFormatRange(m->source,&lower,&lower_len,&upper,&upper_len);
+    for (i = 0; i < CF_COUNT && !exists; i++) {
+        rocksdb_iterator_t *iter = rocksdb_create_iterator_cf(rocks->db,
+                m->ropts,rocks->cf_handles[i]);
+        rocksdb_iter_seek(iter,lower,lower_len);
+        exists = rocksdb_iter_valid(iter) &&
+            !rocksKeyBeyond(rocksdb_iter_key(iter,&klen),klen,upper,upper_len);
+        rocksdb_iter_destroy(iter);
+    }
+    return exists;
+}
+
+int rocksKeyFormatMigrationStart(rocks *rocks) {
+    struct rocksKeyFormatMigration *m = &rocks->key_format_migration;
+    uint64_t estimated_keys = 0;
+    int error;
+
+    atomicSet(m->status,ROCKS_KEY_FORMAT_MIGRATION_NONE);
+    atomicSet(m->stop,0);
+    atomicSet(m->scanned,0);
+    atomicSet(m->keys,0);
+    atomicSet(m->failed,0);
+    atomicSet(m->bytes_before,0);
+    atomicSet(m->bytes_after,0);
+    atomicSet(m->time_ms,0);
+
+    if (server.dbnum > ROCKS_KEY_V2_MAX_DBNUM) return 0;
+
+    m->source = SWAP_KEY_FORMAT_OTHER(server.swap_key_format);
+    m->ropts = rocksdb_readoptions_create();
+    rocksdb_readoptions_set_verify_checksums(m->ropts,0);
+    rocksdb_readoptions_set_fill_cache(m->ropts,0);
+    rocksdb_readoptions_set_total_order_seek(m->ropts,1);
+
+    if (!rocksKeyFormatSourceExists(rocks)) return 0;
+
+    rocksdb_property_int_cf(rocks->db,rocks->cf_handles[META_CF],
+            "rocksdb.estimate-num-keys",&estimated_keys);
+    m->estimated_keys = estimated_keys;
+    m->start_time = mstime();
+    atomicSet(m->status,ROCKS_KEY_FORMAT_MIGRATION_RUNNING);
+
+    if ((error = pthread_create(&m->thread,NULL,rocksKeyFormatMigrationMain,rocks))) {
+        serverLog(LL_WARNING,"[ROCKS] create key format migration thread failed: %s.",
+                strerror(error));
+        atomicSet(m->status,ROCKS_KEY_FORMAT_MIGRATION_NONE);
+        m->thread = 0;
+        return -1;
+    }
+    serverLog(LL_NOTICE,"[ROCKS] key format migration to v%d started, about %lld keys.",
+            server.swap_key_format+1,m->estimated_keys);
+    return 0;
+}
+
+void rocksKeyFormatMigrationStop(rocks *rocks) {
+    struct rocksKeyFormatMigration *m = &rocks->key_format_migration;
+    if (m->thread) {
+        atomicSet(m->stop,1);
+        pthread_join(m->thread,NULL);
+        m->thread = 0;
+    }
+    atomicSet(m->status,ROCKS_KEY_FORMAT_MIGRATION_NONE);
+    if (m->ropts) {
+        rocksdb_readoptions_destroy(m->ropts);
+        m->ropts = NULL;
+    }
+}
+
 static int rocksOpen(rocks *rocks) {
     char *errs[3] = {NULL}, dir[ROCKS_DIR_MAX_LEN], *err = NULL, longlong_str[20];
     rocksdb_block_based_table_options_t *block_opts = NULL;
@@ -118,6 +592,13 @@ static int rocksOpen(rocks *rocks) {
     rocks->iter_ropts = rocksdb_readoptions_create();
     rocksdb_readoptions_set_verify_checksums(rocks->iter_ropts, 0);
     rocksdb_readoptions_set_fill_cache(rocks->iter_ropts, 1);
+    /* iterators may cross key versions, prefix bloom must be bypassed. */
+    rocksdb_readoptions_set_total_order_seek(rocks->iter_ropts, 1);
+
+    rocks->prefix_iter_ropts = rocksdb_readoptions_create();
+    rocksdb_readoptions_set_verify_checksums(rocks->prefix_iter_ropts, 0);
+    rocksdb_readoptions_set_fill_cache(rocks->prefix_iter_ropts, 1);
+    rocksdb_readoptions_set_prefix_same_as_start(rocks->prefix_iter_ropts, 1);
     
 
     rocks->wopts = rocksdb_writeoptions_create();
@@ -140,6 +621,8 @@ static int rocksOpen(rocks *rocks) {
     rocksdb_readoptions_set_verify_checksums(rocks->filter_meta_ropts, 0);
     rocksdb_readoptions_set_fill_cache(rocks->filter_meta_ropts, 0);
 
+    rocks->block_cache = rocksCreateBlockCache();
+
     /* data cf */
     rocks->cf_opts[DATA_CF] = rocksdb_options_create_copy(rocks->db_opts);
     rocks_init_option_compression(rocks->cf_opts[DATA_CF],server.rocksdb_data_compression);
@@ -170,13 +653,12 @@ static int rocksOpen(rocks *rocks) {
     rocksdb_block_based_options_set_block_size(block_opts, server.rocksdb_data_block_size);
     rocksdb_block_based_options_set_cache_index_and_filter_blocks(block_opts, server.rocksdb_data_cache_index_and_filter_blocks);
     rocksdb_block_based_options_set_filter_policy(block_opts, rocksdb_filterpolicy_create_bloom(10));
-    rocksdb_cache_t *data_cache = rocksdb_cache_create_lru(server.rocksdb_data_block_cache_size);
-    rocksdb_block_based_options_set_block_cache(block_opts, data_cache);
-    rocksdb_cache_destroy(data_cache);
+    rocksSetBlockCache(block_opts, rocks->block_cache, server.rocksdb_data_block_cache_high_priority);
     rocksdb_options_set_block_based_table_factory(rocks->cf_opts[DATA_CF], block_opts);
     rocksdb_block_based_options_destroy(block_opts);
 
     rocksdb_options_set_compaction_filter_factory(rocks->cf_opts[DATA_CF], createDataCfCompactionFilterFactory());
+    rocksSetDataKeyPrefixExtractor(rocks->cf_opts[DATA_CF]);
 
     /* score cf */
     rocks->cf_opts[SCORE_CF] = rocksdb_options_create_copy(rocks->db_opts);
@@ -208,13 +690,12 @@ static int rocksOpen(rocks *rocks) {
     rocksdb_block_based_options_set_block_size(block_opts, server.rocksdb_data_block_size);
     rocksdb_block_based_options_set_cache_index_and_filter_blocks(block_opts, server.rocksdb_data_cache_index_and_filter_blocks);
     rocksdb_block_based_options_set_filter_policy(block_opts, rocksdb_filterpolicy_create_bloom(10));
-    rocksdb_cache_t *score_cache = rocksdb_cache_create_lru(server.rocksdb_data_block_cache_size);
-    rocksdb_block_based_options_set_block_cache(block_opts, score_cache);
-    rocksdb_cache_destroy(score_cache);
+    rocksSetBlockCache(block_opts, rocks->block_cache, server.rocksdb_data_block_cache_high_priority);
     rocksdb_options_set_block_based_table_factory(rocks->cf_opts[SCORE_CF], block_opts);
     rocksdb_block_based_options_destroy(block_opts);
 
     rocksdb_options_set_compaction_filter_factory(rocks->cf_opts[SCORE_CF], createScoreCfCompactionFilterFactory());
+    rocksSetDataKeyPrefixExtractor(rocks->cf_opts[SCORE_CF]);
 
     /* meta cf */
     rocks->cf_opts[META_CF] = rocksdb_options_create_copy(rocks->db_opts);
@@ -246,9 +727,7 @@ static int rocksOpen(rocks *rocks) {
     rocksdb_block_based_options_set_block_size(block_opts, server.rocksdb_meta_block_size);
     rocksdb_block_based_options_set_cache_index_and_filter_blocks(block_opts, server.rocksdb_meta_cache_index_and_filter_blocks);
     rocksdb_block_based_options_set_filter_policy(block_opts, rocksdb_filterpolicy_create_bloom(10));
-    rocksdb_cache_t *meta_cache = rocksdb_cache_create_lru(server.rocksdb_meta_block_cache_size);
-    rocksdb_block_based_options_set_block_cache(block_opts, meta_cache);
-    rocksdb_cache_destroy(meta_cache);
+    rocksSetBlockCache(block_opts, rocks->block_cache, server.rocksdb_meta_block_cache_high_priority);
     rocksdb_options_set_block_based_table_factory(rocks->cf_opts[META_CF], block_opts);
     rocksdb_block_based_options_destroy(block_opts);
 
@@ -291,6 +770,8 @@ static int rocksOpen(rocks *rocks) {
         err = NULL;
     }
 
+    if (rocksKeyFormatMigrationStart(rocks)) return -1;
+
     return 0;
 }
 
@@ -302,6 +783,12 @@ int serverRocksInit() {
     rocks->snapshot = NULL;
     rocks->rocksdb_epoch = 0;
     atomicSetWithSync(server.rocksdb_inflight_snapshot, 0);
+    if (server.swap_key_format == SWAP_KEY_FORMAT_V2 &&
+            server.dbnum > ROCKS_KEY_V2_MAX_DBNUM) {
+        serverLog(LL_WARNING, "[ROCKS] swap-key-format v2 requires databases <= %d, fallback to v1.",
+                ROCKS_KEY_V2_MAX_DBNUM);
+        server.swap_key_format = SWAP_KEY_FORMAT_V1;
+    }
     struct stat statbuf;
     if (!stat(ROCKS_DATA, &statbuf) && S_ISDIR(statbuf.st_mode) && !server.swap_persist_enabled) {
         /* "data.rocks" folder already exists, remove it on start if persist not enabled. */
@@ -315,6 +802,7 @@ int serverRocksInit() {
         }
     }
     pthread_rwlock_init(rocks->rwlock,NULL);
+    pthread_mutex_init(&rocks->key_format_migration.lock,NULL);
     server.rocks = rocks;
     return rocksOpen(server.rocks);
 }
@@ -326,6 +814,8 @@ static void rocksClose(rocks *rocks) {
     snprintf(dir, ROCKS_DIR_MAX_LEN, "%s/%d", ROCKS_DATA, rocks->rocksdb_epoch);
     serverLog(LL_NOTICE, "[ROCKS] closing rocksdb(%s).",dir);
 
+    rocksKeyFormatMigrationStop(rocks);
+
     mstime_t start_time = mstime();
     rocksdb_cancel_all_background_work(rocks->db, 1);
     serverLog(LL_NOTICE, "[ROCKS] cancelled all background work, took %lld ms.",
@@ -351,8 +841,12 @@ static void rocksClose(rocks *rocks) {
     rocks->filter_meta_ropts = NULL;
     rocksdb_readoptions_destroy(rocks->iter_ropts);
     rocks->iter_ropts = NULL;
+    rocksdb_readoptions_destroy(rocks->prefix_iter_ropts);
+    rocks->prefix_iter_ropts = NULL;
     rocksdb_close(rocks->db);
     rocks->db = NULL;
+    rocksdb_cache_destroy(rocks->block_cache);
+    rocks->block_cache = NULL;
 }
 
 int rocksRestore(rocks *rocks, const char *checkpoint_dir) {
@@ -515,6 +1009,38 @@ int rmdirRecursive(const char *path) {
 	return r;
 }
 
+/* Keys not yet moved (or left) by key format migration are flushed too,
+ * migration lock prevents them from being moved back after flushed. */
+static int rocksFlushDBSourceFormat(rocks *rocks, int startdb, int enddb) {
+    struct rocksKeyFormatMigration *m = &rocks->key_format_migration;
+    int i, status, retval = 0;
+    char *err = NULL;
+    sds startkey, endkey;
+
+    atomicGet(m->status,status);
+    if (status == ROCKS_KEY_FORMAT_MIGRATION_NONE) return 0;
+
+    startkey = rocksEncodeDbRangeStartKeyWithFormat(m->source,startdb);
+    endkey = rocksEncodeDbRangeEndKeyWithFormat(m->source,enddb);
+    rocksKeyFormatMigrationLock(rocks);
+    for (i = 0; i < CF_COUNT; i++) {
+        rocksdb_delete_range_cf(rocks->db,rocks->wopts,rocks->cf_handles[i],
+                startkey,sdslen(startkey),endkey,sdslen(endkey),&err);
+        if (err != NULL) {
+            retval = -1;
+            serverLog(LL_WARNING,
+                    "[ROCKS] flush db(%d-%d) in key format v%d fail:%s",
+                    startdb,enddb,m->source+1,err);
+            zlibc_free(err);
+            err = NULL;
+        }
+    }
+    rocksKeyFormatMigrationUnlock(rocks);
+    sdsfree(startkey);
+    sdsfree(endkey);
+    return retval;
+}
+
 int rocksFlushDB(int dbid) {
     int startdb, enddb, retval = 0, i;
     sds startkey = NULL, endkey = NULL;
@@ -550,6 +1076,8 @@ int rocksFlushDB(int dbid) {
     if (startkey) sdsfree(startkey);
     if (endkey) sdsfree(endkey);
 
+    if (rocksFlushDBSourceFormat(server.rocks,startdb,enddb)) retval = -1;
+
     return retval;
 }
 
@@ -1210,6 +1738,40 @@ sds genSwapStorageInfoString(sds info) {
     return info;
 }
 
+static sds genRocksdbBlockCacheInfoString(sds info) {
+    size_t capacity = 0, usage = 0, pinned_usage = 0;
+
+    /* block cache is recreated & destroyed with rocks (e.g. restore),
+     * snapshot under rocks lock just like capacity updated. */
+    rocks *rocks = serverRocksGetReadLock();
+    if (rocks->block_cache) {
+        capacity = rocksdb_cache_get_capacity(rocks->block_cache);
+        usage = rocksdb_cache_get_usage(rocks->block_cache);
+        pinned_usage = rocksdb_cache_get_pinned_usage(rocks->block_cache);
+    }
+    serverRocksUnlock(rocks);
+    info = sdscatprintf(info,
+            "rocksdb_block_cache:type=%s,capacity=%lu,usage=%lu,pinned_usage=%lu\r\n",
+            server.rocksdb_block_cache_type == ROCKS_BLOCK_CACHE_HYPER_CLOCK ? "hyper_clock" : "lru",
+            capacity,usage,pinned_usage);
+
+    for (int cf = 0; cf < CF_COUNT; cf++) {
+        rocksCacheStat *stat = server.ror_stats->rocks_cache_stats+cf;
+        long long hit, block_read, read_bytes;
+        int high_priority = cf == META_CF ? server.rocksdb_meta_block_cache_high_priority :
+            server.rocksdb_data_block_cache_high_priority;
+        atomicGet(stat->hit,hit);
+        atomicGet(stat->block_read,block_read);
+        atomicGet(stat->read_bytes,read_bytes);
+        info = sdscatprintf(info,
+                "rocksdb_block_cache_%s:high_priority=%d,hit=%lld,block_read=%lld,hit_rate=%.2f%%,read_bytes=%lld\r\n",
+                stat->name,high_priority,hit,block_read,
+                hit+block_read > 0 ? (double)hit*100/(hit+block_read) : 0,read_bytes);
+    }
+
+    return info;
+}
+
 sds genRocksdbInfoString(sds info) {
 	size_t sequence = 0;
 	rocksdb_t *db = server.rocks->db;
@@ -1217,6 +1779,8 @@ sds genRocksdbInfoString(sds info) {
 	if (db) sequence = rocksdb_get_latest_sequence_number(db);
 	info = sdscatprintf(info,"rocksdb_sequence:%lu\r\n",sequence);
 
+    info = genRocksdbBlockCacheInfoString(info);
+
     char* rocksdb_stats = server.rocksdb_internal_stats? server.rocksdb_internal_stats->cfs[DATA_CF].rocksdb_stats_cache: NULL;
     info = compactLevelsInfo(info, rocksdb_stats);
     info = cumulativeInfo(info, rocksdb_stats);
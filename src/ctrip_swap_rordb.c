@@ -372,6 +372,7 @@ static cuckooFilter *rordbLoadCuckooFilter(rio *rdb) {
     cuckoo_filter->hash_fn = cuckooGenHashFunction;
     if ((cuckoo_filter->bits_per_tag = rdbLoadLen(rdb,NULL)) == -1) goto err;
     if ((len = rdbLoadLen(rdb,NULL)) == RDB_LENERR) goto err;
+    if (len == 0 || len > CUCKOO_FILTER_MAX_GROWN_TABLES) goto err;
     cuckoo_filter->ntables = len;
     cuckoo_filter->tables = zcalloc(cuckoo_filter->ntables*sizeof(cuckooTable));
 
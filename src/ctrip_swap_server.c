@@ -52,6 +52,10 @@ void swapInitServerConfig(void) {
     /* Swap batch limits presets. */
     for (int j = 0; j < SWAP_TYPES; j++)
         server.swap_batch_limits[j] = swapBatchLimitsDefaults[j];
+
+    /* Swap priority weights presets. */
+    for (int j = 0; j < SWAP_PRIORITY_TYPES; j++)
+        server.swap_priority_weights[j] = swapPriorityWeightsDefaults[j];
 }
 
 void ctrip_ignoreAcceptEvent() {
@@ -144,6 +148,15 @@ void swapInit() {
         server.swap_load_clients[i] = c;
     }
 
+    server.swap_prefetch_clients = zmalloc(server.dbnum*sizeof(client*));
+    for (i = 0; i < server.dbnum; i++) {
+        client *c = createClient(NULL);
+        c->cmd = lookupCommandByCString("SWAP.LOAD");
+        c->db = server.db+i;
+        c->swap_lock_mode = SWAP_LOCK_SHARED;
+        server.swap_prefetch_clients[i] = c;
+    }
+
     server.swap_expire_clients = zmalloc(server.dbnum*sizeof(client*));
     for (i = 0; i < server.dbnum; i++) {
         client *c = createClient(NULL);
@@ -224,6 +237,9 @@ void swapInitServer(void) {
     server.swap_error_count = 0;
     server.swap_load_paused = 0;
     server.swap_load_err_cnt = 0;
+    server.swap_prefetch_inprogress_count = 0;
+    server.stat_swap_prefetch_cmds = 0;
+    server.stat_swap_prefetch_keys = 0;
     server.swap_rocksdb_stats_collect_interval_ms = 2000;
     server.swap_txid = 0;
     server.swap_rewind_type = SWAP_REWIND_OFF;
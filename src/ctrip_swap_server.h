@@ -90,7 +90,8 @@ typedef void (*dataSwapFinishedCallback)(void *ctx, int action, char *rawkey, ch
     struct metaScanResult *swap_metas;  \
     int swap_errcode; \
     struct argRewrites *swap_arg_rewrites;  \
-    int rate_limit_event_id; /* add time event when rate limit */
+    int rate_limit_event_id; /* add time event when rate limit */ \
+    int swap_prefetch_ahead; /* # of querybuf commands already looked ahead. */
 
 #define SWAP_TYPES_FORWARD 5
 typedef struct swapBatchLimitsConfig {
@@ -98,6 +99,11 @@ typedef struct swapBatchLimitsConfig {
     unsigned long long mem;
 } swapBatchLimitsConfig;
 
+#define SWAP_PRIORITY_TYPES_FORWARD 6
+typedef struct swapPriorityWeightsConfig {
+    int weight;
+} swapPriorityWeightsConfig;
+
 #define SWAP_REDIS_SERVER_ \
     list *clients_to_free;      /* Clients to close when swaps finished. */ \
     int swap_slow_expire_effort;    /* From -10 to 10, default -5, swap slow expire effort */ \
@@ -133,8 +139,12 @@ typedef struct swapBatchLimitsConfig {
     int swap_threads_auto_scale_up_threshold; /* when the number of requests exceeds a certain threshold, a new thread is created */ \
     int swap_threads_auto_scale_down_idle_seconds; \
     struct swapThread *swap_threads; \
+    int swap_threads_work_stealing; \
+    long long swap_threads_steal_epoch; /* bumped before each steal. */ \
     /* async */ \
     struct asyncCompleteQueue *swap_CQ;  \
+    int swap_complete_queue_drain_max_batches; \
+    int swap_complete_queue_drain_max_us; \
     /* parallel sync */ \
     struct parallelSync *swap_parallel_sync; \
     unsigned long long rocksdb_disk_used; /* rocksd disk usage bytes, updated every 1 minute. */  \
@@ -144,6 +154,7 @@ typedef struct swapBatchLimitsConfig {
     client **swap_scan_expire_clients; /* array of expire scan clients (one for each db). */ \
     client **swap_ttl_clients; /* array of expire scan clients (one for each db). */ \
     client **swap_load_clients;  \
+    client **swap_prefetch_clients; /* array of lookahead prefetch clients (one for each db). */ \
     client *swap_mutex_client; /* exec op needed global swap lock */ \
     struct rorStat *ror_stats;  \
     struct swapHitStat *swap_hit_stats; \
@@ -191,6 +202,7 @@ typedef struct swapBatchLimitsConfig {
     list *swap_rewinding_clients; \
     uint64_t swap_key_version; \
     size_t swap_bitmap_subkey_size; \
+    size_t swap_string_chunked_threshold; \
     redisAtomic unsigned long long swap_bitmap_switched_to_string_count; \
     redisAtomic unsigned long long swap_string_switched_to_bitmap_count; \
     int swap_rdb_bitmap_encode_enabled; \
@@ -199,10 +211,22 @@ typedef struct swapBatchLimitsConfig {
     int swap_evict_inprogress_limit;  \
     int swap_evict_inprogress_growth_rate;  \
     int swap_evict_loop_check_interval; \
+    int swap_evict_cost_aware; \
+    int swap_evict_subkey_hotness; \
+    int swap_swapin_admission; \
+    int swap_swapin_admission_min_freq; \
+    int swap_evict_watermark_low; \
+    int swap_evict_watermark_high; \
+    int swap_pre_evict_period_ms; \
     struct swapEvictionCtx *swap_eviction_ctx;  \
     int swap_load_inprogress_count; \
     int swap_load_paused; \
     size_t swap_load_err_cnt; \
+    int swap_prefetch_lookahead; \
+    int swap_prefetch_lookahead_bytes; \
+    int swap_prefetch_inprogress_count; \
+    long long stat_swap_prefetch_cmds; \
+    long long stat_swap_prefetch_keys; \
     /* swap scan session */ \
     struct swapScanSessions *swap_scan_sessions;  \
     int swap_scan_session_bits; \
@@ -210,6 +234,12 @@ typedef struct swapBatchLimitsConfig {
     /* rocksdb configs */ \
     unsigned long long rocksdb_meta_block_cache_size; \
     unsigned long long rocksdb_data_block_cache_size; \
+    unsigned long long rocksdb_shared_block_cache_size; /* shared by all cfs, 0 means sum of cf block cache size. */ \
+    int rocksdb_block_cache_type; \
+    int rocksdb_block_cache_high_pri_pool_percent; \
+    int rocksdb_data_block_cache_high_priority; \
+    int rocksdb_data_prefix_bloom; \
+    int rocksdb_meta_block_cache_high_priority; \
     int rocksdb_max_open_files; \
     int rocksdb_WAL_ttl_seconds;  \
     int rocksdb_WAL_size_limit_MB;  \
@@ -266,6 +296,8 @@ typedef struct swapBatchLimitsConfig {
     int rocksdb_data_level0_file_num_compaction_trigger; \
     int rocksdb_meta_level0_file_num_compaction_trigger; \
     int rocksdb_read_enable_async_io; \
+    int swap_rio_pinned_get; /* multiget into pinned slices to skip one value copy. */ \
+    int swap_rio_batch_iterate; /* iterate batched ranges with shared iterator. */ \
     /* swap block*/ \
     struct swapUnblockCtx* swap_dependency_block_ctx; \
     /* absent cache */ \
@@ -275,10 +307,14 @@ typedef struct swapBatchLimitsConfig {
     /* cuckoo filter */ \
     int swap_cuckoo_filter_enabled; \
     int swap_cuckoo_filter_bit_type; \
+    int swap_key_format; \
+    int swap_native_value_encoding; \
     unsigned long long swap_cuckoo_filter_estimated_keys; \
     /* swap batch */ \
     struct swapBatchCtx *swap_batch_ctx; \
     swapBatchLimitsConfig swap_batch_limits[SWAP_TYPES_FORWARD]; \
+    int swap_batch_adaptive; \
+    int swap_batch_latency_slo_us; \
     /* swap ratelimit */ \
     int swap_ratelimit_maxmemory_percentage; \
     int swap_ratelimit_maxmemory_pause_growth_rate; \
@@ -288,6 +324,12 @@ typedef struct swapBatchLimitsConfig {
     long long stat_swap_ratelimit_rejected_cmd_count; \
     unsigned long long swap_compaction_filter_disable_until; \
     int swap_compaction_filter_skip_level; \
+    int swap_compaction_filter_scan_meta; \
+    int swap_dispatch_policy; \
+    int swap_lock_read_shared; \
+    int swap_lock_subkey_enabled; \
+    swapPriorityWeightsConfig swap_priority_weights[SWAP_PRIORITY_TYPES_FORWARD]; \
+    int swap_priority_starvation_ms; \
     int swap_dirty_subkeys_enabled; \
     /* swap persist */ \
     int swap_persist_enabled; \
@@ -40,9 +40,9 @@ static void createFakeSetForDeleteIfCold(swapData *data) {
 
 /* return 1 if noswap needed */
 static int setSwapAnaOutSelectSubkeys(swapData *data, setDataCtx *datactx,
-        int *may_keep_data) {
-    int select_type, noswap;
-    size_t count;
+        uint32_t cmd_intention_flags, int *may_keep_data) {
+    int select_type, noswap, hotness;
+    size_t count, skipped = 0;
     robj *subkeys;
     unsigned long long evict_memory = 0;
 
@@ -81,6 +81,8 @@ static int setSwapAnaOutSelectSubkeys(swapData *data, setDataCtx *datactx,
     *may_keep_data = 1;
     if (select_type == SELECT_MAIN) {
         sds vstr;
+        hotness = swapSubkeyHotnessApplicable(cmd_intention_flags,
+                setTypeSize(subkeys));
         setTypeIterator *si = setTypeInitIterator(subkeys);
         while (NULL != (vstr = setTypeNextObject(si))) {
             size_t vlen = sdslen(vstr);
@@ -94,11 +96,20 @@ static int setSwapAnaOutSelectSubkeys(swapData *data, setDataCtx *datactx,
                 break;
             }
 
+            /* Keep hot subkeys (no more than a step) in memory. */
+            if (hotness && skipped < count &&
+                    swapSubkeyHotnessEvictSkip(data->key,vstr)) {
+                sdsfree(vstr);
+                skipped++;
+                continue;
+            }
+
             subkey = createObject(OBJ_STRING, vstr);
             evict_memory += vlen;
             datactx->ctx.sub.subkeys[datactx->ctx.sub.num++] = subkey;
         }
         setTypeReleaseIterator(si);
+        if (skipped && !noswap) *may_keep_data = 0;
     } else {
         robj *subkey;
         size_t sublen;
@@ -256,7 +267,8 @@ int setSwapAna(swapData *data, int thd, struct keyRequest *req,
                 /* may_keep_data is true if we could keep data in memory and clear dirty
                  * after persisting data to rocksdb. */
                 int may_keep_data;
-                int noswap = setSwapAnaOutSelectSubkeys(data,datactx,&may_keep_data);
+                int noswap = setSwapAnaOutSelectSubkeys(data,datactx,
+                        cmd_intention_flags,&may_keep_data);
 
                 int keep_data = swapDataPersistKeepData(data,cmd_intention_flags,may_keep_data);
 
@@ -74,10 +74,37 @@ void initStatsSwap() {
         server.ror_stats->compaction_filter_stats[i].filt_count = 0;
         server.ror_stats->compaction_filter_stats[i].scan_count = 0;
         server.ror_stats->compaction_filter_stats[i].rio_count = 0;
+        server.ror_stats->compaction_filter_stats[i].seek_count = 0;
+        server.ror_stats->compaction_filter_stats[i].next_count = 0;
         server.ror_stats->compaction_filter_stats[i].stats_metric_idx_filt = metric_offset+COMPACTION_FILTER_METRIC_FILT;
         server.ror_stats->compaction_filter_stats[i].stats_metric_idx_scan = metric_offset+COMPACTION_FILTER_METRIC_SCAN;
         server.ror_stats->compaction_filter_stats[i].stats_metric_idx_rio = metric_offset+COMPACTION_FILTER_METRIC_RIO;
     }
+    server.ror_stats->rio_pinned_get_stats.batch = 0;
+    server.ror_stats->rio_pinned_get_stats.count = 0;
+    server.ror_stats->rio_pinned_get_stats.memory = 0;
+    server.ror_stats->rio_iterate_stats.batch = 0;
+    server.ror_stats->rio_iterate_stats.ranges = 0;
+    server.ror_stats->rio_iterate_stats.iterators = 0;
+    server.ror_stats->rio_iterate_stats.seeks = 0;
+    server.ror_stats->key_format_stats.keys = 0;
+    server.ror_stats->key_format_stats.bytes = 0;
+    server.ror_stats->key_format_stats.v1_bytes = 0;
+    server.ror_stats->dispatch_stats.affinity_batches = 0;
+    server.ror_stats->dispatch_stats.affinity_splits = 0;
+    server.ror_stats->dispatch_stats.affinity_overflows = 0;
+    for (i = 0; i < SWAP_PRIORITY_TYPES; i++) {
+        server.ror_stats->priority_stats[i].batches = 0;
+        server.ror_stats->priority_stats[i].wait_us = 0;
+        server.ror_stats->priority_stats[i].starved = 0;
+    }
+    server.ror_stats->rocks_cache_stats = zmalloc(sizeof(rocksCacheStat) * CF_COUNT);
+    for (i = 0; i < CF_COUNT; i++) {
+        server.ror_stats->rocks_cache_stats[i].name = swap_cf_names[i];
+        server.ror_stats->rocks_cache_stats[i].hit = 0;
+        server.ror_stats->rocks_cache_stats[i].block_read = 0;
+        server.ror_stats->rocks_cache_stats[i].read_bytes = 0;
+    }
     server.swap_debug_info = zmalloc(SWAP_DEBUG_INFO_TYPE*sizeof(swapDebugInfo));
     for (i = 0; i < SWAP_DEBUG_INFO_TYPE; i++) {
         metric_offset = SWAP_DEBUG_STATS_METRIC_OFFSET + i*SWAP_DEBUG_SIZE;
@@ -378,13 +405,18 @@ sds genSwapExecInfoString(sds info) {
             "swap_inprogress_memory:%ld\r\n"
             "swap_inprogress_load_count:%d\r\n"
             "swap_load_paused:%d\r\n"
-            "swap_load_error_count:%lu\r\n",
+            "swap_load_error_count:%lu\r\n"
+            "swap_prefetch:lookahead=%d,inprogress=%d,commands=%lld,keys=%lld\r\n",
             server.swap_inprogress_batch,
             server.swap_inprogress_count,
             server.swap_inprogress_memory,
             server.swap_load_inprogress_count,
             server.swap_load_paused,
-            server.swap_load_err_cnt);
+            server.swap_load_err_cnt,
+            server.swap_prefetch_lookahead,
+            server.swap_prefetch_inprogress_count,
+            server.stat_swap_prefetch_cmds,
+            server.stat_swap_prefetch_keys);
 
     for (j = 1; j < SWAP_TYPES; j++) {
         swapStat *s = &server.ror_stats->swap_stats[j];
@@ -418,17 +450,67 @@ sds genSwapExecInfoString(sds info) {
                 ops > 0 ? total_latency/ops : 0);
     }
 
+    rioPinnedStat *ps = &server.ror_stats->rio_pinned_get_stats;
+    long long pinned_batch, pinned_count, pinned_memory;
+    atomicGet(ps->batch,pinned_batch);
+    atomicGet(ps->count,pinned_count);
+    atomicGet(ps->memory,pinned_memory);
+    info = sdscatprintf(info,
+            "swap_rio_pinned_get:enabled=%d,batch=%lld,count=%lld,memory=%lld\r\n",
+            server.swap_rio_pinned_get,pinned_batch,pinned_count,pinned_memory);
+
+    rioIterateStat *is = &server.ror_stats->rio_iterate_stats;
+    long long iter_batch, iter_ranges, iter_iterators, iter_seeks;
+    atomicGet(is->batch,iter_batch);
+    atomicGet(is->ranges,iter_ranges);
+    atomicGet(is->iterators,iter_iterators);
+    atomicGet(is->seeks,iter_seeks);
+    info = sdscatprintf(info,
+            "swap_rio_iterate:batch_enabled=%d,batch=%lld,ranges=%lld,iterators=%lld,seeks=%lld,iterators_per_batch=%.2f\r\n",
+            server.swap_rio_batch_iterate,iter_batch,iter_ranges,iter_iterators,iter_seeks,
+            iter_batch > 0 ? (double)iter_iterators/iter_batch : 0);
+
+    keyFormatStat *ks = &server.ror_stats->key_format_stats;
+    struct rocksKeyFormatMigration *km = &server.rocks->key_format_migration;
+    long long kf_keys, kf_bytes, kf_v1_bytes, km_scanned, km_keys, km_left,
+         km_bytes_before, km_bytes_after, km_time_ms;
+    int km_status = rocksKeyFormatMigrationStatus(server.rocks);
+    atomicGet(ks->keys,kf_keys);
+    atomicGet(ks->bytes,kf_bytes);
+    atomicGet(ks->v1_bytes,kf_v1_bytes);
+    atomicGet(km->scanned,km_scanned);
+    atomicGet(km->keys,km_keys);
+    atomicGet(km->failed,km_left);
+    atomicGet(km->bytes_before,km_bytes_before);
+    atomicGet(km->bytes_after,km_bytes_after);
+    atomicGet(km->time_ms,km_time_ms);
+    if (km_status == ROCKS_KEY_FORMAT_MIGRATION_RUNNING)
+        km_time_ms = mstime() - km->start_time;
+    info = sdscatprintf(info,
+            "swap_key_format:format=v%d,keys=%lld,key_bytes_per_subkey=%.2f,v1_key_bytes_per_subkey=%.2f,migrate_status=%s,migrate_progress=%.2f,migrated_keys=%lld,migrate_left_keys=%lld,migrated_bytes_before=%lld,migrated_bytes_after=%lld,migrate_time_ms=%lld\r\n",
+            server.swap_key_format+1,kf_keys,
+            kf_keys > 0 ? (double)kf_bytes/kf_keys : 0,
+            kf_keys > 0 ? (double)kf_v1_bytes/kf_keys : 0,
+            rocksKeyFormatMigrationStatusName(km_status),
+            km_status == ROCKS_KEY_FORMAT_MIGRATION_DONE ? 100.0 :
+            km->estimated_keys > 0 ? MIN(100.0,(double)km_scanned*100/km->estimated_keys) : 0,
+            km_keys,km_left,km_bytes_before,km_bytes_after,km_time_ms);
+
     for (j = 0; j < CF_COUNT; j++) {
         compactionFilterStat *cfs = &server.ror_stats->compaction_filter_stats[j];
-        long long filt_count, scan_count, rio_count;
+        long long filt_count, scan_count, rio_count, seek_count, next_count;
         atomicGet(cfs->filt_count,filt_count);
         atomicGet(cfs->scan_count,scan_count);
         atomicGet(cfs->rio_count,rio_count);
-        info = sdscatprintf(info,"swap_compaction_filter_%s:filt_count=%lld,scan_count=%lld,rio_count=%lld,filt_ps=%lld,scan_ps=%lld,rio_ps=%lld\r\n",
+        atomicGet(cfs->seek_count,seek_count);
+        atomicGet(cfs->next_count,next_count);
+        info = sdscatprintf(info,"swap_compaction_filter_%s:filt_count=%lld,scan_count=%lld,rio_count=%lld,filt_ps=%lld,scan_ps=%lld,rio_ps=%lld,seek_count=%lld,next_count=%lld,meta_reads_per_key=%.4f\r\n",
                 cfs->name,filt_count,scan_count,rio_count,
                 getInstantaneousMetric(cfs->stats_metric_idx_filt),
                 getInstantaneousMetric(cfs->stats_metric_idx_scan),
-                getInstantaneousMetric(cfs->stats_metric_idx_rio));
+                getInstantaneousMetric(cfs->stats_metric_idx_rio),
+                seek_count,next_count,
+                scan_count > 0 ? (double)(rio_count+seek_count)/scan_count : 0);
     }
     if (server.swap_debug_trace_latency) {
         swapDebugInfo *d;
@@ -476,6 +558,31 @@ void resetStatsSwap() {
         server.ror_stats->compaction_filter_stats[i].filt_count = 0;
         server.ror_stats->compaction_filter_stats[i].scan_count = 0;
         server.ror_stats->compaction_filter_stats[i].rio_count = 0;
+        server.ror_stats->compaction_filter_stats[i].seek_count = 0;
+        server.ror_stats->compaction_filter_stats[i].next_count = 0;
+    }
+    server.ror_stats->rio_pinned_get_stats.batch = 0;
+    server.ror_stats->rio_pinned_get_stats.count = 0;
+    server.ror_stats->rio_pinned_get_stats.memory = 0;
+    server.ror_stats->rio_iterate_stats.batch = 0;
+    server.ror_stats->rio_iterate_stats.ranges = 0;
+    server.ror_stats->rio_iterate_stats.iterators = 0;
+    server.ror_stats->rio_iterate_stats.seeks = 0;
+    server.ror_stats->key_format_stats.keys = 0;
+    server.ror_stats->key_format_stats.bytes = 0;
+    server.ror_stats->key_format_stats.v1_bytes = 0;
+    server.ror_stats->dispatch_stats.affinity_batches = 0;
+    server.ror_stats->dispatch_stats.affinity_splits = 0;
+    server.ror_stats->dispatch_stats.affinity_overflows = 0;
+    for (i = 0; i < SWAP_PRIORITY_TYPES; i++) {
+        server.ror_stats->priority_stats[i].batches = 0;
+        server.ror_stats->priority_stats[i].wait_us = 0;
+        server.ror_stats->priority_stats[i].starved = 0;
+    }
+    for (i = 0; i < CF_COUNT; i++) {
+        server.ror_stats->rocks_cache_stats[i].hit = 0;
+        server.ror_stats->rocks_cache_stats[i].block_read = 0;
+        server.ror_stats->rocks_cache_stats[i].read_bytes = 0;
     }
     resetSwapLockInstantaneousMetrics();
     resetSwapBatchInstantaneousMetrics();
@@ -488,23 +595,29 @@ void resetSwapHitStat() {
     atomicSet(server.swap_hit_stats->stat_swapin_not_found_coldfilter_absentcache_filt_count,0);
     atomicSet(server.swap_hit_stats->stat_swapin_not_found_coldfilter_miss_count,0);
     atomicSet(server.swap_hit_stats->stat_swapin_no_io_count,0);
+    atomicSet(server.swap_hit_stats->stat_swapin_coalesced_count,0);
     atomicSet(server.swap_hit_stats->stat_swapin_data_not_found_count,0);
+    atomicSet(server.swap_hit_stats->stat_swapin_admission_hit_count,0);
+    atomicSet(server.swap_hit_stats->stat_swapin_admission_miss_count,0);
     atomicSet(server.swap_hit_stats->stat_absent_subkey_query_count,0);
     atomicSet(server.swap_hit_stats->stat_absent_subkey_filt_count,0);
 }
 
 sds genSwapHitInfoString(sds info) {
     double memory_hit_perc = 0, keyspace_hit_perc = 0, notfound_coldfilter_filt_perc = 0;
-    long long attempt, noio, notfound_coldfilter_miss, notfound_absentcache_filt,
+    long long attempt, noio, coalesced, notfound_coldfilter_miss, notfound_absentcache_filt,
          notfound_cuckoofilter_filt, notfound, data_notfound,
-         absent_subkey_query, absent_subkey_filt;
+         absent_subkey_query, absent_subkey_filt, admission_hit, admission_miss;
 
     atomicGet(server.swap_hit_stats->stat_swapin_attempt_count,attempt);
     atomicGet(server.swap_hit_stats->stat_swapin_no_io_count,noio);
+    atomicGet(server.swap_hit_stats->stat_swapin_coalesced_count,coalesced);
     atomicGet(server.swap_hit_stats->stat_swapin_not_found_coldfilter_miss_count,notfound_coldfilter_miss);
     atomicGet(server.swap_hit_stats->stat_swapin_not_found_coldfilter_cuckoofilter_filt_count,notfound_cuckoofilter_filt);
     atomicGet(server.swap_hit_stats->stat_swapin_not_found_coldfilter_absentcache_filt_count,notfound_absentcache_filt);
     atomicGet(server.swap_hit_stats->stat_swapin_data_not_found_count,data_notfound);
+    atomicGet(server.swap_hit_stats->stat_swapin_admission_hit_count,admission_hit);
+    atomicGet(server.swap_hit_stats->stat_swapin_admission_miss_count,admission_miss);
     atomicGet(server.swap_hit_stats->stat_absent_subkey_query_count,absent_subkey_query);
     atomicGet(server.swap_hit_stats->stat_absent_subkey_filt_count,absent_subkey_filt);
 
@@ -522,6 +635,7 @@ sds genSwapHitInfoString(sds info) {
             "swap_swapin_attempt_count:%lld\r\n"
             "swap_swapin_not_found_count:%lld\r\n"
             "swap_swapin_no_io_count:%lld\r\n"
+            "swap_swapin_coalesced_count:%lld\r\n"
             "swap_swapin_memory_hit_perc:%.2f%%\r\n"
             "swap_swapin_keyspace_hit_perc:%.2f%%\r\n"
             "swap_swapin_not_found_coldfilter_cuckoofilter_filt_count:%lld\r\n"
@@ -529,12 +643,15 @@ sds genSwapHitInfoString(sds info) {
             "swap_swapin_not_found_coldfilter_miss:%lld\r\n"
             "swap_swapin_not_found_coldfilter_filt_perc:%.2f%%\r\n"
             "swap_swapin_data_not_found_count:%lld\r\n"
+            "swap_swapin_admission_hit_count:%lld\r\n"
+            "swap_swapin_admission_miss_count:%lld\r\n"
             "swap_absent_subkey_query_count:%lld\r\n"
             "swap_absent_subkey_filt_count:%lld\r\n",
-            attempt,notfound,noio,memory_hit_perc,keyspace_hit_perc,
+            attempt,notfound,noio,coalesced,memory_hit_perc,keyspace_hit_perc,
             notfound_cuckoofilter_filt, notfound_absentcache_filt,
             notfound_coldfilter_miss, notfound_coldfilter_filt_perc,
-            data_notfound,absent_subkey_query,absent_subkey_filt);
+            data_notfound,admission_hit,admission_miss,
+            absent_subkey_query,absent_subkey_filt);
 
     return info;
 }
@@ -162,7 +162,7 @@ static sds wholeKeyEncodeDataKey(swapData *data) {
 }
 
 static sds wholeKeyEncodeDataVal(swapData *data) {
-    return data->value ? rocksEncodeValRdb(data->value) : NULL;
+    return data->value ? rocksEncodeVal(data->value) : NULL;
 }
 
 int wholeKeyEncodeData(swapData *data, int intention, void *datactx,
@@ -190,7 +190,7 @@ int wholeKeyDecodeData(swapData *data, int num, int *cfs, sds *rawkeys,
     UNUSED(rawkeys);
     UNUSED(cfs);
     sds rawval = rawvals[0];
-    *pdecoded = rocksDecodeValRdb(rawval);
+    *pdecoded = rocksDecodeVal(rawval);
     return 0;
 }
 
@@ -276,12 +276,34 @@ static void tryTransStringToBitmap(redisDb *db, robj *key) {
     }
 }
 
+int stringChunkedEnabled(void) {
+    return server.swap_string_chunked_threshold > 0 &&
+        server.swap_bitmap_subkeys_enabled;
+}
+
+/* Big strings are chunked the same way as bitmap, so that range commands
+ * only swap in chunks affected. */
+int stringIsChunked(robj *o) {
+    return stringChunkedEnabled() && o != NULL && o->type == OBJ_STRING && sdsEncodedObject(o) &&
+        sdslen(o->ptr) >= server.swap_string_chunked_threshold;
+}
+
+/* Called before evicting a hot key (not locked by others): dirty big strings
+ * are written as chunks. */
+void tryTransStringToChunked(redisDb *db, robj *key, robj *o) {
+    if (objectIsDirty(o) && stringIsChunked(o))
+        tryTransStringToBitmap(db,key);
+}
+
 int wholeKeyBeforeCall(swapData *data, keyRequest *key_request,
         client *c, void *datactx)  {
     UNUSED(data), UNUSED(c), UNUSED(datactx);
     robj *o = lookupKey(data->db, data->key, LOOKUP_NOTOUCH);
     if ((key_request->cmd_flags & CMD_SWAP_DATATYPE_BITMAP) && o) {
-        tryTransStringToBitmap(data->db,data->key);
+        /* string range commands only chunk big strings. */
+        if (!(key_request->cmd_flags & CMD_SWAP_DATATYPE_STRING) ||
+                stringIsChunked(o))
+            tryTransStringToBitmap(data->db,data->key);
     }
     return 0;
 }
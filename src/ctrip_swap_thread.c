@@ -26,61 +26,346 @@
  */
 
 #include "ctrip_swap.h"
+#include <sys/eventfd.h>
 
 
 
+swapRingQueue *swapRingQueueNew(size_t capacity) {
+    size_t i, size = 1;
+    swapRingQueue *q = zcalloc(sizeof(swapRingQueue));
+    while (size < capacity) size <<= 1;
+    q->cells = zmalloc(sizeof(swapRingQueueCell)*size);
+    for (i = 0; i < size; i++) {
+        q->cells[i].seq = i;
+        q->cells[i].data = NULL;
+    }
+    q->mask = size-1;
+    pthread_mutex_init(&q->overflow_lock,NULL);
+    q->overflow = listCreate();
+    return q;
+}
+
+void swapRingQueueFree(swapRingQueue *q) {
+    if (q == NULL) return;
+    zfree(q->cells);
+    pthread_mutex_destroy(&q->overflow_lock);
+    listRelease(q->overflow);
+    zfree(q);
+}
+
+static int swapRingQueueTryPush(swapRingQueue *q, void *data) {
+    swapRingQueueCell *cell;
+    size_t seq, pos = __atomic_load_n(&q->head,__ATOMIC_RELAXED);
+
+    while (1) {
+        cell = q->cells + (pos & q->mask);
+        seq = __atomic_load_n(&cell->seq,__ATOMIC_ACQUIRE);
+        if (seq == pos) {
+            if (__atomic_compare_exchange_n(&q->head,&pos,pos+1,1,
+                        __ATOMIC_SEQ_CST,__ATOMIC_RELAXED))
+                break;
+        } else if ((intptr_t)(seq - pos) < 0) {
+            return 0; /* full */
+        } else {
+            pos = __atomic_load_n(&q->head,__ATOMIC_RELAXED);
+        }
+    }
+
+    cell->data = data;
+    __atomic_store_n(&cell->seq,pos+1,__ATOMIC_RELEASE);
+    return 1;
+}
+
+void swapRingQueuePush(swapRingQueue *q, void *data) {
+    /* keep fifo: once spilled, push to overflow until it's drained. */
+    if (__atomic_load_n(&q->overflow_len,__ATOMIC_SEQ_CST) == 0 &&
+            swapRingQueueTryPush(q,data))
+        return;
+
+    pthread_mutex_lock(&q->overflow_lock);
+    listAddNodeTail(q->overflow,data);
+    __atomic_add_fetch(&q->overflow_len,1,__ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&q->overflow_lock);
+    atomicIncr(q->overflows,1);
+}
+
+/* Owner thread pops and idle threads steal concurrently, returns NULL if
+ * empty or the next cell not published yet (check swapRingQueueDepth to tell). */
+void *swapRingQueuePop(swapRingQueue *q) {
+    void *data = NULL;
+    size_t seq, pos = __atomic_load_n(&q->tail,__ATOMIC_SEQ_CST);
+    swapRingQueueCell *cell;
+    listNode *ln;
+
+    while (1) {
+        cell = q->cells + (pos & q->mask);
+        seq = __atomic_load_n(&cell->seq,__ATOMIC_ACQUIRE);
+        if (seq == pos+1) {
+            if (__atomic_compare_exchange_n(&q->tail,&pos,pos+1,1,
+                        __ATOMIC_SEQ_CST,__ATOMIC_RELAXED)) {
+                data = cell->data;
+                __atomic_store_n(&cell->seq,pos+q->mask+1,__ATOMIC_RELEASE);
+                return data;
+            }
+        } else if ((intptr_t)(seq - (pos+1)) < 0) {
+            break; /* empty or not published yet */
+        } else {
+            pos = __atomic_load_n(&q->tail,__ATOMIC_SEQ_CST);
+        }
+    }
+
+    if (__atomic_load_n(&q->overflow_len,__ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&q->overflow_lock);
+        if ((ln = listFirst(q->overflow))) {
+            data = listNodeValue(ln);
+            listDelNode(q->overflow,ln);
+            __atomic_sub_fetch(&q->overflow_len,1,__ATOMIC_SEQ_CST);
+        }
+        pthread_mutex_unlock(&q->overflow_lock);
+    }
+
+    return data;
+}
+
+size_t swapRingQueueDepth(swapRingQueue *q) {
+    size_t tail = __atomic_load_n(&q->tail,__ATOMIC_SEQ_CST);
+    size_t head = __atomic_load_n(&q->head,__ATOMIC_SEQ_CST);
+    size_t depth = head > tail ? head - tail : 0;
+    return depth + __atomic_load_n(&q->overflow_len,__ATOMIC_SEQ_CST);
+}
+
+static size_t swapThreadPendingDepth(swapThread *thread) {
+    size_t depth = 0;
+    for (int p = 0; p < SWAP_PRIORITY_TYPES; p++)
+        depth += swapRingQueueDepth(thread->pending_reqs[p]);
+    return depth;
+}
+
+static void swapThreadPendingNew(swapThread *thread) {
+    for (int p = 0; p < SWAP_PRIORITY_TYPES; p++) {
+        thread->pending_reqs[p] = swapRingQueueNew(SWAP_RING_QUEUE_CAPACITY);
+        thread->credits[p] = server.swap_priority_weights[p].weight;
+        thread->waiting_since[p] = 0;
+    }
+}
+
+static void swapThreadPendingFree(swapThread *thread) {
+    for (int p = 0; p < SWAP_PRIORITY_TYPES; p++) {
+        swapRingQueueFree(thread->pending_reqs[p]);
+        thread->pending_reqs[p] = NULL;
+    }
+}
+
+static void swapThreadPendingPopped(swapRequestBatch *reqs, int priority,
+        monotime now, int starved) {
+    swapPriorityStat *stat = server.ror_stats->priority_stats+priority;
+    atomicIncr(stat->batches,1);
+    if (now > reqs->dispatch_time)
+        atomicIncr(stat->wait_us,(long long)(now - reqs->dispatch_time));
+    if (starved) atomicIncr(stat->starved,1);
+}
+
+/* Pending batches are served by weighted round robin: each class serves up
+ * to weight batches per round, class runs out of credits yields to lower
+ * classes, credits refilled when no class with credits has batch pending.
+ * A lower class pending longer than swap-priority-starvation-ms is served
+ * regardless of credits. Note that head batch could be stolen anytime, so
+ * pending time is tracked by owner rather than peeked from head batch. */
+static swapRequestBatch *swapThreadPopPending(swapThread *thread) {
+    swapRequestBatch *reqs = NULL;
+    int p, starved = 0;
+    monotime now = getMonotonicUs();
+    monotime starvation_us = (monotime)server.swap_priority_starvation_ms*1000;
+
+    if (starvation_us) {
+        for (p = 1; p < SWAP_PRIORITY_TYPES; p++) {
+            if (swapRingQueueDepth(thread->pending_reqs[p]) == 0) {
+                thread->waiting_since[p] = 0;
+            } else if (thread->waiting_since[p] == 0) {
+                thread->waiting_since[p] = now;
+            } else if (now > thread->waiting_since[p] + starvation_us &&
+                    (reqs = swapRingQueuePop(thread->pending_reqs[p]))) {
+                starved = 1;
+                goto found;
+            }
+        }
+    }
+
+    for (p = 0; p < SWAP_PRIORITY_TYPES; p++) {
+        if (thread->credits[p] <= 0) continue;
+        if ((reqs = swapRingQueuePop(thread->pending_reqs[p]))) goto found;
+    }
+
+    for (p = 0; p < SWAP_PRIORITY_TYPES; p++)
+        thread->credits[p] = server.swap_priority_weights[p].weight;
+
+    for (p = 0; p < SWAP_PRIORITY_TYPES; p++) {
+        if ((reqs = swapRingQueuePop(thread->pending_reqs[p]))) goto found;
+    }
+
+    return NULL;
+
+found:
+    serverAssert(reqs != NULL);
+    if (thread->credits[p] > 0) thread->credits[p]--;
+    thread->waiting_since[p] = swapRingQueueDepth(thread->pending_reqs[p]) ? now : 0;
+    swapThreadPendingPopped(reqs,p,now,starved);
+    return reqs;
+}
+
+static inline int swapThreadsStealEnabled(void) {
+    return server.swap_threads_work_stealing &&
+        server.swap_dispatch_policy != SWAP_DISPATCH_KEY_AFFINITY;
+}
+
+/* Idle worker steals the most urgent pending batch from the busy worker with
+ * the deepest queue. Stealing relies on the key lock invariant: requests are
+ * dispatched only after their key locks are granted, at most one request
+ * per key swaps at a time (subkey lockers & readers sharing a key lock only
+ * do io & decode, merged by main thread), so batches pending in worker
+ * queues never depend on each other and could be processed by any worker.
+ * Defer & util threads are excluded (defer thread serializes its requests),
+ * so is key-affinity mode, which keeps requests of a key on one thread for
+ * coalescing. Caller holds victim's steal_lock. */
+static swapRequestBatch *swapThreadStealFrom(swapThread *thread, swapThread *victim) {
+    swapRequestBatch *reqs = NULL;
+    int p;
+
+    /* swapThreadsDrained detects batch moving between threads by epoch. */
+    __atomic_add_fetch(&server.swap_threads_steal_epoch,1,__ATOMIC_SEQ_CST);
+    for (p = 0; p < SWAP_PRIORITY_TYPES; p++) {
+        if ((reqs = swapRingQueuePop(victim->pending_reqs[p]))) break;
+    }
+    if (reqs) {
+        atomicIncr(thread->inflight_reqs,reqs->count);
+        atomicDecr(victim->inflight_reqs,reqs->count);
+        atomicIncr(thread->steals,1);
+        atomicIncr(victim->stolen,1);
+        swapThreadPendingPopped(reqs,p,getMonotonicUs(),0);
+    }
+    return reqs;
+}
+
+static swapRequestBatch *swapThreadSteal(swapThread *thread) {
+    swapRequestBatch *reqs = NULL;
+    swapThread *victim = NULL;
+    size_t depth, max_depth = 0;
+    unsigned long running;
+    int i, total;
+
+    if (thread->id < EXTRA_SWAP_THREADS_NUM || !swapThreadsStealEnabled())
+        return NULL;
+
+    /* Thread scaled down takes its steal_lock to wait for stealing by or
+     * from it to finish, queues of other threads are only visited with
+     * their steal_lock tried (never blocks, so no lock ordering needed). */
+    pthread_mutex_lock(&thread->steal_lock);
+    if (!thread->stealable) goto end;
+    total = __atomic_load_n(&server.swap_total_threads_num,__ATOMIC_ACQUIRE);
+    for (i = EXTRA_SWAP_THREADS_NUM; i < total; i++) {
+        swapThread *t = server.swap_threads+i;
+        if (t == thread) continue;
+        atomicGetWithSync(t->is_running_rio,running);
+        if (!running) continue; /* owner is about to serve it anyway. */
+        if (pthread_mutex_trylock(&t->steal_lock)) continue;
+        depth = t->stealable ? swapThreadPendingDepth(t) : 0;
+        pthread_mutex_unlock(&t->steal_lock);
+        if (depth > max_depth) max_depth = depth, victim = t;
+    }
+
+    if (victim && !pthread_mutex_trylock(&victim->steal_lock)) {
+        if (victim->stealable) reqs = swapThreadStealFrom(thread,victim);
+        pthread_mutex_unlock(&victim->steal_lock);
+    }
+
+end:
+    pthread_mutex_unlock(&thread->steal_lock);
+
+    return reqs;
+}
+
+/* Wake up swap thread only if it's parked (or parking), so that dispatch
+ * to a busy thread costs no syscall. */
+static int swapThreadWakeup(swapThread *thread, int force) {
+    uint64_t val = 1;
+    if (!__atomic_exchange_n(&thread->parked,0,__ATOMIC_SEQ_CST) && !force)
+        return 0;
+    atomicIncr(thread->wakeups,1);
+    if (write(thread->eventfd,&val,sizeof(val)) < 0 && errno != EAGAIN) {
+        serverLog(LL_WARNING, "[rocks] wakeup swap thread #%d failed: %s",
+                thread->id, strerror(errno));
+    }
+    return 1;
+}
+
+static int swapThreadShouldStop(swapThread *thread) {
+    int stop;
+    atomicGetWithSync(thread->stop,stop);
+    return stop;
+}
+
+/* Returns 1 if thread parked (and waked up). */
+static int swapThreadPark(swapThread *thread) {
+    uint64_t val;
+    long long start_idle_time;
+
+    __atomic_store_n(&thread->parked,1,__ATOMIC_SEQ_CST);
+    /* Recheck after parked published, otherwise dispatcher might see thread
+     * running and skip wakeup. */
+    if (swapThreadPendingDepth(thread) || swapThreadShouldStop(thread)) {
+        __atomic_store_n(&thread->parked,0,__ATOMIC_SEQ_CST);
+        return 0;
+    }
+
+    atomicGet(thread->start_idle_time,start_idle_time);
+    if (start_idle_time == -1) atomicSet(thread->start_idle_time,ustime());
+    atomicIncr(thread->parks,1);
+    if (read(thread->eventfd,&val,sizeof(val)) < 0 && errno != EINTR) {
+        serverLog(LL_WARNING, "[rocks] swap thread #%d park failed: %s",
+                thread->id, strerror(errno));
+    }
+    __atomic_store_n(&thread->parked,0,__ATOMIC_SEQ_CST);
+    return 1;
+}
+
 void *swapThreadMain (void *arg) {
     char thdname[16];
     swapThread *thread = arg;
+    swapRequestBatch *reqs;
 
     snprintf(thdname, sizeof(thdname), "swap_thd_%d", thread->id);
     redis_set_thread_title(thdname);
+    RIOArenaBind(&thread->arena);
 #ifndef __APPLE__
     atomicIncr(server.swap_threads_initialized, 1);
 #endif
-    listIter li;
-    listNode *ln;
-    list *processing_reqs;
     while (1) {
-        pthread_mutex_lock(&thread->lock);
-        while (listLength(thread->pending_reqs) == 0) {
-            if (thread->stop) {
-                pthread_mutex_unlock(&thread->lock);
-                #ifndef __APPLE__
-                    atomicDecr(server.swap_threads_initialized, 1);
-                #endif
-                return NULL;
-            }
-            if (thread->start_idle_time == -1) {
-                thread->start_idle_time = ustime();
-            }
-            pthread_cond_wait(&thread->cond, &thread->lock);
-        }
-        if (server.swap_debug_scale_down_delay_micro) {
-            pthread_mutex_unlock(&thread->lock);
-            usleep(server.swap_debug_scale_down_delay_micro);
-            pthread_mutex_lock(&thread->lock);
-        }
-        thread->start_idle_time = -1;
-        // During the process of copying a linked list, encountering data corruption could lead to the main thread getting stuck on pthread_mutex_lock, making it impossible to terminate the program normally. In this case, AddressSanitizer (ASan) fails to print the detection results, and no core dump file will be generated.
-        processing_reqs = thread->pending_reqs;
-        thread->pending_reqs = listCreate();
-        pthread_mutex_unlock(&thread->lock);
-
-        listRewind(processing_reqs, &li);
+        /* set before pop so that swapThreadsDrained won't miss popped reqs. */
         atomicSetWithSync(thread->is_running_rio, 1);
-        while ((ln = listNext(&li))) {
-            swapRequestBatch *reqs = listNodeValue(ln);
+        while ((reqs = swapThreadPopPending(thread)) ||
+                (reqs = swapThreadSteal(thread))) {
             size_t reqs_count = reqs->count;
+            monotime process_start = getMonotonicUs();
+            atomicSet(thread->start_idle_time, -1);
             swapRequestBatchProcess(reqs);
             atomicDecr(thread->inflight_reqs, reqs_count);
+            atomicIncr(thread->busy_us,(long long)(getMonotonicUs()-process_start));
         }
-
         atomicSetWithSync(thread->is_running_rio, 0);
-        listRelease(processing_reqs);
-    }
 
+        /* reqs pushed but not published yet. */
+        if (swapThreadPendingDepth(thread)) continue;
+
+        if (swapThreadShouldStop(thread)) {
+            #ifndef __APPLE__
+                atomicDecr(server.swap_threads_initialized, 1);
+            #endif
+            return NULL;
+        }
 
+        if (swapThreadPark(thread) && server.swap_debug_scale_down_delay_micro)
+            usleep(server.swap_debug_scale_down_delay_micro);
+    }
 }
 
 /**
@@ -91,17 +376,27 @@ int swapThreadExtendAndInitThread() {
     serverAssert(server.swap_total_threads_num < swapThreadsMaxNum());
     swapThread *thread = server.swap_threads + server.swap_total_threads_num;
     thread->id = server.swap_total_threads_num;
-    thread->pending_reqs = listCreate();
-    thread->stop = false;
-    thread->start_idle_time = -1;
+    swapThreadPendingNew(thread);
+    thread->eventfd = eventfd(0, 0);
+    if (thread->eventfd == -1) {
+        serverLog(LL_WARNING, "Fatal: create swap thread eventfd failed: %s",
+                strerror(errno));
+        swapThreadPendingFree(thread);
+        return -1;
+    }
+    thread->parked = 0;
+    atomicSetWithSync(thread->stop, 0);
+    atomicSet(thread->start_idle_time, -1);
     atomicSetWithSync(thread->is_running_rio, 0);
-    pthread_mutex_init(&thread->lock, NULL);
-    pthread_cond_init(&thread->cond, NULL);
+    thread->create_time = getMonotonicUs();
+    pthread_mutex_lock(&thread->steal_lock);
+    thread->stealable = 1;
+    pthread_mutex_unlock(&thread->steal_lock);
     if (pthread_create(&thread->thread_id, NULL, swapThreadMain, thread)) {
         serverLog(LL_WARNING, "Fatal: create swap threads failed.");
         return -1;
     }
-    server.swap_total_threads_num++;
+    __atomic_add_fetch(&server.swap_total_threads_num,1,__ATOMIC_RELEASE);
     serverLog(LL_WARNING, "create thread success use %lld us", ustime() - start_time);
     return C_OK;
 }
@@ -111,6 +406,9 @@ int swapThreadsInit() {
     server.swap_defer_thread_idx = 0;
     server.swap_util_thread_idx = 1; 
     server.swap_threads = zcalloc(sizeof(swapThread)*(swapThreadsMaxNum()));
+    /* steal_lock outlives thread slot reuse: stealers might try it anytime. */
+    for (i = 0; i < swapThreadsMaxNum(); i++)
+        pthread_mutex_init(&server.swap_threads[i].steal_lock,NULL);
     for (i = 0; i < swapThreadsCoreNum(); i++) {
         swapThreadExtendAndInitThread();
     }
@@ -122,7 +420,6 @@ void swapThreadsDeinit() {
     int i, err;
     for (i = 0; i < server.swap_total_threads_num; i++) {
         swapThread *thread = server.swap_threads+i;
-        listRelease(thread->pending_reqs);
         if (thread->thread_id == pthread_self()) continue;
         if (thread->thread_id && pthread_cancel(thread->thread_id) == 0) {
             if ((err = pthread_join(thread->thread_id, NULL)) != 0) {
@@ -132,6 +429,7 @@ void swapThreadsDeinit() {
                 serverLog(LL_WARNING, "swap thread #%d terminated.", i);
             }
         }
+        swapThreadPendingFree(thread);
     }
 }
 
@@ -143,28 +441,37 @@ static inline int swapThreadsDistNext() {
 }
 
 void swapThreadDestroy(swapThread* thread) {
-    listRelease(thread->pending_reqs);
-    thread->pending_reqs = NULL;
-    pthread_cond_destroy(&thread->cond);
-    pthread_mutex_destroy(&thread->lock);
+    swapThreadPendingFree(thread);
+    RIOArenaDeinit(&thread->arena);
+    close(thread->eventfd);
+    thread->eventfd = -1;
 }
 
 int swapThreadReduceAndCleanupThread() {
     long long start_time = ustime();
     int idx = server.swap_total_threads_num - 1;
     swapThread* thread = server.swap_threads + idx;
-    serverAssert(thread->stop == false);
+    serverAssert(!swapThreadShouldStop(thread));
+    /* Stop stealing from or by thread: blocks until in-progress stealing
+     * (a few queue pops) finishes, later stealers find it unstealable. */
+    pthread_mutex_lock(&thread->steal_lock);
+    thread->stealable = 0;
+    pthread_mutex_unlock(&thread->steal_lock);
     size_t inflight_reqs;
     atomicGet(thread->inflight_reqs, inflight_reqs);
-    serverAssert(inflight_reqs == 0);
-    pthread_mutex_lock(&thread->lock);
-    serverAssert(listLength(thread->pending_reqs) == 0);
-    thread->stop = true;
-    pthread_cond_signal(&thread->cond);
-    pthread_mutex_unlock(&thread->lock);
+    if (inflight_reqs) {
+        /* stole a batch just before stopped. */
+        pthread_mutex_lock(&thread->steal_lock);
+        thread->stealable = 1;
+        pthread_mutex_unlock(&thread->steal_lock);
+        return C_ERR;
+    }
+    serverAssert(swapThreadPendingDepth(thread) == 0);
+    atomicSetWithSync(thread->stop, 1);
+    swapThreadWakeup(thread, 1);
     int res = pthread_join(thread->thread_id, NULL);
     serverAssert(res == 0);
-    server.swap_total_threads_num--;
+    __atomic_sub_fetch(&server.swap_total_threads_num,1,__ATOMIC_RELEASE);
     swapThreadDestroy(thread);  
     serverLog(LL_WARNING, "delete thread  use %lld us", ustime() - start_time);                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                         
     return C_OK;
@@ -188,9 +495,7 @@ int swapThreadsAutoScaleDownIfNeeded(void) {
     if (server.swap_total_threads_num > swapThreadsCoreNum()) {
         swapThread* thread = server.swap_threads + server.swap_total_threads_num -1;
         long long start_idle_time;
-        pthread_mutex_lock(&thread->lock);
-        start_idle_time = thread->start_idle_time;
-        pthread_mutex_unlock(&thread->lock);
+        atomicGet(thread->start_idle_time, start_idle_time);
         size_t inflight_reqs;
         atomicGet(thread->inflight_reqs, inflight_reqs);
         if (start_idle_time == -1 || inflight_reqs > 0) return 0;
@@ -261,6 +566,16 @@ int swapThreadsSelectThreadIdx(size_t swap_threads_inflight_reqs[]) {
     return min_reqs_index;
 }
 
+/* Target thread is busy, wake up one parked worker to steal. */
+static void swapThreadsWakeupStealer(swapThread *busy) {
+    for (int i = EXTRA_SWAP_THREADS_NUM; i < server.swap_total_threads_num; i++) {
+        swapThread *t = server.swap_threads+i;
+        if (t == busy || !__atomic_load_n(&t->parked,__ATOMIC_SEQ_CST))
+            continue;
+        if (swapThreadWakeup(t,0)) break;
+    }
+}
+
 void swapThreadsDispatch(swapRequestBatch *reqs, int idx) {
     if (idx == -1) {
         size_t swap_threads_inflight_reqs[server.swap_total_threads_num];
@@ -276,25 +591,93 @@ void swapThreadsDispatch(swapRequestBatch *reqs, int idx) {
     }
     swapRequestBatchDispatched(reqs);
     swapThread *t = server.swap_threads+idx;
-    pthread_mutex_lock(&t->lock);
-    listAddNodeTail(t->pending_reqs,reqs);
     atomicIncr(t->inflight_reqs, reqs->count);
-    pthread_cond_signal(&t->cond);
-    pthread_mutex_unlock(&t->lock);
+    swapRingQueuePush(t->pending_reqs[reqs->priority],reqs);
+    if (!swapThreadWakeup(t, 0) && idx >= EXTRA_SWAP_THREADS_NUM &&
+            swapThreadsStealEnabled())
+        swapThreadsWakeupStealer(t);
+}
+
+/* Requests of the same key are dispatched to the same core swap thread, so
+ * that they are handled in order by one thread with warm cpu cache. */
+static inline int swapRequestAffinityThreadIdx(swapRequest *req, int workers) {
+    swapData *data = req->data;
+    uint64_t hash;
+    if (data == NULL || data->key == NULL || data->db == NULL) return -1;
+    hash = dictGenHashFunction(data->key->ptr,sdslen(data->key->ptr));
+    return EXTRA_SWAP_THREADS_NUM + (hash + data->db->id) % workers;
+}
+
+/* Split batch by key affinity. Requests without key (e.g. metascan), or
+ * whose thread is loaded beyond auto scale up threshold, are dispatched to
+ * the least loaded thread, which scales up threads if all of them are busy,
+ * so that auto scaled threads take the overflow. */
+void swapThreadsDispatchByKey(swapRequestBatch *reqs) {
+    int workers = swapThreadsCoreNum() - EXTRA_SWAP_THREADS_NUM;
+    int idx, slot, single = 1;
+    size_t i, swap_threads_inflight_reqs[server.swap_total_threads_num];
+    swapRequestBatch **subs;
+
+    if (workers <= 0 || reqs->count == 0) {
+        swapThreadsDispatch(reqs,-1);
+        return;
+    }
+
+    int idxs[reqs->count];
+    swapThreadsGetInflightReqs(swap_threads_inflight_reqs);
+    atomicIncr(server.ror_stats->dispatch_stats.affinity_batches,1);
+    for (i = 0; i < reqs->count; i++) {
+        idx = swapRequestAffinityThreadIdx(reqs->reqs[i],workers);
+        if (idx != -1 && server.swap_threads_auto_scale_up_threshold > 0 &&
+                swap_threads_inflight_reqs[idx] >=
+                (size_t)server.swap_threads_auto_scale_up_threshold) {
+            atomicIncr(server.ror_stats->dispatch_stats.affinity_overflows,1);
+            idx = -1;
+        }
+        idxs[i] = idx;
+        if (idx != idxs[0]) single = 0;
+    }
+
+    if (single) {
+        swapThreadsDispatch(reqs,idxs[0]);
+        return;
+    }
+
+    /* slot workers holds requests without key or overflowed, sub batches
+     * share timers started here so that latency stats cover the split. */
+    swapRequestBatchStartTimers(reqs);
+    subs = zcalloc(sizeof(swapRequestBatch*)*(workers+1));
+    for (i = 0; i < reqs->count; i++) {
+        slot = idxs[i] == -1 ? workers : idxs[i] - EXTRA_SWAP_THREADS_NUM;
+        if (subs[slot] == NULL) subs[slot] = swapRequestBatchSplitNew(reqs);
+        swapRequestBatchAppend(subs[slot],reqs->reqs[i]);
+    }
+    reqs->count = 0; /* reqs moved to subs */
+    swapRequestBatchFree(reqs);
+
+    for (slot = 0; slot <= workers; slot++) {
+        if (subs[slot] == NULL) continue;
+        swapThreadsDispatch(subs[slot],
+                slot == workers ? -1 : slot + EXTRA_SWAP_THREADS_NUM);
+    }
+    atomicIncr(server.ror_stats->dispatch_stats.affinity_splits,1);
+    zfree(subs);
 }
 
 int swapThreadsDrained() {
     swapThread *rt;
     int drained = 1, i;
+    long long steal_epoch = __atomic_load_n(&server.swap_threads_steal_epoch,__ATOMIC_SEQ_CST);
     for (i = 0; i < server.swap_total_threads_num; i++) {
         rt = server.swap_threads+i;
 
-        pthread_mutex_lock(&rt->lock);
         unsigned long count = 0;
         atomicGetWithSync(rt->is_running_rio, count);
-        if (listLength(rt->pending_reqs) || count) drained = 0;
-        pthread_mutex_unlock(&rt->lock);
+        if (swapThreadPendingDepth(rt) || count) drained = 0;
     }
+    /* batch might be stolen by thread already checked. */
+    if (steal_epoch != __atomic_load_n(&server.swap_threads_steal_epoch,__ATOMIC_SEQ_CST))
+        drained = 0;
     return drained;
 }
 
@@ -352,28 +735,259 @@ int submitUtilTask(int type, void *arg, rocksdbUtilTaskCallback cb, void* pd, sd
 }
 
 sds genSwapThreadInfoString(sds info) {
-    size_t thread_depth = 0, async_depth, thread_inflight_reqs = 0, swap_thread_num = (server.swap_total_threads_num - EXTRA_SWAP_THREADS_NUM);
+    size_t thread_depth = 0, priority_depth[SWAP_PRIORITY_TYPES] = {0}, async_depth, thread_inflight_reqs = 0, swap_thread_num = (server.swap_total_threads_num - EXTRA_SWAP_THREADS_NUM);
+    long long wakeups = 0, parks = 0, overflows = 0, steals = 0;
+    long long async_notifies, async_wakeups, async_batches, async_overflows;
+    long long affinity_batches, affinity_splits, affinity_overflows;
+    asyncCompleteQueue *cq = server.swap_CQ;
 
-    pthread_mutex_lock(&server.swap_CQ->lock);
-    async_depth = listLength(server.swap_CQ->complete_queue);
-    pthread_mutex_unlock(&server.swap_CQ->lock);
+    async_depth = swapRingQueueDepth(cq->complete_queue);
     for (int i = EXTRA_SWAP_THREADS_NUM; i < server.swap_total_threads_num; i++) {
         swapThread *thread = server.swap_threads+i;
-        pthread_mutex_lock(&thread->lock);
-        thread_depth += listLength(thread->pending_reqs);
-        pthread_mutex_unlock(&thread->lock);
+        long long thread_wakeups, thread_parks, thread_steals;
+        for (int p = 0; p < SWAP_PRIORITY_TYPES; p++) {
+            size_t depth = swapRingQueueDepth(thread->pending_reqs[p]);
+            long long priority_overflows;
+            atomicGet(thread->pending_reqs[p]->overflows, priority_overflows);
+            priority_depth[p] += depth, thread_depth += depth;
+            overflows += priority_overflows;
+        }
         size_t inflight_reqs;
         atomicGet(thread->inflight_reqs, inflight_reqs);
         thread_inflight_reqs += inflight_reqs;
+        atomicGet(thread->wakeups, thread_wakeups);
+        atomicGet(thread->parks, thread_parks);
+        atomicGet(thread->steals, thread_steals);
+        wakeups += thread_wakeups, parks += thread_parks;
+        steals += thread_steals;
     }
+    size_t total_thread_depth = thread_depth;
     thread_depth /= swap_thread_num;
     thread_inflight_reqs /= swap_thread_num;
+    atomicGet(cq->notifies, async_notifies);
+    atomicGet(cq->wakeups, async_wakeups);
+    atomicGet(cq->batches, async_batches);
+    atomicGet(cq->complete_queue->overflows, async_overflows);
+    atomicGet(server.ror_stats->dispatch_stats.affinity_batches, affinity_batches);
+    atomicGet(server.ror_stats->dispatch_stats.affinity_splits, affinity_splits);
+    atomicGet(server.ror_stats->dispatch_stats.affinity_overflows, affinity_overflows);
     info = sdscatprintf(info,
             "swap_thread_num:%lu\r\n"
             "swap_thread_queue_depth:%lu\r\n"
             "swap_async_queue_depth:%lu\r\n"
-            "swap_thread_inflight_reqs:%lu\r\n",
-            swap_thread_num, thread_depth, async_depth, thread_inflight_reqs);
+            "swap_thread_inflight_reqs:%lu\r\n"
+            "swap_thread_queue:depth=%lu,wakeups=%lld,parks=%lld,overflows=%lld\r\n"
+            "swap_async_queue:depth=%lu,notifies=%lld,wakeups=%lld,batches=%lld,batches_per_wakeup=%.2f,overflows=%lld\r\n"
+            "swap_thread_dispatch:policy=%s,affinity_batches=%lld,affinity_splits=%lld,affinity_overflows=%lld\r\n"
+            "swap_thread_stealing:enabled=%d,steals=%lld\r\n",
+            swap_thread_num, thread_depth, async_depth, thread_inflight_reqs,
+            total_thread_depth, wakeups, parks, overflows,
+            async_depth, async_notifies, async_wakeups, async_batches,
+            async_wakeups ? (double)async_batches/async_wakeups : 0,
+            async_overflows,
+            server.swap_dispatch_policy == SWAP_DISPATCH_KEY_AFFINITY ? "key-affinity" : "least-loaded",
+            affinity_batches, affinity_splits, affinity_overflows,
+            swapThreadsStealEnabled(), steals);
+    info = genAsyncCompleteQueueDrainInfoString(info);
+
+    for (int i = EXTRA_SWAP_THREADS_NUM; i < server.swap_total_threads_num; i++) {
+        swapThread *thread = server.swap_threads+i;
+        long long thread_steals, thread_stolen, busy_us;
+        monotime elapsed = getMonotonicUs() - thread->create_time;
+        atomicGet(thread->steals, thread_steals);
+        atomicGet(thread->stolen, thread_stolen);
+        atomicGet(thread->busy_us, busy_us);
+        info = sdscatprintf(info,
+                "swap_thread_%d:steals=%lld,stolen=%lld,busy_us=%lld,busy_ratio=%.2f\r\n",
+                thread->id, thread_steals, thread_stolen, busy_us,
+                elapsed ? (double)busy_us/elapsed : 0);
+    }
+
+    for (int p = 0; p < SWAP_PRIORITY_TYPES; p++) {
+        long long batches, wait_us, starved;
+        swapPriorityStat *stat = server.ror_stats->priority_stats+p;
+        atomicGet(stat->batches, batches);
+        atomicGet(stat->wait_us, wait_us);
+        atomicGet(stat->starved, starved);
+        info = sdscatprintf(info,
+                "swap_priority_%s:weight=%d,depth=%lu,batches=%lld,wait_us=%lld,avg_wait_us=%.2f,starved=%lld\r\n",
+                swapPriorityName(p), server.swap_priority_weights[p].weight,
+                priority_depth[p], batches, wait_us,
+                batches ? (double)wait_us/batches : 0, starved);
+    }
 
     return info;
 }
+
+#ifdef REDIS_TEST
+
+#define RING_QUEUE_TEST_PRODUCERS 4
+#define RING_QUEUE_TEST_ITEMS 100000
+
+typedef struct ringQueueTestProducer {
+    swapRingQueue *q;
+    long id;
+} ringQueueTestProducer;
+
+static void *ringQueueTestProduce(void *arg) {
+    ringQueueTestProducer *producer = arg;
+    for (long i = 0; i < RING_QUEUE_TEST_ITEMS; i++)
+        swapRingQueuePush(producer->q,(void*)((producer->id<<32)|(i+1)));
+    return NULL;
+}
+
+int swapThreadTest(int argc, char *argv[], int accurate) {
+    UNUSED(argc), UNUSED(argv), UNUSED(accurate);
+    int error = 0;
+
+    TEST("thread: ring queue push & pop") {
+        swapRingQueue *q = swapRingQueueNew(3);
+        long i;
+        test_assert(q->mask == 3);
+        test_assert(swapRingQueuePop(q) == NULL);
+        for (i = 1; i <= 6; i++) swapRingQueuePush(q,(void*)i);
+        test_assert(swapRingQueueDepth(q) == 6);
+        test_assert(q->overflow_len == 2 && q->overflows == 2);
+        /* overflow still in use: push keeps fifo. */
+        test_assert(swapRingQueuePop(q) == (void*)1);
+        swapRingQueuePush(q,(void*)7);
+        test_assert(q->overflow_len == 3);
+        for (i = 2; i <= 7; i++) test_assert(swapRingQueuePop(q) == (void*)i);
+        test_assert(swapRingQueuePop(q) == NULL);
+        test_assert(swapRingQueueDepth(q) == 0);
+        /* ring wraps around. */
+        for (i = 1; i <= 10; i++) {
+            swapRingQueuePush(q,(void*)i);
+            test_assert(swapRingQueuePop(q) == (void*)i);
+        }
+        test_assert(q->overflows == 3);
+        swapRingQueueFree(q);
+    }
+
+    TEST("thread: ring queue multi producer") {
+        swapRingQueue *q = swapRingQueueNew(64);
+        pthread_t threads[RING_QUEUE_TEST_PRODUCERS];
+        ringQueueTestProducer producers[RING_QUEUE_TEST_PRODUCERS];
+        long next[RING_QUEUE_TEST_PRODUCERS] = {0}, popped = 0, ordered = 1;
+
+        for (long i = 0; i < RING_QUEUE_TEST_PRODUCERS; i++) {
+            producers[i].q = q, producers[i].id = i;
+            pthread_create(&threads[i],NULL,ringQueueTestProduce,&producers[i]);
+        }
+        while (popped < RING_QUEUE_TEST_PRODUCERS*RING_QUEUE_TEST_ITEMS) {
+            long item = (long)swapRingQueuePop(q);
+            if (item == 0) continue;
+            long id = item >> 32, seq = item & 0xffffffff;
+            /* per producer order kept unless spilled to overflow. */
+            if (seq <= next[id]) ordered = 0;
+            next[id] = seq;
+            popped++;
+        }
+        for (long i = 0; i < RING_QUEUE_TEST_PRODUCERS; i++) {
+            pthread_join(threads[i],NULL);
+            test_assert(next[i] == RING_QUEUE_TEST_ITEMS);
+        }
+        test_assert(ordered || q->overflows > 0);
+        test_assert(swapRingQueueDepth(q) == 0);
+        swapRingQueueFree(q);
+    }
+
+    TEST("thread: priority weighted round robin & starvation") {
+        swapThread thread = {0};
+        swapRequestBatch *client_reqs[4], *evict_reqs[2];
+        int i;
+
+        monotonicInit();
+        if (server.ror_stats == NULL) initStatsSwap();
+        resetStatsSwap();
+        for (i = 0; i < SWAP_PRIORITY_TYPES; i++)
+            server.swap_priority_weights[i].weight = 1;
+        server.swap_priority_weights[SWAP_PRIORITY_CLIENT].weight = 2;
+        server.swap_priority_starvation_ms = 0;
+        swapThreadPendingNew(&thread);
+
+        for (i = 0; i < 4; i++) {
+            client_reqs[i] = swapRequestBatchNew();
+            client_reqs[i]->priority = SWAP_PRIORITY_CLIENT;
+            client_reqs[i]->dispatch_time = getMonotonicUs();
+            swapRingQueuePush(thread.pending_reqs[SWAP_PRIORITY_CLIENT],client_reqs[i]);
+        }
+        for (i = 0; i < 2; i++) {
+            evict_reqs[i] = swapRequestBatchNew();
+            evict_reqs[i]->priority = SWAP_PRIORITY_EVICT;
+            evict_reqs[i]->dispatch_time = getMonotonicUs();
+            swapRingQueuePush(thread.pending_reqs[SWAP_PRIORITY_EVICT],evict_reqs[i]);
+        }
+        test_assert(swapThreadPendingDepth(&thread) == 6);
+
+        /* client served twice per evict. */
+        test_assert(swapThreadPopPending(&thread) == client_reqs[0]);
+        test_assert(swapThreadPopPending(&thread) == client_reqs[1]);
+        test_assert(swapThreadPopPending(&thread) == evict_reqs[0]);
+        test_assert(swapThreadPopPending(&thread) == client_reqs[2]);
+        test_assert(swapThreadPopPending(&thread) == client_reqs[3]);
+        test_assert(swapThreadPopPending(&thread) == evict_reqs[1]);
+        test_assert(swapThreadPopPending(&thread) == NULL);
+        test_assert(server.ror_stats->priority_stats[SWAP_PRIORITY_CLIENT].batches == 4);
+        test_assert(server.ror_stats->priority_stats[SWAP_PRIORITY_EVICT].batches == 2);
+        test_assert(server.ror_stats->priority_stats[SWAP_PRIORITY_EVICT].starved == 0);
+
+        /* weight 0 class served only by starvation protection. */
+        server.swap_priority_weights[SWAP_PRIORITY_EVICT].weight = 0;
+        server.swap_priority_starvation_ms = 1;
+        evict_reqs[0]->dispatch_time = getMonotonicUs() - 10000;
+        client_reqs[0]->dispatch_time = getMonotonicUs();
+        swapRingQueuePush(thread.pending_reqs[SWAP_PRIORITY_EVICT],evict_reqs[0]);
+        swapRingQueuePush(thread.pending_reqs[SWAP_PRIORITY_CLIENT],client_reqs[0]);
+        thread.waiting_since[SWAP_PRIORITY_EVICT] = getMonotonicUs() - 10000;
+        test_assert(swapThreadPopPending(&thread) == evict_reqs[0]);
+        test_assert(server.ror_stats->priority_stats[SWAP_PRIORITY_EVICT].starved == 1);
+        test_assert(server.ror_stats->priority_stats[SWAP_PRIORITY_EVICT].wait_us >= 10000);
+        test_assert(swapThreadPopPending(&thread) == client_reqs[0]);
+
+        for (i = 0; i < 4; i++) swapRequestBatchFree(client_reqs[i]);
+        for (i = 0; i < 2; i++) swapRequestBatchFree(evict_reqs[i]);
+        for (i = 0; i < SWAP_PRIORITY_TYPES; i++)
+            server.swap_priority_weights[i] = swapPriorityWeightsDefaults[i];
+        server.swap_priority_starvation_ms = 100;
+        swapThreadPendingFree(&thread);
+    }
+
+    TEST("thread: steal pending batch") {
+        swapThread thief = {0}, victim = {0};
+        swapRequestBatch *evict_reqs = swapRequestBatchNew(),
+                         *client_reqs = swapRequestBatchNew();
+        long long steal_epoch = server.swap_threads_steal_epoch;
+
+        resetStatsSwap();
+        swapThreadPendingNew(&thief);
+        swapThreadPendingNew(&victim);
+        evict_reqs->priority = SWAP_PRIORITY_EVICT;
+        client_reqs->priority = SWAP_PRIORITY_CLIENT;
+        client_reqs->count = 3; /* fake inflight count, reset before free. */
+        victim.inflight_reqs = 3;
+        swapRingQueuePush(victim.pending_reqs[SWAP_PRIORITY_EVICT],evict_reqs);
+        swapRingQueuePush(victim.pending_reqs[SWAP_PRIORITY_CLIENT],client_reqs);
+
+        /* most urgent batch stolen first, inflight moved to thief. */
+        test_assert(swapThreadStealFrom(&thief,&victim) == client_reqs);
+        test_assert(thief.inflight_reqs == 3 && victim.inflight_reqs == 0);
+        test_assert(thief.steals == 1 && victim.stolen == 1);
+        test_assert(server.swap_threads_steal_epoch == steal_epoch+1);
+        test_assert(server.ror_stats->priority_stats[SWAP_PRIORITY_CLIENT].batches == 1);
+        test_assert(swapThreadStealFrom(&thief,&victim) == evict_reqs);
+        test_assert(swapThreadStealFrom(&thief,&victim) == NULL);
+        test_assert(swapThreadPendingDepth(&victim) == 0);
+        test_assert(thief.steals == 2 && victim.stolen == 2);
+
+        client_reqs->count = 0;
+        swapRequestBatchFree(client_reqs);
+        swapRequestBatchFree(evict_reqs);
+        swapThreadPendingFree(&thief);
+        swapThreadPendingFree(&victim);
+    }
+
+    return error;
+}
+
+#endif
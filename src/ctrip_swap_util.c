@@ -174,19 +174,177 @@ int rocksDecodeMetaVal(const char *raw, size_t rawlen, int *pswap_type,
 
 typedef unsigned int keylen_t;
 
+/* Key format v1 (legacy):
+ *   meta:  dbid(int)|keylen(keylen_t)|key
+ *   data:  meta|version(8,BE)|flag|subkey
+ *   score: meta|version(8,BE)|flag|score(8,ordered)|subkey
+ * Key format v2 (compact) shrinks the fixed overhead with order preserving
+ * varints, so that db/version ranges still sort correctly:
+ *   meta:  0xff|varint(dbid)|varint(keylen)|key
+ *   data:  meta|varint(version)|flag|subkey
+ *   score: meta|varint(version)|flag|score(8,ordered)|subkey
+ * Encoders use swap-key-format, decoders accept both formats: v1 key never
+ * starts with 0xff as long as databases <= 255. */
+#define ROCKS_KEY_V2_TAG ((char)0xff)
+
+int rocksKeyFormat(const char *raw, size_t rawlen) {
+    if (server.dbnum <= ROCKS_KEY_V2_MAX_DBNUM && rawlen > 0 &&
+            raw[0] == ROCKS_KEY_V2_TAG)
+        return SWAP_KEY_FORMAT_V2;
+    else
+        return SWAP_KEY_FORMAT_V1;
+}
+
+/* Order preserving varint: first byte tells length, bigger value never
+ * encodes to smaller bytes. */
+static inline size_t orderedVarintLen(uint64_t value) {
+    if (value < (1ULL<<7)) return 1;
+    if (value < (1ULL<<14)) return 2;
+    if (value < (1ULL<<21)) return 3;
+    if (value < (1ULL<<28)) return 4;
+    return 9;
+}
+
+static size_t encodeOrderedVarint(char *buf, uint64_t value) {
+    unsigned char *p = (unsigned char*)buf;
+    size_t len = orderedVarintLen(value);
+    switch (len) {
+    case 1:
+        p[0] = value;
+        break;
+    case 2:
+        p[0] = 0x80|(value>>8), p[1] = value;
+        break;
+    case 3:
+        p[0] = 0xc0|(value>>16), p[1] = value>>8, p[2] = value;
+        break;
+    case 4:
+        p[0] = 0xe0|(value>>24), p[1] = value>>16, p[2] = value>>8, p[3] = value;
+        break;
+    default:
+        p[0] = 0xf0;
+        encodeFixed64(buf+1,value);
+        break;
+    }
+    return len;
+}
+
+/* Returns bytes consumed, 0 if buf is not a valid varint. */
+static size_t decodeOrderedVarint(const char *buf, size_t buflen, uint64_t *pvalue) {
+    const unsigned char *p = (const unsigned char*)buf;
+    uint64_t value;
+    size_t len, i;
+
+    if (buflen < 1) return 0;
+    if (p[0] < 0x80) len = 1, value = p[0];
+    else if (p[0] < 0xc0) len = 2, value = p[0]&0x3f;
+    else if (p[0] < 0xe0) len = 3, value = p[0]&0x1f;
+    else if (p[0] < 0xf0) len = 4, value = p[0]&0x0f;
+    else if (p[0] == 0xf0) len = 9, value = 0;
+    else return 0;
+
+    if (buflen < len) return 0;
+    if (len == 9) {
+        value = decodeFixed64(buf+1);
+    } else {
+        for (i = 1; i < len; i++) value = (value<<8)|p[i];
+    }
+    if (pvalue) *pvalue = value;
+    return len;
+}
+
+/* dbid|keylen|key header shared by meta/data/score keys. */
+static inline size_t rocksKeyHeaderLen(int format, int dbid, size_t keylen) {
+    if (format == SWAP_KEY_FORMAT_V2)
+        return 1+orderedVarintLen((uint64_t)dbid)+orderedVarintLen(keylen)+keylen;
+    else
+        return sizeof(int)+sizeof(keylen_t)+keylen;
+}
+
+static size_t rocksEncodeKeyHeader(int format, char *buf, int dbid,
+        const char *key, size_t keylen_) {
+    char *ptr = buf;
+    if (format == SWAP_KEY_FORMAT_V2) {
+        ptr[0] = ROCKS_KEY_V2_TAG, ptr++;
+        ptr += encodeOrderedVarint(ptr,(uint64_t)dbid);
+        ptr += encodeOrderedVarint(ptr,keylen_);
+    } else {
+        keylen_t keylen = keylen_;
+        memcpy(ptr, &dbid, sizeof(dbid)), ptr += sizeof(dbid);
+        memcpy(ptr, &keylen, sizeof(keylen_t)), ptr += sizeof(keylen_t);
+    }
+    if (keylen_) memcpy(ptr, key, keylen_), ptr += keylen_;
+    return ptr - buf;
+}
+
+/* Returns header len, 0 if raw is not a valid key. */
+static size_t rocksDecodeKeyHeader(const char *raw, size_t rawlen, int *pdbid,
+        const char **pkey, size_t *pkeylen) {
+    const char *ptr = raw;
+    size_t len = rawlen, n;
+    uint64_t dbid, keylen;
+
+    if (raw == NULL) return 0;
+    if (rocksKeyFormat(raw,rawlen) == SWAP_KEY_FORMAT_V2) {
+        ptr++, len--;
+        if ((n = decodeOrderedVarint(ptr,len,&dbid)) == 0) return 0;
+        ptr += n, len -= n;
+        if ((n = decodeOrderedVarint(ptr,len,&keylen)) == 0) return 0;
+        ptr += n, len -= n;
+    } else {
+        keylen_t keylen_;
+        int dbid_;
+        if (len < sizeof(int)+sizeof(keylen_t)) return 0;
+        memcpy(&dbid_, ptr, sizeof(int)), ptr += sizeof(int);
+        memcpy(&keylen_, ptr, sizeof(keylen_t)), ptr += sizeof(keylen_t);
+        len -= sizeof(int)+sizeof(keylen_t);
+        dbid = (uint64_t)dbid_, keylen = keylen_;
+    }
+    if (len < keylen) return 0;
+    if (pdbid) *pdbid = (int)dbid;
+    if (pkey) *pkey = ptr;
+    if (pkeylen) *pkeylen = keylen;
+    return ptr - raw + keylen;
+}
+
+static inline size_t rocksKeyVersionLen(int format, uint64_t version) {
+    return format == SWAP_KEY_FORMAT_V2 ? orderedVarintLen(version) : sizeof(uint64_t);
+}
+
+static size_t rocksEncodeKeyVersion(int format, char *buf, uint64_t version) {
+    if (format == SWAP_KEY_FORMAT_V2) {
+        return encodeOrderedVarint(buf,version);
+    } else {
+        uint64_t encoded_version = rocksEncodeVersion(version);
+        memcpy(buf, &encoded_version, sizeof(encoded_version));
+        return sizeof(encoded_version);
+    }
+}
+
+/* Returns version len, 0 if not valid. */
+static size_t rocksDecodeKeyVersion(int format, const char *raw, size_t rawlen,
+        uint64_t *pversion) {
+    if (format == SWAP_KEY_FORMAT_V2) {
+        return decodeOrderedVarint(raw,rawlen,pversion);
+    } else {
+        uint64_t encoded_version;
+        if (rawlen < sizeof(encoded_version)) return 0;
+        memcpy(&encoded_version, raw, sizeof(encoded_version));
+        if (pversion) *pversion = rocksDecodeVersion(encoded_version);
+        return sizeof(encoded_version);
+    }
+}
+
 static sds _rocksEncodeDataKey(int dbid, sds key, uint64_t version,
         uint8_t subkeyflag, sds subkey) {
-    keylen_t keylen = key ? sdslen(key) : 0;
-    keylen_t subkeylen = subkey ? sdslen(subkey) : 0;
-    uint64_t encoded_version = rocksEncodeVersion(version);
-    size_t rawkeylen = sizeof(dbid)+sizeof(keylen)+keylen+
-        sizeof(encoded_version)+1+subkeylen;
+    int format = server.swap_key_format;
+    size_t keylen = key ? sdslen(key) : 0;
+    size_t subkeylen = subkey ? sdslen(subkey) : 0;
+    size_t rawkeylen = rocksKeyHeaderLen(format,dbid,keylen)+
+        rocksKeyVersionLen(format,version)+1+subkeylen;
     sds rawkey = sdsnewlen(SDS_NOINIT,rawkeylen), ptr = rawkey;
-    memcpy(ptr, &dbid, sizeof(dbid)), ptr += sizeof(dbid);
-    memcpy(ptr, &keylen, sizeof(keylen_t)), ptr += sizeof(keylen_t);
-    memcpy(ptr, key, keylen), ptr += keylen;
-    memcpy(ptr, &encoded_version, sizeof(encoded_version));
-    ptr += sizeof(encoded_version);
+    ptr += rocksEncodeKeyHeader(format,ptr,dbid,key,keylen);
+    ptr += rocksEncodeKeyVersion(format,ptr,version);
     ptr[0] = subkeyflag, ptr++;
     if (subkeyflag == ROCKS_KEY_FLAG_SUBKEY) {
         memcpy(ptr, subkey, subkeylen), ptr += subkeylen;
@@ -210,36 +368,41 @@ sds rocksEncodeDataRangeEndKey(redisDb *db, sds key, uint64_t version) {
     return _rocksEncodeDataKey(db->id,key,version,ROCKS_KEY_FLAG_DELETE,NULL);
 }
 
-sds rocksEncodeDbRangeStartKey(int dbid) {
-    sds rawkey = sdsnewlen(SDS_NOINIT,sizeof(dbid));
-    memcpy(rawkey, &dbid, sizeof(dbid));
+sds rocksEncodeDbRangeStartKeyWithFormat(int format, int dbid) {
+    sds rawkey;
+    if (format == SWAP_KEY_FORMAT_V2) {
+        rawkey = sdsnewlen(SDS_NOINIT,1+orderedVarintLen((uint64_t)dbid));
+        rawkey[0] = ROCKS_KEY_V2_TAG;
+        encodeOrderedVarint(rawkey+1,(uint64_t)dbid);
+    } else {
+        rawkey = sdsnewlen(SDS_NOINIT,sizeof(dbid));
+        memcpy(rawkey, &dbid, sizeof(dbid));
+    }
     return rawkey;
 }
 
+sds rocksEncodeDbRangeEndKeyWithFormat(int format, int dbid) {
+    return rocksEncodeDbRangeStartKeyWithFormat(format,dbid+1);
+}
+
+sds rocksEncodeDbRangeStartKey(int dbid) {
+    return rocksEncodeDbRangeStartKeyWithFormat(server.swap_key_format,dbid);
+}
+
 sds rocksEncodeDbRangeEndKey(int dbid) {
-    return rocksEncodeDbRangeStartKey(dbid+1);
+    return rocksEncodeDbRangeEndKeyWithFormat(server.swap_key_format,dbid);
 }
 
 int rocksDecodeDataKey(const char *raw, size_t rawlen, int *dbid,
         const char **key, size_t *keylen, uint64_t *version,
         const char **subkey, size_t *subkeylen) {
-    keylen_t keylen_;
-    uint64_t encoded_version;
-    if (raw == NULL || rawlen < sizeof(int)+sizeof(keylen_t)+sizeof(encoded_version)+1) return -1;
-    if (dbid) *dbid = *(int*)raw;
-    raw += sizeof(int), rawlen -= sizeof(int);
-    keylen_ = *(keylen_t*)raw;
-    if (keylen) *keylen = keylen_;
-    raw += sizeof(keylen_t), rawlen -= sizeof(keylen_t);
-    if (key) *key = raw;
-    if (rawlen < keylen_) return -1;
-    raw += keylen_, rawlen -= keylen_;
-    if (rawlen < sizeof(encoded_version)) return -1;
-    if (version) {
-        encoded_version = *(uint64_t*)raw;
-        *version = rocksDecodeVersion(encoded_version);
-    }
-    raw += sizeof(encoded_version), rawlen -= sizeof(encoded_version);
+    int format = rocksKeyFormat(raw,rawlen);
+    size_t n;
+    if ((n = rocksDecodeKeyHeader(raw,rawlen,dbid,key,keylen)) == 0) return -1;
+    raw += n, rawlen -= n;
+    if ((n = rocksDecodeKeyVersion(format,raw,rawlen,version)) == 0) return -1;
+    raw += n, rawlen -= n;
+    if (rawlen < 1) return -1;
     if (subkeylen) *subkeylen = rawlen - 1;
     if (subkey) {
         *subkey = raw[0] == ROCKS_KEY_FLAG_SUBKEY ? raw + 1 : NULL;
@@ -247,34 +410,80 @@ int rocksDecodeDataKey(const char *raw, size_t rawlen, int *dbid,
     return 0;
 }
 
+/* Length of dbid|keylen|key|version prefix shared by all data/score keys
+ * of the same key version, returns 0 if raw is not a data/score key. */
+size_t rocksDataKeyPrefixLen(const char *raw, size_t rawlen) {
+    size_t headerlen, versionlen;
+    if ((headerlen = rocksDecodeKeyHeader(raw,rawlen,NULL,NULL,NULL)) == 0)
+        return 0;
+    versionlen = rocksDecodeKeyVersion(rocksKeyFormat(raw,rawlen),
+            raw+headerlen,rawlen-headerlen,NULL);
+    return versionlen ? headerlen+versionlen : 0;
+}
+
 /* Note that metakey MUST be prefix of datakeys, rdb save key switch detection
  * relay on that assumption. */
-sds encodeMetaKey(int dbid, const char* key, size_t keylen_) {
-    keylen_t keylen = keylen_;
-    size_t rawkeylen = sizeof(dbid)+sizeof(keylen)+keylen;
-    sds rawkey = sdsnewlen(SDS_NOINIT,rawkeylen), ptr = rawkey;
-    memcpy(ptr, &dbid, sizeof(dbid)), ptr += sizeof(dbid);
-    memcpy(ptr, &keylen, sizeof(keylen_t)), ptr += sizeof(keylen_t);
-    memcpy(ptr, key, keylen), ptr += keylen;
+sds encodeMetaKeyWithFormat(int format, int dbid, const char* key, size_t keylen) {
+    sds rawkey = sdsnewlen(SDS_NOINIT,rocksKeyHeaderLen(format,dbid,keylen));
+    rocksEncodeKeyHeader(format,rawkey,dbid,key,keylen);
     return rawkey;
 }
 
+sds encodeMetaKey(int dbid, const char* key, size_t keylen) {
+    return encodeMetaKeyWithFormat(server.swap_key_format,dbid,key,keylen);
+}
+
 sds rocksEncodeMetaKey(redisDb *db, sds key) {
     return encodeMetaKey(db->id, key, key ? sdslen(key) : 0);
 }
 
 int rocksDecodeMetaKey(const char *raw, size_t rawlen, int *dbid,
         const char **key, size_t *keylen) {
-    keylen_t keylen_;
-    if (raw == NULL || rawlen < sizeof(int)+sizeof(keylen_t)) return -1;
-    if (dbid) *dbid = *(int*)raw;
-    raw += sizeof(int), rawlen -= sizeof(int);
-    keylen_ = *(keylen_t*)raw;
-    if (keylen) *keylen = keylen_;
-    raw += sizeof(keylen_t), rawlen -= sizeof(keylen_t);
-    if (key) *key = raw;
-    if (rawlen < keylen_) return -1;
-    return 0;
+    return rocksDecodeKeyHeader(raw,rawlen,dbid,key,keylen) ? 0 : -1;
+}
+
+/* Length of rawkey (of cf) if encoded in format, 0 if rawkey invalid. */
+size_t rocksKeyEncodedLen(int cf, const char *raw, size_t rawlen, int format) {
+    int dbid;
+    size_t keylen, headerlen, versionlen = 0;
+    uint64_t version = 0;
+
+    if ((headerlen = rocksDecodeKeyHeader(raw,rawlen,&dbid,NULL,&keylen)) == 0)
+        return 0;
+    if (cf != META_CF) {
+        versionlen = rocksDecodeKeyVersion(rocksKeyFormat(raw,rawlen),
+                raw+headerlen,rawlen-headerlen,&version);
+        if (versionlen == 0) return 0;
+    }
+    return rocksKeyHeaderLen(format,dbid,keylen) +
+        (cf != META_CF ? rocksKeyVersionLen(format,version) : 0) +
+        rawlen - headerlen - versionlen;
+}
+
+/* Re-encode rawkey (of cf) in format, flag/score/subkey are kept as is.
+ * Returns NULL if rawkey could not be decoded. */
+sds rocksTranscodeKey(int cf, const char *raw, size_t rawlen, int format) {
+    int dbid;
+    const char *key;
+    size_t keylen, headerlen, versionlen = 0, taillen;
+    uint64_t version = 0;
+    sds rawkey, ptr;
+
+    if ((headerlen = rocksDecodeKeyHeader(raw,rawlen,&dbid,&key,&keylen)) == 0)
+        return NULL;
+    if (cf != META_CF) {
+        versionlen = rocksDecodeKeyVersion(rocksKeyFormat(raw,rawlen),
+                raw+headerlen,rawlen-headerlen,&version);
+        if (versionlen == 0) return NULL;
+    }
+    taillen = rawlen - headerlen - versionlen;
+
+    rawkey = sdsnewlen(SDS_NOINIT,rocksKeyEncodedLen(cf,raw,rawlen,format));
+    ptr = rawkey;
+    ptr += rocksEncodeKeyHeader(format,ptr,dbid,key,keylen);
+    if (cf != META_CF) ptr += rocksEncodeKeyVersion(format,ptr,version);
+    memcpy(ptr, raw+headerlen+versionlen, taillen);
+    return rawkey;
 }
 
 sds rocksEncodeValRdb(robj *value) {
@@ -295,6 +504,72 @@ robj *rocksDecodeValRdb(sds raw) {
     return value;
 }
 
+/* Strings (whole key string and string subvals) are encoded natively to
+ * skip rdb serialization: first byte tags native encoding, which never
+ * collides with rdb object types, so that rdb encoded values stay readable.
+ *   raw/embstr: ROCKS_VAL_NATIVE_RAW|bytes
+ *   int:        ROCKS_VAL_NATIVE_INT|long long */
+sds rocksEncodeVal(robj *value) {
+    sds raw;
+    if (!server.swap_native_value_encoding || value->type != OBJ_STRING)
+        return rocksEncodeValRdb(value);
+
+    if (value->encoding == OBJ_ENCODING_INT) {
+        long long llval = (long)value->ptr;
+        raw = sdsnewlen(SDS_NOINIT,1+sizeof(llval));
+        raw[0] = ROCKS_VAL_NATIVE_INT;
+        memcpy(raw+1,&llval,sizeof(llval));
+    } else {
+        size_t len = sdslen(value->ptr);
+        raw = sdsnewlen(SDS_NOINIT,1+len);
+        raw[0] = ROCKS_VAL_NATIVE_RAW;
+        memcpy(raw+1,value->ptr,len);
+    }
+    return raw;
+}
+
+static robj *rocksDecodeValNative(unsigned char type, const char *payload,
+        size_t len) {
+    long long llval;
+    switch (type) {
+    case ROCKS_VAL_NATIVE_RAW:
+        /* same encoding as decoded from rdb: embstr/int if possible. */
+        return tryObjectEncoding(createStringObject(payload,len));
+    case ROCKS_VAL_NATIVE_INT:
+        if (len != sizeof(llval)) return NULL;
+        memcpy(&llval,payload,sizeof(llval));
+        return createStringObjectFromLongLongForValue(llval);
+    default:
+        return NULL;
+    }
+}
+
+robj *rocksDecodeVal(sds raw) {
+    if (sdslen(raw) > 0 && rocksValIsNative((unsigned char)raw[0]))
+        return rocksDecodeValNative(raw[0],raw+1,sdslen(raw)-1);
+    else
+        return rocksDecodeValRdb(raw);
+}
+
+/* Convert native value (type & payload) to rdb object type & payload, so
+ * that rdb save could write payload as is. */
+int rocksValNativeToRdb(unsigned char *ptype, sds *ppayload) {
+    robj *value;
+    rio sdsrdb;
+
+    if (!rocksValIsNative(*ptype)) return 0;
+    value = rocksDecodeValNative(*ptype,*ppayload,sdslen(*ppayload));
+    if (value == NULL) return -1;
+
+    rioInitWithBuffer(&sdsrdb,sdsempty());
+    rdbSaveObject(&sdsrdb,value,NULL);
+    decrRefCount(value);
+    sdsfree(*ppayload);
+    *ppayload = sdsrdb.io.buffer.ptr;
+    *ptype = RDB_TYPE_STRING;
+    return 0;
+}
+
 sds rocksEncodeObjectMetaLen(unsigned long len) {
     return sdsnewlen(&len,sizeof(len));
 }
@@ -401,9 +676,9 @@ int decodeDouble(const char* val, double* score) {
 
 sds _encodeScoreKey(int dbid, sds key, uint64_t version, uint8_t subkeyflag,
         double score, sds subkey) {
-    uint64_t encoded_version = rocksEncodeVersion(version);
-    keylen_t keylen = key ? sdslen(key) : 0;
-    keylen_t scoresubkeylen, rawkeylen;
+    int format = server.swap_key_format;
+    size_t keylen = key ? sdslen(key) : 0;
+    size_t scoresubkeylen, rawkeylen;
     sds rawkey, ptr;
 
     if (subkeyflag == ROCKS_KEY_FLAG_SUBKEY) {
@@ -414,19 +689,17 @@ sds _encodeScoreKey(int dbid, sds key, uint64_t version, uint8_t subkeyflag,
         scoresubkeylen = 0;
     }
 
-    rawkeylen = sizeof(dbid)+sizeof(keylen)+keylen+sizeof(version)+1+scoresubkeylen;
+    rawkeylen = rocksKeyHeaderLen(format,dbid,keylen)+
+        rocksKeyVersionLen(format,version)+1+scoresubkeylen;
     rawkey = sdsnewlen(SDS_NOINIT,rawkeylen), ptr = rawkey;
 
-    memcpy(ptr, &dbid, sizeof(dbid)), ptr += sizeof(dbid);
-    memcpy(ptr, &keylen, sizeof(keylen_t)), ptr += sizeof(keylen_t);
-    memcpy(ptr, key, keylen), ptr += keylen;
-    memcpy(ptr, &encoded_version, sizeof(encoded_version));
-    ptr += sizeof(encoded_version);
+    ptr += rocksEncodeKeyHeader(format,ptr,dbid,key,keylen);
+    ptr += rocksEncodeKeyVersion(format,ptr,version);
     ptr[0] = subkeyflag, ptr++;
 
     if (subkeyflag == ROCKS_KEY_FLAG_SUBKEY) {
         ptr += encodeDouble(ptr,score);
-        memcpy(ptr,subkey,sdslen(subkey)), ptr += scoresubkeylen;
+        memcpy(ptr,subkey,sdslen(subkey)), ptr += sdslen(subkey);
     }
 
     return rawkey;
@@ -448,27 +721,23 @@ sds encodeScoreKey(redisDb* db, sds key, uint64_t version, double score, sds sub
     }
 }
 
-int decodeScoreKey(const char* raw, int rawlen, int* dbid, const char** key,
+int decodeScoreKey(const char* raw, int rawlen_, int* dbid, const char** key,
         size_t* keylen, uint64_t *version, double* score, const char** subkey,
         size_t* subkeylen) {
-    keylen_t keylen_;
-    if (raw == NULL || rawlen < (int)(sizeof(int)+sizeof(keylen_t)+sizeof(uint64_t)+1+sizeOfDouble)) return -1;
-    if (dbid) *dbid = *(int*)raw;
-    raw += sizeof(int), rawlen -= sizeof(int);
-    keylen_ = *(keylen_t*)raw;
-    if (keylen) *keylen = keylen_;
-    raw += sizeof(keylen_t), rawlen -= sizeof(keylen_t);
-    if (key) *key = raw;
-    if (rawlen < (int)keylen_) return -1;
-    raw += keylen_, rawlen -= keylen_;
-    if (version) {
-        uint64_t encoded_version = *(uint64_t*)raw;
-        *version = rocksDecodeVersion(encoded_version);
-    }
-    raw += sizeof(uint64_t), rawlen -= sizeof(uint64_t);
+    size_t n, rawlen;
+    int format;
+    if (raw == NULL || rawlen_ < 0) return -1;
+    rawlen = rawlen_;
+    format = rocksKeyFormat(raw,rawlen);
+    if ((n = rocksDecodeKeyHeader(raw,rawlen,dbid,key,keylen)) == 0) return -1;
+    raw += n, rawlen -= n;
+    if ((n = rocksDecodeKeyVersion(format,raw,rawlen,version)) == 0) return -1;
+    raw += n, rawlen -= n;
+    if (rawlen < 1) return -1;
     uint8_t subkeyflag = raw[0];
     raw++, rawlen--;
     if (subkeyflag == ROCKS_KEY_FLAG_SUBKEY) {
+        if (rawlen < sizeOfDouble) return -1;
         int double_offset = decodeDouble(raw, score);
         raw += double_offset;
         rawlen -= double_offset;
@@ -791,9 +1060,233 @@ int swapUtilTest(int argc, char **argv, int accurate) {
         dataKey = rocksEncodeDataKey(db,key,12345678,subkey);
         test_assert(memcmp(metaKey,dataKey,sdslen(metaKey)) == 0);
         sdsfree(dataKey);
+        sdsfree(metaKey);
         sdsfree(key), sdsfree(empty), sdsfree(subkey);
     }
 
+    TEST("util - data & score key prefix") {
+        sds key = sdsnew("key"), subkey = sdsnew("subkey");
+        sds dataKey, startKey, endKey, scoreKey, metaKey;
+        size_t prefixlen = sizeof(int)+sizeof(keylen_t)+sdslen(key)+sizeof(uint64_t);
+
+        dataKey = rocksEncodeDataKey(db,key,12345678,subkey);
+        startKey = rocksEncodeDataRangeStartKey(db,key,12345678);
+        endKey = rocksEncodeDataRangeEndKey(db,key,12345678);
+        scoreKey = encodeScoreKey(db,key,12345678,0.5,subkey);
+        metaKey = rocksEncodeMetaKey(db,key);
+
+        test_assert(rocksDataKeyPrefixLen(dataKey,sdslen(dataKey)) == prefixlen);
+        test_assert(rocksDataKeyPrefixLen(startKey,sdslen(startKey)) == prefixlen);
+        test_assert(rocksDataKeyPrefixLen(endKey,sdslen(endKey)) == prefixlen);
+        test_assert(rocksDataKeyPrefixLen(scoreKey,sdslen(scoreKey)) == prefixlen);
+        test_assert(memcmp(dataKey,startKey,prefixlen) == 0);
+        test_assert(memcmp(dataKey,scoreKey,prefixlen) == 0);
+        /* prefix itself is in domain and maps to itself. */
+        test_assert(rocksDataKeyPrefixLen(dataKey,prefixlen) == prefixlen);
+        /* meta key and truncated keys are not in domain. */
+        test_assert(rocksDataKeyPrefixLen(metaKey,sdslen(metaKey)) == 0);
+        test_assert(rocksDataKeyPrefixLen(dataKey,prefixlen-1) == 0);
+        test_assert(rocksDataKeyPrefixLen(dataKey,sizeof(int)) == 0);
+
+        sdsfree(dataKey), sdsfree(startKey), sdsfree(endKey);
+        sdsfree(scoreKey), sdsfree(metaKey);
+        sdsfree(key), sdsfree(subkey);
+    }
+
+    TEST("util - compact key format") {
+        sds key = sdsnew("key"), subkey = sdsnew("subkey"), empty = sdsempty();
+        sds v1key, v2key, transcoded, prev = NULL, cur;
+        sds metaKey, dataKey, scoreKey, dbStart, dbEnd;
+        int dbId;
+        const char *keystr, *subkeystr;
+        size_t klen, slen;
+        uint64_t version;
+        double score;
+        uint64_t versions[] = {0,1,127,128,16383,16384,(1ULL<<21)-1,1ULL<<21,
+            (1ULL<<28)-1,1ULL<<28,0x12345678,UINT64_MAX};
+
+        /* v1 keys never looks like v2 */
+        v1key = rocksEncodeDataKey(db,key,12345678,subkey);
+        test_assert(rocksKeyFormat(v1key,sdslen(v1key)) == SWAP_KEY_FORMAT_V1);
+
+        server.swap_key_format = SWAP_KEY_FORMAT_V2;
+        v2key = rocksEncodeDataKey(db,key,12345678,subkey);
+        test_assert(rocksKeyFormat(v2key,sdslen(v2key)) == SWAP_KEY_FORMAT_V2);
+        /* tag + dbid + keylen + key + version + flag + subkey */
+        test_assert(sdslen(v2key) == 1+1+1+sdslen(key)+4+1+sdslen(subkey));
+        test_assert(sdslen(v1key) - sdslen(v2key) == 9);
+        test_assert(rocksKeyEncodedLen(DATA_CF,v2key,sdslen(v2key),SWAP_KEY_FORMAT_V1) == sdslen(v1key));
+        test_assert(rocksKeyEncodedLen(DATA_CF,v1key,sdslen(v1key),SWAP_KEY_FORMAT_V2) == sdslen(v2key));
+
+        /* decoders accept both formats */
+        test_assert(!rocksDecodeDataKey(v1key,sdslen(v1key),&dbId,&keystr,&klen,&version,&subkeystr,&slen));
+        test_assert(dbId == db->id && version == 12345678 && slen == sdslen(subkey));
+        test_assert(!rocksDecodeDataKey(v2key,sdslen(v2key),&dbId,&keystr,&klen,&version,&subkeystr,&slen));
+        test_assert(dbId == db->id && version == 12345678);
+        test_assert(klen == sdslen(key) && !memcmp(keystr,key,klen));
+        test_assert(slen == sdslen(subkey) && !memcmp(subkeystr,subkey,slen));
+
+        /* transcode both ways */
+        transcoded = rocksTranscodeKey(DATA_CF,v1key,sdslen(v1key),SWAP_KEY_FORMAT_V2);
+        test_assert(!sdscmp(transcoded,v2key));
+        sdsfree(transcoded);
+        transcoded = rocksTranscodeKey(DATA_CF,v2key,sdslen(v2key),SWAP_KEY_FORMAT_V1);
+        test_assert(!sdscmp(transcoded,v1key));
+        sdsfree(transcoded);
+        sdsfree(v1key), sdsfree(v2key);
+
+        /* version order preserved, all subkeys within data range. */
+        for (size_t i = 0; i < sizeof(versions)/sizeof(uint64_t); i++) {
+            sds start = rocksEncodeDataRangeStartKey(db,key,versions[i]);
+            sds end = rocksEncodeDataRangeEndKey(db,key,versions[i]);
+            cur = rocksEncodeDataKey(db,key,versions[i],subkey);
+            test_assert(!rocksDecodeDataKey(cur,sdslen(cur),NULL,NULL,NULL,&version,NULL,NULL));
+            test_assert(version == versions[i]);
+            test_assert(sdscmp(start,cur) < 0 && sdscmp(cur,end) < 0);
+            if (prev) test_assert(sdscmp(prev,start) < 0);
+            if (prev) sdsfree(prev);
+            prev = cur;
+            sdsfree(start), sdsfree(end);
+        }
+        sdsfree(prev);
+
+        /* meta key is prefix of data/score key, all within db range. */
+        metaKey = rocksEncodeMetaKey(db,key);
+        dataKey = rocksEncodeDataKey(db,key,12345678,empty);
+        scoreKey = encodeScoreKey(db,key,12345678,-0.5,subkey);
+        dbStart = rocksEncodeDbRangeStartKey(db->id);
+        dbEnd = rocksEncodeDbRangeEndKey(db->id);
+        test_assert(!memcmp(metaKey,dataKey,sdslen(metaKey)));
+        test_assert(!memcmp(metaKey,scoreKey,sdslen(metaKey)));
+        test_assert(sdscmp(dbStart,metaKey) < 0 && sdscmp(scoreKey,dbEnd) < 0);
+        test_assert(!rocksDecodeMetaKey(metaKey,sdslen(metaKey),&dbId,&keystr,&klen));
+        test_assert(dbId == db->id && klen == sdslen(key));
+        test_assert(!decodeScoreKey(scoreKey,sdslen(scoreKey),&dbId,&keystr,&klen,&version,&score,&subkeystr,&slen));
+        test_assert(score == -0.5 && version == 12345678 && slen == sdslen(subkey));
+        test_assert(rocksDataKeyPrefixLen(dataKey,sdslen(dataKey)) == sdslen(metaKey)+4);
+        test_assert(rocksDataKeyPrefixLen(metaKey,sdslen(metaKey)) == 0);
+        transcoded = rocksTranscodeKey(META_CF,metaKey,sdslen(metaKey),SWAP_KEY_FORMAT_V1);
+        test_assert(sdslen(transcoded) == sizeof(int)+sizeof(keylen_t)+sdslen(key));
+        test_assert(rocksKeyFormat(transcoded,sdslen(transcoded)) == SWAP_KEY_FORMAT_V1);
+        sdsfree(transcoded);
+
+        sdsfree(metaKey), sdsfree(dataKey), sdsfree(scoreKey);
+        sdsfree(dbStart), sdsfree(dbEnd);
+        server.swap_key_format = SWAP_KEY_FORMAT_V1;
+        sdsfree(key), sdsfree(subkey), sdsfree(empty);
+    }
+
+    TEST("util - native value encoding") {
+        robj *raw = createRawStringObject("hello-native-raw-string-value-longer-than-embstr",48);
+        robj *emb = createStringObject("emb",3);
+        robj *num = createStringObjectFromLongLongForValue(-123456789);
+        robj *hash = createHashObject(), *decoded, *rdbdecoded;
+        unsigned char rdbtype;
+        sds encoded, payload;
+
+        server.swap_native_value_encoding = 1;
+        encoded = rocksEncodeVal(raw);
+        test_assert((unsigned char)encoded[0] == ROCKS_VAL_NATIVE_RAW);
+        test_assert(sdslen(encoded) == 1+sdslen(raw->ptr));
+        decoded = rocksDecodeVal(encoded);
+        test_assert(decoded->encoding == OBJ_ENCODING_RAW && equalStringObjects(raw,decoded));
+        decrRefCount(decoded);
+        /* rdb save converts native value to rdb string. */
+        rdbtype = encoded[0], payload = sdsnewlen(encoded+1,sdslen(encoded)-1);
+        test_assert(!rocksValNativeToRdb(&rdbtype,&payload));
+        test_assert(rdbtype == RDB_TYPE_STRING);
+        sdsfree(encoded);
+        encoded = sdscatsds(sdsnewlen(&rdbtype,1),payload);
+        decoded = rocksDecodeValRdb(encoded);
+        test_assert(equalStringObjects(raw,decoded));
+        decrRefCount(decoded), sdsfree(encoded), sdsfree(payload);
+
+        encoded = rocksEncodeVal(emb);
+        test_assert((unsigned char)encoded[0] == ROCKS_VAL_NATIVE_RAW);
+        decoded = rocksDecodeVal(encoded);
+        test_assert(decoded->encoding == OBJ_ENCODING_EMBSTR && equalStringObjects(emb,decoded));
+        decrRefCount(decoded), sdsfree(encoded);
+
+        /* decoded encoding matches rdb decoded encoding. */
+        encoded = rocksEncodeVal(emb);
+        payload = rocksEncodeValRdb(emb);
+        decoded = rocksDecodeVal(encoded);
+        rdbdecoded = rocksDecodeValRdb(payload);
+        test_assert(decoded->encoding == rdbdecoded->encoding);
+        decrRefCount(decoded), decrRefCount(rdbdecoded);
+        sdsfree(encoded), sdsfree(payload);
+
+        encoded = rocksEncodeVal(num);
+        test_assert((unsigned char)encoded[0] == ROCKS_VAL_NATIVE_INT);
+        test_assert(sdslen(encoded) == 1+sizeof(long long));
+        decoded = rocksDecodeVal(encoded);
+        test_assert(decoded->encoding == OBJ_ENCODING_INT && equalStringObjects(num,decoded));
+        decrRefCount(decoded), sdsfree(encoded);
+
+        /* malformed native value */
+        encoded = sdsnewlen("\xf1\x01",2);
+        test_assert(rocksDecodeVal(encoded) == NULL);
+        sdsfree(encoded);
+
+        /* non-string & rdb encoded values stay rdb. */
+        encoded = rocksEncodeVal(hash);
+        test_assert(!rocksValIsNative(encoded[0]));
+        sdsfree(encoded);
+        encoded = rocksEncodeValRdb(num);
+        decoded = rocksDecodeVal(encoded);
+        test_assert(equalStringObjects(num,decoded));
+        decrRefCount(decoded), sdsfree(encoded);
+
+        server.swap_native_value_encoding = 0;
+        encoded = rocksEncodeVal(raw);
+        test_assert(!rocksValIsNative(encoded[0]));
+        decoded = rocksDecodeVal(encoded);
+        test_assert(equalStringObjects(raw,decoded));
+        decrRefCount(decoded), sdsfree(encoded);
+
+        decrRefCount(raw), decrRefCount(emb), decrRefCount(num), decrRefCount(hash);
+    }
+
+    TEST("util - native value encoding throughput") {
+#define NATIVE_VAL_BENCH_BATCH 1024
+        robj *vals[3], *decoded[NATIVE_VAL_BENCH_BATCH];
+        sds encoded[NATIVE_VAL_BENCH_BATCH];
+        int i, j, k, native, rounds = accurate ? 1000 : 100;
+        long long start, enc_us, dec_us;
+
+        vals[0] = createRawStringObject("hello-native-raw-string-value-longer-than-embstr",48);
+        vals[1] = createStringObject("emb",3);
+        vals[2] = createStringObjectFromLongLongForValue(-123456789);
+        for (native = 0; native <= 1; native++) {
+            server.swap_native_value_encoding = native;
+            for (j = 0; j < 3; j++) {
+                enc_us = dec_us = 0;
+                for (k = 0; k < rounds; k++) {
+                    start = ustime();
+                    for (i = 0; i < NATIVE_VAL_BENCH_BATCH; i++)
+                        encoded[i] = rocksEncodeVal(vals[j]);
+                    enc_us += ustime() - start;
+                    start = ustime();
+                    for (i = 0; i < NATIVE_VAL_BENCH_BATCH; i++)
+                        decoded[i] = rocksDecodeVal(encoded[i]);
+                    dec_us += ustime() - start;
+                    for (i = 0; i < NATIVE_VAL_BENCH_BATCH; i++) {
+                        test_assert(equalStringObjects(vals[j],decoded[i]));
+                        decrRefCount(decoded[i]);
+                        sdsfree(encoded[i]);
+                    }
+                }
+                printf("%s %s: encode %.2f Mops/s, decode %.2f Mops/s\n",
+                        native ? "native" : "rdb",
+                        j == 0 ? "raw" : (j == 1 ? "embstr" : "int"),
+                        (double)rounds*NATIVE_VAL_BENCH_BATCH/(enc_us ? enc_us : 1),
+                        (double)rounds*NATIVE_VAL_BENCH_BATCH/(dec_us ? dec_us : 1));
+            }
+        }
+        server.swap_native_value_encoding = 0;
+        for (j = 0; j < 3; j++) decrRefCount(vals[j]);
+    }
+
     return error;
 }
 
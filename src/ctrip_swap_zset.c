@@ -40,9 +40,9 @@ static void createFakeZsetForDeleteIfCold(swapData *data) {
 
 /* return 1 if noswap needed */
 static int zsetSwapAnaOutSelectSubkeys(swapData *data, zsetDataCtx *datactx,
-        int *may_keep_data) {
-    int select_type, noswap;
-    size_t count;
+        uint32_t cmd_intention_flags, int *may_keep_data) {
+    int select_type, noswap, hotness;
+    size_t count, skipped = 0;
     robj *subkeys;
     unsigned long long evict_memory = 0;
 
@@ -82,6 +82,7 @@ static int zsetSwapAnaOutSelectSubkeys(swapData *data, zsetDataCtx *datactx,
     if (select_type == SELECT_MAIN) {
         robj *subkey;
         int len = zsetLength(subkeys);
+        hotness = swapSubkeyHotnessApplicable(cmd_intention_flags,len);
         if (len > 0) {
             if (subkeys->encoding == OBJ_ENCODING_ZIPLIST) {
                 unsigned char *zl = subkeys->ptr;
@@ -103,12 +104,20 @@ static int zsetSwapAnaOutSelectSubkeys(swapData *data, zsetDataCtx *datactx,
 
                     vlong = 0;
                     ziplistGet(eptr, &vstr, &vlen, &vlong);
-                    evict_memory += vlen;
                     if (vstr != NULL) {
                         subkey = createStringObject((const char*)vstr, vlen);
                     } else {
                         subkey = createObject(OBJ_STRING,sdsfromlonglong(vlong));
                     }
+                    /* Keep hot subkeys (no more than a step) in memory. */
+                    if (hotness && skipped < count &&
+                            swapSubkeyHotnessEvictSkip(data->key,subkey->ptr)) {
+                        decrRefCount(subkey);
+                        skipped++;
+                        zzlNext(zl, &eptr, &sptr);
+                        continue;
+                    }
+                    evict_memory += vlen;
                     datactx->bdc.sub.subkeys[datactx->bdc.sub.num++] = subkey;
                     ziplistGet(sptr, &vstr, &vlen, &vlong);
                     evict_memory += vlen;
@@ -128,6 +137,12 @@ static int zsetSwapAnaOutSelectSubkeys(swapData *data, zsetDataCtx *datactx,
                         break;
                     }
                     sds skey = dictGetKey(de);
+                    /* Keep hot subkeys (no more than a step) in memory. */
+                    if (hotness && skipped < count &&
+                            swapSubkeyHotnessEvictSkip(data->key,skey)) {
+                        skipped++;
+                        continue;
+                    }
                     subkey = createStringObject(skey, sdslen(skey));
                     datactx->bdc.sub.subkeys[datactx->bdc.sub.num++] = subkey;
                     evict_memory += sizeof(zset) + sizeof(dictEntry);
@@ -137,6 +152,7 @@ static int zsetSwapAnaOutSelectSubkeys(swapData *data, zsetDataCtx *datactx,
                 serverPanic("unknown zset encoding");
             }
         }
+        if (skipped && !noswap) *may_keep_data = 0;
     } else {
         robj *subkey;
         size_t sublen;
@@ -310,7 +326,8 @@ int zsetSwapAna(swapData *data, int thd, struct keyRequest *req,
             *intention_flags = 0;
         } else {
             int may_keep_data;
-            int noswap = zsetSwapAnaOutSelectSubkeys(data,datactx,&may_keep_data);
+            int noswap = zsetSwapAnaOutSelectSubkeys(data,datactx,
+                    cmd_intention_flags,&may_keep_data);
             int keep_data = swapDataPersistKeepData(data,cmd_intention_flags,may_keep_data);
 
             /* create new meta if needed */
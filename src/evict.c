@@ -185,6 +185,16 @@ void evictionPoolPopulate(int dbid, dict *sampledict, dict *keydict, struct evic
             serverPanic("Unknown eviction policy in evictionPoolPopulate()");
         }
 
+#ifdef ENABLE_SWAP
+        if (server.maxmemory_policy & (MAXMEMORY_FLAG_LRU|MAXMEMORY_FLAG_LFU)) {
+            /* Don't size keys that can't enter the full pool anyway. */
+            if (pool[EVPOOL_SIZE-1].key != NULL &&
+                    swapEvictionCostAwareIdleMax(o,idle) <= pool[0].idle)
+                continue;
+            idle = swapEvictionCostAwareIdle(server.db+dbid,key,o,idle);
+        }
+#endif
+
         /* Insert the element inside the pool.
          * First, find the first empty bucket or the first populated
          * bucket that has an idle time smaller than our idle time. */
@@ -532,7 +542,17 @@ unsigned long evictionTimeLimitUs() {
  *   EVICT_RUNNING  - memory is over the limit, but eviction is still processing
  *   EVICT_FAIL     - memory is over the limit, and there's nothing to evict
  * */
+#ifdef ENABLE_SWAP
 int performEvictions(void) {
+    return swap_performEvictions(0);
+}
+
+/* Evict pre_evict_tofree bytes even if not over maxmemory (pre-eviction
+ * driven by watermarks, see swapPreEvictionCron), 0 for normal eviction. */
+int swap_performEvictions(size_t pre_evict_tofree) {
+#else
+int performEvictions(void) {
+#endif
     if (!isSafeToPerformEvictions()) return EVICT_OK;
 
     int keys_freed = 0;
@@ -545,11 +565,13 @@ int performEvictions(void) {
 
 #ifdef ENABLE_SWAP
     UNUSED(delta), UNUSED(eviction_latency);
-    size_t mem_used;
+    size_t mem_used = 0;
     int over_maxmemory = getMaxmemoryState(&mem_reported,&mem_used,&mem_tofree,NULL) == C_ERR;
-    swapEvictKeysCtx sectx = {mem_used,mem_tofree,0,0,0};
+    int pre_evict = !over_maxmemory && pre_evict_tofree > 0;
+    if (pre_evict) mem_tofree = pre_evict_tofree;
+    swapEvictKeysCtx sectx = {mem_used,mem_tofree,0,0,0,pre_evict};
     swap_performEvictionStart(&sectx);
-    if (!over_maxmemory) return EVICT_OK;
+    if (!over_maxmemory && !pre_evict) return EVICT_OK;
 #else
     if (getMaxmemoryState(&mem_reported,NULL,&mem_tofree,NULL) == C_OK)
         return EVICT_OK;
@@ -721,7 +743,11 @@ int performEvictions(void) {
                  * across the dbAsyncDelete() call, while the thread can
                  * release the memory all the time. */
                 if (server.lazyfree_lazy_eviction) {
+#ifdef ENABLE_SWAP
+                    if (swap_performEvictionMemoryReached(&sectx)) {
+#else
                     if (getMaxmemoryState(NULL,NULL,NULL,NULL) == C_OK) {
+#endif
                         break;
                     }
                 }
@@ -731,7 +757,12 @@ int performEvictions(void) {
                  * memory, don't want to spend too much time here.  */
                 if (elapsedUs(evictionTimer) > eviction_time_limit_us) {
                     // We still need to free memory - start eviction timer proc
+#ifdef ENABLE_SWAP
+                    /* pre-eviction continues in next cron instead. */
+                    if (!isEvictionProcRunning && !sectx.pre_evict) {
+#else
                     if (!isEvictionProcRunning) {
+#endif
                         isEvictionProcRunning = 1;
                         aeCreateTimeEvent(server.el, 0,
                                 evictionTimeProc, NULL, NULL);
@@ -755,8 +786,11 @@ int performEvictions(void) {
 cant_free:
 #ifdef ENABLE_SWAP
     swap_performEvictionEnd(&sectx); /* idempotent */
-#endif
+    /* don't wait lazyfree in cron for pre-eviction. */
+    if (result == EVICT_FAIL && !sectx.pre_evict) {
+#else
     if (result == EVICT_FAIL) {
+#endif
         /* At this point, we have run out of evictable items.  It's possible
          * that some items are being freed in the lazyfree thread.  Perform a
          * short wait here if such jobs exist, but don't wait long.  */
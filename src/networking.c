@@ -212,6 +212,7 @@ client *createClient(connection *conn) {
     c->swap_errcode = 0;
     c->swap_arg_rewrites = argRewritesCreate();
     c->rate_limit_event_id = -1;
+    c->swap_prefetch_ahead = 0;
     c->duration = 0;
 #endif
     listSetFreeMethod(c->pubsub_patterns,decrRefCountVoid);
@@ -2323,8 +2324,13 @@ void processInputBuffer(client *c) {
         if (c->flags & CLIENT_BLOCKED) break;
 
 #ifdef ENABLE_SWAP
-        /* Also abort if the client is swapping. */
-        if (c->flags&CLIENT_SWAPPING || c->flags&CLIENT_SWAP_REWINDING) break;
+        /* Also abort if the client is swapping, looking ahead pipelined
+         * commands so that their keys swap in while current one waits. */
+        if (c->flags&CLIENT_SWAPPING) {
+            swapPrefetchClientQueryBuffer(c);
+            break;
+        }
+        if (c->flags&CLIENT_SWAP_REWINDING) break;
 #endif
         /* Don't process more buffers from clients that have already pending
          * commands to execute in c->argv. */
@@ -2372,6 +2378,10 @@ void processInputBuffer(client *c) {
             serverPanic("Unknown request type");
         }
 
+#ifdef ENABLE_SWAP
+        if (c->swap_prefetch_ahead) c->swap_prefetch_ahead--;
+#endif
+
         /* Multibulk processing could see a <= 0 length. */
         if (c->argc == 0) {
             resetClient(c);
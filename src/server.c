@@ -2482,6 +2482,11 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
     }
 #endif
 
+    run_with_period(server.swap_pre_evict_period_ms) {
+        swapPreEvictionCron();
+    }
+    coldFiltersCron();
+
     run_with_period(1000) {
         serverRocksCron();
 
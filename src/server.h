@@ -2946,6 +2946,9 @@ int iAmMaster(void);
 #if defined(SWAP_TYPES) && (SWAP_TYPES_FORWARD != SWAP_TYPES)
 #error swap types inconsist
 #endif
+#if defined(SWAP_PRIORITY_TYPES) && (SWAP_PRIORITY_TYPES_FORWARD != SWAP_PRIORITY_TYPES)
+#error swap priority types inconsist
+#endif
 
 #endif /* ENABLE_SWAP */
 
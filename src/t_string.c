@@ -438,10 +438,31 @@ void getsetCommand(client *c) {
     rewriteClientCommandArgument(c,0,shared.set);
 }
 
+#ifdef ENABLE_SWAP
+/* Big strings are swapped in chunks (same as bitmap), returns 1 if string
+ * has chunk meta: cold chunks (holes) are not in memory and string length
+ * is kept in meta. */
+static int lookupStringMetaBitmap(redisDb *db, robj *key, robj *o,
+        metaBitmap *meta_bitmap) {
+    objectMeta *om;
+    if (!stringChunkedEnabled()) return 0;
+    om = lookupMeta(db,key);
+    if (om == NULL || om->swap_type != SWAP_TYPE_BITMAP ||
+            bitmapObjectMetaIsMarker(om))
+        return 0;
+    metaBitmapInit(meta_bitmap,objectMetaGetPtr(om),o);
+    return 1;
+}
+#endif
+
 void setrangeCommand(client *c) {
     robj *o;
     long offset;
     sds value = c->argv[3]->ptr;
+#ifdef ENABLE_SWAP
+    metaBitmap meta_bitmap;
+    size_t totlen = 0;
+#endif
 
     if (getLongFromObjectOrReply(c,c->argv[2],&offset,NULL) != C_OK)
         return;
@@ -474,6 +495,10 @@ void setrangeCommand(client *c) {
 
         /* Return existing string length when setting nothing */
         olen = stringObjectLen(o);
+#ifdef ENABLE_SWAP
+        if (lookupStringMetaBitmap(c->db,c->argv[1],o,&meta_bitmap))
+            olen = metaBitmapGetSize(&meta_bitmap);
+#endif
         if (sdslen(value) == 0) {
             addReplyLongLong(c,olen);
             return;
@@ -488,7 +513,25 @@ void setrangeCommand(client *c) {
     }
 
     if (sdslen(value) > 0) {
+#ifdef ENABLE_SWAP
+        if (lookupStringMetaBitmap(c->db,c->argv[1],o,&meta_bitmap)) {
+            /* Chunks covered (and the last one if extended) are swapped in,
+             * skip cold chunks ahead. */
+            size_t size = metaBitmapGetSize(&meta_bitmap);
+            if (offset+sdslen(value) > size) {
+                metaBitmapGrow(&meta_bitmap,
+                        sdslen(o->ptr)+offset+sdslen(value)-size);
+            }
+            offset -= metaBitmapGetColdSubkeysSize(&meta_bitmap,offset);
+            serverAssert(offset+sdslen(value) <= sdslen(o->ptr));
+            totlen = metaBitmapGetSize(&meta_bitmap);
+        } else {
+            o->ptr = sdsgrowzero(o->ptr,offset+sdslen(value));
+            totlen = sdslen(o->ptr);
+        }
+#else
         o->ptr = sdsgrowzero(o->ptr,offset+sdslen(value));
+#endif
         memcpy((char*)o->ptr+offset,value,sdslen(value));
         signalModifiedKey(c,c->db,c->argv[1]);
 #ifdef ENABLE_SWAP
@@ -500,7 +543,11 @@ void setrangeCommand(client *c) {
 #endif
         server.dirty++;
     }
+#ifdef ENABLE_SWAP
+    addReplyLongLong(c,totlen);
+#else
     addReplyLongLong(c,sdslen(o->ptr));
+#endif
 }
 
 void getrangeCommand(client *c) {
@@ -523,6 +570,11 @@ void getrangeCommand(client *c) {
         str = o->ptr;
         strlen = sdslen(str);
     }
+#ifdef ENABLE_SWAP
+    metaBitmap meta_bitmap;
+    int chunked = lookupStringMetaBitmap(c->db,c->argv[1],o,&meta_bitmap);
+    if (chunked) strlen = metaBitmapGetSize(&meta_bitmap);
+#endif
 
     /* Convert negative indexes */
     if (start < 0 && end < 0 && start > end) {
@@ -540,6 +592,15 @@ void getrangeCommand(client *c) {
     if (start > end || strlen == 0) {
         addReply(c,shared.emptybulk);
     } else {
+#ifdef ENABLE_SWAP
+        /* Chunks in range are swapped in, skip cold chunks ahead. */
+        if (chunked) {
+            long long cold_size = metaBitmapGetColdSubkeysSize(&meta_bitmap,start);
+            start -= cold_size;
+            end -= cold_size;
+            serverAssert((size_t)end < sdslen(str));
+        }
+#endif
         addReplyBulkCBuffer(c,(char*)str+start,end-start+1);
     }
 }
@@ -735,13 +796,32 @@ void appendCommand(client *c) {
         /* "append" is an argument, so always an sds */
         append = c->argv[2];
         totlen = stringObjectLen(o)+sdslen(append->ptr);
+#ifdef ENABLE_SWAP
+        metaBitmap meta_bitmap;
+        int chunked = lookupStringMetaBitmap(c->db,c->argv[1],o,&meta_bitmap);
+        if (chunked) totlen = metaBitmapGetSize(&meta_bitmap)+sdslen(append->ptr);
+#endif
         if (checkStringLength(c,totlen) != C_OK)
             return;
 
         /* Append the value */
         o = dbUnshareStringValue(c->db,c->argv[1],o);
+#ifdef ENABLE_SWAP
+        if (chunked) {
+            /* Only the last chunk is swapped in, append to it. */
+            size_t oldlen = sdslen(o->ptr);
+            meta_bitmap.bitmap = o;
+            metaBitmapGrow(&meta_bitmap,oldlen+sdslen(append->ptr));
+            memcpy((char*)o->ptr+oldlen,append->ptr,sdslen(append->ptr));
+            totlen = metaBitmapGetSize(&meta_bitmap);
+        } else {
+            o->ptr = sdscatlen(o->ptr,append->ptr,sdslen(append->ptr));
+            totlen = sdslen(o->ptr);
+        }
+#else
         o->ptr = sdscatlen(o->ptr,append->ptr,sdslen(append->ptr));
         totlen = sdslen(o->ptr);
+#endif
     }
     signalModifiedKey(c,c->db,c->argv[1]);
 #ifdef ENABLE_SWAP
@@ -757,6 +837,14 @@ void strlenCommand(client *c) {
     robj *o;
     if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.czero)) == NULL ||
         checkType(c,o,OBJ_STRING)) return;
+#ifdef ENABLE_SWAP
+    /* Chunked string might not be in memory entirely. */
+    metaBitmap meta_bitmap;
+    if (lookupStringMetaBitmap(c->db,c->argv[1],o,&meta_bitmap)) {
+        addReplyLongLong(c,metaBitmapGetSize(&meta_bitmap));
+        return;
+    }
+#endif
     addReplyLongLong(c,stringObjectLen(o));
 }
 
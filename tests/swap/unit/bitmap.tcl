@@ -2208,4 +2208,105 @@ start_server {tags {"bitmap chaos test"} overrides {save ""}} {
             }
         }
     }
-}
\ No newline at end of file
+}
+start_server {
+    tags {"chunked string"}
+} {
+    r config set swap-debug-evict-keys 0
+    r config set swap-bitmap-subkey-size 4096
+
+    # 10 chunks of 4096 bytes, each chunk filled with its own letter.
+    set str ""
+    for {set i 0} {$i < 10} {incr i} {
+        append str [string repeat [format %c [expr {97+$i}]] 4096]
+    }
+
+    proc build_cold_chunked_string {key str} {
+        r set $key $str
+        r swap.evict $key
+        wait_key_cold r $key
+    }
+
+    test "chunked string disabled: range commands swap in whole string" {
+        r config set swap-string-chunked-threshold 0
+        build_cold_chunked_string mystr $str
+        assert_equal [string range $str 5000 9000] [r getrange mystr 5000 9000]
+        assert [object_is_string r mystr]
+        assert_equal [string length $str] [r strlen mystr]
+        r flushdb
+    }
+
+    r config set swap-string-chunked-threshold 16384
+
+    test "chunked string strlen answered from meta" {
+        build_cold_chunked_string mystr $str
+        assert_equal [string length $str] [r strlen mystr]
+        assert [object_is_warm r mystr]
+        r flushdb
+    }
+
+    test "chunked string getrange across holes and past the end" {
+        build_cold_chunked_string mystr $str
+        assert_equal [string range $str 5000 9000] [r getrange mystr 5000 9000]
+        assert [object_is_warm r mystr]
+        # chunk 0 and 3 cold, 1 and 2 hot
+        assert_equal [string range $str 4000 13000] [r getrange mystr 4000 13000]
+        assert_equal [string range $str 40000 50000] [r getrange mystr 40000 50000]
+        assert_equal [string range $str 40950 40959] [r getrange mystr -10 -1]
+        assert_equal {} [r getrange mystr 50000 60000]
+        assert_equal [string range $str 0 9] [r substr mystr 0 9]
+        assert_equal [string length $str] [r strlen mystr]
+        assert_equal $str [r get mystr]
+        r flushdb
+    }
+
+    test "chunked string setrange across holes and past the end" {
+        set expected $str
+        build_cold_chunked_string mystr $str
+        assert_equal [string range $str 20000 20010] [r getrange mystr 20000 20010]
+
+        # across cold chunk 1 and hot chunk 4
+        set value [string repeat "X" 12300]
+        assert_equal [string length $str] [r setrange mystr 5000 $value]
+        set expected [string replace $expected 5000 17299 $value]
+        assert [object_is_warm r mystr]
+        assert_equal [string range $expected 4000 18000] [r getrange mystr 4000 18000]
+
+        # past the end, gap is zero padded
+        r swap.evict mystr
+        wait_key_cold r mystr
+        assert_equal 45003 [r setrange mystr 45000 "END"]
+        append expected [string repeat "\x00" [expr {45000-[string length $expected]}]] "END"
+        assert [object_is_warm r mystr]
+        assert_equal 45003 [r strlen mystr]
+        assert_equal [string range $expected 40900 45002] [r getrange mystr 40900 -1]
+
+        r swap.evict mystr
+        wait_key_cold r mystr
+        assert_equal $expected [r get mystr]
+        r flushdb
+    }
+
+    test "chunked string append to cold string" {
+        set expected $str
+        build_cold_chunked_string mystr $str
+        assert_equal [expr {[string length $str]+4}] [r append mystr "tail"]
+        append expected "tail"
+        assert [object_is_warm r mystr]
+        assert_equal "jtail" [r getrange mystr -5 -1]
+
+        # append across chunk boundary, hole in the middle
+        r swap.evict mystr
+        wait_key_cold r mystr
+        set value [string repeat "Y" 5000]
+        assert_equal [expr {[string length $expected]+5000}] [r append mystr $value]
+        append expected $value
+        assert_equal [string length $expected] [r strlen mystr]
+        assert_equal [string range $expected 10 20] [r getrange mystr 10 20]
+
+        r swap.evict mystr
+        wait_key_cold r mystr
+        assert_equal $expected [r get mystr]
+        r flushdb
+    }
+}
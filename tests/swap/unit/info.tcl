@@ -7,3 +7,23 @@ start_server {} {
     }
 
 }
+
+start_server {} {
+
+    test {shared block cache info and online resize} {
+        set cache [getInfoProperty [r info rocksdb] rocksdb_block_cache]
+        assert_match {type=lru,capacity=*} $cache
+        r config set rocksdb.shared_block_cache_size 64mb
+        set cache [getInfoProperty [r info rocksdb] rocksdb_block_cache]
+        assert_match "*capacity=[expr 64*1024*1024],*" $cache
+        assert_match {high_priority=1,*} [getInfoProperty [r info rocksdb] rocksdb_block_cache_meta]
+
+        r set foo bar
+        r swap.evict foo
+        wait_key_cold r foo
+        assert_equal [r get foo] bar
+        set data_cache [getInfoProperty [r info rocksdb] rocksdb_block_cache_default]
+        assert_match {high_priority=0,hit=*,block_read=*,hit_rate=*,read_bytes=*} $data_cache
+    }
+
+}
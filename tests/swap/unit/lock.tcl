@@ -76,6 +76,27 @@ start_server {overrides {save ""}} {
             waitForBgsave $master
         }
     }
+
+    test {swap-lock reads wait for in-flight swap in of the same key} {
+        r config set swap-debug-evict-keys 0
+        r set coalesce-key v
+        r swap.evict coalesce-key
+        wait_key_cold r coalesce-key
+        set coalesced [status r swap_swapin_coalesced_count]
+
+        r config set swap-debug-rio-delay-micro 100000
+        set rd1 [redis_deferring_client]
+        set rd2 [redis_deferring_client]
+        $rd1 get coalesce-key
+        $rd2 get coalesce-key
+        assert_equal [$rd1 read] v
+        assert_equal [$rd2 read] v
+        r config set swap-debug-rio-delay-micro 0
+
+        assert_equal [status r swap_swapin_coalesced_count] [expr $coalesced+1]
+        $rd1 close
+        $rd2 close
+    }
 }
 
 
@@ -0,0 +1,50 @@
+start_server {tags {"swap.pre_evict"}} {
+    r config set swap-debug-evict-keys 0
+    r config set maxmemory-policy allkeys-lru
+
+    test "pre-eviction disabled unless high watermark above low" {
+        assert_equal [get_info_property r Swap swap_pre_evict enabled] 0
+        r config set maxmemory 100mb
+        r config set swap-evict-watermark-low 85
+        r config set swap-evict-watermark-high 85
+        assert_equal [get_info_property r Swap swap_pre_evict enabled] 0
+        assert_error {*} {r config set swap-evict-watermark-low 0}
+        r config set swap-evict-watermark-high 95
+        assert_equal [get_info_property r Swap swap_pre_evict enabled] 1
+        r config set swap-evict-watermark-high 0
+        r config set maxmemory 0
+    }
+
+    foreach lazyfree {no yes} {
+        test "pre-eviction evicts below maxmemory in cron (lazyfree-lazy-eviction $lazyfree)" {
+            r flushdb
+            r config set lazyfree-lazy-eviction $lazyfree
+            set buf [string repeat "abcde" 200]
+            for {set i 0} {$i < 1000} {incr i} {
+                r set "key:$i" $buf
+            }
+
+            # used memory at 95% of maxmemory, never over it.
+            set limit [expr {[s used_memory] * 100 / 95}]
+            r config set maxmemory $limit
+            set evicted [get_info_property r Swap swap_pre_evict evicted_keys]
+            r config set swap-evict-watermark-low 85
+            r config set swap-evict-watermark-high 90
+
+            wait_for_condition 100 50 {
+                [get_info_property r Swap swap_pre_evict evicted_keys] > $evicted
+            } else {
+                fail "pre-eviction not triggered"
+            }
+            wait_for_condition 100 50 {
+                [s used_memory] <= $limit * 90 / 100
+            } else {
+                fail "used memory not below high watermark"
+            }
+            assert_equal [r get key:999] $buf
+
+            r config set swap-evict-watermark-high 0
+            r config set maxmemory 0
+        }
+    }
+}
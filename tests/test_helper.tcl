@@ -160,6 +160,7 @@ set ::disk_tests {
     swap/unit/metascan_multidb
     swap/unit/ltrim_check
     swap/unit/swap_thread_race_scaledown
+    swap/unit/pre_evict
 }
 
 set ::all_tests [concat $::gtid_tests $::all_tests]